@@ -20,33 +20,115 @@
 #include "enrichmentcalculator.h"
 
 #include <cmath>
-#include <set>
 #include <vector>
-#include <map>
-#include <random>
+#include <unordered_map>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <atomic>
 #include <array>
+#include <cstddef>
 
 #include "shared/graph/igraphmodel.h"
 #include "shared/graph/igraph.h"
 #include "shared/commands/icommandmanager.h"
 
-#include "shared/utils/container.h"
-#include "shared/utils/msvcwarningsuppress.h"
+#include "shared/utils/threadpool.h"
 
 #include "shared/attributes/iattribute.h"
 
 using namespace Qt::Literals::StringLiterals;
 
-static double combineLogs(double n, double r)
+EnrichmentCalculator::LogFactorials::LogFactorials(size_t n) :
+    _values(n + 1, 0.0)
 {
-    // NOLINTNEXTLINE concurrency-mt-unsafe
-    return std::lgamma(n + 1) - std::lgamma(r + 1) - std::lgamma(n - r + 1);
+    // Kahan summation, so that the error doesn't accumulate with n
+    double sum = 0.0;
+    double compensation = 0.0;
+
+    for(size_t i = 2; i <= n; i++)
+    {
+        auto y = std::log(static_cast<double>(i)) - compensation;
+        auto t = sum + y;
+        compensation = (t - sum) - y;
+        sum = t;
+
+        _values[i] = sum;
+    }
 }
 
-static double hyperGeometricProb(double x, double r1, double r2, double c1, double c2)
+namespace
 {
-    return std::exp(combineLogs(r1, x) + combineLogs(r2, c1 - x) - combineLogs( c1 + c2, c1));
-}
+// The hypergeometric distribution of the value in the first cell of
+// a 2x2 contingency table, given its row and column totals
+class HyperGeometric
+{
+private:
+    const EnrichmentCalculator::LogFactorials* _logFactorials;
+
+    size_t _r1;
+    size_t _r2;
+    size_t _c1;
+    double _logConstant;
+
+public:
+    HyperGeometric(const EnrichmentCalculator::LogFactorials& logFactorials,
+        size_t r1, size_t r2, size_t c1, size_t c2) :
+        _logFactorials(&logFactorials), _r1(r1), _r2(r2), _c1(c1)
+    {
+        const auto& lf = *_logFactorials;
+        _logConstant = lf[r1] + lf[r2] + lf[c1] + lf[c2] - lf[r1 + r2];
+    }
+
+    size_t lowest() const { return _c1 > _r2 ? _c1 - _r2 : 0; }
+    size_t highest() const { return std::min(_c1, _r1); }
+
+    size_t mode() const
+    {
+        auto mode = ((_c1 + 1) * (_r1 + 1)) / (_r1 + _r2 + 2);
+        return std::clamp(mode, lowest(), highest());
+    }
+
+    double logProb(size_t x) const
+    {
+        const auto& lf = *_logFactorials;
+        return _logConstant - lf[x] - lf[_r1 - x] - lf[_c1 - x] - lf[_r2 + x - _c1];
+    }
+
+    // Sums the probabilities from x = from to x = to (inclusive), where from is
+    // the more probable end, stopping once they no longer contribute to the sum
+    double tailSum(size_t from, size_t to) const
+    {
+        constexpr size_t BlockSize = 16;
+        const std::ptrdiff_t step = to >= from ? 1 : -1;
+
+        auto x = static_cast<std::ptrdiff_t>(from);
+        auto count = (to >= from ? to - from : from - to) + 1;
+
+        double sum = 0.0;
+        std::array<double, BlockSize> block{};
+
+        while(count > 0)
+        {
+            auto blockSize = std::min(BlockSize, count);
+
+            // Independent iterations, so the compiler is free to vectorise these
+            for(size_t i = 0; i < blockSize; i++)
+                block[i] = std::exp(logProb(static_cast<size_t>(x + (step * static_cast<std::ptrdiff_t>(i)))));
+
+            sum += std::accumulate(block.begin(), block.begin() + static_cast<std::ptrdiff_t>(blockSize), 0.0);
+
+            x += step * static_cast<std::ptrdiff_t>(blockSize);
+            count -= blockSize;
+
+            if(block[blockSize - 1] <= sum * std::numeric_limits<double>::epsilon())
+                break;
+        }
+
+        return sum;
+    }
+};
+} // namespace
 
 /*
  *  A: Selected In Category
@@ -54,173 +136,233 @@ static double hyperGeometricProb(double x, double r1, double r2, double c1, doub
  *  C: Selected NOT In Category
  *  D: Not Selected NOT In Category
  */
-double EnrichmentCalculator::fishers(size_t a, size_t b, size_t c, size_t d)
+double EnrichmentCalculator::fishers(size_t a, size_t b, size_t c, size_t d,
+    const LogFactorials& logFactorials)
 {
-    auto ab = static_cast<double>(a + b);
-    auto cd = static_cast<double>(c + d);
-    auto ac = static_cast<double>(a + c);
-    auto bd = static_cast<double>(b + d);
+    Q_ASSERT(logFactorials.size() > a + b + c + d);
+
+    const HyperGeometric distribution(logFactorials, a + b, c + d, a + c, b + d);
+
+    // Relative tolerance when comparing probabilities, so that tables
+    // that are equally likely aren't excluded due to rounding error
+    const double threshold = distribution.logProb(a) + 1e-7;
 
+    const auto lowest = distribution.lowest();
+    const auto highest = distribution.highest();
+    const auto mode = distribution.mode();
+
+    auto isInTail = [&](size_t x) { return distribution.logProb(x) <= threshold; };
+
+    // The distribution is unimodal, so the tables that are no more likely than
+    // the observed table form a contiguous run either side of the mode
     double twoPval = 0.0;
 
-    // range of variation
-    const double lm = (ac < cd) ? 0.0 : ac - cd;
-    const double um = (ac < ab) ? ac  : ab;
+    // Below the mode, probabilities increase with x
+    {
+        size_t first = lowest;
+        size_t last = mode + 1;
 
-    // Fisher's exact test
-    const double crit = hyperGeometricProb(static_cast<double>(a), ab, cd, ac, bd);
+        while(first < last)
+        {
+            auto middle = first + ((last - first) / 2);
+            if(isInTail(middle))
+                first = middle + 1;
+            else
+                last = middle;
+        }
 
-    for(auto x = static_cast<int>(lm); x <= static_cast<int>(um); x++)
+        // [lowest, first) are in the tail
+        if(first > lowest)
+            twoPval += distribution.tailSum(first - 1, lowest);
+    }
+
+    // Above the mode, probabilities decrease with x
     {
-        const double prob = hyperGeometricProb(static_cast<double>(x), ab, cd, ac, bd);
+        size_t first = mode + 1;
+        size_t last = highest + 1;
+
+        while(first < last)
+        {
+            auto middle = first + ((last - first) / 2);
+            if(!isInTail(middle))
+                first = middle + 1;
+            else
+                last = middle;
+        }
 
-        if(prob <= crit)
-            twoPval += prob;
+        // [first, highest] are in the tail
+        if(first <= highest)
+            twoPval += distribution.tailSum(first, highest);
     }
 
-    return twoPval;
+    return std::min(twoPval, 1.0);
 }
 
-EnrichmentTableModel::Table EnrichmentCalculator::overRepAgainstEachAttribute(
-    const QString& attributeAName, const QString& attributeBName,
-    IGraphModel* graphModel, ICommand& command)
+namespace
+{
+struct DictionaryEncoding
+{
+    static constexpr size_t NoValue = std::numeric_limits<size_t>::max();
+
+    // Sorted, so that the table is in the same order as the values
+    std::vector<QString> _values;
+
+    // For each node, the index of its value in _values, or NoValue
+    std::vector<size_t> _codes;
+
+    // The number of nodes that have each value
+    std::vector<size_t> _counts;
+};
+
+DictionaryEncoding encode(const IAttribute& attribute, const std::vector<NodeId>& nodeIds)
 {
-    // Count of attribute values within the attribute
-    std::map<QString, size_t> attributeValueEntryCountATotal;
-    std::map<QString, size_t> attributeValueEntryCountBTotal;
-    EnrichmentTableModel::Table tableModel;
+    DictionaryEncoding encoding;
+    std::vector<QString> nodeValues;
+    nodeValues.reserve(nodeIds.size());
+
+    for(auto nodeId : nodeIds)
+        nodeValues.emplace_back(attribute.stringValueOf(nodeId));
 
-    for(auto nodeId : graphModel->graph().nodeIds())
+    std::unordered_map<QString, size_t> index;
+    for(const auto& value : nodeValues)
     {
-        const auto* attributeA = graphModel->attributeByName(attributeAName);
-        const auto* attributeB = graphModel->attributeByName(attributeBName);
-        const auto& stringAttributeA = attributeA->stringValueOf(nodeId);
-        const auto& stringAttributeB = attributeB->stringValueOf(nodeId);
+        if(!value.isEmpty())
+            index.emplace(value, 0);
+    }
+
+    encoding._values.reserve(index.size());
+    for(const auto& [value, code] : index)
+        encoding._values.push_back(value);
 
-        if(!stringAttributeA.isEmpty())
-            ++attributeValueEntryCountATotal[stringAttributeA];
+    std::sort(encoding._values.begin(), encoding._values.end());
+
+    for(size_t code = 0; code < encoding._values.size(); code++)
+        index[encoding._values.at(code)] = code;
+
+    encoding._codes.reserve(nodeValues.size());
+    encoding._counts.resize(encoding._values.size(), 0);
+
+    for(const auto& value : nodeValues)
+    {
+        if(value.isEmpty())
+        {
+            encoding._codes.push_back(DictionaryEncoding::NoValue);
+            continue;
+        }
 
-        if(!stringAttributeB.isEmpty())
-            ++attributeValueEntryCountBTotal[stringAttributeB];
+        auto code = index.at(value);
+        encoding._codes.push_back(code);
+        encoding._counts[code]++;
     }
 
-    // Comparing
+    return encoding;
+}
+} // namespace
 
-    uint64_t progress = 0;
-    auto iterations = static_cast<uint64_t>(attributeValueEntryCountBTotal.size() *
-        attributeValueEntryCountATotal.size());
+EnrichmentTableModel::Table EnrichmentCalculator::overRepAgainstEachAttribute(
+    const QString& attributeAName, const QString& attributeBName,
+    IGraphModel* graphModel, ICommand& command)
+{
+    const auto& nodeIds = graphModel->graph().nodeIds();
+    const auto n = nodeIds.size();
 
-    // Get all the nodeIds for each AttributeFor value
-    // Maps of vectors uhoh.
     const auto* attributeA = graphModel->attributeByName(attributeAName);
     const auto* attributeB = graphModel->attributeByName(attributeBName);
 
-    std::map<QString, std::vector<NodeId>> nodeIdsForAttributeValue;
-    for(auto nodeId : graphModel->graph().nodeIds())
-    {
-        const auto& value = attributeA->stringValueOf(nodeId);
+    // Attribute values are generated on demand, so fetch each of them only once
+    // and replace them with integer codes for the purposes of counting
+    auto encodingA = encode(*attributeA, nodeIds);
+    auto encodingB = encode(*attributeB, nodeIds);
 
-        if(!value.isEmpty())
-            nodeIdsForAttributeValue[value].push_back(nodeId); // clazy:exclude=reserve-candidates
+    const auto numValuesA = encodingA._values.size();
+    const auto numValuesB = encodingB._values.size();
+
+    EnrichmentTableModel::Table tableModel(numValuesA * numValuesB);
+
+    if(tableModel.empty())
+        return tableModel;
+
+    // Group the nodes by their value of attribute A
+    std::vector<size_t> offsetsA(numValuesA + 1, 0);
+    for(size_t code = 0; code < numValuesA; code++)
+        offsetsA[code + 1] = offsetsA[code] + encodingA._counts[code];
+
+    std::vector<size_t> nodesByValueA(offsetsA.back());
+    auto positionsA = offsetsA;
+    for(size_t node = 0; node < n; node++)
+    {
+        auto code = encodingA._codes[node];
+        if(code != DictionaryEncoding::NoValue)
+            nodesByValueA[positionsA[code]++] = node;
     }
 
-    for(auto& attributeValueA : u::keysFor(attributeValueEntryCountATotal))
+    std::vector<size_t> codesA(numValuesA);
+    std::iota(codesA.begin(), codesA.end(), 0);
+
+    const LogFactorials logFactorials(n);
+
+    std::atomic<size_t> numCodesComplete = 0;
+
+    // Each value of A produces its own row of the contingency table, and its own rows of results
+    parallel_for(codesA.begin(), codesA.end(),
+    [&](size_t codeA)
     {
-        auto& selectedNodes = nodeIdsForAttributeValue[attributeValueA];
+        const auto& attributeValueA = encodingA._values.at(codeA);
 
-        for(auto& attributeValueB : u::keysFor(attributeValueEntryCountBTotal))
+        std::vector<size_t> selectedInCategoryCounts(numValuesB, 0);
+        for(auto i = offsetsA[codeA]; i < offsetsA[codeA + 1]; i++)
         {
-            EnrichmentTableModel::Row row(EnrichmentTableModel::Results::NumResultColumns);
-            command.setProgress(static_cast<int>(progress * 100U / iterations));
-            progress++;
+            auto codeB = encodingB._codes[nodesByValueA[i]];
+            if(codeB != DictionaryEncoding::NoValue)
+                selectedInCategoryCounts[codeB]++;
+        }
 
-            auto n = graphModel->graph().numNodes();
+        const auto c1 = encodingA._counts[codeA];
+        const auto c2 = n - c1;
 
-            size_t selectedInCategory = 0;
-            for(auto nodeId : selectedNodes)
-            {
-                if(attributeB->stringValueOf(nodeId) == attributeValueB)
-                    selectedInCategory++;
-            }
+        for(size_t codeB = 0; codeB < numValuesB; codeB++)
+        {
+            const auto& attributeValueB = encodingB._values.at(codeB);
+            auto& row = tableModel[(codeA * numValuesB) + codeB];
+            row.resize(EnrichmentTableModel::Results::NumResultColumns);
 
-            auto r1 = attributeValueEntryCountBTotal[attributeValueB];
+            auto selectedInCategory = selectedInCategoryCounts[codeB];
+            auto r1 = encodingB._counts[codeB];
             auto fexp = static_cast<double>(r1) / static_cast<double>(n);
-            auto stdevs = doRandomSampling(static_cast<int>(selectedNodes.size()), fexp);
 
-            auto expectedNo = (static_cast<double>(r1) / static_cast<double>(n)) *
-                static_cast<double>(selectedNodes.size());
-            auto expectedDev = stdevs[0] * static_cast<double>(selectedNodes.size());
+            // Under the null hypothesis, the number of selected nodes in the category
+            // follows a hypergeometric distribution, which has this variance
+            auto variance = n > 1 ? static_cast<double>(c1) * fexp * (1.0 - fexp) *
+                (static_cast<double>(c2) / static_cast<double>(n - 1)) : 0.0;
+
+            auto expectedNo = fexp * static_cast<double>(c1);
+            auto expectedDev = std::sqrt(variance);
 
             auto nonSelectedInCategory = r1 - selectedInCategory;
-            auto c1 = selectedNodes.size();
             auto selectedNotInCategory = c1 - selectedInCategory;
-            auto c2 = n - c1;
             auto nonSelectedNotInCategory = c2 - nonSelectedInCategory;
-            auto f = fishers(selectedInCategory, nonSelectedInCategory, selectedNotInCategory, nonSelectedNotInCategory);
+            auto f = fishers(selectedInCategory, nonSelectedInCategory,
+                selectedNotInCategory, nonSelectedNotInCategory, logFactorials);
 
             row[EnrichmentTableModel::Results::SelectionA] = attributeValueA;
             row[EnrichmentTableModel::Results::SelectionB] = attributeValueB;
             row[EnrichmentTableModel::Results::Observed] = u"%1 of %2"_s
                 .arg(selectedInCategory)
-                .arg(selectedNodes.size());
+                .arg(c1);
             row[EnrichmentTableModel::Results::ExpectedTrial] = u"%1 ± %2 of %3"_s
                 .arg(QString::number(expectedNo, 'f', 2),
                 QString::number(expectedDev, 'f', 2),
-                QString::number(selectedNodes.size()));
+                QString::number(c1));
             row[EnrichmentTableModel::Results::OverRep] = static_cast<double>(selectedInCategory) / expectedNo;
             row[EnrichmentTableModel::Results::Fishers] = f;
             row[EnrichmentTableModel::Results::BonferroniAdjusted] =
-                std::min(1.0, f * static_cast<double>(attributeValueEntryCountBTotal.size()));
-
-            tableModel.push_back(row);
+                std::min(1.0, f * static_cast<double>(numValuesB));
         }
-    }
 
-    return tableModel;
-}
+        command.setProgress(static_cast<int>((++numCodesComplete * 100) / numValuesA));
+    });
 
-MSVC_WARNING_SUPPRESS_NEXTLINE(6262)
-std::vector<double> EnrichmentCalculator::doRandomSampling(int sampleCount, double expectedFrequency)
-{
-    const size_t NUMBER_OF_TRIALS = 1000;
-    std::array<double, NUMBER_OF_TRIALS> observed{};
-    std::array<double, NUMBER_OF_TRIALS> overRepresentation{};
-    double observationAvg = 0.0;
-    double overRepresentationAvg = 0.0;
-    double observationStdDev = 0.0;
-    double overRepresentationStdDev = 0.0;
-
-    std::random_device rd;
-    auto seededGenerator = std::mt19937(rd());
-    auto distribution = std::uniform_real_distribution<>(0.0f, 1.0f);
-
-    for(size_t i = 0; i < NUMBER_OF_TRIALS; i++)
-    {
-        int hits = 0;
-        for(int j = 0; j < sampleCount; j++)
-        {
-            if(static_cast<double>(distribution(seededGenerator)) <= expectedFrequency)
-                hits++;
-        }
-
-        observed.at(i) = hits / static_cast<double>(sampleCount);
-        overRepresentation.at(i) = observed.at(i) / expectedFrequency;
-        observationAvg += observed.at(i);
-        overRepresentationAvg += overRepresentation.at(i);
-    }
-
-    observationAvg = observationAvg / static_cast<double>(NUMBER_OF_TRIALS);
-    overRepresentationAvg = overRepresentationAvg / static_cast<double>(NUMBER_OF_TRIALS);
+    command.setProgress(-1);
 
-    for(size_t i = 0; i < NUMBER_OF_TRIALS; i++)
-    {
-        observationStdDev += (observed.at(i) - observationAvg) * (observed.at(i) - observationAvg);
-        overRepresentationStdDev += (overRepresentation.at(i) - overRepresentationAvg) * (overRepresentation.at(i) - overRepresentationAvg);
-    }
-
-    observationStdDev = std::sqrt(observationStdDev / static_cast<double>(NUMBER_OF_TRIALS));
-    overRepresentationStdDev = std::sqrt(overRepresentationStdDev / static_cast<double>(NUMBER_OF_TRIALS));
-
-    return { observationStdDev, overRepresentationStdDev, observationAvg, overRepresentationAvg };
+    return tableModel;
 }
-
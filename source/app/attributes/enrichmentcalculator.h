@@ -20,6 +20,7 @@
 #ifndef ENRICHMENTCALCULATOR_H
 #define ENRICHMENTCALCULATOR_H
 #include <vector>
+#include <cstddef>
 
 #include "enrichmenttablemodel.h"
 
@@ -30,8 +31,20 @@ class ICommand;
 class EnrichmentCalculator
 {
 public:
-    static double fishers(size_t a, size_t b, size_t c, size_t d);
-    static std::vector<double> doRandomSampling(int sampleCount, double expectedFrequency);
+    // Table of log(i!) for 0 <= i <= n
+    class LogFactorials
+    {
+    private:
+        std::vector<double> _values;
+
+    public:
+        explicit LogFactorials(size_t n);
+
+        size_t size() const { return _values.size(); }
+        double operator[](size_t i) const { return _values[i]; }
+    };
+
+    static double fishers(size_t a, size_t b, size_t c, size_t d, const LogFactorials& logFactorials);
     static EnrichmentTableModel::Table overRepAgainstEachAttribute(const QString& attributeAName,
         const QString& attributeBName, IGraphModel* graphModel, ICommand& command);
 };
@@ -26,6 +26,7 @@
 #include "shared/graph/grapharray.h"
 
 #include "app/layout/nodepositions.h"
+#include "app/layout/nodespatialindex.h"
 
 #include "app/ui/document.h"
 #include "app/ui/selectionmanager.h"
@@ -87,6 +88,7 @@
 
 #include <set>
 #include <map>
+#include <mutex>
 #include <vector>
 #include <utility>
 
@@ -97,11 +99,12 @@ using EdgeVisuals = EdgeArray<ElementVisual>;
 
 static void updateTextVisualPositions(TextVisuals& textVisuals, const NodePositions& nodePositions)
 {
-    // This must be called when the layout is paused or otherwise locked
+    const auto snapshot = nodePositions.snapshot();
+
     for(auto& [componentId, textVisuals_] : textVisuals)
     {
         for(auto& textVisual : textVisuals_)
-            textVisual.updatePositions(nodePositions);
+            textVisual.updatePositions(snapshot);
     }
 }
 
@@ -113,7 +116,6 @@ class GraphModelImpl
 public:
     explicit GraphModelImpl(GraphModel& graphModel) :
         _transformedGraph(graphModel, _graph),
-        _nodePositions(_graph),
         _nodeVisuals(_graph),
         _edgeVisuals(_graph),
         _mappedNodeVisuals(_graph),
@@ -223,6 +225,39 @@ private:
     std::set<AttributeChangesTracker*> _attributeChangesTrackers;
 
     bool _visualUpdateRequired = false;
+
+    struct NodeSpatialIndexEntry
+    {
+        std::shared_ptr<NodeSpatialIndex> _index;
+        size_t _positionsVersion = 0;
+        size_t _nodeSizesVersion = 0;
+
+        // Corresponding to _index->nodeIds(); kept so that the index can be
+        // refitted to new positions without reading the node visuals
+        std::vector<float> _radii;
+    };
+
+    // Built on demand, and discarded whenever the graph changes
+    std::mutex _nodeSpatialIndexesMutex;
+    std::map<ComponentId, NodeSpatialIndexEntry> _nodeSpatialIndexes;
+    std::atomic<size_t> _nodeSizesVersion = 0;
+
+    // Must be called with _nodeSpatialIndexesMutex held
+    void refitNodeSpatialIndex(NodeSpatialIndexEntry& entry, bool force = false) const
+    {
+        const auto snapshot = _nodePositions.snapshot();
+
+        if(!force && entry._positionsVersion == snapshot.version())
+            return;
+
+        // Another thread may still be using the existing index, so it can't be updated in place;
+        // references are only handed out with the mutex held, so otherwise it's ours alone
+        if(entry._index.use_count() > 1)
+            entry._index = std::make_shared<NodeSpatialIndex>(*entry._index);
+
+        entry._index->update(snapshot, entry._radii);
+        entry._positionsVersion = snapshot.version();
+    }
 };
 
 GraphModel::GraphModel(const QString& name, IPlugin* plugin) :
@@ -472,6 +507,58 @@ const TextVisuals& GraphModel::textVisuals() const { return _->_textVisuals; }
 NodePositions& GraphModel::nodePositions() { return _->_nodePositions; }
 const NodePositions& GraphModel::nodePositions() const { return _->_nodePositions; }
 
+std::shared_ptr<const NodeSpatialIndex> GraphModel::nodeSpatialIndex(ComponentId componentId) const
+{
+    const std::unique_lock<std::mutex> lock(_->_nodeSpatialIndexesMutex);
+
+    auto& entry = _->_nodeSpatialIndexes[componentId];
+    const auto nodeSizesVersion = _->_nodeSizesVersion.load();
+
+    const bool created = entry._index == nullptr;
+
+    if(created)
+    {
+        const auto* component = graph().componentById(componentId);
+        Q_ASSERT(component != nullptr);
+        entry._index = std::make_shared<NodeSpatialIndex>(component->nodeIds());
+    }
+
+    const bool nodeSizesChanged = created || entry._nodeSizesVersion != nodeSizesVersion;
+
+    if(nodeSizesChanged)
+    {
+        const auto& nodeIds = entry._index->nodeIds();
+        entry._radii.clear();
+        entry._radii.reserve(nodeIds.size());
+
+        for(auto nodeId : nodeIds)
+            entry._radii.emplace_back(_->_nodeVisuals.at(nodeId)._size);
+
+        entry._nodeSizesVersion = nodeSizesVersion;
+    }
+
+    // During a layout this has usually already been done by updateNodeSpatialIndexes
+    _->refitNodeSpatialIndex(entry, nodeSizesChanged);
+
+    return entry._index;
+}
+
+void GraphModel::updateNodeSpatialIndexes()
+{
+    const std::unique_lock<std::mutex> lock(_->_nodeSpatialIndexesMutex);
+    const auto nodeSizesVersion = _->_nodeSizesVersion.load();
+
+    for(auto& [componentId, entry] : _->_nodeSpatialIndexes)
+    {
+        // The node sizes can only be safely read by the thread that changes them,
+        // so if they have changed, updating the index is left to the next query
+        if(entry._index == nullptr || entry._nodeSizesVersion != nodeSizesVersion)
+            continue;
+
+        _->refitNodeSpatialIndex(entry);
+    }
+}
+
 const NodeArray<QString>& GraphModel::nodeNames() const { return _->_nodeNames; }
 QString GraphModel::nodeName(NodeId nodeId) const { return _->_nodeNames[nodeId]; }
 void GraphModel::setNodeName(NodeId nodeId, const QString& name)
@@ -1412,6 +1499,9 @@ void GraphModel::updateVisuals(bool force)
         _->_edgeVisuals = newEdgeVisuals;
         _->_textVisuals = _->_newTextVisuals;
 
+        if(Flags<VisualChangeFlags>(nodeChange).test(VisualChangeFlags::Size))
+            _->_nodeSizesVersion++;
+
         emit visualsChanged(nodeChange, edgeChange, textChange);
     }
 }
@@ -1472,6 +1562,12 @@ void GraphModel::onTransformedGraphChanged(const Graph*, bool changeOccurred)
 {
     _->_removedDynamicAttributeNames.clear();
 
+    if(changeOccurred)
+    {
+        const std::unique_lock<std::mutex> lock(_->_nodeSpatialIndexesMutex);
+        _->_nodeSpatialIndexes.clear();
+    }
+
     auto attributeIdentities = _->currentAttributeIdentities();
 
     // Compare with previous attributes
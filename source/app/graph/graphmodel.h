@@ -46,6 +46,7 @@ class GraphModelImpl;
 class Graph;
 class MutableGraph;
 class NodePositions;
+class NodeSpatialIndex;
 
 class SelectionManager;
 class SearchManager;
@@ -120,6 +121,15 @@ public:
     NodePositions& nodePositions();
     const NodePositions& nodePositions() const;
 
+    // An index of the latest node positions in a component, for spatial queries; it holds
+    // the positions it was built from, which should be used in preference to nodePositions()
+    // when testing the nodes it returns, as the latter may since have been updated again
+    std::shared_ptr<const NodeSpatialIndex> nodeSpatialIndex(ComponentId componentId) const;
+
+    // Refit any existing indexes to the latest node positions; called by the layout after
+    // publishing them, so that queries don't have to wait for it themselves
+    void updateNodeSpatialIndexes();
+
     const NodeArray<QString>& nodeNames() const;
 
     QString nodeName(NodeId nodeId) const override;
@@ -20,43 +20,78 @@
 #ifndef BARNESHUTTREE_H
 #define BARNESHUTTREE_H
 
-#include "spatialtree.h"
-#include "shared/utils/fixedsizestack.h"
+#include "nodepositions.h"
 
+#include "shared/graph/igraphcomponent.h"
+#include "shared/utils/scopetimer.h"
+
+#include <QtGlobal>
 #include <QVector3D>
 
-#include <functional>
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
 
-class AbstractBarnesHutTree : virtual public AbstractSpatialTree
+// The tree is stored linearised in depth first order, in a set of flat arrays; each
+// node is immediately followed by its children and records the index of the node
+// that follows its entire subtree, so it can be traversed without a stack. Points
+// are sorted into Morton order before the tree is built, meaning that nodes which
+// are close in space are also close in memory. None of the storage is released
+// between builds, so once it has grown to size, rebuilding the tree doesn't allocate.
+template<size_t NumDimensions>
+class BarnesHutTree
 {
-public:
-    virtual QVector3D evaluateKernel(const NodeLayoutPositions& nodePositions, NodeId nodeId,
-        const std::function<QVector3D(int, const QVector3D&, float)>& kernel) const = 0;
-};
+    static_assert(NumDimensions == 2 || NumDimensions == 3);
 
-template<size_t NumDimensions>
-class BarnesHutTree;
+private:
+    static constexpr uint32_t NUM_CHILDREN = 1u << NumDimensions;
 
-template<size_t NumDimensions>
-struct BarnesHutSubVolume : SubVolume<BarnesHutTree<NumDimensions>, NumDimensions> { float _sSq = 0.0f; };
+    // 21 bits per dimension allows a 3D Morton code to fit in 64 bits
+    static constexpr uint32_t MAX_DEPTH = 21;
+    static constexpr uint32_t MAX_POINTS_PER_LEAF = 8;
 
-template<size_t NumDimensions>
-class BarnesHutTree :
-    public SpatialTree<BarnesHutTree<NumDimensions>, NumDimensions, BarnesHutSubVolume<NumDimensions>>,
-    public AbstractBarnesHutTree
-{
-private:
     static constexpr float E = 0.0001f;
     static constexpr float E2 = E * E;
 
-    // Cycle through different epsilon vectors so that there is enough
-    // variation that the forces don't get stuck in 2 or fewer dimensions
-    mutable size_t _di = 0;
-    QVector3D differenceEpsilon() const
+    float _theta = 0.8f;
+
+    // Per point data, in Morton order
+    std::vector<float> _pointX;
+    std::vector<float> _pointY;
+    std::vector<float> _pointZ;
+    std::vector<float> _pointMass;
+    std::vector<NodeId> _pointNodeIds;
+
+    // Per tree node data
+    std::vector<float> _centreX;
+    std::vector<float> _centreY;
+    std::vector<float> _centreZ;
+    std::vector<float> _mass;
+    std::vector<float> _sizeSq;
+    std::vector<uint32_t> _next;
+    std::vector<uint32_t> _firstPoint;
+    std::vector<uint32_t> _numPoints; // Zero for internal nodes
+    uint32_t _numNodes = 0;
+
+    // Scratch space used while building
+    std::vector<QVector3D> _unsortedPositions;
+    std::vector<uint64_t> _codes;
+    std::vector<uint64_t> _codesScratch;
+    std::vector<uint32_t> _order;
+    std::vector<uint32_t> _orderScratch;
+    std::array<float, MAX_DEPTH + 1> _depthSizeSq = {};
+
+    // When two points coincide there is no direction in which to apply a force, so pick
+    // one of these instead; they vary by point so that the forces don't end up stuck in
+    // 2 or fewer dimensions
+    static const QVector3D& differenceEpsilon(size_t index)
     {
         if constexpr(NumDimensions == 3)
         {
-            static std::array<QVector3D, 6> vs =
+            static const std::array<QVector3D, 6> vs =
             {{
                 {   E, 0.0f, 0.0f},
                 {0.0f,    E, 0.0f},
@@ -66,12 +101,11 @@ private:
                 {0.0f, 0.0f,   -E},
             }};
 
-            _di = (_di + 1) % vs.size();
-            return vs.at(_di);
+            return vs.at(index % vs.size());
         }
-        else if constexpr(NumDimensions == 2)
+        else
         {
-            static std::array<QVector3D, 4> vs =
+            static const std::array<QVector3D, 4> vs =
             {{
                 {   E, 0.0f, 0.0f},
                 {0.0f,    E, 0.0f},
@@ -79,91 +113,372 @@ private:
                 {0.0f,   -E, 0.0f},
             }};
 
-            _di = (_di + 1) % vs.size();
-            return vs.at(_di);
+            return vs.at(index % vs.size());
         }
     }
 
-    float _theta = 0.8f;
-    int _mass = 0;
-    QVector3D _centreOfMass;
-
-    void initialise(const NodeLayoutPositions& nodePositions, const std::vector<NodeId>& nodeIds) override
+    // Spread the low MAX_DEPTH bits of value out so that there are
+    // NumDimensions - 1 zero bits between each of them
+    static uint64_t spreadBits(uint32_t value)
     {
-        _mass = static_cast<int>(nodeIds.size());
-        _centreOfMass = nodePositions.centreOfMass(nodeIds);
+        uint64_t x = value & ((1u << MAX_DEPTH) - 1u);
+
+        if constexpr(NumDimensions == 3)
+        {
+            x = (x | (x << 32u)) & 0x001F00000000FFFFull;
+            x = (x | (x << 16u)) & 0x001F0000FF0000FFull;
+            x = (x | (x <<  8u)) & 0x100F00F00F00F00Full;
+            x = (x | (x <<  4u)) & 0x10C30C30C30C30C3ull;
+            x = (x | (x <<  2u)) & 0x1249249249249249ull;
+        }
+        else
+        {
+            x = (x | (x << 16u)) & 0x0000FFFF0000FFFFull;
+            x = (x | (x <<  8u)) & 0x00FF00FF00FF00FFull;
+            x = (x | (x <<  4u)) & 0x0F0F0F0F0F0F0F0Full;
+            x = (x | (x <<  2u)) & 0x3333333333333333ull;
+            x = (x | (x <<  1u)) & 0x5555555555555555ull;
+        }
 
-        for(auto& subVolume : this->_subVolumes)
-            subVolume._sSq = subVolume._boundingBox.maxLength() * subVolume._boundingBox.maxLength();
+        return x;
     }
 
-public:
-    BarnesHutTree()
+    // The index of the child, at depth, of the cell containing code
+    static uint32_t childIndex(uint64_t code, uint32_t depth)
     {
-        this->setMaxNodesPerLeaf(1);
+        const auto shift = NumDimensions * (MAX_DEPTH - depth);
+        return static_cast<uint32_t>(code >> shift) & (NUM_CHILDREN - 1u);
     }
 
-    void setTheta(float theta) { _theta = theta; }
+    // LSD radix sort of _codes, carrying _order along with it
+    void sortByCode()
+    {
+        constexpr size_t RADIX_BITS = 8;
+        constexpr size_t RADIX = size_t{1} << RADIX_BITS;
+        constexpr size_t NUM_PASSES = (NumDimensions * MAX_DEPTH + RADIX_BITS - 1) / RADIX_BITS;
+
+        const auto numCodes = _codes.size();
+        std::array<std::array<uint32_t, RADIX>, NUM_PASSES> histograms = {};
+
+        for(const auto code : _codes)
+        {
+            for(size_t pass = 0; pass < NUM_PASSES; pass++)
+                histograms.at(pass).at((code >> (pass * RADIX_BITS)) & (RADIX - 1))++;
+        }
+
+        _codesScratch.resize(numCodes);
+        _orderScratch.resize(numCodes);
 
-    QVector3D evaluateKernel(const NodeLayoutPositions& nodePositions, NodeId nodeId,
-        const std::function<QVector3D(int, const QVector3D&, float)>& kernel) const override
+        for(size_t pass = 0; pass < NUM_PASSES; pass++)
+        {
+            auto& histogram = histograms.at(pass);
+
+            // Every code has the same digit in this position, so there is nothing to do
+            if(std::any_of(histogram.begin(), histogram.end(),
+                [numCodes](auto count) { return count == numCodes; }))
+            {
+                continue;
+            }
+
+            uint32_t offset = 0;
+            for(auto& count : histogram)
+                offset += std::exchange(count, offset);
+
+            for(size_t i = 0; i < numCodes; i++)
+            {
+                const auto digit = (_codes[i] >> (pass * RADIX_BITS)) & (RADIX - 1);
+                const auto destination = histogram[digit]++;
+
+                _codesScratch[destination] = _codes[i];
+                _orderScratch[destination] = _order[i];
+            }
+
+            std::swap(_codes, _codesScratch);
+            std::swap(_order, _orderScratch);
+        }
+    }
+
+    // Builds the node covering points [first, last), all of whose codes share
+    // the same prefix down to depth, returning its index
+    uint32_t buildNode(uint32_t first, uint32_t last, uint32_t depth)
     {
-        const QVector3D& nodePosition = nodePositions.get(nodeId);
-        QVector3D result;
-        FixedSizeStack<const BarnesHutTree*> stack(this->_depthFirstTraversalStackSizeRequirement);
+        // Descend past any levels at which every point falls within the same child
+        while(last - first > MAX_POINTS_PER_LEAF && depth < MAX_DEPTH &&
+            childIndex(_codes[first], depth + 1) == childIndex(_codes[last - 1], depth + 1))
+        {
+            depth++;
+        }
 
-        stack.push(this);
+        const auto index = _numNodes++;
+        _sizeSq[index] = _depthSizeSq.at(depth);
 
-        while(!stack.empty())
+        double x = 0.0;
+        double y = 0.0;
+        double z = 0.0;
+        double mass = 0.0;
+
+        if(last - first <= MAX_POINTS_PER_LEAF || depth == MAX_DEPTH)
         {
-            const BarnesHutTree* subTree = stack.pop();
+            _firstPoint[index] = first;
+            _numPoints[index] = last - first;
 
-            for(size_t i = 0; i < subTree->_numInternalNodes; i++)
+            for(auto i = first; i < last; i++)
             {
-                auto subVolume = subTree->_internalNodes.at(i);
+                const auto pointMass = static_cast<double>(_pointMass[i]);
+
+                x += static_cast<double>(_pointX[i]) * pointMass;
+                y += static_cast<double>(_pointY[i]) * pointMass;
+                z += static_cast<double>(_pointZ[i]) * pointMass;
+                mass += pointMass;
+            }
+        }
+        else
+        {
+            _firstPoint[index] = first;
+            _numPoints[index] = 0;
 
-                const QVector3D& centreOfMass = subVolume->_subTree->_centreOfMass;
-                QVector3D difference = (centreOfMass - nodePosition);
-                float distanceSq = difference.lengthSquared();
+            auto childFirst = first;
+            while(childFirst < last)
+            {
+                const auto child = childIndex(_codes[childFirst], depth + 1);
+                const auto childLast = static_cast<uint32_t>(std::distance(_codes.begin(),
+                    std::partition_point(_codes.begin() + childFirst, _codes.begin() + last,
+                    [child, depth](uint64_t code) { return childIndex(code, depth + 1) == child; })));
 
-                if(distanceSq == 0.0f)
-                {
-                    difference = differenceEpsilon();
-                    distanceSq = E2;
-                }
+                const auto childNode = buildNode(childFirst, childLast, depth + 1);
+                const auto childMass = static_cast<double>(_mass[childNode]);
 
-                const float sOverD = subVolume->_sSq / distanceSq;
+                x += static_cast<double>(_centreX[childNode]) * childMass;
+                y += static_cast<double>(_centreY[childNode]) * childMass;
+                z += static_cast<double>(_centreZ[childNode]) * childMass;
+                mass += childMass;
 
-                if(sOverD > _theta)
-                    stack.push(subVolume->_subTree.get());
-                else
-                    result += kernel(subVolume->_subTree->_mass, difference, distanceSq);
+                childFirst = childLast;
             }
+        }
+
+        _centreX[index] = static_cast<float>(x / mass);
+        _centreY[index] = static_cast<float>(y / mass);
+        _centreZ[index] = static_cast<float>(z / mass);
+        _mass[index] = static_cast<float>(mass);
+        _next[index] = _numNodes;
+
+        return index;
+    }
+
+    // If masses is null, every point has a mass of 1
+    void buildFrom(const QVector3D* positions, const float* masses, size_t numPoints)
+    {
+        Q_ASSERT(numPoints < std::numeric_limits<uint32_t>::max() / 2);
+
+        _numNodes = 0;
+        _pointX.resize(numPoints);
+        _pointY.resize(numPoints);
+        _pointZ.resize(numPoints);
+        _pointMass.resize(numPoints);
+        _order.resize(numPoints);
 
-            for(size_t i = 0; i < subTree->_numNonEmptyLeaves; i++)
+        if(numPoints == 0)
+            return;
+
+        QVector3D min = positions[0];
+        QVector3D max = min;
+        for(size_t i = 0; i < numPoints; i++)
+        {
+            const auto& position = positions[i];
+            min = {std::min(min.x(), position.x()), std::min(min.y(), position.y()), std::min(min.z(), position.z())};
+            max = {std::max(max.x(), position.x()), std::max(max.y(), position.y()), std::max(max.z(), position.z())};
+        }
+
+        const QVector3D extent = max - min;
+        float maxExtent = std::max(extent.x(), extent.y());
+        if constexpr(NumDimensions == 3)
+            maxExtent = std::max(maxExtent, extent.z());
+
+        for(size_t depth = 0; depth < _depthSizeSq.size(); depth++)
+        {
+            const float size = maxExtent / static_cast<float>(1u << depth);
+            _depthSizeSq.at(depth) = size * size;
+        }
+
+        // Quantise each position onto a grid of 2^MAX_DEPTH cells per dimension
+        constexpr auto NUM_CELLS = static_cast<float>(1u << MAX_DEPTH);
+        constexpr auto MAX_CELL = static_cast<float>((1u << MAX_DEPTH) - 1u);
+        auto cell = [&](float value, float minimum, float length)
+        {
+            if(length <= 0.0f)
+                return 0u;
+
+            return static_cast<uint32_t>(std::clamp(((value - minimum) / length) * NUM_CELLS, 0.0f, MAX_CELL));
+        };
+
+        _codes.resize(numPoints);
+        for(size_t i = 0; i < numPoints; i++)
+        {
+            const auto& position = positions[i];
+
+            uint64_t code = spreadBits(cell(position.x(), min.x(), extent.x())) |
+                (spreadBits(cell(position.y(), min.y(), extent.y())) << 1u);
+
+            if constexpr(NumDimensions == 3)
+                code |= spreadBits(cell(position.z(), min.z(), extent.z())) << 2u;
+
+            _codes[i] = code;
+            _order[i] = static_cast<uint32_t>(i);
+        }
+
+        sortByCode();
+
+        for(size_t i = 0; i < numPoints; i++)
+        {
+            const auto& position = positions[_order[i]];
+
+            _pointX[i] = position.x();
+            _pointY[i] = position.y();
+            _pointZ[i] = position.z();
+            _pointMass[i] = masses != nullptr ? masses[_order[i]] : 1.0f;
+        }
+
+        // Every internal node has at least two children, so there can
+        // be no more than 2n - 1 nodes in total
+        const auto maxNodes = (2 * numPoints) - 1;
+        _centreX.resize(maxNodes);
+        _centreY.resize(maxNodes);
+        _centreZ.resize(maxNodes);
+        _mass.resize(maxNodes);
+        _sizeSq.resize(maxNodes);
+        _next.resize(maxNodes);
+        _firstPoint.resize(maxNodes);
+        _numPoints.resize(maxNodes);
+
+        buildNode(0, static_cast<uint32_t>(numPoints), 0);
+        Q_ASSERT(_numNodes <= maxNodes);
+    }
+
+    // The traversal behind evaluateKernel and evaluateKernelAt; the
+    // point at excludedIndex, if there is one, doesn't contribute
+    template<typename Kernel>
+    QVector3D sumKernel(float px, float py, float pz, size_t excludedIndex,
+        size_t epsilonIndex, const Kernel& kernel) const
+    {
+        float rx = 0.0f;
+        float ry = 0.0f;
+        float rz = 0.0f;
+        float coincidentMass = 0.0f;
+
+        uint32_t i = 0;
+        while(i < _numNodes)
+        {
+            const float dx = _centreX[i] - px;
+            const float dy = _centreY[i] - py;
+            const float dz = _centreZ[i] - pz;
+            const float distanceSq = (dx * dx) + (dy * dy) + (dz * dz);
+
+            if(distanceSq > 0.0f && _sizeSq[i] <= _theta * distanceSq)
             {
-                auto subVolume = subTree->_nonEmptyLeaves.at(i);
+                // Far enough away to be approximated by its centre of mass
+                const float f = kernel(_mass[i], distanceSq);
+                rx += dx * f;
+                ry += dy * f;
+                rz += dz * f;
 
-                const NodeId otherNodeId = subVolume->_nodeIds.front();
-                if(otherNodeId != nodeId)
+                i = _next[i];
+            }
+            else if(_numPoints[i] > 0)
+            {
+                // Leaf; the points are contiguous, so this loop is branch free
+                // over the position arrays and amenable to vectorisation
+                const auto first = _firstPoint[i];
+                const auto last = first + _numPoints[i];
+
+                for(auto p = first; p < last; p++)
                 {
-                    const QVector3D& otherNodePosition = nodePositions.get(otherNodeId);
-                    QVector3D difference = otherNodePosition - nodePosition;
-                    float distanceSq = difference.lengthSquared();
+                    const float pdx = _pointX[p] - px;
+                    const float pdy = _pointY[p] - py;
+                    const float pdz = _pointZ[p] - pz;
+                    const float pDistanceSq = (pdx * pdx) + (pdy * pdy) + (pdz * pdz);
 
-                    if(distanceSq == 0.0f)
-                    {
-                        difference = differenceEpsilon();
-                        distanceSq = E2;
-                    }
+                    const bool distinct = pDistanceSq > 0.0f;
+                    const float f = distinct ? kernel(_pointMass[p], pDistanceSq) : 0.0f;
+                    rx += pdx * f;
+                    ry += pdy * f;
+                    rz += pdz * f;
 
-                    result += kernel(1, difference, distanceSq);
+                    coincidentMass += (!distinct && p != excludedIndex) ? _pointMass[p] : 0.0f;
                 }
+
+                i = _next[i];
             }
+            else
+                i++;
         }
 
+        QVector3D result(rx, ry, rz);
+
+        if(coincidentMass > 0.0f)
+            result += differenceEpsilon(epsilonIndex) * kernel(coincidentMass, E2);
+
         return result;
     }
+
+public:
+    void setTheta(float theta) { _theta = theta; }
+
+    void build(const IGraphComponent& graph, const NodeLayoutPositions& nodePositions)
+    {
+        SCOPE_TIMER_MULTISAMPLES(50)
+
+        const auto& nodeIds = graph.nodeIds();
+
+        _unsortedPositions.resize(nodeIds.size());
+        for(size_t i = 0; i < nodeIds.size(); i++)
+            _unsortedPositions[i] = nodePositions.get(nodeIds[i]);
+
+        buildFrom(_unsortedPositions.data(), nullptr, _unsortedPositions.size());
+
+        _pointNodeIds.resize(nodeIds.size());
+        for(size_t i = 0; i < nodeIds.size(); i++)
+            _pointNodeIds[i] = nodeIds[_order[i]];
+    }
+
+    // Build from positions that aren't associated with NodeIds; use
+    // indexAt to map the tree's points back to the input positions
+    void build(const std::vector<QVector3D>& positions)
+    {
+        buildFrom(positions.data(), nullptr, positions.size());
+        _pointNodeIds.clear();
+    }
+
+    // As above, but with each point having the corresponding mass, rather than 1
+    void build(const std::vector<QVector3D>& positions, const std::vector<float>& masses)
+    {
+        Q_ASSERT(masses.size() == positions.size());
+
+        buildFrom(positions.data(), masses.data(), positions.size());
+        _pointNodeIds.clear();
+    }
+
+    // Points are indexed in Morton order, so evaluating them
+    // in index order gives the best locality of reference
+    size_t numPoints() const { return _pointX.size(); }
+    NodeId nodeIdAt(size_t index) const { return _pointNodeIds[index]; }
+    size_t indexAt(size_t index) const { return _order[index]; }
+
+    // Sums difference * kernel(mass, distanceSq) over the tree, where difference is the
+    // vector from the point at index to each (approximated) mass, excluding itself
+    template<typename Kernel>
+    QVector3D evaluateKernel(size_t index, const Kernel& kernel) const
+    {
+        return sumKernel(_pointX[index], _pointY[index], _pointZ[index], index, index, kernel);
+    }
+
+    // As evaluateKernel, but from an arbitrary position rather than one of the tree's own
+    // points; index only selects the direction used should position coincide with a point
+    template<typename Kernel>
+    QVector3D evaluateKernelAt(const QVector3D& position, size_t index, const Kernel& kernel) const
+    {
+        return sumKernel(position.x(), position.y(), position.z(), numPoints(), index, kernel);
+    }
 };
 
 using BarnesHutTree2D = BarnesHutTree<2>;
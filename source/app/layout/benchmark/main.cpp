@@ -0,0 +1,388 @@
+/* Copyright © 2013-2025 Tim Angus
+ * Copyright © 2013-2025 Tom Freeman
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// A headless layout benchmark; it generates a synthetic graph, iterates the force directed
+// layout over every component until it finishes, in the same manner as LayoutThread, and
+// reports the timings along with measures of the quality of the resultant layout. All
+// randomness is seeded, so for a given set of arguments, runs are directly comparable.
+
+#include "app/graph/mutablegraph.h"
+#include "app/layout/forcedirectedlayout.h"
+#include "app/layout/nodepositions.h"
+
+#include "shared/utils/random.h"
+#include "shared/utils/scopetimer.h"
+#include "shared/utils/threadpool.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <numbers>
+#include <queue>
+#include <random>
+#include <utility>
+#include <vector>
+
+using namespace Qt::Literals::StringLiterals;
+
+static const size_t NUM_STRESS_SOURCES = 16;
+
+static void generateGrid(MutableGraph& graph, size_t numNodes)
+{
+    const auto width = std::max(size_t{1}, static_cast<size_t>(std::sqrt(static_cast<double>(numNodes))));
+
+    std::vector<NodeId> nodeIds(width * width);
+    for(auto& nodeId : nodeIds)
+        nodeId = graph.addNode();
+
+    for(size_t y = 0; y < width; y++)
+    {
+        for(size_t x = 0; x < width; x++)
+        {
+            const auto nodeId = nodeIds.at((y * width) + x);
+
+            if(x + 1 < width)
+                graph.addEdge(nodeId, nodeIds.at((y * width) + x + 1));
+
+            if(y + 1 < width)
+                graph.addEdge(nodeId, nodeIds.at(((y + 1) * width) + x));
+        }
+    }
+}
+
+// Points in the unit square, connected to every other point within a radius chosen to give a mean degree of about 6
+static void generateRandomGeometric(MutableGraph& graph, size_t numNodes, std::mt19937& generator)
+{
+    const double MEAN_DEGREE = 6.0;
+    const auto radius = std::sqrt(MEAN_DEGREE / (std::numbers::pi * static_cast<double>(numNodes)));
+    const auto radiusSq = radius * radius;
+
+    std::uniform_real_distribution<double> distribution(0.0, 1.0);
+
+    std::vector<std::pair<double, double>> points(numNodes);
+    std::vector<NodeId> nodeIds(numNodes);
+    for(size_t i = 0; i < numNodes; i++)
+    {
+        const auto x = distribution(generator);
+        const auto y = distribution(generator);
+
+        points[i] = {x, y};
+        nodeIds[i] = graph.addNode();
+    }
+
+    // Bucket the points into cells the size of the radius, so that only adjacent cells need checking
+    const auto cellsPerSide = std::max(size_t{1}, static_cast<size_t>(1.0 / radius));
+    auto cellCoordinate = [cellsPerSide](double v)
+    {
+        return std::min(cellsPerSide - 1, static_cast<size_t>(v * static_cast<double>(cellsPerSide)));
+    };
+
+    std::vector<std::vector<size_t>> cells(cellsPerSide * cellsPerSide);
+    for(size_t i = 0; i < numNodes; i++)
+    {
+        const auto& [x, y] = points[i];
+        cells.at((cellCoordinate(y) * cellsPerSide) + cellCoordinate(x)).push_back(i);
+    }
+
+    for(size_t i = 0; i < numNodes; i++)
+    {
+        const auto& [x, y] = points[i];
+        const auto cx = cellCoordinate(x);
+        const auto cy = cellCoordinate(y);
+
+        for(auto ny = cy > 0 ? cy - 1 : cy; ny <= std::min(cy + 1, cellsPerSide - 1); ny++)
+        {
+            for(auto nx = cx > 0 ? cx - 1 : cx; nx <= std::min(cx + 1, cellsPerSide - 1); nx++)
+            {
+                for(const auto j : cells.at((ny * cellsPerSide) + nx))
+                {
+                    if(j <= i)
+                        continue;
+
+                    const auto dx = points[j].first - x;
+                    const auto dy = points[j].second - y;
+
+                    if((dx * dx) + (dy * dy) <= radiusSq)
+                        graph.addEdge(nodeIds[i], nodeIds[j]);
+                }
+            }
+        }
+    }
+}
+
+// Barabási–Albert preferential attachment
+static void generateScaleFree(MutableGraph& graph, size_t numNodes, std::mt19937& generator)
+{
+    const size_t EDGES_PER_NODE = 2;
+
+    std::vector<NodeId> nodeIds;
+    nodeIds.reserve(numNodes);
+
+    // Each node appears here once for every edge it has, so picking from it uniformly is preferential
+    std::vector<NodeId> edgeEnds;
+
+    const auto numInitialNodes = std::min(numNodes, EDGES_PER_NODE + 1);
+    for(size_t i = 0; i < numInitialNodes; i++)
+    {
+        const auto nodeId = graph.addNode();
+
+        for(const auto otherNodeId : nodeIds)
+        {
+            graph.addEdge(otherNodeId, nodeId);
+            edgeEnds.push_back(otherNodeId);
+            edgeEnds.push_back(nodeId);
+        }
+
+        nodeIds.push_back(nodeId);
+    }
+
+    std::vector<NodeId> targets;
+    for(size_t i = numInitialNodes; i < numNodes; i++)
+    {
+        targets.clear();
+
+        while(targets.size() < EDGES_PER_NODE)
+        {
+            std::uniform_int_distribution<size_t> distribution(0, edgeEnds.size() - 1);
+            const auto target = edgeEnds.at(distribution(generator));
+
+            if(std::find(targets.begin(), targets.end(), target) == targets.end())
+                targets.push_back(target);
+        }
+
+        const auto nodeId = graph.addNode();
+
+        for(const auto target : targets)
+        {
+            graph.addEdge(nodeId, target);
+            edgeEnds.push_back(nodeId);
+            edgeEnds.push_back(target);
+        }
+
+        nodeIds.push_back(nodeId);
+    }
+}
+
+namespace
+{
+struct Quality
+{
+    double _stress = 0.0;
+    double _edgeLengthCoefficientOfVariation = 0.0;
+};
+} // namespace
+
+// Stress is measured against hop distances from a sample of source nodes in each component. The layout is
+// optimally scaled first, i.e. by s minimising sum(((s * e - d) / d)^2), so the result is independent of
+// the layout's overall size. Each pair's contribution expands to s^2 (e/d)^2 - 2s (e/d) + 1, so only the
+// sums of (e/d) and (e/d)^2 need accumulating.
+static Quality measureQuality(const Graph& graph, const NodeLayoutPositions& positions)
+{
+    double sumRatio = 0.0;
+    double sumRatioSq = 0.0;
+    double numPairs = 0.0;
+
+    NodeArray<int> hops(graph, -1);
+
+    for(const auto componentId : graph.componentIds())
+    {
+        const auto& nodeIds = graph.componentById(componentId)->nodeIds();
+        const auto stride = std::max(size_t{1}, nodeIds.size() / NUM_STRESS_SOURCES);
+
+        for(size_t i = 0; i < nodeIds.size(); i += stride)
+        {
+            const auto sourceNodeId = nodeIds.at(i);
+            const auto& sourcePosition = positions.get(sourceNodeId);
+
+            for(const auto nodeId : nodeIds)
+                hops.set(nodeId, -1);
+
+            std::queue<NodeId> queue;
+            queue.push(sourceNodeId);
+            hops.set(sourceNodeId, 0);
+
+            while(!queue.empty())
+            {
+                const auto nodeId = queue.front();
+                queue.pop();
+
+                const auto nodeHops = hops.get(nodeId);
+
+                if(nodeHops > 0)
+                {
+                    const auto e = static_cast<double>((positions.get(nodeId) - sourcePosition).length());
+                    const auto ratio = e / static_cast<double>(nodeHops);
+
+                    sumRatio += ratio;
+                    sumRatioSq += ratio * ratio;
+                    numPairs += 1.0;
+                }
+
+                for(const auto neighbourId : graph.neighboursOf(nodeId))
+                {
+                    if(hops.get(neighbourId) < 0)
+                    {
+                        hops.set(neighbourId, nodeHops + 1);
+                        queue.push(neighbourId);
+                    }
+                }
+            }
+        }
+    }
+
+    Quality quality;
+
+    if(numPairs > 0.0 && sumRatioSq > 0.0)
+    {
+        const auto scale = sumRatio / sumRatioSq;
+        quality._stress = ((scale * scale * sumRatioSq) - (2.0 * scale * sumRatio) + numPairs) / numPairs;
+    }
+
+    double sumLength = 0.0;
+    double sumLengthSq = 0.0;
+    double numEdges = 0.0;
+
+    for(const auto edgeId : graph.edgeIds())
+    {
+        const auto& edge = graph.edgeById(edgeId);
+        if(edge.isLoop())
+            continue;
+
+        const auto length = static_cast<double>((positions.get(edge.targetId()) - positions.get(edge.sourceId())).length());
+        sumLength += length;
+        sumLengthSq += length * length;
+        numEdges += 1.0;
+    }
+
+    if(numEdges > 0.0 && sumLength > 0.0)
+    {
+        const auto mean = sumLength / numEdges;
+        const auto variance = std::max(0.0, (sumLengthSq / numEdges) - (mean * mean));
+        quality._edgeLengthCoefficientOfVariation = std::sqrt(variance) / mean;
+    }
+
+    return quality;
+}
+
+int main(int argc, char* argv[])
+{
+    const QCoreApplication app(argc, argv);
+
+    QCommandLineParser commandLineParser;
+
+    commandLineParser.setSingleDashWordOptionMode(QCommandLineParser::ParseAsLongOptions);
+    commandLineParser.addHelpOption();
+    commandLineParser.addOptions(
+    {
+        {{"g", "graph"}, QObject::tr("The type of graph to generate: grid, geometric or scalefree."), "type", "geometric"},
+        {{"n", "nodes"}, QObject::tr("The number of nodes to generate."), "count", "10000"},
+        {{"s", "seed"}, QObject::tr("The seed for random number generation."), "seed", "1"},
+        {{"d", "dimensions"}, QObject::tr("Lay out in 2 or 3 dimensions."), "dimensions", "3"},
+        {{"i", "maxIterations"}, QObject::tr("Stop after this many iterations, if not finished."), "count", "10000"},
+    });
+
+    commandLineParser.process(QCoreApplication::arguments());
+
+    const auto graphType = commandLineParser.value(u"graph"_s);
+    const auto numNodes = commandLineParser.value(u"nodes"_s).toULongLong();
+    const auto seed = commandLineParser.value(u"seed"_s).toUInt();
+    const auto maxIterations = commandLineParser.value(u"maxIterations"_s).toULongLong();
+    const auto dimensionality = commandLineParser.value(u"dimensions"_s) == u"2"_s ?
+        Layout::Dimensionality::TwoDee : Layout::Dimensionality::ThreeDee;
+
+    u::setRandomSeed(seed);
+
+    const ThreadPoolSingleton threadPool;
+    const ScopeTimerManager scopeTimerManager;
+
+    MutableGraph graph;
+    graph.enableComponentManagement();
+
+    std::mt19937 generator(seed);
+
+    graph.beginTransaction();
+
+    if(graphType == u"grid"_s)
+        generateGrid(graph, numNodes);
+    else if(graphType == u"geometric"_s)
+        generateRandomGeometric(graph, numNodes, generator);
+    else if(graphType == u"scalefree"_s)
+        generateScaleFree(graph, numNodes, generator);
+    else
+    {
+        std::cerr << "Unknown graph type " << graphType.toStdString() << "\n";
+        return 1;
+    }
+
+    graph.endTransaction();
+
+    std::cout << graphType.toStdString() << ": " << graph.numNodes() << " nodes, " <<
+        graph.numEdges() << " edges, " << graph.numComponents() << " components\n";
+
+    ForceDirectedLayoutFactory layoutFactory(graph);
+    NodeLayoutPositions positions(graph);
+
+    std::vector<std::pair<ComponentId, std::unique_ptr<Layout>>> layouts;
+    for(const auto componentId : graph.componentIds())
+        layouts.emplace_back(componentId, layoutFactory.create(componentId, positions, dimensionality));
+
+    QElapsedTimer elapsedTimer;
+    elapsedTimer.start();
+
+    size_t numIterations = 0;
+    for(; numIterations < maxIterations; numIterations++)
+    {
+        std::vector<LayoutTask> layoutTasks;
+
+        for(const auto& [componentId, layout] : layouts)
+        {
+            if(!layoutIsFinished(*layout))
+                layoutTasks.push_back({componentId, layout.get(), numIterations == 0});
+        }
+
+        if(layoutTasks.empty())
+            break;
+
+        if(dimensionality == Layout::Dimensionality::TwoDee)
+            positions.flatten();
+
+        executeLayoutTasks(layoutTasks, dimensionality);
+    }
+
+    const auto elapsedMs = static_cast<double>(elapsedTimer.nsecsElapsed()) / 1.0e6;
+    const auto quality = measureQuality(graph, positions);
+
+    std::cout << "iterations: " << numIterations <<
+        (numIterations >= maxIterations ? " (unfinished)" : "") << "\n" <<
+        "total time: " << elapsedMs << " ms\n" <<
+        "time per iteration: " << (numIterations > 0 ? elapsedMs / static_cast<double>(numIterations) : 0.0) << " ms\n" <<
+        "stress: " << quality._stress << "\n" <<
+        "edge length coefficient of variation: " << quality._edgeLengthCoefficientOfVariation << "\n";
+
+    // Includes the separate timings of the individual stages of each iteration
+    ScopeTimerManager::instance()->reportToQDebug();
+
+    return 0;
+}
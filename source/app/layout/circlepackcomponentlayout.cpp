@@ -187,6 +187,46 @@ static void circlePack(const std::vector<ComponentId>& componentIds,
     }
 }
 
+// Arranges circles in rows, left to right, each row being as tall as its first circle; given
+// circles sorted by decreasing radius, this is a reasonably tight and, crucially, linear packing
+static void shelfPack(std::vector<ComponentId>::const_iterator first,
+                      std::vector<ComponentId>::const_iterator last,
+                      ComponentLayoutData& componentLayoutData,
+                      const QPointF& topLeft, float width)
+{
+    const auto left = static_cast<float>(topLeft.x());
+    float x = left;
+    float y = static_cast<float>(topLeft.y());
+    float shelfHeight = 0.0f;
+
+    for(auto it = first; it != last; ++it)
+    {
+        auto& circle = componentLayoutData[*it];
+        const float diameter = circle.radius() * 2.0f;
+
+        if(x > left && x + diameter > left + width)
+        {
+            x = left;
+            y += shelfHeight;
+            shelfHeight = 0.0f;
+        }
+
+        circle.setX(x + circle.radius());
+        circle.setY(y + circle.radius());
+
+        x += diameter;
+        shelfHeight = std::max(shelfHeight, diameter);
+    }
+}
+
+// Circle packing costs rather more than linear time, so beyond this
+// many components, the (smallest) remainder are shelf packed instead
+static const size_t MAX_CIRCLE_PACKED_COMPONENTS = 1000;
+
+// Components whose radii have changed by less than this proportion keep their
+// previous radii, so that small changes don't require the layout to be repeated
+static const float RADIUS_TOLERANCE = 0.05f;
+
 void CirclePackComponentLayout::executeReal(const Graph& graph, const std::vector<ComponentId> &componentIds,
                                             ComponentLayoutData& componentLayoutData)
 {
@@ -197,12 +237,13 @@ void CirclePackComponentLayout::executeReal(const Graph& graph, const std::vecto
     auto largestComponentId = graph.componentIdOfLargestComponent();
     const size_t maxNumNodes = graph.componentById(largestComponentId)->numNodes();
 
+    auto minimumComponentRadius = u::pref(u"visuals/minimumComponentRadius"_s).toFloat();
     for(auto componentId : componentIds)
     {
         const auto* component = graph.componentById(componentId);
         const float size = (static_cast<float>(component->numNodes()) * 100.0f) /
             static_cast<float>(maxNumNodes);
-        componentLayoutData[componentId].setRadius(size);
+        componentLayoutData[componentId].setRadius(std::max(size, minimumComponentRadius));
     }
 
     auto sortedComponentIds = componentIds;
@@ -215,15 +256,54 @@ void CirclePackComponentLayout::executeReal(const Graph& graph, const std::vecto
         return componentLayoutData[a].radius() > componentLayoutData[b].radius();
     });
 
-    ComponentArray<Links> links(graph);
+    const auto numCirclePacked = std::min(sortedComponentIds.size(), MAX_CIRCLE_PACKED_COMPONENTS);
+    auto circlePackedEnd = sortedComponentIds.begin() + static_cast<std::ptrdiff_t>(numCirclePacked);
 
-    auto minimumComponentRadius = u::pref(u"visuals/minimumComponentRadius"_s).toFloat();
-    for(auto componentId : sortedComponentIds)
+    const bool unchanged = std::equal(sortedComponentIds.begin(), circlePackedEnd,
+        _packedComponentIds.begin(), _packedComponentIds.end()) &&
+        std::equal(sortedComponentIds.begin(), circlePackedEnd, _packedCircles.begin(),
+    [&componentLayoutData](ComponentId componentId, const Circle& packedCircle)
+    {
+        const float difference = std::abs(componentLayoutData[componentId].radius() - packedCircle.radius());
+        return difference <= packedCircle.radius() * RADIUS_TOLERANCE;
+    });
+
+    if(unchanged)
+    {
+        for(size_t i = 0; i < numCirclePacked; i++)
+            componentLayoutData[sortedComponentIds[i]] = _packedCircles[i];
+    }
+    else
+    {
+        ComponentArray<Links> links(graph);
+
+        for(auto it = sortedComponentIds.begin(); it != circlePackedEnd; ++it)
+            links[*it]._prev = links[*it]._next = *it;
+
+        _packedComponentIds.assign(sortedComponentIds.begin(), circlePackedEnd);
+        circlePack(_packedComponentIds, componentLayoutData, links);
+
+        _packedCircles.clear();
+        _packedCircles.reserve(numCirclePacked);
+        for(auto componentId : _packedComponentIds)
+            _packedCircles.emplace_back(componentLayoutData[componentId]);
+    }
+
+    if(circlePackedEnd == sortedComponentIds.end())
+        return;
+
+    // Place the remaining components beneath the circle packed ones, in a region
+    // whose width is chosen such that the layout as a whole is roughly square
+    auto circlePackedBoundingBox = boundingBoxFor(_packedComponentIds, componentLayoutData);
+    auto area = static_cast<float>(circlePackedBoundingBox.width() * circlePackedBoundingBox.height());
+
+    for(auto it = circlePackedEnd; it != sortedComponentIds.end(); ++it)
     {
-        componentLayoutData[componentId].setRadius(std::max(componentLayoutData[componentId].radius(),
-                                                            minimumComponentRadius));
-        links[componentId]._prev = links[componentId]._next = componentId;
+        const float diameter = componentLayoutData[*it].radius() * 2.0f;
+        area += diameter * diameter;
     }
 
-    circlePack(sortedComponentIds, componentLayoutData, links);
+    const float width = std::max(static_cast<float>(circlePackedBoundingBox.width()), std::sqrt(area));
+    shelfPack(circlePackedEnd, sortedComponentIds.end(), componentLayoutData,
+        circlePackedBoundingBox.bottomLeft(), width);
 }
@@ -22,9 +22,16 @@
 
 #include "componentlayout.h"
 
+#include <vector>
+
 class CirclePackComponentLayout : public ComponentLayout
 {
 private:
+    // The circle packed components from the previous execution, in packing order;
+    // these are reused as is when none of the components have significantly changed size
+    std::vector<ComponentId> _packedComponentIds;
+    std::vector<Circle> _packedCircles;
+
     void executeReal(const Graph &graph, const std::vector<ComponentId>& componentIds,
                      ComponentLayoutData &componentLayoutData) override;
 };
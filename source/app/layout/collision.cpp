@@ -21,10 +21,36 @@
 
 #include "app/graph/graph.h"
 #include "app/graph/graphmodel.h"
+#include "app/layout/nodepositions.h"
+#include "app/layout/nodespatialindex.h"
 #include "app/ui/visualisations/elementvisual.h"
 
 #include "app/maths/ray.h"
 #include "app/maths/plane.h"
+#include "app/maths/frustum.h"
+
+#include <algorithm>
+#include <limits>
+
+static bool partlyInFrontOf(const BoundingBox3D& boundingBox, const Plane& plane)
+{
+    // The corner of the box that is furthest in front of the plane
+    const auto& normal = plane.normal();
+    const QVector3D corner(
+        normal.x() >= 0.0f ? boundingBox.max().x() : boundingBox.min().x(),
+        normal.y() >= 0.0f ? boundingBox.max().y() : boundingBox.min().y(),
+        normal.z() >= 0.0f ? boundingBox.max().z() : boundingBox.min().z());
+
+    return plane.sideForPoint(corner) == Plane::Side::Front;
+}
+
+// A lower bound on the distance from the line to any point in the box
+static float minimumDistanceToLine(const BoundingBox3D& boundingBox,
+    const QVector3D& point, const QVector3D& direction)
+{
+    const float radius = (boundingBox.max() - boundingBox.min()).length() * 0.5f;
+    return std::max(0.0f, boundingBox.centre().distanceToLine(point, direction) - radius);
+}
 
 NodeId Collision::nodeClosestToLine(const std::vector<NodeId>& nodeIds, const QVector3D &point, const QVector3D &direction)
 {
@@ -56,7 +82,33 @@ NodeId Collision::nodeClosestToLine(const std::vector<NodeId>& nodeIds, const QV
 
 NodeId Collision::nodeClosestToLine(const QVector3D &point, const QVector3D &direction)
 {
-    return nodeClosestToLine(_graphModel->graph().componentById(_componentId)->nodeIds(), point, direction);
+    const Plane plane(point, direction);
+
+    Q_ASSERT(!_componentId.isNull());
+    const auto nodeSpatialIndex = _graphModel->nodeSpatialIndex(_componentId);
+
+    return nodeSpatialIndex->nearest(
+    [this, &plane, &point, &direction](const BoundingBox3D& boundingBox)
+    {
+        const auto offsetBoundingBox = boundingBox + _offset;
+
+        if(!partlyInFrontOf(offsetBoundingBox, plane))
+            return std::numeric_limits<float>::max();
+
+        return minimumDistanceToLine(offsetBoundingBox, point, direction);
+    },
+    [this, &plane, &point, &direction](NodeId nodeId, const QVector3D& nodePosition)
+    {
+        if(!_includeNotFound && _graphModel->nodeVisual(nodeId).state().test(VisualFlags::Unhighlighted))
+            return std::numeric_limits<float>::max();
+
+        const QVector3D position = nodePosition + _offset;
+
+        if(plane.sideForPoint(position) != Plane::Side::Front)
+            return std::numeric_limits<float>::max();
+
+        return position.distanceToLine(point, direction);
+    });
 }
 
 void Collision::nodesIntersectingLine(const QVector3D& point, const QVector3D& direction, std::vector<NodeId>& intersectingNodeIds)
@@ -64,28 +116,49 @@ void Collision::nodesIntersectingLine(const QVector3D& point, const QVector3D& d
     nodesInsideCylinder(point, direction, 0.0f, intersectingNodeIds);
 }
 
-void Collision::nodesInsideCylinder(const QVector3D &point, const QVector3D &direction, float radius, std::vector<NodeId>& containedNodeIds)
+template<typename Fn>
+void Collision::forEachNodeInsideCylinder(const QVector3D& point, const QVector3D& direction, float radius, const Fn& fn)
 {
     const Plane plane(point, direction);
 
     Q_ASSERT(!_componentId.isNull());
-    const auto* component = _graphModel->graph().componentById(_componentId);
-    const auto& nodeIds = component->nodeIds();
-    for(const NodeId nodeId : nodeIds)
+    const auto nodeSpatialIndex = _graphModel->nodeSpatialIndex(_componentId);
+
+    // The index's bounding boxes account for the size of each node, so any box
+    // containing a node inside the cylinder must intersect the ray, once expanded
+    // by the radius; this is considerably tighter than a bounding sphere test
+    const Ray ray(point - _offset, direction);
+    const QVector3D expansion(radius, radius, radius);
+
+    nodeSpatialIndex->forEach(
+    [&ray, &expansion](const BoundingBox3D& boundingBox)
+    {
+        return BoundingBox3D(boundingBox.min() - expansion, boundingBox.max() + expansion).intersects(ray);
+    },
+    [&](NodeId nodeId, const QVector3D& nodePosition)
     {
         if(!_includeNotFound && _graphModel->nodeVisual(nodeId).state().test(VisualFlags::Unhighlighted))
-            continue;
+            return;
 
-        const QVector3D position = _graphModel->nodePositions().get(nodeId) + _offset;
+        const QVector3D position = nodePosition + _offset;
 
         if(plane.sideForPoint(position) != Plane::Side::Front)
-            continue;
+            return;
 
         const float distance = position.distanceToLine(point, direction);
 
         if(distance <= radius + _graphModel->nodeVisual(nodeId)._size)
-            containedNodeIds.push_back(nodeId);
-    }
+            fn(nodeId, nodePosition);
+    });
+}
+
+void Collision::nodesInsideCylinder(const QVector3D &point, const QVector3D &direction, float radius, std::vector<NodeId>& containedNodeIds)
+{
+    forEachNodeInsideCylinder(point, direction, radius,
+    [&containedNodeIds](NodeId nodeId, const QVector3D&)
+    {
+        containedNodeIds.push_back(nodeId);
+    });
 }
 
 NodeId Collision::nearestNodeIntersectingLine(const QVector3D& point, const QVector3D& direction)
@@ -95,26 +168,42 @@ NodeId Collision::nearestNodeIntersectingLine(const QVector3D& point, const QVec
 
 NodeId Collision::nearestNodeInsideCylinder(const QVector3D& point, const QVector3D& direction, float radius)
 {
-    std::vector<NodeId> nodeIds;
-
-    nodesInsideCylinder(point, direction, radius, nodeIds);
-
     NodeId closestNodeId;
     float minimumDistance = std::numeric_limits<float>::max();
 
-    for(const NodeId nodeId : nodeIds)
+    forEachNodeInsideCylinder(point, direction, radius,
+    [&](NodeId nodeId, const QVector3D& position)
     {
-        if(!_includeNotFound && _graphModel->nodeVisual(nodeId).state().test(VisualFlags::Unhighlighted))
-            continue;
-
-        const float distance = _graphModel->nodePositions().get(nodeId).distanceToPoint(point);
+        const float distance = position.distanceToPoint(point);
 
         if(distance < minimumDistance)
         {
             minimumDistance = distance;
             closestNodeId = nodeId;
         }
-    }
+    });
 
     return closestNodeId;
 }
+
+void Collision::nodesInsideFrustum(const BaseFrustum& frustum, std::vector<NodeId>& containedNodeIds)
+{
+    Q_ASSERT(!_componentId.isNull());
+    const auto nodeSpatialIndex = _graphModel->nodeSpatialIndex(_componentId);
+
+    nodeSpatialIndex->forEach(
+    [this, &frustum](const BoundingBox3D& boundingBox)
+    {
+        return frustum.mayIntersect(boundingBox + _offset);
+    },
+    [&](NodeId nodeId, const QVector3D& nodePosition)
+    {
+        if(!_includeNotFound && _graphModel->nodeVisual(nodeId).state().test(VisualFlags::Unhighlighted))
+            return;
+
+        const QVector3D position = nodePosition + _offset;
+
+        if(frustum.containsPoint(position))
+            containedNodeIds.push_back(nodeId);
+    });
+}
@@ -29,6 +29,7 @@
 #include <memory>
 
 class GraphModel;
+class BaseFrustum;
 
 class Collision
 {
@@ -38,6 +39,9 @@ private:
     QVector3D _offset;
     bool _includeNotFound = false;
 
+    template<typename Fn>
+    void forEachNodeInsideCylinder(const QVector3D& point, const QVector3D& direction, float radius, const Fn& fn);
+
 public:
     Collision(const GraphModel& graphModel, ComponentId componentId, bool includeNotFound = false) :
         _graphModel(&graphModel),
@@ -57,6 +61,8 @@ public:
 
     NodeId nearestNodeIntersectingLine(const QVector3D& point, const QVector3D& direction);
     NodeId nearestNodeInsideCylinder(const QVector3D& point, const QVector3D& direction, float radius);
+
+    void nodesInsideFrustum(const BaseFrustum& frustum, std::vector<NodeId>& containedNodeIds);
 };
 
 #endif // COLLISION_H
@@ -17,171 +17,310 @@
  * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+
 #include "fastinitiallayout.h"
 
-#include <QMatrix4x4>
-#include <QVector4D>
+#include "app/graph/graph.h"
+
+#include "shared/utils/threadpool.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstdint>
+#include <limits>
 #include <numbers>
+#include <vector>
+
+static const float SPHERE_RADIUS = 20.0f;
 
-void FastInitialLayout::positionNode(QVector3D& offsetPosition, const QMatrix4x4& orientationMatrix,
-                                     const QVector3D& parentNodePosition, NodeId childNodeId,
-                                     NodeArray<QVector3D>& directionNodeVectors)
+// Work is split into blocks of this many nodes; ranges of
+// fewer nodes than this aren't worth parallelising at all
+static const size_t NODE_BLOCK_SIZE = 1024;
+
+template<typename Fn>
+static void forEachBlock(size_t first, size_t last, const Fn& fn)
 {
-    const float SPHERE_RADIUS = 20.0f;
-    offsetPosition = offsetPosition * SPHERE_RADIUS;
-    offsetPosition = (QVector4D(offsetPosition, 1.0f) * orientationMatrix).toVector3D();
+    if(last - first <= NODE_BLOCK_SIZE)
+    {
+        fn(first, last);
+        return;
+    }
+
+    std::vector<size_t> blockStarts;
+    for(auto blockStart = first; blockStart < last; blockStart += NODE_BLOCK_SIZE)
+        blockStarts.push_back(blockStart);
 
-    directionNodeVectors.set(childNodeId, offsetPosition.normalized());
-    positions().set(childNodeId, parentNodePosition + offsetPosition);
+    parallel_for(blockStarts.begin(), blockStarts.end(),
+    [&fn, last](size_t blockStart)
+    {
+        fn(blockStart, std::min(blockStart + NODE_BLOCK_SIZE, last));
+    });
 }
 
-void FastInitialLayout::execute(bool, Dimensionality dimensionality)
+// The unit offsets of the children of a node with numEdges edges, placed on a "spiral" that
+// approximates an equal distribution on a sphere; these depend only on numEdges, so they are
+// computed once for each distinct value, rather than once for each node
+static std::vector<QVector3D> spiralDirections(uint32_t numEdges)
 {
-    const auto& graph = graphComponent().graph();
-    NodeArray<bool> visitedNodes(graph);
-    NodeArray<QVector3D> directionNodeVectors(graph);
+    std::vector<QVector3D> directions(numEdges);
+    float phi = 0.0f;
 
-    std::queue<NodeId> nodeQueue;
-    nodeQueue.push(nodeIds().front());
-    visitedNodes.set(nodeIds().front(), true);
-
-    // This performs a breadth-first tree layout, positioning child nodes in a "spiral"
-    // configuration around the parent. This approximates equal distrubution on a sphere.
-    // The end result is a quick and dirty "spanning tree" layout
-    while(!nodeQueue.empty())
+    // i starts at 2 because the first child(ren) are placed at the top and bottom
+    for(uint32_t i = 2; i < numEdges; i++)
     {
-        auto parentNodeId = nodeQueue.front();
-        nodeQueue.pop();
-
-        auto edgeIds = graph.nodeById(parentNodeId).edgeIds();
-        const QVector3D parentNodePosition = positions().get(parentNodeId);
-
-        QMatrix4x4 orientationMatrix;
-        orientationMatrix.setToIdentity();
-        const QVector3D forward = directionNodeVectors.at(parentNodeId);
-        // All except initial node, calculate an orientation matrix. This makes
-        // the tree grow outwards from parent nodes
-        if(parentNodeId != nodeIds().front())
-        {
-            QVector3D up = QVector3D(forward.z(), -forward.x(), forward.y());
+        auto h = -1.0f + 2.0f * (static_cast<float>(i) - 1.0f) / static_cast<float>(numEdges - 1);
+        auto theta = std::acos(h);
+        phi = phi + 3.6f / (std::sqrt(static_cast<float>(numEdges) * (1.0f - h * h)));
+        phi = std::fmod(phi, 2.0f * std::numbers::pi_v<float>);
 
-            auto dot = QVector3D::dotProduct(up, forward);
-            up -= (dot * forward);
-            up.normalize();
+        directions.at(i) = {h, std::cos(phi) * std::sin(theta), std::sin(phi) * std::sin(theta)};
+    }
 
-            const QVector3D right = QVector3D::crossProduct(up, forward);
-            orientationMatrix.setRow(0, QVector4D(right));
-            orientationMatrix.setRow(1, QVector4D(up));
-            orientationMatrix.setRow(2, QVector4D(forward));
-        }
+    return directions;
+}
+
+// This performs a breadth-first tree layout, positioning child nodes in a "spiral"
+// configuration around the parent. This approximates equal distrubution on a sphere.
+// The end result is a quick and dirty "spanning tree" layout
+template<typename IndexOfFn>
+void FastInitialLayout::layout(const IndexOfFn& indexOf, Dimensionality dimensionality)
+{
+    const auto* graph = dynamic_cast<const Graph*>(&graphComponent().graph());
+    Q_ASSERT(graph != nullptr);
+
+    const auto numNodes = nodeIds().size();
+
+    // The search proceeds a level at a time, with the nodes of each level visited in parallel; a
+    // node is claimed as a child by the first node in the level that's adjacent to it, so that
+    // the tree, and therefore the layout, is identical to that of a serial breadth-first search
+    constexpr auto UNCLAIMED = std::numeric_limits<uint32_t>::max();
+    constexpr auto LISTED = 1u << 31u;
+    std::vector<std::atomic<uint32_t>> claims(numNodes);
+    for(auto& claim : claims)
+        claim.store(UNCLAIMED, std::memory_order_relaxed);
+
+    // Everything else is indexed in breadth-first order, so each node's children are contiguous
+    std::vector<uint32_t> order(numNodes);
+    std::vector<uint32_t> firstChildren(numNodes);
+    std::vector<uint32_t> numChildren(numNodes);
+    std::vector<std::pair<uint32_t, uint32_t>> levels;
 
-        auto edgeIdIterator = edgeIds.begin();
-        int edgeCountOffset = 0;
+    // Claims are one more than the position of the claimant, leaving 0 for the root
+    order.at(0) = 0;
+    claims.at(0) = 0;
 
-        // First node (bottom)
-        // First two nodes connected to base node should be positioned top and
-        // bottom, UNLESS the node has a parent node, in which case do not position
-        // the first node as it would be in the parents position!
-        if(edgeIdIterator != edgeIds.end() && parentNodeId == nodeIds().front())
+    uint32_t levelStart = 0;
+    uint32_t levelEnd = 1;
+
+    auto forEachNeighbour = [&](uint32_t position, const auto& fn)
+    {
+        const auto nodeId = nodeIds().at(order[position]);
+
+        for(auto edgeId : graph->edgeIdsForNodeId(nodeId))
+            fn(indexOf(graph->edgeById(edgeId).oppositeId(nodeId)));
+    };
+
+    while(levelStart < levelEnd)
+    {
+        levels.emplace_back(levelStart, levelEnd);
+
+        forEachBlock(levelStart, levelEnd, [&](size_t first, size_t last)
         {
-            const auto& edge = graph.edgeById(*edgeIdIterator);
-            auto childNodeId = edge.oppositeId(parentNodeId);
+            for(auto position = static_cast<uint32_t>(first); position < last; position++)
+            {
+                const auto claim = position + 1;
+
+                forEachNeighbour(position, [&](uint32_t neighbour)
+                {
+                    auto current = claims[neighbour].load();
+                    while(claim < current && !claims[neighbour].compare_exchange_weak(current, claim)) {}
+                });
+            }
+        });
 
-            const bool visited = visitedNodes.get(childNodeId);
-            if(!visited)
+        // Multiple edges may lead to the same child, so each is marked once listed
+        forEachBlock(levelStart, levelEnd, [&](size_t first, size_t last)
+        {
+            for(auto position = static_cast<uint32_t>(first); position < last; position++)
             {
-                QVector3D offsetPosition(1.0, 0.0, 0.0);
-                positionNode(offsetPosition,
-                             orientationMatrix,
-                             parentNodePosition,
-                             childNodeId,
-                             directionNodeVectors);
-
-                nodeQueue.push(childNodeId);
-                visitedNodes.set(childNodeId, true);
-                ++edgeIdIterator;
+                const auto claim = position + 1;
+                uint32_t count = 0;
+
+                forEachNeighbour(position, [&](uint32_t neighbour)
+                {
+                    if(claims[neighbour].load(std::memory_order_relaxed) == claim)
+                    {
+                        claims[neighbour].store(claim | LISTED, std::memory_order_relaxed);
+                        count++;
+                    }
+                });
+
+                numChildren[position] = count;
             }
-        }
-        else
+        });
+
+        auto nextLevelEnd = levelEnd;
+        for(auto position = levelStart; position < levelEnd; position++)
         {
-            // Add a dummy edge to the size to calculate spiral positions for the extra node
-            edgeCountOffset++;
+            firstChildren[position] = nextLevelEnd;
+            nextLevelEnd += numChildren[position];
         }
 
-        // Second node (top)
-        if(edgeIdIterator != edgeIds.end())
+        forEachBlock(levelStart, levelEnd, [&](size_t first, size_t last)
         {
-            const auto& edge = graph.edgeById(*edgeIdIterator);
-            auto childNodeId = edge.oppositeId(parentNodeId);
-            bool visited = visitedNodes.get(childNodeId);
-
-            // Find the next connected node which has not been visted already
-            while(visited)
+            for(auto position = static_cast<uint32_t>(first); position < last; position++)
             {
-                ++edgeIdIterator;
-                if(edgeIdIterator != edgeIds.end())
+                const auto claim = position + 1;
+                auto child = firstChildren[position];
+
+                forEachNeighbour(position, [&](uint32_t neighbour)
                 {
-                    const auto &newEdge = graph.edgeById(*edgeIdIterator);
-                    childNodeId = newEdge.oppositeId(parentNodeId);
-                    visited = visitedNodes.get(childNodeId);
-                }
-                else
-                    break;
+                    if(claims[neighbour].load(std::memory_order_relaxed) == (claim | LISTED))
+                    {
+                        claims[neighbour].store(claim, std::memory_order_relaxed);
+                        order[child++] = neighbour;
+                    }
+                });
             }
+        });
+
+        levelStart = levelEnd;
+        levelEnd = nextLevelEnd;
+    }
+
+    Q_ASSERT(levelEnd == numNodes);
+
+    // The root's first two children are placed at its top and bottom, unless its first
+    // edge is a loop; every other node's first child is placed directly away from its parent
+    const auto& rootEdgeIds = graph->edgeIdsForNodeId(nodeIds().at(order[0]));
+    const uint32_t numRootPoleChildren = rootEdgeIds.begin() != rootEdgeIds.end() &&
+        graph->edgeById(*rootEdgeIds.begin()).isLoop() ? 1 : 2;
+
+    // Other than the root, each node has a notional extra edge, which spaces the
+    // spiral such that no child is placed in the direction of its parent
+    auto numSpiralEdges = [&](uint32_t position)
+    {
+        const auto degree = static_cast<uint32_t>(graph->nodeById(nodeIds().at(order[position])).degree());
+        return position == 0 ? degree : degree + 1;
+    };
+
+    uint32_t maxSpiralEdges = 0;
+    for(uint32_t position = 0; position < numNodes; position++)
+    {
+        if(numChildren[position] > 1)
+            maxSpiralEdges = std::max(maxSpiralEdges, numSpiralEdges(position));
+    }
+
+    std::vector<bool> spiralEdgesUsed(maxSpiralEdges + 1);
+    for(uint32_t position = 0; position < numNodes; position++)
+    {
+        if(numChildren[position] > 1)
+            spiralEdgesUsed[numSpiralEdges(position)] = true;
+    }
+
+    std::vector<std::vector<QVector3D>> directionTables(maxSpiralEdges + 1);
+    for(uint32_t numEdges = 0; numEdges <= maxSpiralEdges; numEdges++)
+    {
+        if(spiralEdgesUsed[numEdges])
+            directionTables[numEdges] = spiralDirections(numEdges);
+    }
+
+    std::vector<QVector3D> nodePositions(numNodes);
+    std::vector<QVector3D> directions(numNodes);
+    nodePositions.at(0) = positions().get(nodeIds().at(order[0]));
 
-            if(!visited)
+    // Every node's position depends only on its parent's, so each level is placed in parallel
+    for(const auto& [first, last] : levels)
+    {
+        forEachBlock(first, last, [&](size_t blockFirst, size_t blockLast)
+        {
+            for(auto position = static_cast<uint32_t>(blockFirst); position < blockLast; position++)
             {
-                nodeQueue.push(childNodeId);
+                if(numChildren[position] == 0)
+                    continue;
+
+                // Orient the children such that the tree grows outwards from the parent
+                QVector3D right(1.0f, 0.0f, 0.0f);
+                QVector3D up(0.0f, 1.0f, 0.0f);
+                QVector3D forward(0.0f, 0.0f, 1.0f);
+
+                if(position != 0)
+                {
+                    forward = directions[position];
+                    up = QVector3D(forward.z(), -forward.x(), forward.y());
 
-                QVector3D offsetPosition(1.0, 0.0, 0.0);
+                    auto dot = QVector3D::dotProduct(up, forward);
+                    up -= (dot * forward);
+                    up.normalize();
 
-                positionNode(offsetPosition,
-                             orientationMatrix,
-                             parentNodePosition,
-                             childNodeId,
-                             directionNodeVectors);
+                    right = QVector3D::crossProduct(up, forward);
+                }
+
+                const auto numPoleChildren = position == 0 ? numRootPoleChildren : 1u;
+                const auto* directionTable = numChildren[position] > 1 ?
+                    &directionTables[numSpiralEdges(position)] : nullptr;
+                const auto& parentPosition = nodePositions[position];
+
+                for(uint32_t i = 0; i < numChildren[position]; i++)
+                {
+                    QVector3D offset(1.0f, 0.0f, 0.0f);
+
+                    if(i >= numPoleChildren)
+                    {
+                        Q_ASSERT(directionTable != nullptr && 2 + i - numPoleChildren < directionTable->size());
+                        offset = (*directionTable)[2 + i - numPoleChildren];
+                    }
 
-                visitedNodes.set(childNodeId, true);
+                    const auto direction = (offset.x() * right) + (offset.y() * up) + (offset.z() * forward);
+                    const auto child = firstChildren[position] + i;
 
-                ++edgeIdIterator;
+                    nodePositions[child] = parentPosition + (direction * SPHERE_RADIUS);
+                    directions[child] = direction.normalized();
+                }
             }
-        }
+        });
+    }
 
-        float phi = 0.0f;
-        // i = 2 because we've theoretically already positioned the top and bottom
-        int i = 2;
-        for(;edgeIdIterator != edgeIds.end(); ++edgeIdIterator)
+    forEachBlock(0, numNodes, [&](size_t first, size_t last)
+    {
+        for(auto position = first; position < last; position++)
         {
-            const auto& edge = graph.edgeById(*edgeIdIterator);
-            auto childNodeId = edge.oppositeId(parentNodeId);
+            auto nodePosition = nodePositions[position];
+
+            if(dimensionality == Layout::Dimensionality::TwoDee)
+                nodePosition.setZ(0.0f);
 
-            if(visitedNodes.get(childNodeId))
-                continue;
+            positions().set(nodeIds().at(order[position]), nodePosition);
+        }
+    });
+}
 
-            nodeQueue.push(childNodeId);
+// Components with no more than this proportion of the nodes in the graph use a hash map to
+// find their nodes' indices, rather than a NodeArray, which is the size of the whole graph
+static const size_t HASH_MAP_MAXIMUM_PROPORTION = 16;
 
-            auto h = -1.0f + 2.0f * (static_cast<float>(i) - 1.0f) / static_cast<float>(
-                static_cast<int>(edgeIds.size()) - 1 + edgeCountOffset);
-            auto theta = std::acos(h);
-            phi = phi + 3.6f / (std::sqrt((static_cast<float>(
-                static_cast<int>(edgeIds.size()) + edgeCountOffset)) * (1.0f - h * h)));
-            phi = std::fmod(phi, 2.0f * static_cast<float>(std::numbers::pi_v<float>));
+void FastInitialLayout::execute(bool, Dimensionality dimensionality)
+{
+    const auto& graph = graphComponent().graph();
 
-            QVector3D offsetPosition(h, std::cos(phi) * std::sin(theta), std::sin(phi) * std::sin(theta));
+    if(nodeIds().size() * HASH_MAP_MAXIMUM_PROPORTION <= graph.numNodes())
+    {
+        NodeIdHashMap<uint32_t> indices;
+        indices.reserve(nodeIds().size());
 
-            positionNode(offsetPosition,
-                         orientationMatrix,
-                         parentNodePosition,
-                         childNodeId,
-                         directionNodeVectors);
+        for(size_t i = 0; i < nodeIds().size(); i++)
+            indices.emplace(nodeIds().at(i), static_cast<uint32_t>(i));
 
-            visitedNodes.set(childNodeId, true);
-            i++;
-        }
+        layout([&indices](NodeId nodeId) { return indices.at(nodeId); }, dimensionality);
     }
+    else
+    {
+        NodeArray<uint32_t> indices(graph);
 
-    if(dimensionality == Layout::Dimensionality::TwoDee)
-        positions().flatten();
+        for(size_t i = 0; i < nodeIds().size(); i++)
+            indices[nodeIds().at(i)] = static_cast<uint32_t>(i);
+
+        layout([&indices](NodeId nodeId) { return indices[nodeId]; }, dimensionality);
+    }
 }
@@ -27,9 +27,9 @@ class FastInitialLayout : public Layout
     Q_OBJECT
 
 private:
-    void positionNode(QVector3D& offsetPosition, const QMatrix4x4& orientationMatrix,
-                      const QVector3D& parentNodePosition, NodeId childNodeId,
-                      NodeArray<QVector3D>& directionNodeVectors);
+    template<typename IndexOfFn>
+    void layout(const IndexOfFn& indexOf, Dimensionality dimensionality);
+
 public:
     FastInitialLayout(const IGraphComponent& graphComponent, NodeLayoutPositions& positions)
         : Layout(graphComponent, positions)
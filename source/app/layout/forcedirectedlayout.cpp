@@ -19,17 +19,23 @@
 
 #include "forcedirectedlayout.h"
 #include "fastinitiallayout.h"
-#include "barneshuttree.h"
 
 #include "app/graph/graph.h"
-#include "app/graph/graphmodel.h"
-
-#include "app/preferences.h"
 
 #include "shared/utils/threadpool.h"
 #include "shared/utils/scopetimer.h"
 
+#include <QDebug>
+
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numbers>
+#include <numeric>
+#include <span>
+#include <vector>
 
 using namespace Qt::Literals::StringLiterals;
 
@@ -105,6 +111,29 @@ void ForceDirectedDisplacement::computeAndDamp()
     _previousLength = _previous.length();
 }
 
+// Per node work is split into a few blocks for each worker thread, so that even small
+// components are spread across the pool, and the per block partial sums of the
+// reductions are few enough to total cheaply; the lower bound on the block size
+// keeps the per block overhead from dominating
+static const size_t NODE_BLOCKS_PER_THREAD = 4;
+static const size_t MINIMUM_NODE_BLOCK_SIZE = 64;
+
+static size_t nodeBlockSizeFor(size_t numNodes)
+{
+    const auto numThreads = std::max(ThreadPoolSingleton::instance()->numThreads(), size_t{1});
+    return std::max(MINIMUM_NODE_BLOCK_SIZE, numNodes / (numThreads * NODE_BLOCKS_PER_THREAD));
+}
+
+static std::vector<size_t> nodeBlocksFor(size_t numNodes, size_t blockSize)
+{
+    std::vector<size_t> blockStarts((numNodes + blockSize - 1) / blockSize);
+
+    for(size_t i = 0; i < blockStarts.size(); i++)
+        blockStarts[i] = i * blockSize;
+
+    return blockStarts;
+}
+
 // This is a fairly arbitrary function that was arrived at through experimentation. The parameters
 // shortRange and longRange affect the emphasis that the result places on local forces and global
 // forces, respectively.
@@ -114,21 +143,517 @@ static float repulse(float distanceSq, float shortRange, float longRange)
         ((distanceSq * distanceSq * distanceSq) + 0.0001f);
 }
 
+// Components with at least this many nodes are initially laid out by coarsening them
+// into a hierarchy of successively smaller graphs, laying out the smallest and then
+// working back up the hierarchy, refining the layout at each level in turn
+static const size_t MULTILEVEL_MINIMUM_NODES = 5000;
+static const size_t MULTILEVEL_COARSEST_NODES = 100;
+static const size_t MULTILEVEL_COARSEST_ITERATIONS = 300;
+static const size_t MULTILEVEL_REFINEMENT_ITERATIONS = 50;
+static const float MULTILEVEL_INITIAL_SPACING = 10.0f;
+static const float MULTILEVEL_JITTER = 1.0f;
+
+// If coarsening a level can't remove at least this proportion of its nodes, stop; this
+// happens with star like graphs, where most nodes have no unmatched neighbour available
+static const float MULTILEVEL_MINIMUM_REDUCTION = 0.1f;
+
+// When an already laid out component changes, only the nodes within this many hops of the
+// change are laid out, with the rest of the component frozen in place, until the mean
+// displacement of those nodes falls to INCREMENTAL_SETTLED_DISPLACEMENT
+static const size_t INCREMENTAL_HOPS = 2;
+static const float INCREMENTAL_SETTLED_DISPLACEMENT = 0.05f;
+
+// Every so many iterations that the incremental layout fails to settle, the neighbours of any
+// nodes that are still being displaced significantly also become unfrozen; if it still hasn't
+// settled after some time, or too much of the component is involved, the incremental
+// layout is abandoned in favour of laying out the entire component
+static const size_t INCREMENTAL_SPREAD_INTERVAL = 100;
+static const float INCREMENTAL_SPREAD_DISPLACEMENT = 1.0f;
+static const size_t INCREMENTAL_MAXIMUM_ITERATIONS = 1000;
+static const float INCREMENTAL_MAXIMUM_PROPORTION = 0.5f;
+
+namespace
+{
+// One level of the multilevel hierarchy, with its adjacency in compressed form
+struct MultilevelGraph
+{
+    std::vector<uint32_t> _adjacencyStarts;
+    std::vector<uint32_t> _adjacency;
+    std::vector<uint32_t> _weights;
+
+    // The index of each node's parent in the next coarser level
+    std::vector<uint32_t> _parents;
+
+    size_t numNodes() const { return _weights.size(); }
+
+    auto neighbours(size_t index) const
+    {
+        return std::span(_adjacency).subspan(_adjacencyStarts[index],
+            _adjacencyStarts[index + 1] - _adjacencyStarts[index]);
+    }
+};
+} // namespace
+
+// Collapses matched pairs of adjacent nodes into a single coarser node
+static MultilevelGraph coarsen(MultilevelGraph& fine)
+{
+    constexpr auto UNMATCHED = std::numeric_limits<uint32_t>::max();
+
+    const auto numFineNodes = fine.numNodes();
+    fine._parents.assign(numFineNodes, UNMATCHED);
+
+    // Low degree nodes have the fewest options, so give them first pick
+    std::vector<uint32_t> visitOrder(numFineNodes);
+    std::iota(visitOrder.begin(), visitOrder.end(), 0u);
+    std::stable_sort(visitOrder.begin(), visitOrder.end(), [&fine](auto a, auto b)
+    {
+        return fine.neighbours(a).size() < fine.neighbours(b).size();
+    });
+
+    MultilevelGraph coarse;
+    std::vector<std::array<uint32_t, 2>> children;
+
+    for(const auto index : visitOrder)
+    {
+        if(fine._parents[index] != UNMATCHED)
+            continue;
+
+        // Match with the lightest neighbour, to keep the coarse nodes' weights balanced
+        auto match = UNMATCHED;
+        auto matchWeight = std::numeric_limits<uint32_t>::max();
+        for(const auto neighbour : fine.neighbours(index))
+        {
+            if(fine._parents[neighbour] == UNMATCHED && neighbour != index &&
+                fine._weights[neighbour] < matchWeight)
+            {
+                match = neighbour;
+                matchWeight = fine._weights[neighbour];
+            }
+        }
+
+        const auto parent = static_cast<uint32_t>(coarse._weights.size());
+        fine._parents[index] = parent;
+        auto weight = fine._weights[index];
+
+        if(match != UNMATCHED)
+        {
+            fine._parents[match] = parent;
+            weight += fine._weights[match];
+        }
+
+        coarse._weights.push_back(weight);
+        children.push_back({index, match});
+    }
+
+    coarse._adjacencyStarts.reserve(coarse.numNodes() + 1);
+    coarse._adjacencyStarts.push_back(0);
+
+    std::vector<uint32_t> row;
+    for(uint32_t parent = 0; parent < coarse.numNodes(); parent++)
+    {
+        row.clear();
+
+        for(const auto child : children[parent])
+        {
+            if(child == UNMATCHED)
+                continue;
+
+            for(const auto neighbour : fine.neighbours(child))
+            {
+                const auto neighbourParent = fine._parents[neighbour];
+                if(neighbourParent != parent)
+                    row.push_back(neighbourParent);
+            }
+        }
+
+        std::sort(row.begin(), row.end());
+        row.erase(std::unique(row.begin(), row.end()), row.end());
+
+        coarse._adjacency.insert(coarse._adjacency.end(), row.begin(), row.end());
+        coarse._adjacencyStarts.push_back(static_cast<uint32_t>(coarse._adjacency.size()));
+    }
+
+    return coarse;
+}
+
+// Evenly distributed points on a unit sphere or disc, using the golden angle
+static QVector3D goldenSpiralPoint(size_t index, size_t numPoints, Layout::Dimensionality dimensionality)
+{
+    const auto goldenAngle = std::numbers::pi_v<float> * (3.0f - std::sqrt(5.0f));
+    const auto i = static_cast<float>(index) + 0.5f;
+    const auto n = static_cast<float>(numPoints);
+    const auto theta = goldenAngle * i;
+
+    if(dimensionality == Layout::Dimensionality::TwoDee)
+    {
+        const auto r = std::sqrt(i / n);
+        return {r * std::cos(theta), r * std::sin(theta), 0.0f};
+    }
+
+    const auto z = 1.0f - (2.0f * i / n);
+    const auto r = std::sqrt(std::max(0.0f, 1.0f - (z * z)));
+    return {r * std::cos(theta), r * std::sin(theta), z};
+}
+
+// Runs iterations of the same force model as ForceDirectedLayout::execute, on one level of the hierarchy
+template<typename BarnesHutTreeType>
+static void multilevelIterations(BarnesHutTreeType& barnesHutTree, const MultilevelGraph& level,
+    std::vector<QVector3D>& positions, size_t numIterations, float shortRange, float longRange,
+    const Cancellable& cancellable)
+{
+    std::vector<ForceDirectedDisplacement> displacements(level.numNodes());
+    const auto blockSize = nodeBlockSizeFor(level.numNodes());
+    auto blockStarts = nodeBlocksFor(level.numNodes(), blockSize);
+
+    // Each coarse node stands in for the nodes collapsed into it, so it repels in proportion
+    // to their number, otherwise the coarse layout is too compact for the finer levels
+    std::vector<float> masses(level.numNodes());
+    std::transform(level._weights.begin(), level._weights.end(), masses.begin(),
+        [](auto weight) { return static_cast<float>(weight); });
+
+    for(size_t iteration = 0; iteration < numIterations && !cancellable.cancelled(); iteration++)
+    {
+        barnesHutTree.build(positions, masses);
+
+        parallel_for(blockStarts.begin(), blockStarts.end(),
+        [&](size_t blockStart)
+        {
+            const auto blockEnd = std::min(blockStart + blockSize, barnesHutTree.numPoints());
+
+            for(size_t i = blockStart; i < blockEnd; i++)
+            {
+                displacements[barnesHutTree.indexAt(i)]._repulsive -= barnesHutTree.evaluateKernel(i,
+                [shortRange, longRange](float mass, float distanceSq)
+                {
+                    return mass * repulse(distanceSq, shortRange, longRange);
+                });
+            }
+        });
+
+        parallel_for(blockStarts.begin(), blockStarts.end(),
+        [&](size_t blockStart)
+        {
+            const auto blockEnd = std::min(blockStart + blockSize, level.numNodes());
+
+            for(size_t i = blockStart; i < blockEnd; i++)
+            {
+                auto& displacement = displacements[i];
+
+                for(const auto neighbour : level.neighbours(i))
+                {
+                    const QVector3D difference = positions[neighbour] - positions[i];
+                    displacement._attractive += difference * (difference.lengthSquared() * 0.001f);
+                }
+
+                displacement.computeAndDamp();
+            }
+        });
+
+        parallel_for(blockStarts.begin(), blockStarts.end(),
+        [&](size_t blockStart)
+        {
+            const auto blockEnd = std::min(blockStart + blockSize, level.numNodes());
+
+            for(size_t i = blockStart; i < blockEnd; i++)
+                positions[i] += displacements[i]._next;
+        });
+    }
+}
+
+template<typename BarnesHutTreeType>
+static std::vector<QVector3D> multilevelLayout(BarnesHutTreeType& barnesHutTree,
+    std::vector<MultilevelGraph>& levels, Layout::Dimensionality dimensionality,
+    float shortRange, float longRange, const Cancellable& cancellable)
+{
+    const auto& coarsest = levels.back();
+
+    std::vector<QVector3D> positions(coarsest.numNodes());
+    const auto radius = MULTILEVEL_INITIAL_SPACING * std::sqrt(static_cast<float>(coarsest.numNodes()));
+    for(size_t i = 0; i < positions.size(); i++)
+        positions[i] = goldenSpiralPoint(i, positions.size(), dimensionality) * radius;
+
+    multilevelIterations(barnesHutTree, coarsest, positions, MULTILEVEL_COARSEST_ITERATIONS,
+        shortRange, longRange, cancellable);
+
+    const auto exponent = dimensionality == Layout::Dimensionality::TwoDee ? 1.0f / 2.0f : 1.0f / 3.0f;
+
+    // If cancelled, the remaining levels are still projected, just without any refinement,
+    // so that there are always positions for every node, however rough
+    for(auto levelIndex = levels.size() - 1; levelIndex-- > 0;)
+    {
+        const auto& fine = levels.at(levelIndex);
+        const auto& coarse = levels.at(levelIndex + 1);
+
+        // The finer level has more nodes and so needs more space
+        const auto scale = std::pow(static_cast<float>(fine.numNodes()) /
+            static_cast<float>(coarse.numNodes()), exponent);
+
+        QVector3D centre;
+        for(const auto& position : positions)
+            centre += position;
+        centre /= static_cast<float>(positions.size());
+
+        // Place each node at its parent's position, jittered such that siblings don't coincide
+        std::vector<QVector3D> finePositions(fine.numNodes());
+        for(size_t i = 0; i < finePositions.size(); i++)
+        {
+            const auto& parentPosition = positions[fine._parents[i]];
+            finePositions[i] = centre + ((parentPosition - centre) * scale) +
+                (goldenSpiralPoint(i % 16, 16, dimensionality) * MULTILEVEL_JITTER);
+        }
+
+        positions = std::move(finePositions);
+
+        // The finest level is refined by the normal iterations of the layout
+        if(levelIndex > 0)
+        {
+            multilevelIterations(barnesHutTree, fine, positions, MULTILEVEL_REFINEMENT_ITERATIONS,
+                shortRange, longRange, cancellable);
+        }
+    }
+
+    return positions;
+}
+
+void ForceDirectedLayout::multilevelInitialLayout(Dimensionality dimensionality, float shortRange, float longRange)
+{
+    SCOPE_TIMER
+
+    const auto* graph = dynamic_cast<const Graph*>(&graphComponent().graph());
+    Q_ASSERT(graph != nullptr);
+
+    NodeArray<uint32_t> indices(*graph);
+    for(size_t i = 0; i < nodeIds().size(); i++)
+        indices[nodeIds().at(i)] = static_cast<uint32_t>(i);
+
+    std::vector<MultilevelGraph> levels(1);
+    auto& finest = levels.front();
+    finest._weights.assign(nodeIds().size(), 1);
+    finest._adjacencyStarts.reserve(nodeIds().size() + 1);
+    finest._adjacencyStarts.push_back(0);
+
+    for(const auto nodeId : nodeIds())
+    {
+        for(auto edgeId : graph->edgeIdsForNodeId(nodeId))
+        {
+            const auto& edge = graph->edgeById(edgeId);
+            if(!edge.isLoop())
+                finest._adjacency.push_back(indices[edge.oppositeId(nodeId)]);
+        }
+
+        finest._adjacencyStarts.push_back(static_cast<uint32_t>(finest._adjacency.size()));
+    }
+
+    while(levels.back().numNodes() > MULTILEVEL_COARSEST_NODES && !cancelled())
+    {
+        auto coarse = coarsen(levels.back());
+
+        const auto reduction = 1.0f - (static_cast<float>(coarse.numNodes()) /
+            static_cast<float>(levels.back().numNodes()));
+
+        if(reduction < MULTILEVEL_MINIMUM_REDUCTION)
+            break;
+
+        levels.push_back(std::move(coarse));
+    }
+
+    // Nothing was gained by coarsening, so fall back to the normal initial layout
+    if(levels.size() < 2)
+    {
+        FastInitialLayout initialLayout(graphComponent(), positions());
+        initialLayout.execute(true, dimensionality);
+        return;
+    }
+
+    auto layoutPositions = dimensionality == Dimensionality::ThreeDee ?
+        multilevelLayout(_barnesHutTree3D, levels, dimensionality, shortRange, longRange, *this) :
+        multilevelLayout(_barnesHutTree2D, levels, dimensionality, shortRange, longRange, *this);
+
+    for(size_t i = 0; i < nodeIds().size(); i++)
+        positions().set(nodeIds().at(i), layoutPositions.at(i));
+}
+
+template<typename BarnesHutTreeType>
+void ForceDirectedLayout::computeRepulsiveForces(BarnesHutTreeType& barnesHutTree, float shortRange, float longRange)
+{
+    barnesHutTree.build(graphComponent(), positions());
+
+    // Timed separately from the build
+    SCOPE_TIMER_MULTISAMPLES(50)
+
+    // The tree's points are in Morton order, so each block covers a spatially
+    // coherent set of nodes, which mostly visit the same parts of the tree
+    const auto blockSize = nodeBlockSizeFor(barnesHutTree.numPoints());
+    auto blockStarts = nodeBlocksFor(barnesHutTree.numPoints(), blockSize);
+
+    parallel_for(blockStarts.begin(), blockStarts.end(),
+    [this, &barnesHutTree, blockSize, shortRange, longRange](size_t blockStart)
+    {
+        if(cancelled())
+            return;
+
+        const auto blockEnd = std::min(blockStart + blockSize, barnesHutTree.numPoints());
+
+        for(size_t i = blockStart; i < blockEnd; i++)
+        {
+            _displacements->at(barnesHutTree.nodeIdAt(i))._repulsive -= barnesHutTree.evaluateKernel(i,
+            [shortRange, longRange](float mass, float distanceSq)
+            {
+                return mass * repulse(distanceSq, shortRange, longRange);
+            });
+        }
+    });
+}
+
+template<typename BarnesHutTreeType>
+void ForceDirectedLayout::incrementalIteration(BarnesHutTreeType& frozenBarnesHutTree,
+    BarnesHutTreeType& barnesHutTree, float shortRange, float longRange)
+{
+    if(_incrementalNodeIds.empty())
+    {
+        endIncremental();
+        finishChangeDetection();
+        return;
+    }
+
+    if(_frozenTreeRequiresBuild)
+    {
+        std::vector<QVector3D> frozenPositions;
+        frozenPositions.reserve(nodeIds().size() - _incrementalNodeIds.size());
+
+        for(auto nodeId : nodeIds())
+        {
+            if(!_incrementalNodeIdSet.contains(nodeId))
+                frozenPositions.push_back(positions().get(nodeId));
+        }
+
+        frozenBarnesHutTree.build(frozenPositions);
+        _frozenTreeRequiresBuild = false;
+    }
+
+    const auto numNodes = _incrementalNodeIds.size();
+
+    _incrementalPositions.resize(numNodes);
+    for(size_t i = 0; i < numNodes; i++)
+        _incrementalPositions[i] = positions().get(_incrementalNodeIds[i]);
+
+    barnesHutTree.build(_incrementalPositions);
+
+    const auto* graph = dynamic_cast<const Graph*>(&graphComponent().graph());
+    Q_ASSERT(graph != nullptr);
+
+    auto kernel = [shortRange, longRange](float mass, float distanceSq)
+    {
+        return mass * repulse(distanceSq, shortRange, longRange);
+    };
+
+    const auto blockSize = nodeBlockSizeFor(numNodes);
+    auto blockStarts = nodeBlocksFor(numNodes, blockSize);
+
+    auto deltaForceTotals = parallel_for(blockStarts.begin(), blockStarts.end(),
+    [&](size_t blockStart)
+    {
+        const auto blockEnd = std::min(blockStart + blockSize, numNodes);
+        double deltaForceTotal = 0.0;
+
+        for(size_t i = blockStart; i < blockEnd; i++)
+        {
+            const auto index = barnesHutTree.indexAt(i);
+            const auto nodeId = _incrementalNodeIds[index];
+            const auto& position = _incrementalPositions[index];
+            auto& displacement = _displacements->at(nodeId);
+
+            // Repulsion comes from both the moving nodes and the frozen remainder
+            displacement._repulsive -= barnesHutTree.evaluateKernel(i, kernel) +
+                frozenBarnesHutTree.evaluateKernelAt(position, index, kernel);
+
+            for(auto edgeId : graph->edgeIdsForNodeId(nodeId))
+            {
+                const auto& edge = graph->edgeById(edgeId);
+                if(edge.isLoop())
+                    continue;
+
+                const QVector3D difference = positions().get(edge.oppositeId(nodeId)) - position;
+                displacement._attractive += difference * (difference.lengthSquared() * 0.001f);
+            }
+
+            displacement.computeAndDamp();
+            deltaForceTotal += static_cast<double>(displacement._nextLength);
+        }
+
+        return deltaForceTotal;
+    });
+
+    // Only now that every force has been computed can the nodes be moved
+    for(size_t i = 0; i < numNodes; i++)
+    {
+        const auto nodeId = _incrementalNodeIds[i];
+        positions().set(nodeId, _incrementalPositions[i] + _displacements->at(nodeId)._next);
+    }
+
+    double deltaForceTotal = 0.0;
+    for(auto blockDeltaForceTotal : deltaForceTotals)
+        deltaForceTotal += blockDeltaForceTotal;
+
+    _forceMean = static_cast<float>(deltaForceTotal / static_cast<double>(numNodes));
+    _incrementalIterationCount++;
+
+    if(_forceMean <= INCREMENTAL_SETTLED_DISPLACEMENT)
+    {
+        endIncremental();
+        finishChangeDetection();
+        return;
+    }
+
+    if(_incrementalIterationCount % INCREMENTAL_SPREAD_INTERVAL == 0)
+    {
+        std::vector<NodeId> displacedNodeIds;
+        for(auto nodeId : _incrementalNodeIds)
+        {
+            if(_displacements->at(nodeId)._nextLength > INCREMENTAL_SPREAD_DISPLACEMENT)
+                displacedNodeIds.push_back(nodeId);
+        }
+
+        addIncrementalNodes(displacedNodeIds, 1);
+    }
+
+    const auto maximumNodes = static_cast<size_t>(static_cast<float>(nodeIds().size()) * INCREMENTAL_MAXIMUM_PROPORTION);
+
+    if(_incrementalIterationCount >= INCREMENTAL_MAXIMUM_ITERATIONS || _incrementalNodeIds.size() > maximumNodes)
+    {
+        if(qEnvironmentVariableIntValue("LAYOUT_DEBUG") > 0)
+        {
+            qDebug() << "ForceDirectedLayout incremental layout of" << _incrementalNodeIds.size() <<
+                "nodes unsettled after" << _incrementalIterationCount << "iterations; laying out all" <<
+                nodeIds().size() << "nodes";
+        }
+
+        endIncremental();
+        _changeDetectionPhase = ChangeDetectionPhase::Initial;
+    }
+}
+
 void ForceDirectedLayout::execute(bool firstIteration, Dimensionality dimensionality)
 {
     SCOPE_TIMER_MULTISAMPLES(50)
 
+    const float SHORT_RANGE = _settings->value(u"ShortRangeRepulseTerm"_s);
+    const float LONG_RANGE = 0.01f + _settings->value(u"LongRangeRepulseTerm"_s);
+
     if(firstIteration)
     {
-        FastInitialLayout initialLayout(graphComponent(), positions());
-        initialLayout.execute(firstIteration, dimensionality);
+        if(nodeIds().size() >= MULTILEVEL_MINIMUM_NODES)
+            multilevelInitialLayout(dimensionality, SHORT_RANGE, LONG_RANGE);
+        else
+        {
+            FastInitialLayout initialLayout(graphComponent(), positions());
+            initialLayout.execute(firstIteration, dimensionality);
+        }
 
         for(const NodeId nodeId : nodeIds())
             _displacements->at(nodeId)._previous = {};
     }
 
-    std::unique_ptr<AbstractBarnesHutTree> barnesHutTree;
-
     if(dimensionality == Dimensionality::ThreeDee)
     {
         if(_hasBeenFlattened)
@@ -150,34 +675,30 @@ void ForceDirectedLayout::execute(bool firstIteration, Dimensionality dimensiona
             }
 
             _hasBeenFlattened = false;
-        }
 
-        barnesHutTree = std::make_unique<BarnesHutTree3D>();
+            // Every node has moved, so it's no longer possible to lay out only some of them
+            if(_changeDetectionPhase == ChangeDetectionPhase::Incremental)
+            {
+                endIncremental();
+                _changeDetectionPhase = ChangeDetectionPhase::Initial;
+            }
+        }
     }
     else if(dimensionality == Dimensionality::TwoDee)
-    {
         _hasBeenFlattened = true;
-        barnesHutTree = std::make_unique<BarnesHutTree2D>();
-    }
-
-    barnesHutTree->build(graphComponent(), positions());
 
-    const float SHORT_RANGE = _settings->value(u"ShortRangeRepulseTerm"_s);
-    const float LONG_RANGE = 0.01f + _settings->value(u"LongRangeRepulseTerm"_s);
+    _executed = true;
 
-    // Repulsive forces
-    auto repulsiveResults = parallel_for(nodeIds().begin(), nodeIds().end(),
-    [this, &barnesHutTree, SHORT_RANGE, LONG_RANGE](NodeId nodeId)
+    if(_changeDetectionPhase == ChangeDetectionPhase::Incremental)
     {
-        if(cancelled())
-            return;
+        if(dimensionality == Dimensionality::ThreeDee)
+            incrementalIteration(_frozenBarnesHutTree3D, _barnesHutTree3D, SHORT_RANGE, LONG_RANGE);
+        else
+            incrementalIteration(_frozenBarnesHutTree2D, _barnesHutTree2D, SHORT_RANGE, LONG_RANGE);
 
-        _displacements->at(nodeId)._repulsive -= barnesHutTree->evaluateKernel(positions(), nodeId,
-        [SHORT_RANGE, LONG_RANGE](int mass, const QVector3D& difference, float distanceSq)
-        {
-            return difference * (static_cast<float>(mass) * repulse(distanceSq, SHORT_RANGE, LONG_RANGE));
-        });
-    }, ThreadPool::NonBlocking);
+        _performanceCounter.tick();
+        return;
+    }
 
     // Attractive forces
     auto attractiveResults = parallel_for(edgeIds().begin(), edgeIds().end(),
@@ -197,28 +718,59 @@ void ForceDirectedLayout::execute(bool firstIteration, Dimensionality dimensiona
         }
     }, ThreadPool::NonBlocking);
 
-    repulsiveResults.wait();
+    // Repulsive forces, computed while the attractive forces are in flight
+    if(dimensionality == Dimensionality::ThreeDee)
+        computeRepulsiveForces(_barnesHutTree3D, SHORT_RANGE, LONG_RANGE);
+    else
+        computeRepulsiveForces(_barnesHutTree2D, SHORT_RANGE, LONG_RANGE);
+
     attractiveResults.wait();
 
     if(cancelled())
         return;
 
-    for(auto edgeId : edgeIds())
-    {
-        const auto& edge = graphComponent().graph().edgeById(edgeId);
-        _displacements->at(edge.targetId())._attractive -= _attractiveForces->at(edgeId);
-        _displacements->at(edge.sourceId())._attractive += _attractiveForces->at(edgeId);
-    }
+    const auto* graph = dynamic_cast<const Graph*>(&graphComponent().graph());
+    Q_ASSERT(graph != nullptr);
 
-    parallel_for(nodeIds().begin(), nodeIds().end(),
-    [this](NodeId nodeId)
+    const auto blockSize = nodeBlockSizeFor(nodeIds().size());
+    auto blockStarts = nodeBlocksFor(nodeIds().size(), blockSize);
+
+    // Each node gathers the attractive forces of its own edges, rather than each edge
+    // scattering its force to both of its nodes, so that nodes are independent of each
+    // other and the forces can be accumulated concurrently without contention
+    auto deltaForceTotals = parallel_for(blockStarts.begin(), blockStarts.end(),
+    [this, graph, blockSize](size_t blockStart)
     {
-        _displacements->at(nodeId).computeAndDamp();
-    });
+        const auto blockEnd = std::min(blockStart + blockSize, nodeIds().size());
+        double deltaForceTotal = 0.0;
+
+        for(size_t i = blockStart; i < blockEnd; i++)
+        {
+            const auto nodeId = nodeIds().at(i);
+            auto& displacement = _displacements->at(nodeId);
+
+            for(auto edgeId : graph->edgeIdsForNodeId(nodeId))
+            {
+                const auto& edge = graph->edgeById(edgeId);
+                if(edge.isLoop())
+                    continue;
+
+                if(edge.targetId() == nodeId)
+                    displacement._attractive -= _attractiveForces->at(edgeId);
+                else
+                    displacement._attractive += _attractiveForces->at(edgeId);
+            }
 
-    // Apply the forces
-    for(auto nodeId : nodeIds())
-        positions().set(nodeId, positions().get(nodeId) + _displacements->at(nodeId)._next);
+            displacement.computeAndDamp();
+
+            // Apply the forces
+            positions().set(nodeId, positions().get(nodeId) + displacement._next);
+
+            deltaForceTotal += static_cast<double>(displacement._nextLength);
+        }
+
+        return deltaForceTotal;
+    });
 
     // There are three main phases which decide when to stop the layout.
     // The phases operate primarily on the stddev of the forces within the graph
@@ -236,21 +788,33 @@ void ForceDirectedLayout::execute(bool firstIteration, Dimensionality dimensiona
     //
 
     // Calculate force averages
-    float deltaForceTotal = 0.0f;
-    for(auto nodeId : nodeIds())
-        deltaForceTotal += _displacements->at(nodeId)._nextLength;
+    double deltaForceTotal = 0.0;
+    for(auto blockDeltaForceTotal : deltaForceTotals)
+        deltaForceTotal += blockDeltaForceTotal;
 
-    _forceMean = deltaForceTotal / static_cast<float>(nodeIds().size());
+    _forceMean = static_cast<float>(deltaForceTotal / static_cast<double>(nodeIds().size()));
 
     // Calculate Standard Deviation
-    float variance = 0.0f;
-    for(auto nodeId : nodeIds())
+    auto variances = parallel_for(blockStarts.begin(), blockStarts.end(),
+    [this, blockSize](size_t blockStart)
     {
-        const float d = _displacements->at(nodeId)._nextLength - _forceMean;
-        variance += (d * d);
-    }
+        const auto blockEnd = std::min(blockStart + blockSize, nodeIds().size());
+        double variance = 0.0;
+
+        for(size_t i = blockStart; i < blockEnd; i++)
+        {
+            const float d = _displacements->at(nodeIds().at(i))._nextLength - _forceMean;
+            variance += static_cast<double>(d * d);
+        }
 
-    _forceStdDeviation = std::sqrt(variance / static_cast<float>(nodeIds().size()));
+        return variance;
+    });
+
+    double variance = 0.0;
+    for(auto blockVariance : variances)
+        variance += blockVariance;
+
+    _forceStdDeviation = static_cast<float>(std::sqrt(variance / static_cast<double>(nodeIds().size())));
     switch(_changeDetectionPhase)
     {
         case ChangeDetectionPhase::Initial:
@@ -265,6 +829,7 @@ void ForceDirectedLayout::execute(bool firstIteration, Dimensionality dimensiona
             oscillateChangeDetection();
             break;
 
+        case ChangeDetectionPhase::Incremental:
         case ChangeDetectionPhase::Finished:
         default:
             break;
@@ -273,6 +838,28 @@ void ForceDirectedLayout::execute(bool firstIteration, Dimensionality dimensiona
     _prevStdDevs.push_back(_forceStdDeviation);
     _prevAvgForces.push_back(_forceMean);
     _prevCaptureStdDevs.push_back(_forceStdDeviation);
+
+    _performanceCounter.tick();
+}
+
+ForceDirectedLayout::ForceDirectedLayout(const IGraphComponent& graphComponent,
+    ForceDirectedDisplacements& displacements, EdgeArray<QVector3D>& attractiveForces,
+    NodeLayoutPositions& positions, Layout::Dimensionality dimensionalityMode,
+    const LayoutSettings* settings) :
+    Layout(graphComponent, positions, settings, Iterative::Yes,
+        Dimensionality::TwoOrThreeDee, 0.4f, 4),
+    _displacements(&displacements), _attractiveForces(&attractiveForces),
+    _hasBeenFlattened(dimensionalityMode == Layout::Dimensionality::TwoDee),
+    _performanceCounter(std::chrono::seconds(1))
+{
+    if(qEnvironmentVariableIntValue("LAYOUT_DEBUG") > 2)
+    {
+        _performanceCounter.setReportFn([this](float ticksPerSecond)
+        {
+            qDebug() << "ForceDirectedLayout" << nodeIds().size() << "nodes" <<
+                edgeIds().size() << "edges\t" << ticksPerSecond << "ips";
+        });
+    }
 }
 
 // Initial phase. If the std dev drops below MINIMUM_STDDEV_THRESHOLD this will move the phase onto
@@ -316,8 +903,110 @@ void ForceDirectedLayout::finishChangeDetection()
 
 void ForceDirectedLayout::unfinish()
 {
-    if(_changeDetectionPhase == ChangeDetectionPhase::Finished)
+    if(_changeDetectionPhase == ChangeDetectionPhase::Incremental)
+    {
+        endIncremental();
         _changeDetectionPhase = ChangeDetectionPhase::Initial;
+    }
+    else if(_changeDetectionPhase == ChangeDetectionPhase::Finished)
+        _changeDetectionPhase = ChangeDetectionPhase::Initial;
+}
+
+// Unfreezes seedNodeIds and every node within numHops of them
+void ForceDirectedLayout::addIncrementalNodes(const std::vector<NodeId>& seedNodeIds, size_t numHops)
+{
+    const auto& graph = graphComponent().graph();
+    const auto numNodesBefore = _incrementalNodeIds.size();
+
+    auto unfreeze = [this](NodeId nodeId)
+    {
+        if(!_incrementalNodeIdSet.insert(nodeId).second)
+            return false;
+
+        _incrementalNodeIds.push_back(nodeId);
+
+        // Forget any motion the node had before it was frozen
+        auto& displacement = _displacements->at(nodeId);
+        displacement._previous = {};
+        displacement._previousLength = 0.0f;
+
+        return true;
+    };
+
+    std::vector<NodeId> hopNodeIds;
+    for(auto nodeId : seedNodeIds)
+    {
+        unfreeze(nodeId);
+        hopNodeIds.push_back(nodeId);
+    }
+
+    for(size_t hop = 0; hop < numHops && !hopNodeIds.empty(); hop++)
+    {
+        std::vector<NodeId> nextHopNodeIds;
+
+        for(auto nodeId : hopNodeIds)
+        {
+            for(auto neighbourId : graph.neighboursOf(nodeId))
+            {
+                if(unfreeze(neighbourId))
+                    nextHopNodeIds.push_back(neighbourId);
+            }
+        }
+
+        hopNodeIds = std::move(nextHopNodeIds);
+    }
+
+    if(_incrementalNodeIds.size() != numNodesBefore)
+        _frozenTreeRequiresBuild = true;
+}
+
+void ForceDirectedLayout::endIncremental()
+{
+    _incrementalNodeIds.clear();
+    _incrementalNodeIdSet.clear();
+    _incrementalIterationCount = 0;
+    _frozenTreeRequiresBuild = true;
+
+    // The frozen trees are as large as the component, so don't hang on to them
+    _frozenBarnesHutTree2D = {};
+    _frozenBarnesHutTree3D = {};
+}
+
+void ForceDirectedLayout::reactivate(const std::vector<NodeId>& changedNodeIds)
+{
+    // A layout that is still in progress is laying out every node anyway
+    if(_executed && _changeDetectionPhase != ChangeDetectionPhase::Finished &&
+        _changeDetectionPhase != ChangeDetectionPhase::Incremental)
+    {
+        return;
+    }
+
+    if(_changeDetectionPhase == ChangeDetectionPhase::Incremental)
+    {
+        // The component has changed since the nodes were unfrozen, so
+        // keep only those that are still part of it
+        const auto previousNodeIdSet = std::move(_incrementalNodeIdSet);
+        _incrementalNodeIds.clear();
+        _incrementalNodeIdSet.clear();
+
+        for(auto nodeId : nodeIds())
+        {
+            if(previousNodeIdSet.contains(nodeId))
+            {
+                _incrementalNodeIds.push_back(nodeId);
+                _incrementalNodeIdSet.insert(nodeId);
+            }
+        }
+
+        _frozenTreeRequiresBuild = true;
+    }
+    else
+    {
+        _changeDetectionPhase = ChangeDetectionPhase::Incremental;
+        _incrementalIterationCount = 0;
+    }
+
+    addIncrementalNodes(changedNodeIds, INCREMENTAL_HOPS);
 }
 
 // Allows the layout algorithm to further calculate small layout changes until the change amount
@@ -372,8 +1061,8 @@ void ForceDirectedLayout::oscillateChangeDetection()
     }
 }
 
-ForceDirectedLayoutFactory::ForceDirectedLayoutFactory(GraphModel* graphModel) :
-    LayoutFactory(graphModel), _displacements(graphModel->graph()), _attractiveForces(graphModel->graph())
+ForceDirectedLayoutFactory::ForceDirectedLayoutFactory(const Graph& graph) :
+    LayoutFactory(graph), _displacements(graph), _attractiveForces(graph)
 {
     _layoutSettings.registerSetting("ShortRangeRepulseTerm", QObject::tr("Local"),
         QObject::tr("The repulsive force between nodes that are near each other"),
@@ -387,7 +1076,7 @@ ForceDirectedLayoutFactory::ForceDirectedLayoutFactory(GraphModel* graphModel) :
 std::unique_ptr<Layout> ForceDirectedLayoutFactory::create(ComponentId componentId,
     NodeLayoutPositions& nodePositions, Layout::Dimensionality dimensionalityMode)
 {
-    const auto* component = _graphModel->graph().componentById(componentId);
+    const auto* component = _graph->componentById(componentId);
     return std::make_unique<ForceDirectedLayout>(*component,
         _displacements, _attractiveForces,
         nodePositions, dimensionalityMode, &_layoutSettings);
@@ -21,6 +21,7 @@
 #define FORCEDIRECTEDLAYOUT_H
 
 #include "layout.h"
+#include "barneshuttree.h"
 #include "app/graph/componentmanager.h"
 #include "shared/utils/circularbuffer.h"
 
@@ -56,7 +57,7 @@ private:
     CircularBuffer<float, FINETUNE_DELTA_SAMPLE_SIZE> _prevAvgForces;
     CircularBuffer<float, OSCILLATE_DELTA_SAMPLE_SIZE> _prevCaptureStdDevs;
 
-    enum class ChangeDetectionPhase { Initial, FineTune, Oscillate, Finished };
+    enum class ChangeDetectionPhase { Initial, FineTune, Oscillate, Incremental, Finished };
 
     std::atomic<ChangeDetectionPhase> _changeDetectionPhase = ChangeDetectionPhase::Initial;
 
@@ -71,27 +72,52 @@ private:
     size_t _increasingStdDevIterationCount = 0;
 
     bool _hasBeenFlattened = false;
+    bool _executed = false;
+
+    // These persist between iterations so that their storage can be reused
+    BarnesHutTree2D _barnesHutTree2D;
+    BarnesHutTree3D _barnesHutTree3D;
+
+    // During the Incremental phase only these nodes move, while the rest of the
+    // component is frozen, and so its tree only needs building when they change
+    std::vector<NodeId> _incrementalNodeIds;
+    NodeIdHashSet _incrementalNodeIdSet;
+    std::vector<QVector3D> _incrementalPositions;
+    size_t _incrementalIterationCount = 0;
+    bool _frozenTreeRequiresBuild = true;
+    BarnesHutTree2D _frozenBarnesHutTree2D;
+    BarnesHutTree3D _frozenBarnesHutTree3D;
+
+    PerformanceCounter _performanceCounter;
 
     void fineTuneChangeDetection();
     void oscillateChangeDetection();
     void initialChangeDetection();
     void finishChangeDetection();
 
+    void addIncrementalNodes(const std::vector<NodeId>& seedNodeIds, size_t numHops);
+    void endIncremental();
+
+    void multilevelInitialLayout(Dimensionality dimensionality, float shortRange, float longRange);
+
+    template<typename BarnesHutTreeType>
+    void computeRepulsiveForces(BarnesHutTreeType& barnesHutTree, float shortRange, float longRange);
+
+    template<typename BarnesHutTreeType>
+    void incrementalIteration(BarnesHutTreeType& frozenBarnesHutTree,
+        BarnesHutTreeType& barnesHutTree, float shortRange, float longRange);
+
 public:
     ForceDirectedLayout(const IGraphComponent& graphComponent,
                         ForceDirectedDisplacements& displacements,
                         EdgeArray<QVector3D>& attractiveForces,
                         NodeLayoutPositions& positions,
                         Layout::Dimensionality dimensionalityMode,
-                        const LayoutSettings* settings) :
-        Layout(graphComponent, positions, settings, Iterative::Yes,
-            Dimensionality::TwoOrThreeDee, 0.4f, 4),
-        _displacements(&displacements), _attractiveForces(&attractiveForces),
-        _hasBeenFlattened(dimensionalityMode == Layout::Dimensionality::TwoDee)
-    {}
+                        const LayoutSettings* settings);
 
     bool finished() const override { return _changeDetectionPhase == ChangeDetectionPhase::Finished; }
     void unfinish() override;
+    void reactivate(const std::vector<NodeId>& changedNodeIds) override;
 
     void execute(bool firstIteration, Dimensionality dimensionality) override;
 };
@@ -103,7 +129,7 @@ private:
     EdgeArray<QVector3D> _attractiveForces;
 
 public:
-    explicit ForceDirectedLayoutFactory(GraphModel* graphModel);
+    explicit ForceDirectedLayoutFactory(const Graph& graph);
 
     QString name() const override { return u"ForceDirected"_s; }
     QString displayName() const override { return QObject::tr("Force Directed"); }
@@ -28,6 +28,7 @@
 #include "shared/utils/performancecounter.h"
 #include "shared/utils/cancellable.h"
 #include "shared/utils/enumbitmask.h"
+#include "shared/utils/random.h"
 
 #include "layoutsettings.h"
 
@@ -36,9 +37,6 @@
 #include <QObject>
 
 #include <memory>
-#include <thread>
-#include <mutex>
-#include <condition_variable>
 #include <atomic>
 
 #include <algorithm>
@@ -46,6 +44,7 @@
 #include <cstdint>
 #include <set>
 #include <map>
+#include <vector>
 
 struct LayoutSettingKeyValue
 {
@@ -78,6 +77,7 @@ private:
     size_t _smoothing;
     const IGraphComponent* _graphComponent;
     NodeLayoutPositions* _positions;
+    u::RandomStream _randomStream;
 
 protected:
     const LayoutSettings* _settings;
@@ -108,6 +108,8 @@ public:
     const std::vector<NodeId>& nodeIds() const { return _graphComponent->nodeIds(); }
     const std::vector<EdgeId>& edgeIds() const { return _graphComponent->edgeIds(); }
 
+    u::RandomStream& randomStream() { return _randomStream; }
+
     virtual void execute(bool firstIteration, Dimensionality dimensionalityMode) = 0;
 
     // Indicates that the algorithm is doing no useful work
@@ -116,6 +118,10 @@ public:
     // Resets the state of the algorithm such that finished() no longer returns true
     virtual void unfinish() { qFatal("unfinish not implemented"); }
 
+    // Resets the state of the algorithm such that it lays out the given nodes, which have
+    // been affected by a change to the graph; by default this lays out everything again
+    virtual void reactivate(const std::vector<NodeId>&) { unfinish(); }
+
     virtual bool iterative() const { return _iterative == Iterative::Yes; }
     virtual Dimensionality dimensionality() const { return _dimensionality; }
 
@@ -123,17 +129,33 @@ signals:
     void progress(int percentage);
 };
 
-class GraphModel;
+// A layout is effectively finished when it has nothing to move
+bool layoutIsFinished(const Layout& layout);
+
+struct LayoutTask
+{
+    ComponentId _componentId;
+    Layout* _layout = nullptr;
+    bool _firstIteration = false;
+
+    uint64_t computeCostHint() const;
+};
+
+// Executes a single iteration of each task's layout; those that are costly are executed
+// one at a time, so that they can parallelise internally, and the rest concurrently
+void executeLayoutTasks(const std::vector<LayoutTask>& layoutTasks, Layout::Dimensionality dimensionalityMode);
+
+class Graph;
 
 class LayoutFactory
 {
 protected:
-    GraphModel* _graphModel = nullptr;
+    const Graph* _graph = nullptr;
     LayoutSettings _layoutSettings;
 
 public:
-    explicit LayoutFactory(GraphModel* graphModel) :
-        _graphModel(graphModel)
+    explicit LayoutFactory(const Graph& graph) :
+        _graph(&graph)
     {}
 
     virtual ~LayoutFactory() = default;
@@ -169,99 +191,4 @@ public:
         NodeLayoutPositions& results, Layout::Dimensionality dimensionalityMode) = 0;
 };
 
-class LayoutThread : public QObject
-{
-    Q_OBJECT
-
-    Q_PROPERTY(bool paused READ paused NOTIFY pausedChanged)
-
-private:
-    GraphModel* _graphModel = nullptr;
-    mutable std::mutex _mutex;
-    std::thread _thread;
-    bool _started = false;
-    bool _pause = false;
-    bool _paused = true;
-    bool _stop = false;
-    bool _repeating = false;
-    std::condition_variable _waitForPause;
-    std::condition_variable _waitForResume;
-
-    std::unique_ptr<LayoutFactory> _layoutFactory;
-    ComponentIdMap<std::unique_ptr<Layout>> _layouts;
-    ComponentArray<bool> _executedAtLeastOnce;
-
-    Layout::Dimensionality _dimensionalityMode =
-        Layout::Dimensionality::ThreeDee;
-
-    NodeLayoutPositions _nodeLayoutPositions;
-
-    PerformanceCounter _performanceCounter;
-
-    bool _layoutPotentiallyRequired = false;
-
-    int _debug = 0;
-
-public:
-    LayoutThread(GraphModel& graphModel,
-                 std::unique_ptr<LayoutFactory>&& layoutFactory,
-                 bool repeating = false);
-
-    ~LayoutThread() override
-    {
-        stop();
-
-        if(_thread.joinable())
-            _thread.join();
-    }
-
-    void pause();
-    void pauseAndWait();
-    bool paused() const;
-    void resume();
-
-    void start();
-    void stop();
-
-    bool finished() const;
-
-    void addAllComponents();
-
-    void setNodePositions(const ExactNodePositions& nodePositions);
-
-    Layout::Dimensionality dimensionalityMode();
-    void setDimensionalityMode(Layout::Dimensionality dimensionalityMode);
-
-    QString layoutName() const;
-    QString layoutDisplayName() const;
-
-    std::vector<LayoutSetting>& settings();
-    const LayoutSetting* setting(const QString& name) const;
-
-    void setSettingValue(const QString& name, float value);
-    void setSettingNormalisedValue(const QString& name, float normalisedValue);
-    void resetSettingValue(const QString& name);
-
-private:
-    bool iterative() const;
-    bool allLayoutsFinished() const;
-    bool workToDo() const;
-    void uncancel();
-    void unfinish();
-    void run();
-
-    void addComponent(ComponentId componentId);
-    void removeComponent(ComponentId componentId);
-
-private slots:
-    void onComponentSplit(const Graph*, const ComponentSplitSet& componentSplitSet);
-    void onComponentAdded(const Graph*, ComponentId componentId, bool);
-    void onComponentWillBeRemoved(const Graph*, ComponentId componentId, bool);
-
-signals:
-    void executed();
-    void pausedChanged();
-    void settingChanged(const QString& name, float value);
-};
-
 #endif // LAYOUT_H
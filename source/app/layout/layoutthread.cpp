@@ -0,0 +1,588 @@
+/* Copyright © 2013-2025 Tim Angus
+ * Copyright © 2013-2025 Tom Freeman
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "layoutthread.h"
+#include "shared/utils/thread.h"
+#include "shared/utils/container.h"
+#include "shared/utils/random.h"
+
+#include "app/graph/graph.h"
+#include "app/graph/graphmodel.h"
+#include "app/graph/componentmanager.h"
+
+#include <QDebug>
+
+#include <vector>
+
+using namespace Qt::Literals::StringLiterals;
+
+template<> constexpr bool EnableBitMaskOperators<Layout::Dimensionality> = true;
+
+LayoutThread::LayoutThread(GraphModel& graphModel,
+                           std::unique_ptr<LayoutFactory>&& layoutFactory,
+                           bool repeating) :
+    _graphModel(&graphModel),
+    _repeating(repeating),
+    _layoutFactory(std::move(layoutFactory)),
+    _executedAtLeastOnce(graphModel.graph()),
+    _nodeLayoutPositions(graphModel.graph()),
+    _edgeNodeIds(graphModel.graph()),
+    _performanceCounter(std::chrono::seconds(1)),
+    _debug(qEnvironmentVariableIntValue("LAYOUT_DEBUG"))
+{
+    _performanceCounter.setReportFn([this](float ticksPerSecond)
+    {
+        if(_debug > 1)
+        {
+            auto activeLayouts = std::count_if(_layouts.begin(), _layouts.end(),
+                                               [](auto& layout) { return !layoutIsFinished(*layout.second); });
+            qDebug() << activeLayouts << "layouts\t" << ticksPerSecond << "ips";
+        }
+    });
+
+    for(auto edgeId : graphModel.graph().edgeIds())
+    {
+        const auto& edge = graphModel.graph().edgeById(edgeId);
+        _edgeNodeIds[edgeId] = {edge.sourceId(), edge.targetId()};
+    }
+
+    connect(&graphModel.graph(), &Graph::graphChanged,
+    [this]
+    {
+        const std::unique_lock<std::mutex> lock(_mutex);
+        _layoutPotentiallyRequired = true;
+        findChangedNodes();
+    });
+
+    connect(&graphModel.graph(), &Graph::nodeAdded,
+    [this](const Graph*, NodeId nodeId)
+    {
+        _addedNodeIds.insert(nodeId);
+        _affectedNodeIds.insert(nodeId);
+    });
+
+    connect(&graphModel.graph(), &Graph::edgeAdded,
+    [this](const Graph* graph, EdgeId edgeId)
+    {
+        recordEdgeNodeIds(*graph, edgeId);
+    });
+
+    connect(&graphModel.graph(), &Graph::edgeRemoved,
+    [this](const Graph*, EdgeId edgeId)
+    {
+        auto& [sourceId, targetId] = _edgeNodeIds[edgeId];
+
+        if(!sourceId.isNull())
+        {
+            _affectedNodeIds.insert(sourceId);
+            _affectedNodeIds.insert(targetId);
+        }
+
+        sourceId.setToNull();
+        targetId.setToNull();
+    });
+
+    connect(&graphModel.graph(), &Graph::nodeRemoved,
+    [this](const Graph*, NodeId nodeId)
+    {
+        // The NodeId may be reused, in which case it will be a new node
+        _addedNodeIds.erase(nodeId);
+        _affectedNodeIds.erase(nodeId);
+    });
+
+    connect(&graphModel.graph(), &Graph::componentsWillMerge, this, &LayoutThread::onComponentsWillMerge, Qt::DirectConnection);
+    connect(&graphModel.graph(), &Graph::componentSplit, this, &LayoutThread::onComponentSplit, Qt::DirectConnection);
+    connect(&graphModel.graph(), &Graph::componentAdded, this, &LayoutThread::onComponentAdded, Qt::DirectConnection);
+    connect(&graphModel.graph(), &Graph::componentWillBeRemoved, this, &LayoutThread::onComponentWillBeRemoved, Qt::DirectConnection);
+    connect(this, &LayoutThread::executed, &graphModel, &GraphModel::onLayoutChanged, Qt::DirectConnection);
+
+    connect(&_layoutFactory->settings(), &LayoutSettings::settingChanged,
+    [this]
+    {
+        const std::unique_lock<std::mutex> lock(_mutex);
+
+        _layoutPotentiallyRequired = true;
+        unfinish();
+    });
+
+    connect(&_layoutFactory->settings(), &LayoutSettings::settingChanged,
+        this, &LayoutThread::settingChanged);
+}
+
+void LayoutThread::pause()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    if(_paused)
+        return;
+
+    _pause = true;
+
+    for(auto& layout : _layouts)
+        layout.second->cancel();
+
+    lock.unlock();
+}
+
+void LayoutThread::pauseAndWait()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    if(_paused)
+        return;
+
+    _pause = true;
+
+    for(auto& layout : _layouts)
+        layout.second->cancel();
+
+    _waitForPause.wait(lock);
+
+    lock.unlock();
+}
+
+bool LayoutThread::paused() const
+{
+    const std::unique_lock<std::mutex> lock(_mutex);
+    return _paused;
+}
+
+void LayoutThread::resume()
+{
+    if(!_started)
+    {
+        start();
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    if(!_paused)
+        return;
+
+    // Don't resume if there is nothing to do
+    if(!workToDo())
+        return;
+
+    // If the graph has changed, only the parts of it that were affected need laying out again
+    if(!_changedNodeIds.empty() || !_mergedComponentIds.empty())
+        reactivateChangedComponents();
+    else
+        unfinish();
+
+    _pause = false;
+
+    _waitForResume.notify_all();
+
+    lock.unlock();
+}
+
+void LayoutThread::start()
+{
+    _started = true;
+    _paused = false;
+
+    if(_thread.joinable())
+        _thread.join();
+
+    _thread = std::thread(&LayoutThread::run, this);
+}
+
+void LayoutThread::stop()
+{
+    const std::unique_lock<std::mutex> lock(_mutex);
+    _stop = true;
+    _pause = false;
+
+    for(auto& layout : _layouts)
+        layout.second->cancel();
+
+    _waitForResume.notify_all();
+}
+
+bool LayoutThread::finished() const
+{
+    const std::unique_lock<std::mutex> lock(_mutex);
+
+    return !workToDo();
+}
+
+bool LayoutThread::iterative() const
+{
+    return std::any_of(_layouts.begin(), _layouts.end(),
+    [](const auto& layout)
+    {
+       return layout.second->iterative();
+    });
+}
+
+void LayoutThread::uncancel()
+{
+    for(auto& layout : _layouts)
+        layout.second->uncancel();
+}
+
+void LayoutThread::unfinish()
+{
+    for(auto& layout : _layouts)
+        layout.second->unfinish();
+}
+
+bool LayoutThread::allLayoutsFinished() const
+{
+    return std::all_of(_layouts.begin(), _layouts.end(),
+    [](const auto& layout)
+    {
+       return layoutIsFinished(*layout.second);
+    });
+}
+
+bool LayoutThread::workToDo() const
+{
+    return _layoutPotentiallyRequired || !allLayoutsFinished();
+}
+
+void LayoutThread::run()
+{
+    emit pausedChanged();
+
+    do
+    {
+        u::setCurrentThreadName(u"Layout >"_s);
+
+        std::vector<LayoutTask> layoutTasks;
+        bool flatten = false;
+
+        for(auto& [componentId, layout] : _layouts)
+        {
+            if(layoutIsFinished(*layout))
+                continue;
+
+            // If we're in 2D mode and the layout can handle it, flatten the positions
+            if(_dimensionalityMode == Layout::Dimensionality::TwoDee &&
+               (layout->dimensionality() & _dimensionalityMode))
+            {
+                flatten = true;
+            }
+
+            layoutTasks.push_back({componentId, layout.get(), !_executedAtLeastOnce.get(componentId)});
+        }
+
+        if(flatten)
+            _nodeLayoutPositions.flatten();
+
+        executeLayoutTasks(layoutTasks, _dimensionalityMode);
+
+        for(const auto& layoutTask : layoutTasks)
+            _executedAtLeastOnce.set(layoutTask._componentId, true);
+
+        const bool requiresFlattening = _dimensionalityMode == Layout::Dimensionality::TwoDee &&
+            std::any_of(_layouts.begin(), _layouts.end(),
+            [](const auto& layout)
+            {
+                return layout.second->dimensionality() ==
+                    Layout::Dimensionality::ThreeDee;
+            });
+
+        _graphModel->nodePositions().update(_nodeLayoutPositions, requiresFlattening);
+        _graphModel->updateNodeSpatialIndexes();
+        emit executed();
+
+        _performanceCounter.tick();
+
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        _layoutPotentiallyRequired = false;
+
+        if(_stop)
+            break;
+
+        if(_pause || allLayoutsFinished() || (!iterative() && _repeating))
+        {
+            _paused = true;
+            emit pausedChanged();
+
+            if(_debug != 0)
+            {
+                const auto* reason = _pause ? "manually" :
+                    allLayoutsFinished() ? "because all layouts finished" :
+                    "";
+                qDebug() << "Layout paused" << reason;
+            }
+
+            u::setCurrentThreadName(u"Layout ||"_s);
+            uncancel();
+            _waitForPause.notify_all();
+            _waitForResume.wait(lock);
+
+            _paused = false;
+            emit pausedChanged();
+
+            if(_debug != 0) qDebug() << "Layout resumed";
+        }
+
+        std::this_thread::yield();
+    }
+    while(iterative() || _repeating || allLayoutsFinished());
+
+    const std::unique_lock<std::mutex> lock(_mutex);
+    _layouts.clear();
+    _started = false;
+    _paused = true;
+    _waitForPause.notify_all();
+
+    if(_debug != 0) qDebug() << "Layout stopped";
+}
+
+void LayoutThread::addComponent(ComponentId componentId)
+{
+    if(!u::contains(_layouts, componentId))
+    {
+        const std::unique_lock<std::mutex> lock(_mutex);
+
+        auto layout = _layoutFactory->create(componentId,
+            _nodeLayoutPositions, _dimensionalityMode);
+
+        _graphModel->nodePositions().setScale(layout->scaling());
+        _graphModel->nodePositions().setSmoothing(layout->smoothing());
+        _layouts.emplace(componentId, std::move(layout));
+    }
+}
+
+void LayoutThread::addAllComponents()
+{
+    for(const ComponentId componentId : _graphModel->graph().componentIds())
+        addComponent(componentId);
+}
+
+void LayoutThread::setNodePositions(const ExactNodePositions& nodePositions)
+{
+    _nodeLayoutPositions.set(_graphModel->graph().nodeIds(), nodePositions);
+    _graphModel->nodePositions().update(_nodeLayoutPositions);
+
+    // Stop the layouts throwing away our newly set positions
+    _executedAtLeastOnce.fill(true);
+}
+
+Layout::Dimensionality LayoutThread::dimensionalityMode()
+{
+    return _dimensionalityMode;
+}
+
+void LayoutThread::setDimensionalityMode(Layout::Dimensionality dimensionalityMode)
+{
+    Q_ASSERT(dimensionalityMode != Layout::Dimensionality::TwoOrThreeDee);
+
+    if(dimensionalityMode == _dimensionalityMode)
+        return;
+
+    _dimensionalityMode = dimensionalityMode;
+    _layoutPotentiallyRequired = true;
+
+    // Everything is going to move, so incremental layout is moot
+    _changedNodeIds.clear();
+    _mergedComponentIds.clear();
+}
+
+QString LayoutThread::layoutName() const
+{
+    return _layoutFactory->name();
+}
+
+QString LayoutThread::layoutDisplayName() const
+{
+    return _layoutFactory->displayName();
+}
+
+void LayoutThread::removeComponent(ComponentId componentId)
+{
+    bool resumeAfterRemoval = false;
+
+    if(!paused())
+    {
+        pauseAndWait();
+        resumeAfterRemoval = true;
+    }
+
+    if(u::contains(_layouts, componentId))
+    {
+        const std::unique_lock<std::mutex> lock(_mutex);
+        _layouts.erase(componentId);
+    }
+
+    if(resumeAfterRemoval)
+        resume();
+}
+
+void LayoutThread::recordEdgeNodeIds(const Graph& graph, EdgeId edgeId)
+{
+    const auto& edge = graph.edgeById(edgeId);
+    auto& [sourceId, targetId] = _edgeNodeIds[edgeId];
+
+    // If the EdgeId was reused without its removal being signalled,
+    // the nodes it previously connected are affected too
+    if(!sourceId.isNull())
+    {
+        _affectedNodeIds.insert(sourceId);
+        _affectedNodeIds.insert(targetId);
+    }
+
+    sourceId = edge.sourceId();
+    targetId = edge.targetId();
+
+    _affectedNodeIds.insert(sourceId);
+    _affectedNodeIds.insert(targetId);
+}
+
+void LayoutThread::findChangedNodes()
+{
+    const auto& graph = _graphModel->graph();
+    std::vector<NodeId> newNodeIds;
+
+    for(auto nodeId : _affectedNodeIds)
+    {
+        if(!graph.containsNodeId(nodeId))
+            continue;
+
+        if(u::contains(_addedNodeIds, nodeId))
+            newNodeIds.push_back(nodeId);
+
+        _changedNodeIds[graph.componentIdOfNode(nodeId)].push_back(nodeId);
+    }
+
+    _addedNodeIds.clear();
+    _affectedNodeIds.clear();
+
+    if(!newNodeIds.empty())
+        placeNewNodes(newNodeIds);
+}
+
+// New nodes are placed near to their existing neighbours, if they have any, so that they don't
+// begin wherever their NodeId's previous occupant happened to be, which would typically
+// mean tearing across the component, and then prompting it to be laid out again in full
+void LayoutThread::placeNewNodes(const std::vector<NodeId>& nodeIds)
+{
+    const auto& graph = _graphModel->graph();
+    NodeIdHashSet unplacedNodeIds(nodeIds.begin(), nodeIds.end());
+
+    // Each pass places the nodes that are adjacent to placed nodes, so that
+    // chains of new nodes extend outwards from the existing nodes
+    bool nodesPlaced = true;
+    while(nodesPlaced && !unplacedNodeIds.empty())
+    {
+        std::vector<std::pair<NodeId, QVector3D>> placements;
+
+        for(auto nodeId : unplacedNodeIds)
+        {
+            QVector3D centre;
+            int numPlacedNeighbours = 0;
+
+            for(auto neighbourId : graph.neighboursOf(nodeId))
+            {
+                if(unplacedNodeIds.contains(neighbourId))
+                    continue;
+
+                centre += _nodeLayoutPositions.get(neighbourId);
+                numPlacedNeighbours++;
+            }
+
+            if(numPlacedNeighbours == 0)
+                continue;
+
+            auto position = (centre / static_cast<float>(numPlacedNeighbours)) + u::randQVector3D(-1.0f, 1.0f);
+
+            if(_dimensionalityMode == Layout::Dimensionality::TwoDee)
+                position.setZ(0.0f);
+
+            placements.emplace_back(nodeId, position);
+        }
+
+        for(const auto& [nodeId, position] : placements)
+        {
+            _nodeLayoutPositions[nodeId].fill(position);
+            unplacedNodeIds.erase(nodeId);
+        }
+
+        nodesPlaced = !placements.empty();
+    }
+}
+
+void LayoutThread::reactivateChangedComponents()
+{
+    for(auto& [componentId, layout] : _layouts)
+    {
+        // Merged components have been laid out independently of each other,
+        // likely overlapping, so they can only be fixed by a full layout
+        if(_mergedComponentIds.contains(componentId))
+            layout->unfinish();
+        else if(_executedAtLeastOnce.get(componentId) && u::contains(_changedNodeIds, componentId))
+            layout->reactivate(_changedNodeIds.at(componentId));
+    }
+
+    _changedNodeIds.clear();
+    _mergedComponentIds.clear();
+}
+
+void LayoutThread::onComponentsWillMerge(const Graph*, const ComponentMergeSet& componentMergeSet)
+{
+    _mergedComponentIds.insert(componentMergeSet.newComponentId());
+}
+
+void LayoutThread::onComponentSplit(const Graph*, const ComponentSplitSet& componentSplitSet)
+{
+    // When a component splits and it has already had a layout iteration, all the splitees
+    // have therefore also had an iteration
+    if(_executedAtLeastOnce.get(componentSplitSet.oldComponentId()))
+    {
+        for(auto componentId : componentSplitSet.splitters())
+            _executedAtLeastOnce.set(componentId, true);
+    }
+}
+
+void LayoutThread::onComponentAdded(const Graph*, ComponentId componentId, bool)
+{
+    addComponent(componentId);
+}
+
+void LayoutThread::onComponentWillBeRemoved(const Graph*, ComponentId componentId, bool)
+{
+    removeComponent(componentId);
+}
+
+std::vector<LayoutSetting>& LayoutThread::settings()
+{
+    return _layoutFactory->settings().vector();
+}
+
+const LayoutSetting* LayoutThread::setting(const QString& name) const
+{
+    return _layoutFactory->setting(name);
+}
+
+void LayoutThread::setSettingValue(const QString& name, float value)
+{
+    _layoutFactory->setSettingValue(name, value);
+}
+
+void LayoutThread::setSettingNormalisedValue(const QString& name, float normalisedValue)
+{
+    _layoutFactory->setSettingNormalisedValue(name, normalisedValue);
+}
+
+void LayoutThread::resetSettingValue(const QString& name)
+{
+    _layoutFactory->resetSettingValue(name);
+}
@@ -0,0 +1,150 @@
+/* Copyright © 2013-2025 Tim Angus
+ * Copyright © 2013-2025 Tom Freeman
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LAYOUTTHREAD_H
+#define LAYOUTTHREAD_H
+
+#include "layout.h"
+
+#include "shared/graph/elementid_containers.h"
+#include "shared/utils/performancecounter.h"
+
+#include <QObject>
+
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <utility>
+
+class GraphModel;
+
+class LayoutThread : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(bool paused READ paused NOTIFY pausedChanged)
+
+private:
+    GraphModel* _graphModel = nullptr;
+    mutable std::mutex _mutex;
+    std::thread _thread;
+    bool _started = false;
+    bool _pause = false;
+    bool _paused = true;
+    bool _stop = false;
+    bool _repeating = false;
+    std::condition_variable _waitForPause;
+    std::condition_variable _waitForResume;
+
+    std::unique_ptr<LayoutFactory> _layoutFactory;
+    ComponentIdMap<std::unique_ptr<Layout>> _layouts;
+    ComponentArray<bool> _executedAtLeastOnce;
+
+    Layout::Dimensionality _dimensionalityMode =
+        Layout::Dimensionality::ThreeDee;
+
+    NodeLayoutPositions _nodeLayoutPositions;
+
+    // The endpoints of each edge, recorded when it is added, because by the time
+    // an edge's removal is signalled they can no longer be queried from the graph
+    EdgeArray<std::pair<NodeId, NodeId>> _edgeNodeIds;
+
+    // The nodes touched by the changes since the graph last changed
+    NodeIdSet _addedNodeIds;
+    NodeIdSet _affectedNodeIds;
+    ComponentIdMap<std::vector<NodeId>> _changedNodeIds;
+    ComponentIdSet _mergedComponentIds;
+
+    PerformanceCounter _performanceCounter;
+
+    bool _layoutPotentiallyRequired = false;
+
+    int _debug = 0;
+
+public:
+    LayoutThread(GraphModel& graphModel,
+                 std::unique_ptr<LayoutFactory>&& layoutFactory,
+                 bool repeating = false);
+
+    ~LayoutThread() override
+    {
+        stop();
+
+        if(_thread.joinable())
+            _thread.join();
+    }
+
+    void pause();
+    void pauseAndWait();
+    bool paused() const;
+    void resume();
+
+    void start();
+    void stop();
+
+    bool finished() const;
+
+    void addAllComponents();
+
+    void setNodePositions(const ExactNodePositions& nodePositions);
+
+    Layout::Dimensionality dimensionalityMode();
+    void setDimensionalityMode(Layout::Dimensionality dimensionalityMode);
+
+    QString layoutName() const;
+    QString layoutDisplayName() const;
+
+    std::vector<LayoutSetting>& settings();
+    const LayoutSetting* setting(const QString& name) const;
+
+    void setSettingValue(const QString& name, float value);
+    void setSettingNormalisedValue(const QString& name, float normalisedValue);
+    void resetSettingValue(const QString& name);
+
+private:
+    bool iterative() const;
+    bool allLayoutsFinished() const;
+    bool workToDo() const;
+    void uncancel();
+    void unfinish();
+    void run();
+
+    void addComponent(ComponentId componentId);
+    void removeComponent(ComponentId componentId);
+
+    void recordEdgeNodeIds(const Graph& graph, EdgeId edgeId);
+    void findChangedNodes();
+    void placeNewNodes(const std::vector<NodeId>& nodeIds);
+    void reactivateChangedComponents();
+
+private slots:
+    void onComponentsWillMerge(const Graph*, const ComponentMergeSet& componentMergeSet);
+    void onComponentSplit(const Graph*, const ComponentSplitSet& componentSplitSet);
+    void onComponentAdded(const Graph*, ComponentId componentId, bool);
+    void onComponentWillBeRemoved(const Graph*, ComponentId componentId, bool);
+
+signals:
+    void executed();
+    void pausedChanged();
+    void settingChanged(const QString& name, float value);
+};
+
+#endif // LAYOUTTHREAD_H
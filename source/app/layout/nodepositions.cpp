@@ -19,76 +19,152 @@
 
 #include "nodepositions.h"
 
+#include "shared/utils/threadpool.h"
+
+#include <algorithm>
 #include <cmath>
 #include <numeric>
+#include <thread>
 
-QVector3D NodePositions::getNoLocking(NodeId nodeId) const
+const NodePositions::Buffer& NodePositions::acquire() const
 {
-    return elementFor(nodeId).mean(_smoothing) * _scale;
+    while(true)
+    {
+        const auto index = _latest.load();
+        const auto& buffer = _buffers.at(index);
+
+        buffer._numReaders++;
+
+        // If an update has been published in the meantime, this buffer may already be
+        // in the process of being overwritten, in which case try again with the new one
+        if(_latest.load() == index)
+            return buffer;
+
+        buffer._numReaders--;
+    }
 }
 
-const QVector3D& NodePositions::getNewestNoLocking(NodeId nodeId) const
+NodePositions::Snapshot::~Snapshot()
 {
-    return elementFor(nodeId).newest();
+    if(_buffer != nullptr)
+        _buffer->_numReaders--;
 }
 
-void NodePositions::lock() const
+QVector3D NodePositions::Snapshot::get(NodeId nodeId) const
 {
-    _mutex.lock();
-    _threadId = std::this_thread::get_id();
+    Q_ASSERT(!nodeId.isNull());
+    const auto index = static_cast<size_t>(nodeId);
+
+    // Nodes added since the last update have no position yet
+    if(index >= _buffer->_positions.size())
+        return {};
+
+    return _buffer->_positions[index];
 }
 
-void NodePositions::unlock() const
+QVector3D NodePositions::Snapshot::rawPosition(NodeId nodeId) const
 {
-    _threadId = {};
-    _mutex.unlock();
+    Q_ASSERT(!nodeId.isNull());
+    const auto index = static_cast<size_t>(nodeId);
+
+    if(index >= _buffer->_rawPositions.size())
+        return {};
+
+    return _buffer->_rawPositions[index];
 }
 
-bool NodePositions::unlocked() const
+NodePositions::Snapshot NodePositions::snapshot() const
 {
-    return _threadId == std::thread::id{};
+    return Snapshot(acquire());
 }
 
 QVector3D NodePositions::get(NodeId nodeId) const
 {
-    const std::unique_lock<const NodePositions> lock(*this);
-
-    return getNoLocking(nodeId);
+    return snapshot().get(nodeId);
 }
 
 std::vector<QVector3D> NodePositions::get(const std::vector<NodeId>& nodeIds) const
 {
-    const std::unique_lock<const NodePositions> lock(*this);
+    const auto nodePositions = snapshot();
 
     std::vector<QVector3D> positions;
     positions.reserve(nodeIds.size());
 
     for(auto nodeId : nodeIds)
-        positions.emplace_back(getNoLocking(nodeId));
+        positions.emplace_back(nodePositions.get(nodeId));
 
     return positions;
 }
 
-void NodePositions::flatten()
+// Elements are published in blocks of this many, concurrently
+static const size_t UPDATE_BLOCK_SIZE = 16384;
+
+void NodePositions::update(const NodeLayoutPositions& layoutPositions, bool flatten)
 {
-    const std::unique_lock<std::recursive_mutex> lock(_mutex);
+    const std::unique_lock<std::mutex> lock(_updateMutex);
 
-    generate([this](NodeId nodeId)
+    const auto latest = _latest.load();
+
+    // Find a buffer that isn't the latest and has no readers; since it isn't the latest,
+    // no new readers can begin using it, so it's safe to overwrite
+    auto index = latest;
+    while(index == latest)
     {
-        auto positions = elementFor(nodeId);
+        for(size_t i = 0; i < NUM_BUFFERS; i++)
+        {
+            if(i != latest && _buffers.at(i)._numReaders == 0)
+            {
+                index = i;
+                break;
+            }
+        }
+
+        if(index == latest)
+            std::this_thread::yield();
+    }
 
-        for(size_t i = 0; i < positions.size(); i++)
-            positions.at(i).setZ(0.0f);
+    auto& buffer = _buffers.at(index);
+    const auto& layoutArray = layoutPositions._array;
+    const auto size = layoutArray.size();
+    const auto smoothing = _smoothing.load();
+    const auto scale = _scale.load();
 
-        return positions;
-    });
-}
+    buffer._positions.resize(size);
+    buffer._rawPositions.resize(size);
 
-void NodePositions::update(const NodePositions& other)
-{
-    const std::unique_lock<const NodePositions> lock(*this);
+    std::vector<size_t> blockStarts((size + UPDATE_BLOCK_SIZE - 1) / UPDATE_BLOCK_SIZE);
+    for(size_t i = 0; i < blockStarts.size(); i++)
+        blockStarts[i] = i * UPDATE_BLOCK_SIZE;
+
+    if(!blockStarts.empty())
+    {
+        // The smoothing is done here, once per update, rather than on every read
+        parallel_for(blockStarts.begin(), blockStarts.end(),
+        [&](size_t blockStart)
+        {
+            const auto blockEnd = std::min(blockStart + UPDATE_BLOCK_SIZE, size);
+
+            for(size_t i = blockStart; i < blockEnd; i++)
+            {
+                auto position = layoutArray[i].mean(smoothing) * scale;
+                auto rawPosition = layoutArray[i].newest();
+
+                if(flatten)
+                {
+                    position.setZ(0.0f);
+                    rawPosition.setZ(0.0f);
+                }
+
+                buffer._positions[i] = position;
+                buffer._rawPositions[i] = rawPosition;
+            }
+        });
+    }
+
+    buffer._version = _version + 1;
 
-    _array = other._array;
+    _latest = index;
+    _version++;
 }
 
 template<typename GetFn>
@@ -105,28 +181,23 @@ static QVector3D centreOfMassWithFn(const std::vector<NodeId>& nodeIds, const Ge
 
 QVector3D NodePositions::centreOfMass(const std::vector<NodeId>& nodeIds) const
 {
-    const std::unique_lock<const NodePositions> lock(*this);
+    const auto nodePositions = snapshot();
 
-    return centreOfMassWithFn(nodeIds, [this](NodeId nodeId) { return getNoLocking(nodeId); });
+    return centreOfMassWithFn(nodeIds, [&nodePositions](NodeId nodeId) { return nodePositions.get(nodeId); });
 }
 
-const QVector3D& NodePositions::at(NodeId nodeId) const
+QVector3D NodePositions::at(NodeId nodeId) const
 {
-    const std::unique_lock<const NodePositions> lock(*this);
-
-    return getNewestNoLocking(nodeId);
+    return snapshot().rawPosition(nodeId);
 }
 
 const QVector3D& NodeLayoutPositions::get(NodeId nodeId) const
 {
-    Q_ASSERT(unlocked());
-
-    return getNewestNoLocking(nodeId);
+    return elementFor(nodeId).newest();
 }
 
 void NodeLayoutPositions::set(NodeId nodeId, const QVector3D& position)
 {
-    Q_ASSERT(unlocked());
     Q_ASSERT(!std::isnan(position.x()) && !std::isnan(position.y()) && !std::isnan(position.z()));
 
     elementFor(nodeId).push_back(position);
@@ -134,8 +205,6 @@ void NodeLayoutPositions::set(NodeId nodeId, const QVector3D& position)
 
 void NodeLayoutPositions::set(const std::vector<NodeId>& nodeIds, const ExactNodePositions& nodePositions)
 {
-    Q_ASSERT(unlocked());
-
     for(auto nodeId : nodeIds)
     {
         auto position = nodePositions.at(nodeId);
@@ -145,23 +214,32 @@ void NodeLayoutPositions::set(const std::vector<NodeId>& nodeIds, const ExactNod
     }
 }
 
-QVector3D NodeLayoutPositions::centreOfMass(const std::vector<NodeId>& nodeIds) const
+void NodeLayoutPositions::flatten()
 {
-    Q_ASSERT(unlocked());
+    generate([this](NodeId nodeId)
+    {
+        auto positions = elementFor(nodeId);
+
+        for(size_t i = 0; i < positions.size(); i++)
+            positions.at(i).setZ(0.0f);
 
-    return centreOfMassWithFn(nodeIds, [this](NodeId nodeId) { return getNewestNoLocking(nodeId); });
+        return positions;
+    });
 }
 
-BoundingBox3D NodeLayoutPositions::boundingBox(const std::vector<NodeId>& nodeIds) const
+QVector3D NodeLayoutPositions::centreOfMass(const std::vector<NodeId>& nodeIds) const
 {
-    Q_ASSERT(unlocked());
+    return centreOfMassWithFn(nodeIds, [this](NodeId nodeId) { return get(nodeId); });
+}
 
+BoundingBox3D NodeLayoutPositions::boundingBox(const std::vector<NodeId>& nodeIds) const
+{
     if(nodeIds.empty())
         return {};
 
     Q_ASSERT(!nodeIds.empty());
 
-    auto firstPosition = getNewestNoLocking(nodeIds.front());
+    auto firstPosition = get(nodeIds.front());
     BoundingBox3D boundingBox(firstPosition, firstPosition);
 
     for(const NodeId nodeId : nodeIds)
@@ -26,8 +26,10 @@
 #include "app/maths/boundingbox.h"
 
 #include <array>
+#include <atomic>
 #include <mutex>
-#include <thread>
+#include <utility>
+#include <vector>
 
 #include <QVector3D>
 
@@ -36,26 +38,86 @@ static const int MAX_SMOOTHING = 8;
 class MeanPosition : public CircularBuffer<QVector3D, MAX_SMOOTHING>
 { public: MeanPosition() { push_back({}); } };
 
-class NodePositions : public NodeArray<MeanPosition>
+using ExactNodePositions = NodeArray<QVector3D>;
+
+// The positions that the layout algorithms work on; these are only
+// accessed by the layout, so they are read and written without locking
+class NodeLayoutPositions : public NodeArray<MeanPosition>
+{
+    friend class NodePositions;
+
+public:
+    using NodeArray::NodeArray;
+    using NodeArray::set;
+
+    // These accessors get and set the raw node positions, i.e. before
+    // they are scaled and/or smoothed
+    const QVector3D& get(NodeId nodeId) const;
+    void set(NodeId nodeId, const QVector3D& position);
+    void set(const std::vector<NodeId>& nodeIds, const ExactNodePositions& nodePositions);
+
+    void flatten();
+
+    QVector3D centreOfMass(const std::vector<NodeId>& nodeIds) const;
+    BoundingBox3D boundingBox(const std::vector<NodeId>& nodeIds) const;
+};
+
+// The positions published by the layout, for everything else to read. Each update writes
+// a complete, scaled and smoothed copy of the layout positions into a buffer that no reader
+// is using, then atomically makes it the latest. Readers therefore never block, neither the
+// layout nor each other, and never see a partially updated set of positions.
+class NodePositions
 {
 private:
-    mutable std::recursive_mutex _mutex;
-    mutable std::thread::id _threadId;
+    static constexpr size_t NUM_BUFFERS = 3;
+
+    struct Buffer
+    {
+        std::vector<QVector3D> _positions;
+        std::vector<QVector3D> _rawPositions;
+        size_t _version = 0;
+        mutable std::atomic<int> _numReaders = 0;
+    };
+
+    std::array<Buffer, NUM_BUFFERS> _buffers;
+    std::atomic<size_t> _latest = 0;
+    std::atomic<size_t> _version = 0;
 
-    float _scale = 1.0f;
-    size_t _smoothing = 1;
+    // Serialises updates only; readers never take it
+    std::mutex _updateMutex;
 
-    QVector3D getNoLocking(NodeId nodeId) const;
+    std::atomic<float> _scale = 1.0f;
+    std::atomic<size_t> _smoothing = 1;
 
-protected:
-    const QVector3D& getNewestNoLocking(NodeId nodeId) const;
+    const Buffer& acquire() const;
 
 public:
-    using NodeArray::NodeArray;
+    // A consistent view of the latest positions, which remains valid
+    // for the lifetime of the Snapshot, even if they are updated again
+    class Snapshot
+    {
+        friend class NodePositions;
+
+    private:
+        const Buffer* _buffer = nullptr;
 
-    void lock() const;
-    void unlock() const;
-    bool unlocked() const;
+        explicit Snapshot(const Buffer& buffer) : _buffer(&buffer) {}
+
+    public:
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+        Snapshot(Snapshot&& other) noexcept : _buffer(std::exchange(other._buffer, nullptr)) {}
+        Snapshot& operator=(Snapshot&&) = delete;
+        ~Snapshot();
+
+        QVector3D get(NodeId nodeId) const;
+        QVector3D rawPosition(NodeId nodeId) const;
+
+        // The version() at which these positions were published
+        size_t version() const { return _buffer->_version; }
+    };
+
+    Snapshot snapshot() const;
 
     void setScale(float scale) { _scale = scale; }
     float scale() const { return _scale; }
@@ -66,44 +128,18 @@ public:
     QVector3D get(NodeId nodeId) const;
     std::vector<QVector3D> get(const std::vector<NodeId>& nodeIds) const;
 
-    void flatten();
+    // Publish layoutPositions; this blocks only if every buffer besides
+    // the latest is still being read, which should be momentary
+    void update(const NodeLayoutPositions& layoutPositions, bool flatten = false);
 
-    void update(const NodePositions& other);
+    // Incremented by every update, so that anything derived from
+    // the positions can tell when it needs to be recomputed
+    size_t version() const { return _version; }
 
     QVector3D centreOfMass(const std::vector<NodeId>& nodeIds) const;
 
-    // This is only here as NativeSaver requires its interface
-    const QVector3D& at(NodeId nodeId) const;
-
-    // Delete base accessors that could be harmful
-    MeanPosition& operator[](NodeId nodeId) = delete;
-    const MeanPosition& operator[](NodeId nodeId) const = delete;
-    MeanPosition& at(NodeId nodeId) = delete;
-};
-
-using ExactNodePositions = NodeArray<QVector3D>;
-
-// This interface is exposed to the Layout algorithms only, giving
-// them a fast interface to getting and setting node positions,
-// without needing to lock
-class NodeLayoutPositions : public NodePositions
-{
-public:
-    using NodePositions::NodePositions;
-    using NodePositions::set;
-
-    // These accessors get and set the raw node positions, i.e. before
-    // they are scaled and/or smoothed
-    const QVector3D& get(NodeId nodeId) const;
-    void set(NodeId nodeId, const QVector3D& position);
-    void set(const std::vector<NodeId>& nodeIds, const ExactNodePositions& nodePositions);
-
-    QVector3D centreOfMass(const std::vector<NodeId>& nodeIds) const;
-    BoundingBox3D boundingBox(const std::vector<NodeId>& nodeIds) const;
+    // The raw position; this is only here as NativeSaver requires its interface
+    QVector3D at(NodeId nodeId) const;
 };
 
-// Ensure data members aren't added to NodeLayoutPositions, so that
-// NodePositions::update doesn't slice
-static_assert(sizeof(NodePositions) == sizeof(NodeLayoutPositions));
-
 #endif // NODEPOSITIONS_H
@@ -0,0 +1,129 @@
+/* Copyright © 2013-2025 Tim Angus
+ * Copyright © 2013-2025 Tom Freeman
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nodespatialindex.h"
+
+#include <QtGlobal>
+
+#include <algorithm>
+#include <numeric>
+
+// Once refitting has made the tree this much less efficient than it was
+// when built, it's worth the cost of rebuilding it from scratch
+static const float MAX_REFIT_COST_RATIO = 2.0f;
+
+uint32_t NodeSpatialIndex::build(uint32_t first, uint32_t last)
+{
+    const auto index = static_cast<uint32_t>(_treeNodes.size());
+    _treeNodes.emplace_back();
+
+    if(last - first <= MAX_NODES_PER_LEAF)
+    {
+        _treeNodes[index]._first = first;
+        _treeNodes[index]._count = last - first;
+        return index;
+    }
+
+    const auto& firstPosition = _positions[_order[first]];
+    BoundingBox3D centreBoundingBox(firstPosition, firstPosition);
+    for(auto i = first + 1; i < last; i++)
+        centreBoundingBox.expandToInclude(_positions[_order[i]]);
+
+    int axis = 0;
+    if(centreBoundingBox.yLength() > centreBoundingBox.xLength())
+        axis = 1;
+    if(centreBoundingBox.zLength() > std::max(centreBoundingBox.xLength(), centreBoundingBox.yLength()))
+        axis = 2;
+
+    // Splitting at the median guarantees a balanced tree, whatever the distribution of nodes
+    const auto middle = first + ((last - first) / 2);
+    std::nth_element(_order.begin() + first, _order.begin() + middle, _order.begin() + last,
+    [this, axis](uint32_t a, uint32_t b)
+    {
+        return _positions[a][axis] < _positions[b][axis];
+    });
+
+    build(first, middle);
+    const auto right = build(middle, last);
+    _treeNodes[index]._right = right;
+
+    return index;
+}
+
+float NodeSpatialIndex::refit(const std::vector<float>& radii)
+{
+    float cost = 0.0f;
+
+    // Children always follow their parents, so working backwards visits them first
+    for(auto index = _treeNodes.size(); index-- > 0;)
+    {
+        auto& treeNode = _treeNodes[index];
+
+        if(treeNode.isLeaf())
+        {
+            for(auto i = treeNode._first; i < treeNode._first + treeNode._count; i++)
+            {
+                const auto& position = _positions[_order[i]];
+                const auto radius = radii[_order[i]];
+                const BoundingBox3D boundingBox(position - QVector3D(radius, radius, radius),
+                    position + QVector3D(radius, radius, radius));
+
+                if(i == treeNode._first)
+                    treeNode._boundingBox = boundingBox;
+                else
+                    treeNode._boundingBox.expandToInclude(boundingBox);
+            }
+
+            continue;
+        }
+
+        treeNode._boundingBox = _treeNodes[index + 1]._boundingBox;
+        treeNode._boundingBox.expandToInclude(_treeNodes[treeNode._right]._boundingBox);
+
+        const auto& boundingBox = treeNode._boundingBox;
+        cost += boundingBox.xLength() * boundingBox.yLength() +
+            boundingBox.yLength() * boundingBox.zLength() +
+            boundingBox.zLength() * boundingBox.xLength();
+    }
+
+    return cost;
+}
+
+void NodeSpatialIndex::update(const NodePositions::Snapshot& nodePositions, const std::vector<float>& radii)
+{
+    Q_ASSERT(radii.size() == _nodeIds.size());
+
+    _positions.resize(_nodeIds.size());
+    for(size_t i = 0; i < _nodeIds.size(); i++)
+        _positions[i] = nodePositions.get(_nodeIds[i]);
+
+    if(!_treeNodes.empty() && refit(radii) <= _builtCost * MAX_REFIT_COST_RATIO)
+        return;
+
+    _treeNodes.clear();
+
+    if(_nodeIds.empty())
+        return;
+
+    _order.resize(_nodeIds.size());
+    std::iota(_order.begin(), _order.end(), 0u);
+
+    build(0, static_cast<uint32_t>(_order.size()));
+    _builtCost = refit(radii);
+}
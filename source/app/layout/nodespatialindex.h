@@ -0,0 +1,179 @@
+/* Copyright © 2013-2025 Tim Angus
+ * Copyright © 2013-2025 Tom Freeman
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NODESPATIALINDEX_H
+#define NODESPATIALINDEX_H
+
+#include "shared/graph/elementid.h"
+#include "app/layout/nodepositions.h"
+#include "app/maths/boundingbox.h"
+
+#include <QVector3D>
+
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// A bounding volume hierarchy over the nodes of a component, each node being treated as a
+// sphere of its visual size. Building the hierarchy costs O(n log n), but as the nodes move
+// it can usually be refitted in O(n) instead; either way, this need only happen when new
+// positions are published, rather than for every query. Queries then descend only into the
+// subtrees whose bounds pass some test, so typically visit O(log n) of them. The index keeps
+// the positions it was last updated with, and queries are answered with those, so that they
+// always agree with the bounds, however many times the positions have been published since.
+class NodeSpatialIndex
+{
+private:
+    static constexpr uint32_t MAX_NODES_PER_LEAF = 8;
+
+    // Stored in depth first order, so each internal tree node's left child immediately
+    // follows it; leaves cover a contiguous range of _order, and have no right child
+    struct TreeNode
+    {
+        BoundingBox3D _boundingBox;
+        uint32_t _first = 0;
+        uint32_t _count = 0;
+        uint32_t _right = 0;
+
+        bool isLeaf() const { return _right == 0; }
+    };
+
+    std::vector<NodeId> _nodeIds;
+
+    // Corresponding to _nodeIds
+    std::vector<QVector3D> _positions;
+
+    // Indices into _nodeIds, in tree order
+    std::vector<uint32_t> _order;
+
+    std::vector<TreeNode> _treeNodes;
+
+    // The sum of the internal nodes' surface areas when the tree was last built, for
+    // judging how much less efficient at culling refitting has since made it
+    float _builtCost = 0.0f;
+
+    uint32_t build(uint32_t first, uint32_t last);
+    float refit(const std::vector<float>& radii);
+
+public:
+    explicit NodeSpatialIndex(const std::vector<NodeId>& nodeIds) :
+        _nodeIds(nodeIds)
+    {}
+
+    const std::vector<NodeId>& nodeIds() const { return _nodeIds; }
+
+    // radii correspond to nodeIds()
+    void update(const NodePositions::Snapshot& nodePositions, const std::vector<float>& radii);
+
+    // Calls fn with each node, and its position, in every leaf whose bounding box passes boxTest
+    template<typename BoxTestFn, typename Fn>
+    void forEach(const BoxTestFn& boxTest, const Fn& fn) const
+    {
+        if(_treeNodes.empty())
+            return;
+
+        std::vector<uint32_t> stack{0};
+
+        while(!stack.empty())
+        {
+            const auto index = stack.back();
+            const auto& treeNode = _treeNodes[index];
+            stack.pop_back();
+
+            if(!boxTest(treeNode._boundingBox))
+                continue;
+
+            if(treeNode.isLeaf())
+            {
+                for(auto i = treeNode._first; i < treeNode._first + treeNode._count; i++)
+                    fn(_nodeIds[_order[i]], _positions[_order[i]]);
+
+                continue;
+            }
+
+            stack.push_back(treeNode._right);
+            stack.push_back(index + 1);
+        }
+    }
+
+    // Finds the node for which distanceFn, given a node and its position, is least, where
+    // boxDistanceFn gives a lower bound on distanceFn for the nodes within a bounding box;
+    // subtrees are visited nearest first, and skipped entirely if they can't contain anything nearer
+    template<typename BoxDistanceFn, typename DistanceFn>
+    NodeId nearest(const BoxDistanceFn& boxDistanceFn, const DistanceFn& distanceFn) const
+    {
+        NodeId nearestNodeId;
+
+        if(_treeNodes.empty())
+            return nearestNodeId;
+
+        float minimumDistance = std::numeric_limits<float>::max();
+        std::vector<std::pair<uint32_t, float>> stack{{0, boxDistanceFn(_treeNodes.front()._boundingBox)}};
+
+        while(!stack.empty())
+        {
+            const auto [index, boxDistance] = stack.back();
+            stack.pop_back();
+
+            if(boxDistance >= minimumDistance)
+                continue;
+
+            const auto& treeNode = _treeNodes[index];
+
+            if(treeNode.isLeaf())
+            {
+                for(auto i = treeNode._first; i < treeNode._first + treeNode._count; i++)
+                {
+                    const auto nodeId = _nodeIds[_order[i]];
+                    const float distance = distanceFn(nodeId, _positions[_order[i]]);
+
+                    if(distance < minimumDistance)
+                    {
+                        minimumDistance = distance;
+                        nearestNodeId = nodeId;
+                    }
+                }
+
+                continue;
+            }
+
+            const auto left = index + 1;
+            const auto right = treeNode._right;
+            const float leftDistance = boxDistanceFn(_treeNodes[left]._boundingBox);
+            const float rightDistance = boxDistanceFn(_treeNodes[right]._boundingBox);
+
+            // Push the further child first, so that the nearer is visited first
+            if(leftDistance < rightDistance)
+            {
+                stack.emplace_back(right, rightDistance);
+                stack.emplace_back(left, leftDistance);
+            }
+            else
+            {
+                stack.emplace_back(left, leftDistance);
+                stack.emplace_back(right, rightDistance);
+            }
+        }
+
+        return nearestNodeId;
+    }
+};
+
+#endif // NODESPATIALINDEX_H
@@ -69,6 +69,7 @@
 #include "shared/utils/console.h"
 #include "shared/utils/consolecapture.h"
 #include "shared/utils/signalhandling.h"
+#include "shared/utils/random.h"
 #include "shared/ui/visualisations/defaultgradients.h"
 #include "shared/ui/visualisations/defaultpalettes.h"
 
@@ -248,6 +249,7 @@ int start(int argc, char *argv[], ConsoleOutputFiles& consoleOutputFiles)
         {{"m", "startMaximised"}, QObject::tr("Put the application window in maximised state.")},
         {{"w", "skipWelcome"}, QObject::tr("Don't show the welcome screen on first start.")},
         {{"p", "parameters"}, QObject::tr("Run in headless mode, using parameters from <file>."), "file"},
+        {{"s", "seed"}, QObject::tr("Seed random number generation, so that layouts are reproducible."), "seed"},
     });
 
     commandLineParser.process(QCoreApplication::arguments());
@@ -278,6 +280,9 @@ int start(int argc, char *argv[], ConsoleOutputFiles& consoleOutputFiles)
     if(commandLineParser.isSet(u"skipWelcome"_s) && !u::prefExists(u"tracking/permission"_s))
         u::setPref(u"tracking/permission"_s, u"anonymous"_s);
 
+    if(commandLineParser.isSet(u"seed"_s))
+        u::setRandomSeed(commandLineParser.value(u"seed"_s).toUInt());
+
     QGuiApplication::styleHints()->setMousePressAndHoldInterval(500);
 
     QIcon mainIcon;
@@ -389,6 +394,9 @@ int start(int argc, char *argv[], ConsoleOutputFiles& consoleOutputFiles)
 
     u::definePref(u"misc/autoBackgroundUpdateCheck"_s,          true);
 
+    u::definePref(u"misc/cacheParsedData"_s,                    true);
+    u::definePref(u"misc/parsedDataCacheSize"_s,                2048);
+
     u::definePref(u"find/findByAttributeSortLexically"_s,       true);
 
     u::definePref(u"screenshot/width"_s,                        1920);
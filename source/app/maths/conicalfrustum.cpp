@@ -21,6 +21,8 @@
 
 #include "shared/utils/utils.h"
 
+#include <algorithm>
+
 ConicalFrustum::ConicalFrustum(const Line3D& centreLine, const Line3D& surfaceLine) :
     _centreLine(centreLine)
 {
@@ -47,3 +49,18 @@ bool ConicalFrustum::containsPoint(const QVector3D& point) const
 
     return distanceToCentreLine < testRadius;
 }
+
+bool ConicalFrustum::mayIntersect(const BoundingBox3D& boundingBox) const
+{
+    // Test the box's bounding sphere against the planes and the wider end of the cone
+    const auto centre = boundingBox.centre();
+    const float radius = (boundingBox.max() - boundingBox.min()).length() * 0.5f;
+
+    if(-_nearPlane.distanceToPoint(centre) > radius || -_farPlane.distanceToPoint(centre) > radius)
+        return false;
+
+    const float distanceToCentreLine = centre.distanceToLine(_centreLine.start(),
+        (_centreLine.end() - _centreLine.start()).normalized());
+
+    return distanceToCentreLine <= std::max(_nearRadius, _farRadius) + radius;
+}
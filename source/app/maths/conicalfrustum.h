@@ -41,6 +41,7 @@ public:
     ConicalFrustum(const Line3D &centreLine, const Line3D& surfaceLine);
 
     bool containsPoint(const QVector3D& point) const override;
+    bool mayIntersect(const BoundingBox3D& boundingBox) const override;
     Line3D centreLine() const override { return _centreLine; }
 };
 
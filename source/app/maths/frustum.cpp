@@ -42,6 +42,21 @@ bool Frustum::containsPoint(const QVector3D& point) const
     });
 }
 
+bool Frustum::mayIntersect(const BoundingBox3D& boundingBox) const
+{
+    return std::all_of(_planes.begin(), _planes.end(), [&boundingBox](const auto& plane)
+    {
+        // The corner of the box that is furthest behind the plane
+        const auto& normal = plane.normal();
+        const QVector3D corner(
+            normal.x() >= 0.0f ? boundingBox.min().x() : boundingBox.max().x(),
+            normal.y() >= 0.0f ? boundingBox.min().y() : boundingBox.max().y(),
+            normal.z() >= 0.0f ? boundingBox.min().z() : boundingBox.max().z());
+
+        return plane.sideForPoint(corner) == Plane::Side::Back;
+    });
+}
+
 bool BaseFrustum::containsLine(const Line3D& line) const
 {
     return containsPoint(line.start()) && containsPoint(line.end());
@@ -22,6 +22,7 @@
 
 #include "plane.h"
 #include "line.h"
+#include "boundingbox.h"
 
 #include <QVector3D>
 
@@ -35,6 +36,9 @@ public:
     virtual bool containsPoint(const QVector3D& point) const = 0;
     bool containsLine(const Line3D& line) const;
 
+    // Conservative; false only if the box is definitely entirely outside the frustum
+    virtual bool mayIntersect(const BoundingBox3D& boundingBox) const = 0;
+
     virtual Line3D centreLine() const = 0;
 };
 
@@ -48,6 +52,7 @@ public:
     Frustum(const Line3D& line1, const Line3D& line2, const Line3D& line3, const Line3D& line4);
 
     bool containsPoint(const QVector3D& point) const override;
+    bool mayIntersect(const BoundingBox3D& boundingBox) const override;
     Line3D centreLine() const override { return _centreLine; }
 };
 
@@ -234,12 +234,13 @@ void GraphRenderer::updateGPUDataIfRequired()
 
     _gpuDataRequiresUpdate = false;
 
-    const std::unique_lock<NodePositions> nodePositionsLock(_graphModel->nodePositions());
     const std::unique_lock<std::recursive_mutex> glyphMapLock(_glyphMap->mutex());
 
     int componentIndex = 0;
 
-    auto& nodePositions = _graphModel->nodePositions();
+    // Reading the positions through a snapshot doesn't block the layout, and
+    // guarantees they're consistent with each other for the whole update
+    const auto nodePositions = _graphModel->nodePositions().snapshot();
 
     resetGPUGraphData();
 
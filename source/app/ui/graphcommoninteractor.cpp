@@ -50,22 +50,13 @@ NodeIdSet nodeIdsInsideFrustum(const GraphModel& graphModel,
                                ComponentId componentId,
                                const BaseFrustum& frustum)
 {
-    NodeIdSet selection;
+    Q_ASSERT(graphModel.graph().componentById(componentId) != nullptr);
 
-    const auto* component = graphModel.graph().componentById(componentId);
-    Q_ASSERT(component != nullptr);
+    std::vector<NodeId> nodeIds;
+    Collision collision(graphModel, componentId);
+    collision.nodesInsideFrustum(frustum, nodeIds);
 
-    for(const NodeId nodeId : component->nodeIds())
-    {
-        if(graphModel.nodeVisual(nodeId).state().test(VisualFlags::Unhighlighted))
-            continue;
-
-        const QVector3D nodePosition = graphModel.nodePositions().get(nodeId);
-        if(frustum.containsPoint(nodePosition))
-            selection.insert(nodeId);
-    }
-
-    return selection;
+    return {nodeIds.begin(), nodeIds.end()};
 }
 
 static NodeId nodeIdInsideFrustumNearestPoint(const GraphModel& graphModel,
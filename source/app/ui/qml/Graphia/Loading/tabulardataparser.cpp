@@ -21,6 +21,7 @@
 
 #include "shared/loading/xlsxtabulardataparser.h"
 #include "shared/loading/matlabfileparser.h"
+#include "shared/loading/tabulardatacache.h"
 
 #include "shared/utils/scope_exit.h"
 #include "shared/utils/container.h"
@@ -147,9 +148,11 @@ TabularDataParser::~TabularDataParser()
     _dataParserWatcher.waitForFinished();
 }
 
-void TabularDataParser::update()
+void TabularDataParser::update(bool columnTypeIdentitiesKnown)
 {
-    _columnTypeIdentities = _dataPtr->columnTypeIdentities(this);
+    if(!columnTypeIdentitiesKnown)
+        _columnTypeIdentities = _dataPtr->columnTypeIdentities(this);
+
     _rowTypeIdentities = _dataPtr->rowTypeIdentities(this);
 
     _columnDuplicates = _dataPtr->columnDuplicates(this);
@@ -165,6 +168,25 @@ bool TabularDataParser::parse(const QUrl& fileUrl)
         if(fileUrl.isEmpty())
             return;
 
+        auto extension = QFileInfo(fileUrl.toLocalFile()).suffix();
+
+        setProgress(-1);
+        const TabularDataCache cache(fileUrl, extension);
+
+        bool success = false;
+
+        auto cachedData = std::make_shared<TabularData>();
+        if(cache.load(*cachedData, _columnTypeIdentities))
+        {
+            _dataPtr = cachedData;
+
+            // The cache may have been populated without knowing the column types
+            update(!_columnTypeIdentities.empty());
+            emit dataChanged();
+
+            success = true;
+        }
+
         auto tryToParseUsing = [fileUrl, this](auto&& parser)
         {
             _dataPtr->reset();
@@ -199,13 +221,15 @@ bool TabularDataParser::parse(const QUrl& fileUrl)
             {u"txt"_s,     [&tryToParseUsing]{ return tryToParseUsing(TxtFileParser()); }}
         };
 
-        auto extension = QFileInfo(fileUrl.toLocalFile()).suffix();
-        bool success = false;
-
-        if(u::contains(parsers, extension))
+        if(!success && u::contains(parsers, extension))
         {
             const auto& tryParse = parsers.at(extension);
             success = tryParse();
+
+            // Only cache the result when the extension is correct, as
+            // the cache is subsequently looked up using the extension
+            if(success)
+                cache.save(*_dataPtr, _columnTypeIdentities);
         }
 
         if(!success)
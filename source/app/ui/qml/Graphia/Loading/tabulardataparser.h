@@ -101,7 +101,7 @@ private:
     bool _failed = false;
     QString _failureReason;
 
-    void update();
+    void update(bool columnTypeIdentitiesKnown = false);
 
 protected:
     const TabularData& tabularData() const { return *_dataPtr; }
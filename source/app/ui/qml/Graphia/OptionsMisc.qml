@@ -40,6 +40,8 @@ Item
         property alias disableHubbles: disableHubblesCheckbox.checked
         property alias maxUndoLevels: maxUndoSpinBox.value
         property alias panGestureZooms: panGestureZoomsCheckbox.checked
+        property alias cacheParsedData: cacheParsedDataCheckbox.checked
+        property alias parsedDataCacheSize: parsedDataCacheSizeSpinBox.value
     }
 
     Preferences
@@ -153,7 +155,8 @@ Item
                 font.bold: true
                 text: qsTr("Performance")
 
-                visible: disableMultisamplingCheckbox.visible || macOsOldHardwareText.visible
+                visible: disableMultisamplingCheckbox.visible || macOsOldHardwareText.visible ||
+                    cacheParsedDataCheckbox.visible
             }
 
             CheckBox
@@ -182,6 +185,34 @@ Item
                 onLinkActivated: function(link) { NativeUtils.showAppInFileManager(); }
             }
 
+            CheckBox
+            {
+                id: cacheParsedDataCheckbox
+                visible: Qt.platform.os !== "wasm"
+                text: qsTr("Cache Parsed Tabular Data")
+            }
+
+            RowLayout
+            {
+                Layout.leftMargin: Constants.margin * 2
+                visible: cacheParsedDataCheckbox.visible
+                enabled: cacheParsedDataCheckbox.checked
+
+                Label { text: qsTr("Cache Size (MB):") }
+
+                SpinBox
+                {
+                    id: parsedDataCacheSizeSpinBox
+
+                    editable: true
+                    Component.onCompleted: { contentItem.selectByMouse = true; }
+
+                    from: 64
+                    to: 65536
+                    stepSize: 256
+                }
+            }
+
             Label
             {
                 Layout.topMargin: Constants.margin * 2
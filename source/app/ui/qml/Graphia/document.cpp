@@ -41,7 +41,7 @@
 #include "app/loading/isaver.h"
 
 #include "app/layout/forcedirectedlayout.h"
-#include "app/layout/layout.h"
+#include "app/layout/layoutthread.h"
 #include "app/layout/collision.h"
 
 #include "app/commands/applytransformscommand.h"
@@ -876,7 +876,7 @@ void Document::onLoadComplete(const QUrl&, bool success)
     if(!_bookmarks.empty())
         emit bookmarksChanged();
 
-    _layoutThread = std::make_unique<LayoutThread>(*_graphModel, std::make_unique<ForceDirectedLayoutFactory>(_graphModel.get()));
+    _layoutThread = std::make_unique<LayoutThread>(*_graphModel, std::make_unique<ForceDirectedLayoutFactory>(_graphModel->graph()));
 
     for(const auto& layoutSetting : _loadedLayoutSettings)
         _layoutThread->setSettingValue(layoutSetting._name, layoutSetting._value);
@@ -22,9 +22,8 @@
 #include "app/maths/boundingsphere.h"
 #include "app/layout/nodepositions.h"
 
-void TextVisual::updatePositions(const NodePositions& nodePositions)
+void TextVisual::updatePositions(const NodePositions::Snapshot& nodePositions)
 {
-    // This must be called when the layout is paused or otherwise locked
     std::vector<QVector3D> points;
     points.reserve(_nodeIds.size());
 
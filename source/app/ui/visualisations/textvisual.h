@@ -21,6 +21,7 @@
 #define TEXTVISUAL_H
 
 #include "shared/graph/elementid.h"
+#include "app/layout/nodepositions.h"
 
 #include <QString>
 #include <QColor>
@@ -29,8 +30,6 @@
 #include <vector>
 #include <map>
 
-class NodePositions;
-
 struct TextVisual
 {
     QString _text;
@@ -42,7 +41,7 @@ struct TextVisual
     QVector3D _centre;
     float _radius = 0.0f;
 
-    void updatePositions(const NodePositions& nodePositions);
+    void updatePositions(const NodePositions::Snapshot& nodePositions);
 };
 
 using TextVisuals = std::map<ComponentId, std::vector<TextVisual>>;
@@ -119,48 +119,56 @@ double CosineSimilarityAlgorithm::evaluate(size_t, const ContinuousDataVector* v
 void BicorAlgorithm::preprocess(size_t size, const ContinuousDataVectors& vectors)
 {
     _base = &vectors.front();
-    _processedVectors.resize(vectors.size());
+    _size = size;
+    _processed.resize(vectors.size() * size);
 
-    for(size_t i = 0; const auto& vector : vectors)
+    // Capture absDiffs by value, giving each thread its own scratch buffer
+    std::vector<double> absDiffs(size);
+
+    parallel_for(vectors.begin(), vectors.end(),
+    [&, absDiffs](ContinuousDataVectors::const_iterator vectorIt) mutable
     {
-        auto median = u::medianOf(vector.data());
+        auto row = static_cast<size_t>(std::distance(vectors.begin(), vectorIt));
+        auto* processed = &_processed[row * size];
 
-        std::vector<double> absDiffs(size);
-        std::vector<double> intermediate(size);
+        std::copy(vectorIt->begin(), vectorIt->end(), absDiffs.begin());
+        auto median = u::medianInPlace(absDiffs.begin(), absDiffs.end());
 
-        for(size_t j = 0; auto value : vector)
+        for(size_t j = 0; j < size; j++)
         {
-            intermediate[j] = value - median;
-            absDiffs[j] = std::abs(intermediate[j]);
-            j++;
+            processed[j] = vectorIt->valueAt(j) - median;
+            absDiffs[j] = std::abs(processed[j]);
         }
 
-        auto mad = u::medianOf(absDiffs);
+        auto mad = u::medianInPlace(absDiffs.begin(), absDiffs.end());
 
-        for(size_t j = 0; auto value : intermediate)
+        double sumSq = 0.0;
+        for(size_t j = 0; j < size; j++)
         {
+            auto value = processed[j];
             auto u = value / (9.0 * mad);
             auto v = 1 - (u * u);
             auto newValue = value * (v * v) * (v > 0.0 ? 1.0 : 0.0);
 
-            intermediate[j++] = newValue;
+            processed[j] = newValue;
+            sumSq += newValue * newValue;
         }
 
-        auto& processedVector = _processedVectors.at(i++);
-        processedVector = {intermediate, vector.nodeId(), vector.computeCostHint()};
-        processedVector.update();
-    }
+        auto magnitude = std::sqrt(sumSq);
+
+        // Degenerate rows become NaN, so that any correlation with them is discarded
+        auto scale = magnitude > 0.0 ? 1.0 / magnitude : std::nan("1");
+        for(size_t j = 0; j < size; j++)
+            processed[j] *= scale;
+    });
 }
 
 double BicorAlgorithm::evaluate(size_t, const ContinuousDataVector* vectorA, const ContinuousDataVector* vectorB) const
 {
     auto a = static_cast<size_t>(std::distance(_base, vectorA));
     auto b = static_cast<size_t>(std::distance(_base, vectorB));
-    const auto& processedVectorA = _processedVectors.at(a);
-    const auto& processedVectorB = _processedVectors.at(b);
-
-    const double productSum = std::inner_product(processedVectorA.begin(), processedVectorA.end(),
-        processedVectorB.begin(), 0.0);
+    const auto* processedA = &_processed[a * _size];
+    const auto* processedB = &_processed[b * _size];
 
-    return productSum / (processedVectorA.magnitude() * processedVectorB.magnitude());
+    return std::inner_product(processedA, processedA + _size, processedB, 0.0);
 }
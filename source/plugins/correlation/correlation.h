@@ -195,6 +195,13 @@ private:
             return threadResults;
         });
 
+        if constexpr(std::is_base_of_v<RequiresRanking, Algorithm>)
+        {
+            // The rankings are only needed while correlating, so don't hang on to them
+            for(const auto& vector : vectors)
+                vector.releaseRanking();
+        }
+
         if(progressable != nullptr)
         {
             // Returning the results might take time
@@ -367,7 +374,11 @@ class BicorAlgorithm
 {
 private:
     const ContinuousDataVector* _base = nullptr;
-    ContinuousDataVectors _processedVectors;
+    size_t _size = 0;
+
+    // Row-major, with each row scaled to unit magnitude, so that
+    // evaluation reduces to a dot product
+    std::vector<double> _processed;
 
 public:
     void preprocess(size_t size, const ContinuousDataVectors& vectors);
@@ -412,23 +423,6 @@ private:
     template<typename F>
     using results_t = decltype(std::declval<F>().results());
 
-    struct Fraction
-    {
-        int _numerator = 0;
-        int _denominator = 0;
-
-        Fraction& operator+=(const Fraction& other)
-        {
-            _numerator += other._numerator;
-            _denominator += other._denominator;
-
-            return *this;
-        }
-
-        // NOLINTNEXTLINE google-explicit-constructor
-        operator double() const { return static_cast<double>(_numerator) / _denominator; }
-    };
-
     auto process(const TokenisedDataVectors& vectors, const QVariantMap& parameters,
         Cancellable* cancellable = nullptr, Progressable* progressable = nullptr) const
     {
@@ -455,45 +449,23 @@ private:
             if(cancellable != nullptr && cancellable->cancelled())
                 return threadResults;
 
-            auto binary = [&](auto vectorAValue, auto vectorBValue) -> Fraction
+            for(auto vectorBIt = vectorAIt + 1; vectorBIt != vectors.end(); ++vectorBIt)
             {
-                return {vectorAValue && vectorBValue ? 1 : 0, 1};
-            };
+                // Columns where both tokens are zero only contribute to the
+                // denominator of the Simple Matching Coefficient
+                const size_t numerator = treatAsBinary ?
+                    vectorAIt->numPresentInBoth(*vectorBIt) :
+                    vectorAIt->numMatching(*vectorBIt);
+                const size_t denominator = Denominator == 0 ?
+                    vectorAIt->numPresentInEither(*vectorBIt) : size;
 
-            auto nonBinary = [&](auto vectorAValue, auto vectorBValue) -> Fraction
-            {
-                return {vectorAValue == vectorBValue ? 1 : 0, 1};
-            };
+                const double r = static_cast<double>(numerator) / static_cast<double>(denominator);
 
-            auto createEdgesForVectorPairs = [&](auto&& f)
-            {
-                for(auto vectorBIt = vectorAIt + 1; vectorBIt != vectors.end(); ++vectorBIt)
-                {
-                    Fraction fraction;
-                    for(size_t i = 0; i < size; i++)
-                    {
-                        const auto& vectorAValue = vectorAIt->valueAt(i);
-                        const auto& vectorBValue = vectorBIt->valueAt(i);
-
-                        if(!vectorAValue && !vectorBValue)
-                            fraction += {0, Denominator};
-                        else
-                            fraction += f(vectorAValue, vectorBValue);
-                    }
-
-                    const double r = fraction;
-
-                    if(!std::isfinite(r))
-                        continue;
-
-                    filterMethod.add(&threadResults, vectorAIt, vectorBIt, r);
-                }
-            };
-
-            if(treatAsBinary)
-                createEdgesForVectorPairs(binary);
-            else
-                createEdgesForVectorPairs(nonBinary);
+                if(!std::isfinite(r))
+                    continue;
+
+                filterMethod.add(&threadResults, vectorAIt, vectorBIt, r);
+            }
 
             cost += vectorAIt->computeCostHint();
 
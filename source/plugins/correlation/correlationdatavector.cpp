@@ -22,16 +22,17 @@
 #include "shared/utils/container.h"
 
 #include <algorithm>
+#include <bit>
 #include <cmath>
 
 void ContinuousDataVector::update()
 {
-    _statistics = u::findStatisticsFor(_data);
+    _statistics = u::findStatisticsFor(*this);
 }
 
 void ContinuousDataVector::generateRanking() const
 {
-    _rankingVector = std::make_shared<ContinuousDataVector>(u::rankingOf(_data), _nodeId, _cost);
+    _rankingVector = std::make_shared<ContinuousDataVector>(u::rankingOf(*this), _nodeId, _cost);
     _rankingVector->update();
 }
 
@@ -39,3 +40,118 @@ const ContinuousDataVector* ContinuousDataVector::ranking() const
 {
     return _rankingVector.get();
 }
+
+void ContinuousDataVector::releaseRanking() const
+{
+    _rankingVector.reset();
+}
+
+namespace
+{
+size_t popcountOfAnd(const uint64_t* a, const uint64_t* b, size_t numWords)
+{
+    size_t count = 0;
+
+    for(size_t i = 0; i < numWords; i++)
+        count += static_cast<size_t>(std::popcount(a[i] & b[i]));
+
+    return count;
+}
+
+size_t popcountOfOr(const uint64_t* a, const uint64_t* b, size_t numWords)
+{
+    size_t count = 0;
+
+    for(size_t i = 0; i < numWords; i++)
+        count += static_cast<size_t>(std::popcount(a[i] | b[i]));
+
+    return count;
+}
+} // namespace
+
+void TokenisedDataVector::update()
+{
+    _numWords = (size() + 63) / 64;
+    _presence.assign(_numWords, 0);
+    _oneHotTokens.clear();
+    _oneHotBits.clear();
+    _hasOneHot = false;
+
+    for(size_t i = 0; i < size(); i++)
+    {
+        if(_values[i] != 0)
+            _presence[i / 64] |= (uint64_t{1} << (i % 64));
+    }
+
+    std::vector<size_t> tokens;
+    std::copy_if(begin(), end(), std::back_inserter(tokens),
+        [](auto token) { return token != 0; });
+    u::removeDuplicates(tokens);
+
+    if(tokens.size() > MAX_ONE_HOT_TOKENS)
+        return;
+
+    _hasOneHot = true;
+    _oneHotTokens = std::move(tokens);
+    _oneHotBits.assign(_oneHotTokens.size() * _numWords, 0);
+
+    for(size_t i = 0; i < size(); i++)
+    {
+        if(_values[i] == 0)
+            continue;
+
+        auto it = std::lower_bound(_oneHotTokens.begin(), _oneHotTokens.end(), _values[i]);
+        auto tokenIndex = static_cast<size_t>(std::distance(_oneHotTokens.begin(), it));
+        _oneHotBits[(tokenIndex * _numWords) + (i / 64)] |= (uint64_t{1} << (i % 64));
+    }
+}
+
+size_t TokenisedDataVector::numPresentInEither(const TokenisedDataVector& other) const
+{
+    Q_ASSERT(_numWords == other._numWords);
+    return popcountOfOr(_presence.data(), other._presence.data(), _numWords);
+}
+
+size_t TokenisedDataVector::numPresentInBoth(const TokenisedDataVector& other) const
+{
+    Q_ASSERT(_numWords == other._numWords);
+    return popcountOfAnd(_presence.data(), other._presence.data(), _numWords);
+}
+
+size_t TokenisedDataVector::numMatching(const TokenisedDataVector& other) const
+{
+    Q_ASSERT(_numWords == other._numWords);
+
+    if(!_hasOneHot || !other._hasOneHot)
+    {
+        size_t count = 0;
+
+        for(size_t i = 0; i < size(); i++)
+            count += (_values[i] != 0 && _values[i] == other._values[i]) ? 1 : 0;
+
+        return count;
+    }
+
+    // Only tokens common to both vectors can match, so walk the two sorted token lists together
+    size_t count = 0;
+    size_t a = 0;
+    size_t b = 0;
+
+    while(a < _oneHotTokens.size() && b < other._oneHotTokens.size())
+    {
+        if(_oneHotTokens[a] < other._oneHotTokens[b])
+            a++;
+        else if(_oneHotTokens[a] > other._oneHotTokens[b])
+            b++;
+        else
+        {
+            count += popcountOfAnd(&_oneHotBits[a * _numWords],
+                &other._oneHotBits[b * _numWords], _numWords);
+
+            a++;
+            b++;
+        }
+    }
+
+    return count;
+}
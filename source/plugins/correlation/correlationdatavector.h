@@ -23,12 +23,14 @@
 #include "shared/graph/elementid.h"
 #include "shared/utils/statistics.h"
 #include "shared/utils/container.h"
+#include "shared/utils/threadpool.h"
 
 #include <vector>
 #include <limits>
 #include <iterator>
 #include <memory>
-#include <map>
+#include <span>
+#include <unordered_map>
 #include <type_traits>
 
 #include <QString>
@@ -37,21 +39,88 @@ template<typename T>
 class CorrelationDataVector
 {
 protected:
+    // Empty when the vector is a view of values that are stored elsewhere
     std::vector<T> _data;
 
+    T* _values = nullptr;
+    size_t _size = 0;
+    bool _isView = false;
+
     NodeId _nodeId;
     uint64_t _cost = 0;
 
+private:
+    void viewOwnData()
+    {
+        if(_isView)
+            return;
+
+        _values = _data.data();
+        _size = _data.size();
+    }
+
 public:
-    using ConstDataIterator = typename decltype(_data)::const_iterator;
-    using DataIterator = typename decltype(_data)::iterator;
-    using DataOffset = typename decltype(_data)::size_type;
+    using value_type = T;
+    using reference = T&;
+    using const_reference = const T&;
+    using iterator = T*;
+    using const_iterator = const T*;
+    using difference_type = std::ptrdiff_t;
+    using size_type = size_t;
+
+    using ConstDataIterator = const_iterator;
+    using DataIterator = iterator;
+    using DataOffset = size_type;
 
     CorrelationDataVector() = default;
-    CorrelationDataVector(const CorrelationDataVector&) = default;
-    CorrelationDataVector& operator=(const CorrelationDataVector&) = default;
     virtual ~CorrelationDataVector() = default;
 
+    CorrelationDataVector(const CorrelationDataVector& other) :
+        _data(other._data), _values(other._values), _size(other._size), _isView(other._isView),
+        _nodeId(other._nodeId), _cost(other._cost)
+    {
+        viewOwnData();
+    }
+
+    CorrelationDataVector(CorrelationDataVector&& other) noexcept :
+        _data(std::move(other._data)), _values(other._values), _size(other._size), _isView(other._isView),
+        _nodeId(other._nodeId), _cost(other._cost)
+    {
+        viewOwnData();
+    }
+
+    CorrelationDataVector& operator=(const CorrelationDataVector& other)
+    {
+        if(this != &other)
+        {
+            _data = other._data;
+            _values = other._values;
+            _size = other._size;
+            _isView = other._isView;
+            _nodeId = other._nodeId;
+            _cost = other._cost;
+            viewOwnData();
+        }
+
+        return *this;
+    }
+
+    CorrelationDataVector& operator=(CorrelationDataVector&& other) noexcept
+    {
+        if(this != &other)
+        {
+            _data = std::move(other._data);
+            _values = other._values;
+            _size = other._size;
+            _isView = other._isView;
+            _nodeId = other._nodeId;
+            _cost = other._cost;
+            viewOwnData();
+        }
+
+        return *this;
+    }
+
     // Column from row-wise input
     template<typename U>
     CorrelationDataVector(const std::vector<U>& data, size_t column,
@@ -68,6 +137,8 @@ public:
             auto index = (row * numColumns) + column;
             _data.push_back(data.at(index));
         }
+
+        viewOwnData();
     }
 
     // Row from row-wise input
@@ -79,6 +150,7 @@ public:
         _nodeId(nodeId), _cost(computeCost)
     {
         Q_ASSERT((numColumns * (row + 1)) <= data.size());
+        viewOwnData();
     }
 
     template<typename U>
@@ -87,19 +159,29 @@ public:
         CorrelationDataVector(dataVector, 0, dataVector.size(), nodeId, computeCost)
     {}
 
-    DataIterator begin() { return _data.begin(); }
-    DataIterator end() { return _data.end(); }
+    // View of values owned elsewhere, which must outlive the vector and not be reallocated;
+    // writes through the vector are visible to the owner and vice versa
+    CorrelationDataVector(std::span<T> values, NodeId nodeId, uint64_t computeCost = 1) :
+        _values(values.data()), _size(values.size()), _isView(true),
+        _nodeId(nodeId), _cost(computeCost)
+    {}
+
+    iterator begin() { return _values; }
+    iterator end() { return _values + _size; }
 
-    ConstDataIterator begin() const { return _data.begin(); }
-    ConstDataIterator end() const { return _data.end(); }
+    const_iterator begin() const { return _values; }
+    const_iterator end() const { return _values + _size; }
 
-    const std::vector<T>& data() const { return _data; }
+    const T* data() const { return _values; }
 
     uint64_t computeCostHint() const { return _cost; }
 
-    size_t size() const { return _data.size(); }
-    const T& valueAt(size_t index) const { return _data.at(index); }
-    void setValueAt(size_t index, const T& value) { _data[index] = value; }
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    const T& operator[](size_t index) const { return _values[index]; }
+    const T& valueAt(size_t index) const { Q_ASSERT(index < _size); return _values[index]; }
+    void setValueAt(size_t index, const T& value) { Q_ASSERT(index < _size); _values[index] = value; }
 
     NodeId nodeId() const { return _nodeId; }
 
@@ -132,6 +214,7 @@ public:
 
     void generateRanking() const;
     const ContinuousDataVector* ranking() const;
+    void releaseRanking() const;
 };
 
 class DiscreteDataVector : public CorrelationDataVector<QString>
@@ -142,8 +225,35 @@ public:
 
 class TokenisedDataVector : public CorrelationDataVector<size_t>
 {
+private:
+    // Beyond this many distinct tokens, comparing one-hot bit sets becomes
+    // slower than comparing the tokens themselves
+    static constexpr size_t MAX_ONE_HOT_TOKENS = 32;
+
+    size_t _numWords = 0;
+
+    // A bit is set for each column with a non-zero token
+    std::vector<uint64_t> _presence;
+
+    // For each distinct non-zero token, in ascending order, a bit set of the
+    // columns which have that token; not built if there are too many tokens
+    bool _hasOneHot = false;
+    std::vector<size_t> _oneHotTokens;
+    std::vector<uint64_t> _oneHotBits;
+
 public:
     using CorrelationDataVector::CorrelationDataVector;
+
+    void update() override;
+
+    // Number of columns where either or both vectors have a non-zero token
+    size_t numPresentInEither(const TokenisedDataVector& other) const;
+
+    // Number of columns where both vectors have a non-zero token
+    size_t numPresentInBoth(const TokenisedDataVector& other) const;
+
+    // Number of columns where both vectors have the same non-zero token
+    size_t numMatching(const TokenisedDataVector& other) const;
 };
 
 using ContinuousDataVectors = std::vector<ContinuousDataVector>;
@@ -164,12 +274,13 @@ using CorrelationVector = std::vector<CorrelationDataVectorRelation<CDVType>>;
 template<typename DataVectors>
 TokenisedDataVectors tokeniseDataVectors(const DataVectors& dataVectors)
 {
-    using T = typename DataVectors::value_type::ConstDataIterator::value_type;
+    using DataVector = typename DataVectors::value_type;
+    using T = typename DataVector::value_type;
 
-    TokenisedDataVectors tokenisedDataVectors;
+    if(dataVectors.empty())
+        return {};
 
-    size_t token = 1;
-    std::map<T, size_t> valueMap;
+    std::unordered_map<T, size_t> valueMap;
 
     // Map various falsey values to the 0 token
     if constexpr(std::is_same_v<T, QString>)
@@ -177,24 +288,41 @@ TokenisedDataVectors tokeniseDataVectors(const DataVectors& dataVectors)
     else
         valueMap[0] = 0;
 
-    for(const auto& dataVector : dataVectors)
+    // Find the distinct values of each vector concurrently...
+    auto distinctValues = parallel_for(dataVectors.begin(), dataVectors.end(),
+    [](const DataVector& dataVector)
     {
-        std::vector<size_t> tokens;
-        tokens.reserve(dataVector.size());
+        std::vector<T> values(dataVector.begin(), dataVector.end());
+        u::removeDuplicates(values);
 
-        for(const auto& value : dataVector)
-        {
-            if(!u::contains(valueMap, value))
-            {
-                valueMap[value] = token;
-                token++;
-            }
+        return values;
+    });
+
+    // ...then assign the tokens serially, so that they are deterministic
+    size_t token = 1;
+    for(const auto& value : distinctValues)
+    {
+        if(valueMap.try_emplace(value, token).second)
+            token++;
+    }
 
+    TokenisedDataVectors tokenisedDataVectors(dataVectors.size());
+
+    // valueMap is now only read, so it can be shared between threads
+    parallel_for(dataVectors.begin(), dataVectors.end(),
+    [&](typename DataVectors::const_iterator it)
+    {
+        std::vector<size_t> tokens;
+        tokens.reserve(it->size());
+
+        for(const auto& value : *it)
             tokens.emplace_back(valueMap.at(value));
-        }
 
-        tokenisedDataVectors.emplace_back(tokens, dataVector.nodeId(), dataVector.computeCostHint());
-    }
+        auto index = static_cast<size_t>(std::distance(dataVectors.begin(), it));
+        auto& tokenisedDataVector = tokenisedDataVectors.at(index);
+        tokenisedDataVector = {tokens, it->nodeId(), it->computeCostHint()};
+        tokenisedDataVector.update();
+    });
 
     return tokenisedDataVectors;
 }
@@ -0,0 +1,192 @@
+/* Copyright © 2013-2025 Tim Angus
+ * Copyright © 2013-2025 Tom Freeman
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "correlationedgecache.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <cstdint>
+#include <vector>
+
+using namespace Qt::Literals::StringLiterals;
+
+namespace
+{
+// Bump this whenever the layout below changes
+constexpr uint32_t CACHE_VERSION = 2;
+constexpr uint32_t CACHE_MAGIC = 0x43454347; // "GCEC"
+constexpr qsizetype MAX_CACHE_FILES = 8;
+
+// The file consists of this header followed by every edge, in the order
+// in which the correlation produced them, in host byte order
+struct Header
+{
+    uint32_t _magic = CACHE_MAGIC;
+    uint32_t _version = CACHE_VERSION;
+    uint32_t _filterType = 0;
+    uint32_t _polarity = 0;
+    double _minimumThreshold = 0.0;
+    uint64_t _maximumK = 0;
+    uint64_t _numEdges = 0;
+};
+
+struct Record
+{
+    int32_t _source = -1;
+    int32_t _target = -1;
+    double _r = 0.0;
+};
+
+static_assert(sizeof(Header) % sizeof(double) == 0);
+static_assert(sizeof(Record) == 2 * sizeof(double));
+
+} // namespace
+
+QString CorrelationEdgeCache::directory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + u"/correlation"_s;
+}
+
+void CorrelationEdgeCache::prune()
+{
+    const QDir dir(directory());
+    auto fileInfos = dir.entryInfoList({u"*.cache"_s}, QDir::Files, QDir::Time);
+
+    // Newest first, so remove everything after the first MAX_CACHE_FILES
+    for(qsizetype i = MAX_CACHE_FILES; i < fileInfos.size(); i++)
+        QFile::remove(fileInfos.at(i).absoluteFilePath());
+}
+
+CorrelationEdgeCache::CorrelationEdgeCache(const QByteArray& key, CorrelationFilterType filterType,
+    CorrelationPolarity polarity) :
+    _filterType(filterType), _polarity(polarity)
+{
+    if(key.isEmpty())
+        return;
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(key);
+    hash.addData(u"%1:%2:%3"_s.arg(static_cast<int>(filterType))
+        .arg(static_cast<int>(polarity)).arg(CACHE_VERSION).toUtf8());
+
+    _fileName = u"%1/%2.cache"_s.arg(directory(), QString(hash.result().toHex()));
+}
+
+bool CorrelationEdgeCache::load(EdgeList& edges, double minimumThreshold, size_t maximumK) const
+{
+    if(!valid())
+        return false;
+
+    QFile file(_fileName);
+    if(!file.open(QIODevice::ReadOnly) || file.size() < static_cast<qint64>(sizeof(Header)))
+        return false;
+
+    Header header;
+    if(file.read(reinterpret_cast<char*>(&header), sizeof(Header)) != sizeof(Header)) // NOLINT cppcoreguidelines-pro-type-reinterpret-cast
+        return false;
+
+    if(header._magic != CACHE_MAGIC || header._version != CACHE_VERSION ||
+        header._filterType != static_cast<uint32_t>(_filterType) ||
+        header._polarity != static_cast<uint32_t>(_polarity) ||
+        static_cast<uint64_t>(file.size()) != sizeof(Header) + (header._numEdges * sizeof(Record)))
+    {
+        return false;
+    }
+
+    // The stored edges are only a superset of the requested edges when the
+    // requested threshold is at least as restrictive as the stored one
+    if(minimumThreshold < header._minimumThreshold)
+        return false;
+
+    // KnnProtoGraph only retains a candidate edge if it's stronger than those a node already
+    // has, so the edges that survive depend on the order they're found in; hence slicing the
+    // stored edges to a smaller k or higher threshold wouldn't necessarily match recomputing
+    if(_filterType == CorrelationFilterType::Knn &&
+        (maximumK != header._maximumK || minimumThreshold != header._minimumThreshold))
+    {
+        return false;
+    }
+
+    std::vector<Record> records(static_cast<size_t>(header._numEdges));
+    const auto recordsSize = static_cast<qint64>(records.size() * sizeof(Record));
+    if(file.read(reinterpret_cast<char*>(records.data()), recordsSize) != recordsSize) // NOLINT cppcoreguidelines-pro-type-reinterpret-cast
+        return false;
+
+    edges.clear();
+    edges.reserve(records.size());
+
+    // Filtering preserves the order of the edges, so they are created with
+    // the same EdgeIds as they would be if the correlation were recomputed
+    for(const auto& record : records)
+    {
+        if(correlationExceedsThreshold(_polarity, record._r, minimumThreshold))
+            edges.push_back({NodeId(record._source), NodeId(record._target), record._r});
+    }
+
+    // Mark this entry as recently used, so it survives pruning
+    file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+
+    return true;
+}
+
+bool CorrelationEdgeCache::save(const EdgeList& edges, double minimumThreshold, size_t maximumK) const
+{
+    if(!valid())
+        return false;
+
+    if(!QDir().mkpath(directory()))
+        return false;
+
+    std::vector<Record> records;
+    records.reserve(edges.size());
+    for(const auto& edge : edges)
+    {
+        records.push_back({static_cast<int32_t>(static_cast<int>(edge._source)),
+            static_cast<int32_t>(static_cast<int>(edge._target)), edge._weight});
+    }
+
+    Header header;
+    header._filterType = static_cast<uint32_t>(_filterType);
+    header._polarity = static_cast<uint32_t>(_polarity);
+    header._minimumThreshold = minimumThreshold;
+    header._maximumK = maximumK;
+    header._numEdges = records.size();
+
+    QSaveFile file(_fileName);
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+
+    const auto recordsSize = static_cast<qint64>(records.size() * sizeof(Record));
+
+    bool success = file.write(reinterpret_cast<const char*>(&header), sizeof(Header)) == sizeof(Header); // NOLINT cppcoreguidelines-pro-type-reinterpret-cast
+    success = success && file.write(reinterpret_cast<const char*>(records.data()), recordsSize) == recordsSize; // NOLINT cppcoreguidelines-pro-type-reinterpret-cast
+
+    if(!success || !file.commit())
+        return false;
+
+    prune();
+
+    return true;
+}
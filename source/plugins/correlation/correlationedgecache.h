@@ -0,0 +1,63 @@
+/* Copyright © 2013-2025 Tim Angus
+ * Copyright © 2013-2025 Tom Freeman
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORRELATIONEDGECACHE_H
+#define CORRELATIONEDGECACHE_H
+
+#include "correlationtype.h"
+
+#include "shared/graph/edgelist.h"
+
+#include <QByteArray>
+#include <QString>
+
+#include <cstddef>
+
+// Persists the edges that result from a correlation, so that subsequently
+// correlating the same data with a higher minimum threshold can be answered
+// by filtering the stored edges, instead of recomputing every pairwise
+// correlation value; the edges are stored in the order the correlation
+// produced them, so the filtered edges (and hence EdgeIds) match those of
+// a fresh correlation
+class CorrelationEdgeCache
+{
+private:
+    QString _fileName;
+    CorrelationFilterType _filterType = CorrelationFilterType::Threshold;
+    CorrelationPolarity _polarity = CorrelationPolarity::Positive;
+
+    static QString directory();
+    static void prune();
+
+public:
+    // key should encode the data and everything other than the minimum threshold
+    // and maximum k that influences the resultant correlation values
+    CorrelationEdgeCache(const QByteArray& key, CorrelationFilterType filterType,
+        CorrelationPolarity polarity);
+
+    bool valid() const { return !_fileName.isEmpty(); }
+
+    // Fails if nothing is stored, or if what is stored is not a superset of the requested
+    // edges; k-NN edges are only reused when the threshold and k are identical, since
+    // which edges a node retains depends on the order its candidates are encountered
+    bool load(EdgeList& edges, double minimumThreshold, size_t maximumK) const;
+    bool save(const EdgeList& edges, double minimumThreshold, size_t maximumK) const;
+};
+
+#endif // CORRELATIONEDGECACHE_H
@@ -20,6 +20,7 @@
 #include "correlationplugin.h"
 
 #include "correlation.h"
+#include "correlationedgecache.h"
 
 #include "importannotationscommand.h"
 
@@ -39,14 +40,18 @@
 
 #include "shared/ui/visualisations/ielementvisual.h"
 
+#include "shared/loading/binaryblock_json.h"
 #include "shared/loading/xlsxtabulardataparser.h"
 
 #include <json_helper.h>
 #include <qcustomplotcolorprovider.h>
 
+#include <QCryptographicHash>
 #include <QDir>
 
 #include <map>
+#include <limits>
+#include <algorithm>
 
 using namespace Qt::Literals::StringLiterals;
 
@@ -159,7 +164,9 @@ bool CorrelationPluginInstance::loadUserData(const TabularData& tabularData,
                 {
                     double transformedValue = 0.0;
 
-                    if(!value.isEmpty())
+                    if(tabularData.hasNumericValues() && !value.isEmpty())
+                        transformedValue = tabularData.numericValueAt(columnIndex, rowIndex);
+                    else if(!value.isEmpty())
                     {
                         bool success = false;
                         transformedValue = value.toDouble(&success);
@@ -167,8 +174,8 @@ bool CorrelationPluginInstance::loadUserData(const TabularData& tabularData,
                     }
                     else
                     {
-                        transformedValue = CorrelationFileParser::imputeValue(_missingDataType, _missingDataReplacementValue,
-                            tabularData, dataRect, columnIndex, rowIndex);
+                        // Imputed once all the values are known
+                        transformedValue = std::numeric_limits<double>::quiet_NaN();
                         _valuesWereImputed = true;
                     }
 
@@ -194,6 +201,12 @@ bool CorrelationPluginInstance::loadUserData(const TabularData& tabularData,
 
     parser.setProgress(-1);
 
+    if(_valuesWereImputed)
+    {
+        CorrelationFileParser::imputeValues(_missingDataType, _missingDataReplacementValue,
+            static_cast<size_t>(dataRect.width()), _continuousData);
+    }
+
     CorrelationFileParser::clipValues(_clippingType, _clippingValue,
         static_cast<size_t>(dataRect.width()), _continuousData);
 
@@ -213,13 +226,9 @@ bool CorrelationPluginInstance::loadUserData(const TabularData& tabularData,
 
 void CorrelationPluginInstance::normalise(IParser* parser)
 {
+    // The rows are views of _continuousData, so normalising them in place
+    // also normalises the canonical data
     CorrelationFileParser::normalise(_normaliseType, _continuousDataRows, parser);
-
-    // Normalising obviously changes all the values in _continuousDataRows, so we
-    // must sync _data up so that it matches
-    _continuousData.clear();
-    for(const auto& dataRow : _continuousDataRows)
-        _continuousData.insert(_continuousData.end(), dataRow.begin(), dataRow.end());
 }
 
 void CorrelationPluginInstance::finishDataRows()
@@ -413,36 +422,119 @@ QStringList CorrelationPluginInstance::numericalAttributeNames() const
     return u::toQStringList(attributeNames);
 }
 
+QByteArray CorrelationPluginInstance::correlationCacheKey() const
+{
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+
+    hash.addData(u"%1:%2:%3:%4:%5:%6"_s
+        .arg(static_cast<int>(_correlationDataType))
+        .arg(static_cast<int>(_continuousCorrelationType))
+        .arg(static_cast<int>(_discreteCorrelationType))
+        .arg(static_cast<int>(_treatAsBinary))
+        .arg(_numContinuousColumns + _numDiscreteColumns)
+        .arg(_numRows).toUtf8());
+
+    auto addBytes = [&hash](const auto* data, size_t size)
+    {
+        hash.addData(QByteArrayView(reinterpret_cast<const char*>(data), // NOLINT cppcoreguidelines-pro-type-reinterpret-cast
+            static_cast<qsizetype>(size * sizeof(*data))));
+    };
+
+    // The NodeIds are included so that the cached edges are guaranteed to refer to the same nodes
+    auto correlationDataType = normaliseQmlEnum<CorrelationDataType>(_correlationDataType);
+    switch(correlationDataType)
+    {
+    default:
+    case CorrelationDataType::Continuous:
+        for(const auto& dataRow : _continuousDataRows)
+        {
+            auto nodeId = static_cast<int>(dataRow.nodeId());
+            addBytes(&nodeId, 1);
+            addBytes(dataRow.data(), dataRow.size());
+        }
+        break;
+
+    case CorrelationDataType::Discrete:
+        for(const auto& dataRow : _discreteDataRows)
+        {
+            auto nodeId = static_cast<int>(dataRow.nodeId());
+            addBytes(&nodeId, 1);
+
+            for(const auto& value : dataRow)
+            {
+                auto length = value.size();
+                addBytes(&length, 1);
+                addBytes(value.constData(), static_cast<size_t>(length));
+            }
+        }
+        break;
+    }
+
+    return hash.result();
+}
+
 EdgeList CorrelationPluginInstance::correlation(IParser& parser)
 {
     auto correlationDataType = normaliseQmlEnum<CorrelationDataType>(_correlationDataType);
+    auto correlationFilterType = normaliseQmlEnum<CorrelationFilterType>(_correlationFilterType);
+
+    // Discrete correlation values are never negative
+    auto correlationPolarity = correlationDataType == CorrelationDataType::Continuous ?
+        normaliseQmlEnum<CorrelationPolarity>(_correlationPolarity) : CorrelationPolarity::Positive;
+    auto maximumK = correlationFilterType == CorrelationFilterType::Knn ? _maximumK : 0;
+
+    // When storing edges, thresholded correlations are computed down to the floor, so
+    // that the same data can later be imported with any threshold above it, cheaply
+    auto computedThreshold = _storeEdges && correlationFilterType == CorrelationFilterType::Threshold ?
+        std::min(_minimumThreshold, _edgeStoreFloor) : _minimumThreshold;
+
+    const CorrelationEdgeCache cache(_storeEdges ? correlationCacheKey() : QByteArray(),
+        correlationFilterType, correlationPolarity);
+
+    EdgeList edges;
+    if(cache.load(edges, _minimumThreshold, maximumK))
+        return edges;
+
     switch(correlationDataType)
     {
     default:
     case CorrelationDataType::Continuous:
     {
         auto continuousCorrelation = ContinuousCorrelation::create(_continuousCorrelationType, _correlationFilterType);
-        return continuousCorrelation->edgeList(_continuousDataRows,
+        edges = continuousCorrelation->edgeList(_continuousDataRows,
             {
-                {u"minimumThreshold"_s, _minimumThreshold},
+                {u"minimumThreshold"_s, computedThreshold},
                 {u"maximumK"_s, static_cast<uint>(_maximumK)},
                 {u"correlationPolarity"_s, static_cast<int>(_correlationPolarity)}
             }, &parser, &parser);
+        break;
     }
 
     case CorrelationDataType::Discrete:
     {
         auto discreteCorrelation = DiscreteCorrelation::create(_discreteCorrelationType, _correlationFilterType);
-        return discreteCorrelation->edgeList(_discreteDataRows,
+        edges = discreteCorrelation->edgeList(_discreteDataRows,
             {
-                {u"minimumThreshold"_s, _minimumThreshold},
+                {u"minimumThreshold"_s, computedThreshold},
                 {u"maximumK"_s, static_cast<uint>(_maximumK)},
                 {u"treatAsBinary"_s, _treatAsBinary}
             }, &parser, &parser);
+        break;
     }
     }
 
-    return {};
+    if(parser.cancelled())
+        return edges;
+
+    cache.save(edges, computedThreshold, maximumK);
+
+    if(computedThreshold < _minimumThreshold)
+    {
+        std::erase_if(edges, [&](const auto& edge)
+            { return !correlationExceedsThreshold(correlationPolarity, edge._weight, _minimumThreshold); });
+    }
+
+    return edges;
 }
 
 bool CorrelationPluginInstance::createEdges(const EdgeList& edges, IParser& parser)
@@ -510,6 +602,18 @@ void CorrelationPluginInstance::makeDataColumnNamesUnique()
     }
 }
 
+std::span<double> CorrelationPluginInstance::continuousDataFor(size_t row)
+{
+    Q_ASSERT(((row + 1) * _numContinuousColumns) <= _continuousData.size());
+    return std::span(_continuousData).subspan(row * _numContinuousColumns, _numContinuousColumns);
+}
+
+std::span<QString> CorrelationPluginInstance::discreteDataFor(size_t row)
+{
+    Q_ASSERT(((row + 1) * _numDiscreteColumns) <= _discreteData.size());
+    return std::span(_discreteData).subspan(row * _numDiscreteColumns, _numDiscreteColumns);
+}
+
 void CorrelationPluginInstance::finishDataRow(size_t row)
 {
     Q_ASSERT(row < _numRows);
@@ -517,8 +621,8 @@ void CorrelationPluginInstance::finishDataRow(size_t row)
     auto nodeId = graphModel()->mutableGraph().addNode();
     auto computeCost = static_cast<uint64_t>(_numRows - row + 1);
 
-    _continuousDataRows.emplace_back(_continuousData, row, _numContinuousColumns, nodeId, computeCost);
-    _discreteDataRows.emplace_back(_discreteData, row, _numDiscreteColumns, nodeId, computeCost);
+    _continuousDataRows.emplace_back(continuousDataFor(row), nodeId, computeCost);
+    _discreteDataRows.emplace_back(discreteDataFor(row), nodeId, computeCost);
 
     _graphModel->userNodeData().setElementIdForIndex(nodeId, row);
 
@@ -686,6 +790,12 @@ void CorrelationPluginInstance::applyParameter(const QString& name, const QVaria
         _clippingValue = value.toDouble();
     else if(name == u"treatAsBinary"_s)
         _treatAsBinary = value.toBool();
+    else if(name == u"hierarchicalClusteringLinkage"_s)
+        _hcLinkage = qmlEnumFor<HierarchicalClusteringLinkage>(value);
+    else if(name == u"storeEdges"_s)
+        _storeEdges = value.toBool();
+    else if(name == u"edgeStoreFloor"_s)
+        _edgeStoreFloor = value.toDouble();
     else if(name == u"dataRect"_s)
     {
         if(value.canConvert<QVariantMap>())
@@ -896,7 +1006,7 @@ void CorrelationPluginInstance::computeHierarchicalClustering()
     if(_continuousHcOrder.empty())
     {
         commandManager()->execute(ExecutePolicy::Once, std::make_unique<HierarchicalClusteringCommand>(
-            _continuousData, _numContinuousColumns, _numRows, *this));
+            _continuousData, _numContinuousColumns, _numRows, *this, _hcLinkage));
     }
     else
         emit hierarchicalClusteringComplete();
@@ -983,40 +1093,42 @@ QByteArray CorrelationPluginInstance::save(IMutableGraph& graph, Progressable& p
     progressable.setPhase(QObject::tr("Data"));
     jsonObject["continuousData"] = [&]
     {
-        json array;
+        std::vector<double> values;
+        values.reserve(graph.nodeIds().size() * _numContinuousColumns);
 
         uint64_t i = 0;
         for(const auto& nodeId : graph.nodeIds())
         {
             const auto& dataRow = continuousDataRowForNodeId(nodeId);
-            std::copy(dataRow.begin(), dataRow.end(), std::back_inserter(array));
+            values.insert(values.end(), dataRow.begin(), dataRow.end());
 
             progressable.setProgress(static_cast<int>((i++) * 100 / graph.nodeIds().size()));
         }
 
         progressable.setProgress(-1);
-        Q_ASSERT(_numContinuousColumns == 0 || (array.size() % _numContinuousColumns) == 0);
+        Q_ASSERT(_numContinuousColumns == 0 || (values.size() % _numContinuousColumns) == 0);
 
-        return array;
+        return u::binaryBlockAsJson(values);
     }();
 
     jsonObject["discreteData"] = [&]
     {
-        json array;
+        std::vector<QString> values;
+        values.reserve(graph.nodeIds().size() * _numDiscreteColumns);
 
         uint64_t i = 0;
         for(const auto& nodeId : graph.nodeIds())
         {
             const auto& dataRow = discreteDataRowForNodeId(nodeId);
-            std::copy(dataRow.begin(), dataRow.end(), std::back_inserter(array));
+            values.insert(values.end(), dataRow.begin(), dataRow.end());
 
             progressable.setProgress(static_cast<int>((i++) * 100 / graph.nodeIds().size()));
         }
 
         progressable.setProgress(-1);
-        Q_ASSERT(_numDiscreteColumns == 0 || (array.size() % _numDiscreteColumns) == 0);
+        Q_ASSERT(_numDiscreteColumns == 0 || (values.size() % _numDiscreteColumns) == 0);
 
-        return array;
+        return u::binaryBlockAsJson(values);
     }();
 
     jsonObject["hcOrdering"] = [&]
@@ -1036,7 +1148,7 @@ QByteArray CorrelationPluginInstance::save(IMutableGraph& graph, Progressable& p
     }();
 
     progressable.setPhase(QObject::tr("Correlation Values"));
-    jsonObject["correlationValues"] = u::graphArrayAsJson(*_correlationValues, graph.edgeIds(), &progressable);
+    jsonObject["correlationValues"] = u::graphArrayAsBinaryJson(*_correlationValues, graph.edgeIds());
 
     jsonObject["minimumThreshold"] = _minimumThreshold;
     jsonObject["maximumK"] = _maximumK;
@@ -1051,6 +1163,7 @@ QByteArray CorrelationPluginInstance::save(IMutableGraph& graph, Progressable& p
     jsonObject["missingDataReplacementValue"] = _missingDataReplacementValue;
     jsonObject["clippingType"] = static_cast<int>(_clippingType);
     jsonObject["clippingValue"] = _clippingValue;
+    jsonObject["hierarchicalClusteringLinkage"] = static_cast<int>(_hcLinkage);
 
     return QByteArray::fromStdString(jsonObject.dump());
 }
@@ -1131,10 +1244,22 @@ bool CorrelationPluginInstance::load(const QByteArray& data, int dataVersion, IM
     }
 
     const auto& jsonContinuousData = jsonObject[continuousDataKey];
-    for(const auto& value : jsonContinuousData)
+
+    if(dataVersion >= 16)
+    {
+        if(!u::binaryBlockFromJson(jsonContinuousData, _continuousData))
+        {
+            setGenericFailureReason(CURRENT_SOURCE_LOCATION);
+            return false;
+        }
+    }
+    else
     {
-        _continuousData.emplace_back(value);
-        parser.setProgress(static_cast<int>((i++ * 100) / jsonContinuousData.size()));
+        for(const auto& value : jsonContinuousData)
+        {
+            _continuousData.emplace_back(value);
+            parser.setProgress(static_cast<int>((i++ * 100) / jsonContinuousData.size()));
+        }
     }
 
     if(_numContinuousColumns > 0)
@@ -1159,12 +1284,24 @@ bool CorrelationPluginInstance::load(const QByteArray& data, int dataVersion, IM
             return false;
         }
 
-        i = 0;
         const auto& jsonDiscreteData = jsonObject["discreteData"];
-        for(const auto& value : jsonDiscreteData)
+
+        if(dataVersion >= 16)
         {
-            _discreteData.emplace_back(QString::fromStdString(value));
-            parser.setProgress(static_cast<int>((i++ * 100) / jsonDiscreteData.size()));
+            if(!u::binaryBlockFromJson(jsonDiscreteData, _discreteData))
+            {
+                setGenericFailureReason(CURRENT_SOURCE_LOCATION);
+                return false;
+            }
+        }
+        else
+        {
+            i = 0;
+            for(const auto& value : jsonDiscreteData)
+            {
+                _discreteData.emplace_back(QString::fromStdString(value));
+                parser.setProgress(static_cast<int>((i++ * 100) / jsonDiscreteData.size()));
+            }
         }
 
         if(_numDiscreteColumns > 0)
@@ -1212,8 +1349,8 @@ bool CorrelationPluginInstance::load(const QByteArray& data, int dataVersion, IM
 
         if(!nodeId.isNull())
         {
-            _continuousDataRows.emplace_back(_continuousData, row, _numContinuousColumns, nodeId).update();
-            _discreteDataRows.emplace_back(_discreteData, row, _numDiscreteColumns, nodeId).update();
+            _continuousDataRows.emplace_back(continuousDataFor(row), nodeId).update();
+            _discreteDataRows.emplace_back(discreteDataFor(row), nodeId).update();
         }
 
         parser.setProgress(static_cast<int>((row * 100) / _numRows));
@@ -1234,7 +1371,21 @@ bool CorrelationPluginInstance::load(const QByteArray& data, int dataVersion, IM
     parser.setPhase(QObject::tr("Correlation Values"));
     i = 0;
 
-    if(dataVersion >= 2)
+    if(dataVersion >= 16)
+    {
+        auto valid = u::forEachBinaryJsonGraphArray(jsonCorrelationValues, [&](EdgeId edgeId, double correlationValue)
+        {
+            Q_ASSERT(graph.containsEdgeId(edgeId));
+            _correlationValues->set(edgeId, correlationValue);
+        });
+
+        if(!valid)
+        {
+            setGenericFailureReason(CURRENT_SOURCE_LOCATION);
+            return false;
+        }
+    }
+    else if(dataVersion >= 2)
     {
         u::forEachJsonGraphArray(jsonCorrelationValues, [&](EdgeId edgeId, double correlationValue)
         {
@@ -1293,6 +1444,17 @@ bool CorrelationPluginInstance::load(const QByteArray& data, int dataVersion, IM
         _clippingValue = jsonObject["clippingValue"];
     }
 
+    if(dataVersion >= 17)
+    {
+        if(!u::contains(jsonObject, "hierarchicalClusteringLinkage"))
+        {
+            setGenericFailureReason(CURRENT_SOURCE_LOCATION);
+            return false;
+        }
+
+        _hcLinkage = normaliseQmlEnum<HierarchicalClusteringLinkage>(jsonObject["hierarchicalClusteringLinkage"]);
+    }
+
     if(dataVersion >= 7)
     {
         if(!u::containsAllOf(jsonObject, {"correlationDataType", "continuousCorrelationType",
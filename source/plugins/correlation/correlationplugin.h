@@ -41,6 +41,7 @@
 #include <functional>
 #include <algorithm>
 #include <utility>
+#include <span>
 
 #include <QString>
 #include <QStringList>
@@ -89,6 +90,8 @@ private:
 
     CorrelationNodeAttributeTableModel _nodeAttributeTableModel;
 
+    // The canonical row-major data; the data rows are views into these, so
+    // they must not be reallocated once the rows have been created
     std::vector<double> _continuousData;
     std::vector<QString> _discreteData;
 
@@ -121,6 +124,9 @@ private:
     ClippingType _clippingType = ClippingType::None;
     double _clippingValue = 0.0;
     bool _treatAsBinary = false;
+    HierarchicalClusteringLinkage _hcLinkage = HierarchicalClusteringLinkage::Single;
+    bool _storeEdges = false;
+    double _edgeStoreFloor = 0.5;
     QStringList _additionalTransforms;
     QStringList _additionalVisualisations;
 
@@ -153,6 +159,11 @@ private:
     QStringList sharedValuesAttributeNames() const;
     QStringList numericalAttributeNames() const;
 
+    QByteArray correlationCacheKey() const;
+
+    std::span<double> continuousDataFor(size_t row);
+    std::span<QString> discreteDataFor(size_t row);
+
 public:
     void setDimensions(size_t numContinuousColumns, size_t numDiscreteColumns, size_t numRows);
     bool loadUserData(const TabularData& tabularData, const QRect& dataRect, IParser& parser);
@@ -244,7 +255,7 @@ public:
 
     QString imageSource() const override { return u"qrc:///qt/qml/Graphia/Plugins/Correlation/plots.svg"_s; }
 
-    int dataVersion() const override { return 15; }
+    int dataVersion() const override { return 17; }
 
     QStringList identifyUrl(const QUrl& url) const override;
     QString failureReason(const QUrl& url) const override;
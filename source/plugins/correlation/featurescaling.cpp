@@ -19,243 +19,104 @@
 
 #include "featurescaling.h"
 
-#include "shared/loading/iparser.h"
-#include "shared/utils/cancellable.h"
-
 #include <limits>
 #include <algorithm>
 #include <cmath>
 
-struct StandardNormalisationValues
+namespace
 {
-    std::vector<double>* mins = nullptr;
-    std::vector<double>* maxs = nullptr;
-    std::vector<double>* ranges = nullptr;
-    std::vector<double>* means = nullptr;
-    std::vector<double>* stddevs = nullptr;
-};
-
-static bool calcStandardValues(const ContinuousDataVectors& dataRows,
-    const StandardNormalisationValues& values, IParser* parser = nullptr)
+struct ColumnValues
 {
-    if(dataRows.empty())
-        return true;
-
-    auto numColumns = dataRows.at(0).size();
-
-    if(values.mins != nullptr)
-        values.mins->resize(numColumns, std::numeric_limits<double>::max());
-
-    if(values.maxs != nullptr)
-        values.maxs->resize(numColumns, std::numeric_limits<double>::lowest());
-
-    if(values.ranges != nullptr)
-        values.ranges->resize(numColumns);
-
-    if(values.means != nullptr)
-        values.means->resize(numColumns, 0.0);
+    double _min = std::numeric_limits<double>::max();
+    double _max = std::numeric_limits<double>::lowest();
+    double _mean = 0.0;
 
-    if(values.stddevs != nullptr)
-        values.stddevs->resize(numColumns, 0.0);
+    double range() const { return _max - _min; }
+};
 
-    uint64_t i = 0;
+ColumnValues columnValuesFor(const double* column, size_t numRows)
+{
+    ColumnValues values;
+    double sum = 0.0;
 
-    for(const auto& dataRow : dataRows)
+    for(size_t row = 0; row < numRows; row++)
     {
-        if(parser != nullptr && parser->cancelled())
-            return false;
-
-        for(size_t column = 0; column < numColumns; column++)
-        {
-            auto value = dataRow.valueAt(column);
-
-            if(values.mins != nullptr)
-                (*values.mins)[column] = std::min((*values.mins)[column], value);
-
-            if(values.maxs != nullptr)
-                (*values.maxs)[column] = std::max((*values.maxs)[column], value);
-
-            if(values.means != nullptr)
-                (*values.means)[column] += (value / static_cast<double>(numColumns));
-        }
-
-        if(parser != nullptr)
-            parser->setProgress(static_cast<int>((i * 100) / dataRows.size()));
+        auto value = column[row];
 
-        i++;
+        values._min = std::min(values._min, value);
+        values._max = std::max(values._max, value);
+        sum += value;
     }
 
-    if(values.ranges != nullptr && values.mins != nullptr && values.maxs != nullptr)
-    {
-        for(size_t column = 0; column < numColumns; column++)
-            (*values.ranges)[column] = (*values.maxs)[column] - (*values.mins)[column];
-    }
-
-    if(values.stddevs != nullptr && values.means != nullptr)
-    {
-        i = 0;
+    values._mean = sum / static_cast<double>(numRows);
 
-        for(const auto& dataRow : dataRows)
-        {
-            if(parser != nullptr && parser->cancelled())
-                return false;
-
-            for(size_t column = 0; column < numColumns; column++)
-            {
-                auto deviation = dataRow.valueAt(column) - (*values.means)[column];
-                deviation *= deviation;
-                (*values.stddevs)[column] += (deviation / static_cast<double>(numColumns));
-            }
-
-            if(parser != nullptr)
-                parser->setProgress(static_cast<int>((i * 100) / dataRows.size()));
+    return values;
+}
 
-            i++;
-        }
+double stddevFor(const double* column, size_t numRows, double mean)
+{
+    double sum = 0.0;
 
-        // Variance -> Std. Deviations
-        for(size_t column = 0; column < numColumns; column++)
-            (*values.stddevs)[column] = std::sqrt((*values.stddevs)[column]);
+    for(size_t row = 0; row < numRows; row++)
+    {
+        auto deviation = column[row] - mean;
+        sum += deviation * deviation;
     }
 
-    return true;
+    return std::sqrt(sum / static_cast<double>(numRows));
 }
 
-static bool normalise(ContinuousDataVectors& dataRows,
-    const std::vector<double>& subtractors,
-    const std::vector<double>& denominators,
-    IParser* parser)
+void normalise(double* column, size_t numRows, double subtractor, double denominator)
 {
-    auto numColumns = dataRows.at(0).size();
-
-    uint64_t i = 0;
-
-    for(auto& dataRow : dataRows)
+    if(denominator > 0.0)
     {
-        if(parser != nullptr && parser->cancelled())
-            return false;
-
-        for(size_t column = 0; column < numColumns; column++)
-        {
-            if(denominators[column] > 0.0)
-            {
-                dataRow.setValueAt(column,
-                    (dataRow.valueAt(column) - subtractors[column]) / denominators[column]);
-            }
-            else
-                dataRow.setValueAt(column, 0.0);
-        }
-
-        if(parser != nullptr)
-            parser->setProgress(static_cast<int>((i * 100) / dataRows.size()));
-
-        i++;
+        for(size_t row = 0; row < numRows; row++)
+            column[row] = (column[row] - subtractor) / denominator;
     }
-
-    if(parser != nullptr)
-        parser->setProgress(-1);
-
-    return true;
+    else
+        std::fill(column, column + numRows, 0.0);
 }
+} // namespace
 
-bool MinMaxNormaliser::process(ContinuousDataVectors& dataRows,
-    IParser* parser) const
+bool MinMaxNormaliser::process(ContinuousDataVectors& dataRows, IParser* parser) const
 {
-    if(dataRows.empty())
-        return true;
-
-    std::vector<double> mins;
-    std::vector<double> maxs;
-    std::vector<double> ranges;
-
-    if(!calcStandardValues(dataRows, {&mins, &maxs, &ranges}, parser))
-        return false;
-
-    return normalise(dataRows, mins, ranges, parser);
+    return processColumns(dataRows, [](double* column, size_t numRows)
+    {
+        auto values = columnValuesFor(column, numRows);
+        normalise(column, numRows, values._min, values.range());
+    }, parser);
 }
 
 bool MeanNormaliser::process(ContinuousDataVectors& dataRows, IParser* parser) const
 {
-    if(dataRows.empty())
-        return true;
-
-    std::vector<double> mins;
-    std::vector<double> maxs;
-    std::vector<double> ranges;
-    std::vector<double> means;
-
-    if(!calcStandardValues(dataRows, {&mins, &maxs, &ranges, &means}, parser))
-        return false;
-
-    return normalise(dataRows, means, ranges, parser);
+    return processColumns(dataRows, [](double* column, size_t numRows)
+    {
+        auto values = columnValuesFor(column, numRows);
+        normalise(column, numRows, values._mean, values.range());
+    }, parser);
 }
 
 bool StandardisationNormaliser::process(ContinuousDataVectors& dataRows, IParser* parser) const
 {
-    if(dataRows.empty())
-        return true;
-
-    std::vector<double> mins;
-    std::vector<double> maxs;
-    std::vector<double> ranges;
-    std::vector<double> means;
-    std::vector<double> stddevs;
-
-    if(!calcStandardValues(dataRows, {&mins, &maxs, &ranges, &means, &stddevs}, parser))
-        return false;
-
-    return normalise(dataRows, means, stddevs, parser);
+    return processColumns(dataRows, [](double* column, size_t numRows)
+    {
+        auto values = columnValuesFor(column, numRows);
+        auto stddev = stddevFor(column, numRows, values._mean);
+        normalise(column, numRows, values._mean, stddev);
+    }, parser);
 }
 
 bool UnitScalingNormaliser::process(ContinuousDataVectors& dataRows, IParser* parser) const
 {
-    auto numColumns = dataRows.at(0).size();
-
-    std::vector<double> vectorLengthColumn(numColumns);
-
-    uint64_t i = 0;
-
-    for(auto& dataRow : dataRows)
-    {
-        if(parser != nullptr && parser->cancelled())
-            return false;
-
-        for(size_t column = 0; column < numColumns; column++)
-        {
-            auto value = dataRow.valueAt(column);
-            vectorLengthColumn[column] += (value * value);
-        }
-
-        if(parser != nullptr)
-            parser->setProgress(static_cast<int>((i * 100) / dataRows.size()));
-
-        i++;
-    }
-
-    if(parser != nullptr)
-        parser->setProgress(-1);
-
-    for(size_t column = 0; column < numColumns; column++)
-        vectorLengthColumn[column] = std::sqrt(vectorLengthColumn[column]);
-
-    i = 0;
-
-    for(auto& dataRow : dataRows)
+    return processColumns(dataRows, [](double* column, size_t numRows)
     {
-        if(parser != nullptr && parser->cancelled())
-            return false;
+        double sumSq = 0.0;
+        for(size_t row = 0; row < numRows; row++)
+            sumSq += column[row] * column[row];
 
-        for(size_t column = 0; column < numColumns; column++)
-        {
-            auto scaledValue = dataRow.valueAt(column) / vectorLengthColumn[column];
-            dataRow.setValueAt(column, scaledValue);
-        }
-
-        if(parser != nullptr)
-            parser->setProgress(static_cast<int>((i * 100) / dataRows.size()));
-
-        i++;
-    }
+        auto vectorLength = std::sqrt(sumSq);
 
-    return true;
+        for(size_t row = 0; row < numRows; row++)
+            column[row] /= vectorLength;
+    }, parser);
 }
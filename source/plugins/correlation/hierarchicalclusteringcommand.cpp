@@ -20,11 +20,15 @@
 #include "hierarchicalclusteringcommand.h"
 
 #include "correlationplugin.h"
-#include "correlationdatavector.h"
-#include "correlation.h"
+
+#include "shared/utils/threadpool.h"
 
 #include <vector>
 #include <limits>
+#include <numeric>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 
 #include <QObject>
 
@@ -66,140 +70,417 @@ struct Link
     size_t _pi;
 };
 
-class EuclideanDistanceAlgorithm
+namespace
+{
+// Stores only the upper triangle (excluding the diagonal) of a symmetric
+// distance matrix, so that it occupies a quarter of the memory that a full
+// matrix of doubles would; row i's entries (i, i + 1) ... (i, size - 1) are
+// contiguous
+class CondensedDistanceMatrix
 {
+private:
+    size_t _size = 0;
+    std::vector<float> _distances;
+
+    size_t offsetOf(size_t i, size_t j) const
+    {
+        Q_ASSERT(i < j && j < _size);
+        return ((i * ((2 * _size) - i - 1)) / 2) + (j - i - 1);
+    }
+
 public:
-    double evaluate(size_t size, const ContinuousDataVector* vectorA, const ContinuousDataVector* vectorB) const
+    explicit CondensedDistanceMatrix(size_t size) :
+        _size(size), _distances((size * (size - 1)) / 2)
+    {}
+
+    size_t size() const { return _size; }
+
+    float valueAt(size_t i, size_t j) const
     {
-        double sum = 0.0;
+        return i < j ? _distances[offsetOf(i, j)] : _distances[offsetOf(j, i)];
+    }
 
-        for(size_t i = 0; i < size; i++)
-        {
-            auto diff = vectorA->valueAt(i) - vectorB->valueAt(i);
-            auto diffSq = diff * diff;
-            sum += diffSq;
-        }
+    void setValueAt(size_t i, size_t j, float value)
+    {
+        if(i < j)
+            _distances[offsetOf(i, j)] = value;
+        else
+            _distances[offsetOf(j, i)] = value;
+    }
 
-        return sum != 0.0 ? std::sqrt(sum) : 0.0;
+    float* row(size_t i)
+    {
+        Q_ASSERT(i + 1 < _size);
+        return &_distances[offsetOf(i, i + 1)];
     }
+};
 
-    static QString name() { return {}; }
-    static QString description() { return {}; }
-    static QString attributeName() { return {}; }
-    static QString attributeDescription() { return {}; }
+// Two clusters (identified by any of their members) being joined at some distance
+struct Merge
+{
+    size_t _a = 0;
+    size_t _b = 0;
+    float _distance = 0.0f;
 };
 
-class EuclideanDistanceCorrelation : public CovarianceCorrelation<EuclideanDistanceAlgorithm, ThresholdFilter> {};
+constexpr size_t CHUNK_SIZE = 4096;
 
-HierarchicalClusteringCommand::HierarchicalClusteringCommand(const std::vector<double>& data,
-    size_t numColumns, size_t numRows, CorrelationPluginInstance& correlationPluginInstance) :
-    _data(&data), _numColumns(numColumns), _numRows(numRows),
-    _correlationPluginInstance(&correlationPluginInstance)
+std::vector<size_t> chunksOf(size_t size)
 {
-    Q_ASSERT(_numColumns > 0 && _numRows > 0);
+    std::vector<size_t> chunks;
+
+    for(size_t chunk = 0; chunk < size; chunk += CHUNK_SIZE)
+        chunks.push_back(chunk);
+
+    return chunks;
 }
 
-bool HierarchicalClusteringCommand::execute()
+double sumOfSquaredDifferences(const double* a, const double* b, size_t size)
 {
-    ContinuousDataVectors dataColumns;
+    double sum = 0.0;
 
-    for(size_t column = 0; column < _numColumns; column++)
-        dataColumns.emplace_back(*_data, column, _numColumns, _numRows);
+    for(size_t k = 0; k < size; k++)
+    {
+        auto diff = a[k] - b[k];
+        sum += diff * diff;
+    }
 
-    for(auto& dataColumn : dataColumns)
-        dataColumn.update();
+    return sum;
+}
 
-    const EuclideanDistanceCorrelation correlation;
+// Distance from column i to every subsequent column, four at a time so
+// that each value of column i is loaded once per four distances
+void computeDistanceRow(CondensedDistanceMatrix& matrix, const std::vector<double>& columns,
+    size_t numRows, size_t i)
+{
+    const auto numColumns = matrix.size();
+    if(i + 1 >= numColumns)
+        return;
 
-    setPhase(QObject::tr("Correlating"));
-    auto matrix = correlation.matrix(dataColumns, {}, this, this);
+    const auto* a = &columns[i * numRows];
+    auto* out = matrix.row(i);
+    size_t j = i + 1;
 
-    if(cancelled())
-        return false;
+    for(; j + 4 <= numColumns; j += 4)
+    {
+        const auto* b0 = &columns[j * numRows];
+        const auto* b1 = b0 + numRows;
+        const auto* b2 = b1 + numRows;
+        const auto* b3 = b2 + numRows;
 
-    setPhase(QObject::tr("Clustering"));
+        double s0 = 0.0;
+        double s1 = 0.0;
+        double s2 = 0.0;
+        double s3 = 0.0;
+
+        for(size_t k = 0; k < numRows; k++)
+        {
+            auto ak = a[k];
+            auto d0 = ak - b0[k]; s0 += d0 * d0;
+            auto d1 = ak - b1[k]; s1 += d1 * d1;
+            auto d2 = ak - b2[k]; s2 += d2 * d2;
+            auto d3 = ak - b3[k]; s3 += d3 * d3;
+        }
+
+        *out++ = static_cast<float>(std::sqrt(s0));
+        *out++ = static_cast<float>(std::sqrt(s1));
+        *out++ = static_cast<float>(std::sqrt(s2));
+        *out++ = static_cast<float>(std::sqrt(s3));
+    }
+
+    for(; j < numColumns; j++)
+        *out++ = static_cast<float>(std::sqrt(sumOfSquaredDifferences(a, &columns[j * numRows], numRows)));
+}
 
-    std::vector<double> ls(dataColumns.size());
-    std::vector<size_t> ps(dataColumns.size());
-    std::vector<double> ms(dataColumns.size());
+// Single linkage clusters are given by the minimum spanning tree of the
+// distances, which is found here using the dense variant of Prim's algorithm,
+// each step of which is performed concurrently over chunks of the columns
+std::vector<Merge> singleLinkage(const CondensedDistanceMatrix& matrix, ICommand& command)
+{
+    const auto size = matrix.size();
+
+    std::vector<float> nearest(size, std::numeric_limits<float>::infinity());
+    std::vector<size_t> nearestTo(size, 0);
+    std::vector<char> inTree(size, 0);
 
-    ps[0] = 0;
-    ls[0] = std::numeric_limits<double>::infinity();
+    auto chunks = chunksOf(size);
 
-    uint64_t progress = 0;
-    const uint64_t total = (dataColumns.size() * (dataColumns.size() - 1)) / 2;
+    std::vector<Merge> merges;
+    merges.reserve(size - 1);
 
-    for(size_t i = 1; i < dataColumns.size(); i++)
+    size_t current = 0;
+    inTree[current] = 1;
+
+    for(size_t step = 1; step < size; step++)
     {
-        ps[i] = i;
-        ls[i] = std::numeric_limits<double>::infinity();
+        struct Candidate
+        {
+            size_t _index;
+            float _distance;
+        };
 
-        for(size_t j = 0; j < i; j++)
-            ms[j] = matrix.valueAt(i, j);
+        auto candidates = parallel_for(chunks.begin(), chunks.end(),
+        [&](size_t chunk)
+        {
+            Candidate best{size, std::numeric_limits<float>::infinity()};
+
+            for(size_t j = chunk; j < std::min(chunk + CHUNK_SIZE, size); j++)
+            {
+                if(inTree[j] != 0)
+                    continue;
+
+                auto distance = matrix.valueAt(current, j);
+                if(distance < nearest[j])
+                {
+                    nearest[j] = distance;
+                    nearestTo[j] = current;
+                }
+
+                if(best._index == size || nearest[j] < best._distance)
+                    best = {j, nearest[j]};
+            }
 
-        for(size_t j = 0; j < i; j++)
+            return best;
+        });
+
+        Candidate best{size, std::numeric_limits<float>::infinity()};
+        for(const auto& candidate : candidates)
         {
-            auto pi = ps[j];
+            if(candidate._index == size)
+                continue;
 
-            if(ls[j] >= ms[j])
+            if(best._index == size || candidate._distance < best._distance ||
+                (candidate._distance == best._distance && candidate._index < best._index))
             {
-                ms[pi] = std::min(ms[pi], ls[j]);
-                ls[j] = ms[j];
-                ps[j] = i;
+                best = candidate;
             }
-            else
-                ms[pi] = std::min(ms[pi], ms[j]);
         }
 
-        for(size_t j = 0; j < i; j++)
+        Q_ASSERT(best._index < size);
+
+        merges.push_back({nearestTo[best._index], best._index, best._distance});
+        inTree[best._index] = 1;
+        current = best._index;
+
+        command.setProgress(static_cast<int>((step * 100) / size));
+
+        if(command.cancelled())
+            return {};
+    }
+
+    return merges;
+}
+
+// Average and complete linkage are found using nearest neighbour chains,
+// updating the distances in place using the Lance-Williams formulae; the
+// surviving member of each merge represents the combined cluster thereafter
+std::vector<Merge> chainLinkage(CondensedDistanceMatrix& matrix,
+    HierarchicalClusteringLinkage linkage, ICommand& command)
+{
+    const auto size = matrix.size();
+
+    std::vector<size_t> clusterSizes(size, 1);
+    std::vector<char> active(size, 1);
+    std::vector<size_t> chain;
+
+    std::vector<Merge> merges;
+    merges.reserve(size - 1);
+
+    size_t firstActive = 0;
+
+    while(merges.size() < size - 1)
+    {
+        if(chain.empty())
         {
-            auto pi = ps[j];
+            while(active[firstActive] == 0)
+                firstActive++;
 
-            if(ls[j] >= ls[pi])
-                ps[j] = i;
+            chain.push_back(firstActive);
+        }
 
-            setProgress(static_cast<int>((progress++ * 100) / total));
+        size_t a = 0;
+        size_t b = 0;
+
+        while(true)
+        {
+            a = chain.back();
+
+            // Prefer the previous link in the chain when it's one of the nearest,
+            // otherwise ties could cause the chain to cycle indefinitely
+            auto hasPrevious = chain.size() > 1;
+            b = hasPrevious ? chain[chain.size() - 2] : size;
+            auto minDistance = hasPrevious ? matrix.valueAt(a, b) : std::numeric_limits<float>::infinity();
+
+            for(size_t x = 0; x < size; x++)
+            {
+                if(x == a || active[x] == 0)
+                    continue;
+
+                auto distance = matrix.valueAt(a, x);
+                if(b == size || distance < minDistance)
+                {
+                    minDistance = distance;
+                    b = x;
+                }
+            }
+
+            if(hasPrevious && b == chain[chain.size() - 2])
+                break;
+
+            chain.push_back(b);
         }
 
-        if(cancelled())
-            return false;
+        chain.resize(chain.size() - 2);
+        merges.push_back({a, b, matrix.valueAt(a, b)});
+
+        const auto sizeA = static_cast<double>(clusterSizes[a]);
+        const auto sizeB = static_cast<double>(clusterSizes[b]);
+
+        for(size_t x = 0; x < size; x++)
+        {
+            if(x == a || x == b || active[x] == 0)
+                continue;
+
+            const auto distanceA = static_cast<double>(matrix.valueAt(a, x));
+            const auto distanceB = static_cast<double>(matrix.valueAt(b, x));
+
+            auto distance = linkage == HierarchicalClusteringLinkage::Complete ?
+                std::max(distanceA, distanceB) :
+                ((sizeA * distanceA) + (sizeB * distanceB)) / (sizeA + sizeB);
+
+            matrix.setValueAt(b, x, static_cast<float>(distance));
+        }
+
+        clusterSizes[b] += clusterSizes[a];
+        active[a] = 0;
+
+        command.setProgress(static_cast<int>((merges.size() * 100) / size));
+
+        if(command.cancelled())
+            return {};
     }
 
-    setProgress(-1);
+    return merges;
+}
+} // namespace
+
+HierarchicalClusteringCommand::HierarchicalClusteringCommand(const std::vector<double>& data,
+    size_t numColumns, size_t numRows, CorrelationPluginInstance& correlationPluginInstance,
+    HierarchicalClusteringLinkage linkage) :
+    _data(&data), _numColumns(numColumns), _numRows(numRows), _linkage(linkage),
+    _correlationPluginInstance(&correlationPluginInstance)
+{
+    Q_ASSERT(_numColumns > 0 && _numRows > 0);
+}
+
+bool HierarchicalClusteringCommand::execute()
+{
+    const auto numColumns = _numColumns;
+    const auto numRows = _numRows;
+    const auto& data = *_data;
 
-    std::vector<size_t> sortedIndices(dataColumns.size());
-    std::iota(sortedIndices.begin(), sortedIndices.end(), 0);
+    std::vector<size_t> ordering(numColumns, 0);
 
-    std::sort(sortedIndices.begin(), sortedIndices.end(),
-        [&ls](auto a, auto b) { return ls.at(a) < ls.at(b); });
+    if(numColumns == 1)
+    {
+        _correlationPluginInstance->setHcOrdering(ordering);
+        return true;
+    }
+
+    setPhase(QObject::tr("Correlating"));
+
+    // Make each column contiguous, so that the distance kernel is streaming through memory
+    std::vector<double> columns(numColumns * numRows);
+    auto columnIndices = chunksOf(numColumns);
+    parallel_for(columnIndices.begin(), columnIndices.end(),
+    [&](size_t chunk)
+    {
+        for(size_t row = 0; row < numRows; row++)
+        {
+            for(size_t column = chunk; column < std::min(chunk + CHUNK_SIZE, numColumns); column++)
+                columns[(column * numRows) + row] = data[(row * numColumns) + column];
+        }
+    });
+
+    CondensedDistanceMatrix matrix(numColumns);
+
+    // Row i of the triangle has (numColumns - i - 1) entries, so pair it with row
+    // (numColumns - i - 1) in order that each unit of work costs roughly the same
+    std::vector<size_t> rowPairs((numColumns + 1) / 2);
+    std::iota(rowPairs.begin(), rowPairs.end(), 0);
+
+    std::atomic<size_t> numPairsComputed = 0;
+    parallel_for(rowPairs.begin(), rowPairs.end(),
+    [&](size_t i)
+    {
+        if(cancelled())
+            return;
+
+        computeDistanceRow(matrix, columns, numRows, i);
+
+        auto mirror = numColumns - i - 1;
+        if(mirror != i)
+            computeDistanceRow(matrix, columns, numRows, mirror);
+
+        setProgress(static_cast<int>((++numPairsComputed * 100) / rowPairs.size()));
+    });
+
+    // We don't need this any more, so free up any memory it's consuming
+    columns = {};
+
+    if(cancelled())
+        return false;
+
+    setPhase(QObject::tr("Clustering"));
+    setProgress(0);
+
+    auto merges = _linkage == HierarchicalClusteringLinkage::Single ?
+        singleLinkage(matrix, *this) :
+        chainLinkage(matrix, _linkage, *this);
+
+    if(cancelled())
+        return false;
+
+    setProgress(-1);
+
+    std::stable_sort(merges.begin(), merges.end(),
+        [](const auto& a, const auto& b) { return a._distance < b._distance; });
 
     std::vector<Link> links;
-    links.reserve(dataColumns.size());
+    links.reserve(numColumns);
+
+    Unions unions(numColumns * 2);
 
-    Unions unions(dataColumns.size() * 2);
+    // The highest numbered column in each cluster; the cluster for which this
+    // is lower is placed first in each link, so that the leaf ordering is the
+    // same as that of the pointer representation
+    std::vector<size_t> maxColumns(numColumns * 2);
+    std::iota(maxColumns.begin(), maxColumns.end(), 0);
 
     // Generate linkage
-    for(size_t i = 0; i < dataColumns.size() - 1; i++)
+    for(size_t i = 0; i < merges.size(); i++)
     {
-        auto index = sortedIndices.at(i);
-        auto pi = ps.at(index);
+        const auto& merge = merges.at(i);
+
+        auto rA = unions.find(merge._a);
+        auto rB = unions.find(merge._b);
 
-        auto rIndex = unions.find(index);
-        auto rPi = unions.find(pi);
+        if(maxColumns.at(rA) > maxColumns.at(rB))
+            std::swap(rA, rB);
 
-        links.push_back({rIndex, rPi});
+        links.push_back({rA, rB});
+        maxColumns[numColumns + i] = maxColumns.at(rB);
 
-        unions.join(index, dataColumns.size() + i);
-        unions.join(pi, dataColumns.size() + i);
+        unions.join(merge._a, numColumns + i);
+        unions.join(merge._b, numColumns + i);
     }
 
     // Find leaves
     size_t orderingIndex = 0;
     size_t i = 0;
-    std::vector<size_t> current(dataColumns.size());
-    current[0] = (dataColumns.size() * 2) - 2;
-    std::vector<bool> visited(dataColumns.size() * 2);
-    std::vector<size_t> ordering(dataColumns.size());
+    std::vector<size_t> current(numColumns);
+    current[0] = (numColumns * 2) - 2;
+    std::vector<bool> visited(numColumns * 2);
 
     auto add = [&](size_t index)
     {
@@ -207,7 +488,7 @@ bool HierarchicalClusteringCommand::execute()
             return false;
 
         visited[index] = true;
-        if(index >= dataColumns.size())
+        if(index >= numColumns)
         {
             current[++i] = index;
             return true;
@@ -219,7 +500,7 @@ bool HierarchicalClusteringCommand::execute()
 
     while(true)
     {
-        const auto& link = links.at(current[i] - dataColumns.size());
+        const auto& link = links.at(current[i] - numColumns);
 
         if(add(link._index) || add(link._pi))
             continue;
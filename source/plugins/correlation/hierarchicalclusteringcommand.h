@@ -22,8 +22,12 @@
 
 #include "shared/commands/icommand.h"
 
+#include "correlationtype.h"
+
 #include <QObject>
 
+#include <vector>
+
 class CorrelationPluginInstance;
 
 class HierarchicalClusteringCommand : public ICommand
@@ -32,13 +36,15 @@ private:
     const std::vector<double>* _data = nullptr;
     size_t _numColumns = 0;
     size_t _numRows = 0;
+    HierarchicalClusteringLinkage _linkage = HierarchicalClusteringLinkage::Single;
 
     CorrelationPluginInstance* _correlationPluginInstance = nullptr;
 
 public:
     HierarchicalClusteringCommand(const std::vector<double>& data,
         size_t numColumns, size_t numRows,
-        CorrelationPluginInstance& correlationPluginInstance);
+        CorrelationPluginInstance& correlationPluginInstance,
+        HierarchicalClusteringLinkage linkage);
 
     QString description() const override { return QObject::tr("Sorting Columns"); }
 
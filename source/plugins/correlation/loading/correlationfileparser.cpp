@@ -29,17 +29,22 @@
 #include "shared/graph/imutablegraph.h"
 
 #include "shared/loading/tabulardata.h"
+#include "shared/loading/tabulardatacache.h"
 #include "shared/loading/xlsxtabulardataparser.h"
 
 #include "shared/utils/container.h"
 #include "shared/utils/string.h"
+#include "shared/utils/threadpool.h"
 
 #include <QRect>
 
 #include <vector>
 #include <set>
+#include <algorithm>
+#include <cmath>
 #include <utility>
 #include <limits>
+#include <numeric>
 #include <span>
 
 using namespace Qt::Literals::StringLiterals;
@@ -50,98 +55,214 @@ CorrelationFileParser::CorrelationFileParser(CorrelationPluginInstance* plugin,
     _tabularData(std::move(tabularData)), _dataRect(dataRect)
 {}
 
-double CorrelationFileParser::imputeValue(MissingDataType missingDataType,
-    double replacementValue, const TabularData& tabularData,
-    const QRect& dataRect, size_t columnIndex, size_t rowIndex)
+namespace
 {
-    double imputedValue = 0.0;
+// The number of row blocks to sum separately when reducing the column averages
+constexpr size_t NumColumnAverageBlocks = 64;
 
-    auto left = static_cast<size_t>(dataRect.x());
-    auto right = static_cast<size_t>(dataRect.x()) + static_cast<size_t>(dataRect.width());
+std::vector<size_t> indicesUpTo(size_t size)
+{
+    std::vector<size_t> indices(size);
+    std::iota(indices.begin(), indices.end(), 0);
 
-    switch(missingDataType)
-    {
-    case MissingDataType::Constant:
-    {
-        imputedValue = replacementValue;
-        break;
-    }
-    case MissingDataType::ColumnAverage:
+    return indices;
+}
+
+// Missing values are NaN; columns without any values average to 0
+std::vector<double> columnAveragesOf(size_t width, const std::vector<double>& data)
+{
+    const size_t numRows = data.size() / width;
+    const size_t blockSize = std::max(size_t{1}, (numRows + NumColumnAverageBlocks - 1) / NumColumnAverageBlocks);
+    const size_t numBlocks = (numRows + blockSize - 1) / blockSize;
+
+    std::vector<double> blockSums(numBlocks * width, 0.0);
+    std::vector<size_t> blockCounts(numBlocks * width, 0);
+
+    auto blocks = indicesUpTo(numBlocks);
+    parallel_for(blocks.begin(), blocks.end(),
+    [&](size_t block)
     {
-        // Calculate column averages
-        double averageValue = 0.0;
-        size_t rowCount = 0;
-        for(size_t avgRowIndex = left; avgRowIndex < right; avgRowIndex++)
+        auto* sums = &blockSums.at(block * width);
+        auto* counts = &blockCounts.at(block * width);
+        const size_t blockEnd = std::min((block + 1) * blockSize, numRows);
+
+        for(size_t row = block * blockSize; row < blockEnd; row++)
         {
-            const auto& value = tabularData.valueAt(columnIndex, avgRowIndex);
-            if(!value.isEmpty())
+            const auto* rowData = &data.at(row * width);
+
+            for(size_t column = 0; column < width; column++)
             {
-                averageValue += value.toDouble();
-                rowCount++;
+                if(std::isnan(rowData[column]))
+                    continue;
+
+                sums[column] += rowData[column];
+                counts[column]++;
             }
         }
+    });
 
-        if(rowCount > 0)
-            averageValue /= static_cast<double>(rowCount);
+    std::vector<double> columnAverages(width, 0.0);
 
-        imputedValue = averageValue;
-        break;
+    for(size_t column = 0; column < width; column++)
+    {
+        double sum = 0.0;
+        size_t count = 0;
+
+        for(size_t block = 0; block < numBlocks; block++)
+        {
+            sum += blockSums.at((block * width) + column);
+            count += blockCounts.at((block * width) + column);
+        }
+
+        if(count > 0)
+            columnAverages[column] = sum / static_cast<double>(count);
     }
-    case MissingDataType::RowInterpolation:
+
+    return columnAverages;
+}
+
+void interpolateRow(double* rowData, size_t width)
+{
+    // The column of the most recent value that isn't missing, or width if there isn't one yet
+    size_t leftColumn = width;
+
+    for(size_t column = 0; column < width; column++)
     {
-        double rightValue = 0.0;
-        double leftValue = 0.0;
-        size_t leftDistance = 0;
-        size_t rightDistance = 0;
-        bool rightValueFound = false;
-        bool leftValueFound = false;
-
-        // Find right value
-        for(size_t rightColumn = columnIndex; rightColumn < right; rightColumn++)
+        if(std::isnan(rowData[column]))
+            continue;
+
+        const double rightValue = rowData[column];
+
+        if(leftColumn == width)
         {
-            const auto& value = tabularData.valueAt(rightColumn, rowIndex);
-            if(!value.isEmpty())
-            {
-                rightValue = value.toDouble();
-                rightValueFound = true;
-                rightDistance = (rightColumn > columnIndex) ? rightColumn - columnIndex : columnIndex - rightColumn;
-                break;
-            }
+            // Leading missing values take the first value
+            std::fill(rowData, rowData + column, rightValue);
         }
-        // Find left value
-        for(size_t leftColumn = columnIndex; leftColumn-- != left;)
+        else if(column > leftColumn + 1)
         {
-            const auto& value = tabularData.valueAt(leftColumn, rowIndex);
-            if(!value.isEmpty())
+            const double leftValue = rowData[leftColumn];
+            const auto gap = static_cast<double>(column - leftColumn);
+
+            for(size_t gapColumn = leftColumn + 1; gapColumn < column; gapColumn++)
             {
-                leftValue = value.toDouble();
-                leftValueFound = true;
-                leftDistance = (leftColumn > columnIndex) ? leftColumn - columnIndex : columnIndex - leftColumn;
-                break;
+                const double tween = static_cast<double>(gapColumn - leftColumn) / gap;
+                // https://devblogs.nvidia.com/lerp-faster-cuda/
+                rowData[gapColumn] = std::fma(tween, rightValue, std::fma(-tween, leftValue, leftValue));
             }
         }
 
-        // Lerp the result if possible, otherwise just set to found value
-        if(leftValueFound && rightValueFound)
+        leftColumn = column;
+    }
+
+    // Trailing missing values take the last value, or zero if the whole row is missing
+    const double lastValue = leftColumn < width ? rowData[leftColumn] : 0.0;
+    const size_t firstTrailingColumn = leftColumn < width ? leftColumn + 1 : 0;
+    std::fill(rowData + firstTrailingColumn, rowData + width, lastValue);
+}
+} // namespace
+
+QString CorrelationFileParser::tabularDataCacheParameters(const QString& urlTypeName)
+{
+    auto extension = urlTypeName;
+    extension.remove(u"Correlation"_s);
+
+    return extension.toLower();
+}
+
+std::vector<double> CorrelationFileParser::columnAveragesFor(const TabularData& tabularData, const QRect& dataRect)
+{
+    auto left = static_cast<size_t>(dataRect.x());
+    auto top = static_cast<size_t>(dataRect.y());
+    auto bottom = top + static_cast<size_t>(dataRect.height());
+
+    auto columns = indicesUpTo(static_cast<size_t>(dataRect.width()));
+    std::vector<double> columnAverages(columns.size(), 0.0);
+
+    if(columns.empty())
+        return columnAverages;
+
+    parallel_for(columns.begin(), columns.end(),
+    [&](size_t column)
+    {
+        double sum = 0.0;
+        size_t count = 0;
+
+        for(size_t row = top; row < bottom; row++)
         {
-            const double tween = static_cast<double>(leftDistance) / static_cast<double>(leftDistance + rightDistance);
-            // https://devblogs.nvidia.com/lerp-faster-cuda/
-            const double lerpedValue = std::fma(tween, rightValue, std::fma(-tween, leftValue, leftValue));
-            imputedValue = lerpedValue;
+            const auto& value = tabularData.valueAt(left + column, row);
+            if(value.isEmpty())
+                continue;
+
+            sum += tabularData.hasNumericValues() ?
+                tabularData.numericValueAt(left + column, row) : value.toDouble();
+            count++;
         }
-        else if(leftValueFound && !rightValueFound)
-            imputedValue = leftValue;
-        else if(!leftValueFound && rightValueFound)
-            imputedValue = rightValue;
-        else // Nothing on the row, just zero it
-            imputedValue = 0.0;
+
+        if(count > 0)
+            columnAverages.at(column) = sum / static_cast<double>(count);
+    });
+
+    return columnAverages;
+}
+
+void CorrelationFileParser::imputeValues(MissingDataType missingDataType, double replacementValue,
+    size_t width, std::vector<double>& data, std::vector<double> columnAverages)
+{
+    Q_ASSERT(width > 0 && data.size() % width == 0);
+
+    if(data.empty())
+        return;
+
+    const size_t numRows = data.size() / width;
+    auto rows = indicesUpTo(numRows);
+
+    switch(missingDataType)
+    {
+    case MissingDataType::Constant:
+    {
+        parallel_for(data.begin(), data.end(),
+        [replacementValue](std::vector<double>::iterator it)
+        {
+            if(std::isnan(*it))
+                *it = replacementValue;
+        });
         break;
     }
-    default:
+
+    case MissingDataType::ColumnAverage:
+    {
+        if(columnAverages.empty())
+            columnAverages = columnAveragesOf(width, data);
+
+        Q_ASSERT(columnAverages.size() == width);
+
+        parallel_for(rows.begin(), rows.end(),
+        [&](size_t row)
+        {
+            auto* rowData = &data.at(row * width);
+
+            for(size_t column = 0; column < width; column++)
+            {
+                if(std::isnan(rowData[column]))
+                    rowData[column] = columnAverages[column];
+            }
+        });
+        break;
+    }
+
+    case MissingDataType::RowInterpolation:
+    {
+        parallel_for(rows.begin(), rows.end(),
+        [&](size_t row)
+        {
+            interpolateRow(&data.at(row * width), width);
+        });
         break;
     }
 
-    return imputedValue;
+    default:
+        break;
+    }
 }
 
 void CorrelationFileParser::clipValues(ClippingType clippingType, double clippingValue,
@@ -251,10 +372,10 @@ void CorrelationFileParser::normalise(NormaliseType normaliseType,
         break;
     }
 
-    if(normaliseType != NormaliseType::None)
+    if(normaliseType != NormaliseType::None && !dataRows.empty())
     {
-        for(auto& dataRow : dataRows)
-            dataRow.update();
+        parallel_for(dataRows.begin(), dataRows.end(),
+            [](ContinuousDataVector& dataRow) { dataRow.update(); });
     }
 }
 
@@ -297,7 +418,12 @@ bool CorrelationFileParser::parse(const QUrl& fileUrl, IGraphModel*)
 {
     if(_tabularData.empty())
     {
-        const bool success = parseUsing(_urlTypeName, [this, &fileUrl](auto&& parser)
+        setProgress(-1);
+        const TabularDataCache cache(fileUrl, tabularDataCacheParameters(_urlTypeName));
+        std::vector<TypeIdentity> columnTypeIdentities;
+
+        const bool success = cache.load(_tabularData, columnTypeIdentities) ||
+            parseUsing(_urlTypeName, [this, &fileUrl, &cache](auto&& parser)
         {
             parser.setProgressFn([this](int progress) { setProgress(progress); });
 
@@ -308,6 +434,7 @@ bool CorrelationFileParser::parse(const QUrl& fileUrl, IGraphModel*)
             }
 
             _tabularData = std::move(parser.tabularData());
+            cache.save(_tabularData, {});
 
             return true;
         });
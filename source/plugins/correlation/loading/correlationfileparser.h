@@ -29,6 +29,8 @@
 #include <QString>
 #include <QRect>
 
+#include <vector>
+
 class CorrelationPluginInstance;
 
 class CorrelationFileParser : public IParser
@@ -43,8 +45,17 @@ public:
     explicit CorrelationFileParser(CorrelationPluginInstance* plugin, const QString& urlTypeName,
         TabularData& tabularData, QRect dataRect);
 
-    static double imputeValue(MissingDataType missingDataType, double replacementValue,
-        const TabularData& tabularData, const QRect& dataRect, size_t columnIndex, size_t rowIndex);
+    // The TabularDataCache parameters for a given file type; these match those used when
+    // the file is opened generically, i.e. its extension
+    static QString tabularDataCacheParameters(const QString& urlTypeName);
+
+    // The mean of the non-empty values in each column of dataRect
+    static std::vector<double> columnAveragesFor(const TabularData& tabularData, const QRect& dataRect);
+
+    // Replaces the missing values, which are NaN, in data, a row-major matrix of the given width;
+    // if columnAverages isn't supplied, it is computed from the values that are present
+    static void imputeValues(MissingDataType missingDataType, double replacementValue,
+        size_t width, std::vector<double>& data, std::vector<double> columnAverages = {});
     static void clipValues(ClippingType clippingType, double clippingValue, size_t width, std::vector<double>& data);
     static double scaleValue(ScalingType scalingType, double value,
         double epsilon = std::nextafter(0.0, 1.0));
@@ -0,0 +1,139 @@
+/* Copyright © 2013-2025 Tim Angus
+ * Copyright © 2013-2025 Tom Freeman
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "normaliser.h"
+
+#include "shared/loading/iparser.h"
+#include "shared/utils/threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+
+namespace
+{
+// Transposing blocks of columns at a time means each row is read contiguously
+constexpr size_t TRANSPOSE_BLOCK_SIZE = 64;
+
+std::vector<size_t> columnBlocksFor(size_t numColumns)
+{
+    std::vector<size_t> blockStarts((numColumns + TRANSPOSE_BLOCK_SIZE - 1) / TRANSPOSE_BLOCK_SIZE);
+
+    for(size_t i = 0; i < blockStarts.size(); i++)
+        blockStarts[i] = i * TRANSPOSE_BLOCK_SIZE;
+
+    return blockStarts;
+}
+} // namespace
+
+std::vector<double> Normaliser::columnMajorFrom(const ContinuousDataVectors& dataRows)
+{
+    if(dataRows.empty())
+        return {};
+
+    const auto numRows = dataRows.size();
+    const auto numColumns = dataRows.front().size();
+    std::vector<double> columns(numRows * numColumns);
+
+    auto blockStarts = columnBlocksFor(numColumns);
+    parallel_for(blockStarts.begin(), blockStarts.end(),
+    [&](size_t blockStart)
+    {
+        const auto blockEnd = std::min(blockStart + TRANSPOSE_BLOCK_SIZE, numColumns);
+
+        for(size_t row = 0; row < numRows; row++)
+        {
+            const auto* data = dataRows[row].data();
+
+            for(size_t column = blockStart; column < blockEnd; column++)
+                columns[(column * numRows) + row] = data[column];
+        }
+    });
+
+    return columns;
+}
+
+void Normaliser::setFromColumnMajor(ContinuousDataVectors& dataRows, const std::vector<double>& columns)
+{
+    if(dataRows.empty())
+        return;
+
+    const auto numRows = dataRows.size();
+    const auto numColumns = dataRows.front().size();
+    Q_ASSERT(columns.size() == numRows * numColumns);
+
+    parallel_for(dataRows.begin(), dataRows.end(),
+    [&](ContinuousDataVectors::iterator rowIt)
+    {
+        const auto row = static_cast<size_t>(std::distance(dataRows.begin(), rowIt));
+        auto dataIt = rowIt->begin();
+
+        for(size_t column = 0; column < numColumns; column++)
+            *dataIt++ = columns[(column * numRows) + row];
+    });
+}
+
+bool Normaliser::forEachColumn(std::vector<double>& columns, size_t numRows,
+    const ColumnFn& columnFn, IParser* parser)
+{
+    if(numRows == 0 || columns.empty())
+        return true;
+
+    const auto numColumns = columns.size() / numRows;
+    std::vector<size_t> columnIndices(numColumns);
+    std::iota(columnIndices.begin(), columnIndices.end(), 0);
+
+    std::atomic<size_t> numProcessed(0);
+
+    parallel_for(columnIndices.begin(), columnIndices.end(),
+    [&](size_t column)
+    {
+        if(parser != nullptr && parser->cancelled())
+            return;
+
+        columnFn(&columns[column * numRows], numRows);
+
+        if(parser != nullptr)
+            parser->setProgress(static_cast<int>((++numProcessed * 100) / numColumns));
+    });
+
+    if(parser != nullptr)
+        parser->setProgress(-1);
+
+    return parser == nullptr || !parser->cancelled();
+}
+
+bool Normaliser::processColumns(ContinuousDataVectors& dataRows,
+    const ColumnFn& columnFn, IParser* parser)
+{
+    if(dataRows.empty())
+        return true;
+
+    if(parser != nullptr)
+        parser->setProgress(-1);
+
+    auto columns = columnMajorFrom(dataRows);
+
+    if(!forEachColumn(columns, dataRows.size(), columnFn, parser))
+        return false;
+
+    setFromColumnMajor(dataRows, columns);
+
+    return true;
+}
@@ -24,6 +24,7 @@
 
 #include <vector>
 #include <cstdlib>
+#include <functional>
 
 class Cancellable;
 class IParser;
@@ -33,6 +34,22 @@ class Normaliser
 public:
     virtual ~Normaliser() = default;
     virtual bool process(ContinuousDataVectors& dataRows, IParser* parser = nullptr) const = 0;
+
+protected:
+    // Normalisation is generally performed on columns, which are strided in dataRows,
+    // so they are staged in a column-major buffer where each column is contiguous
+    static std::vector<double> columnMajorFrom(const ContinuousDataVectors& dataRows);
+    static void setFromColumnMajor(ContinuousDataVectors& dataRows, const std::vector<double>& columns);
+
+    using ColumnFn = std::function<void(double* column, size_t numRows)>;
+
+    // Calls columnFn concurrently for each column of the column-major buffer
+    static bool forEachColumn(std::vector<double>& columns, size_t numRows,
+        const ColumnFn& columnFn, IParser* parser);
+
+    // Stages dataRows, calls columnFn for each column, then writes the result back
+    static bool processColumns(ContinuousDataVectors& dataRows,
+        const ColumnFn& columnFn, IParser* parser);
 };
 
 #endif // NORMALISER_H
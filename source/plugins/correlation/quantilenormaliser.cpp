@@ -20,10 +20,10 @@
 #include "quantilenormaliser.h"
 
 #include "shared/loading/iparser.h"
-#include "shared/utils/cancellable.h"
+#include "shared/utils/threadpool.h"
 
-#include <set>
 #include <algorithm>
+#include <numeric>
 
 #include <QtGlobal>
 
@@ -32,92 +32,74 @@ bool QuantileNormaliser::process(ContinuousDataVectors& dataRows, IParser* parse
     if(dataRows.empty())
         return true;
 
-    auto numColumns = dataRows.at(0).size();
+    const auto numRows = dataRows.size();
+    const auto numColumns = dataRows.at(0).size();
 
-    std::vector<std::vector<double>> sortedColumnValues(numColumns);
-    std::vector<size_t> ranking(dataRows.size() * numColumns);
+    if(parser != nullptr)
+        parser->setProgress(-1);
 
-    size_t row = 0;
+    auto columns = columnMajorFrom(dataRows);
 
-    for(size_t column = 0; column < numColumns; column++)
+    // For each value, the index of that value amongst the unique sorted values of its column
+    std::vector<size_t> ranking(numRows * numColumns);
+
+    // Sort each column in place, recording the ranking of its original values
+    if(!forEachColumn(columns, numRows, [&](double* column, size_t)
     {
-        if(parser != nullptr && parser->cancelled())
-            return false;
+        auto* columnRanking = &ranking[static_cast<size_t>(column - columns.data())];
 
-        std::vector<double> columnValues;
-        columnValues.reserve(dataRows.size());
+        const std::vector<double> values(column, column + numRows);
+        std::vector<size_t> sortedIndices(numRows);
+        std::iota(sortedIndices.begin(), sortedIndices.end(), 0);
+        std::sort(sortedIndices.begin(), sortedIndices.end(),
+            [&values](size_t a, size_t b) { return values[a] < values[b]; });
 
-        // Get column values
-        std::transform(dataRows.begin(), dataRows.end(), std::back_inserter(columnValues),
-        [column](const auto& dataRow)
-        {
-            return dataRow.valueAt(column);
-        });
-
-        // Sort
-        auto sortedValues = columnValues;
-        std::sort(sortedValues.begin(), sortedValues.end());
-        auto uniqueSortedValues = sortedValues;
-        uniqueSortedValues.erase(std::unique(uniqueSortedValues.begin(), uniqueSortedValues.end()),
-            uniqueSortedValues.end());
-
-        row = 0;
-        for(const auto& dataRow : dataRows)
+        size_t rank = 0;
+        for(size_t i = 0; i < numRows; i++)
         {
-            auto index = (row * numColumns) + column;
+            auto index = sortedIndices[i];
 
-            // Set the ranking
-            size_t i = 0;
-            for(auto uniqueValue : uniqueSortedValues)
-            {
-                if(uniqueValue == dataRow.valueAt(column))
-                    ranking[index] = i;
+            if(i > 0 && values[index] != column[i - 1])
+                rank++;
 
-                i++;
-            }
-
-            row++;
+            column[i] = values[index];
+            columnRanking[index] = rank;
         }
-
-        if(parser != nullptr)
-            parser->setProgress(static_cast<int>((column * 100) / numColumns));
-
-        // Copy Result to sortedColumns
-        sortedColumnValues[column] = sortedValues;
+    }, parser))
+    {
+        return false;
     }
 
-    if(parser != nullptr)
-        parser->setProgress(-1);
-
-    std::vector<double> rowMeans(dataRows.size());
-
     // Populate row means
-    for(row = 0; row < rowMeans.size(); row++)
+    std::vector<double> rowMeans(numRows, 0.0);
+    for(size_t column = 0; column < numColumns; column++)
     {
-        double meanValue = 0.0;
-        for(size_t column = 0; column < numColumns; column++)
-            meanValue += sortedColumnValues[column][row];
+        const auto* sortedValues = &columns[column * numRows];
 
-        rowMeans[row] = meanValue / static_cast<double>(numColumns);
+        for(size_t row = 0; row < numRows; row++)
+            rowMeans[row] += sortedValues[row];
     }
 
-    row = 0;
-    for(auto& dataRow : dataRows)
+    for(auto& rowMean : rowMeans)
+        rowMean /= static_cast<double>(numColumns);
+
+    if(!forEachColumn(columns, numRows, [&](double* column, size_t)
     {
-        if(parser != nullptr && parser->cancelled())
-            return false;
+        const auto* columnRanking = &ranking[static_cast<size_t>(column - columns.data())];
 
-        for(size_t column = 0; column < numColumns; column++)
+        for(size_t row = 0; row < numRows; row++)
         {
-            auto index = (row * numColumns) + column;
-            auto rank = ranking[index];
+            auto rank = columnRanking[row];
             Q_ASSERT(rank < rowMeans.size());
 
-            dataRow.setValueAt(column, rowMeans[rank]);
+            column[row] = rowMeans[rank];
         }
-
-        row++;
+    }, parser))
+    {
+        return false;
     }
 
+    setFromColumnMajor(dataRows, columns);
+
     return true;
 }
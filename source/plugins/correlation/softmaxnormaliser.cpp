@@ -19,67 +19,23 @@
 
 #include "softmaxnormaliser.h"
 
-#include "shared/loading/iparser.h"
-#include "shared/utils/cancellable.h"
-
+#include <algorithm>
 #include <cmath>
 
 bool SoftmaxNormaliser::process(ContinuousDataVectors& dataRows, IParser* parser) const
 {
-    if(dataRows.empty())
-        return true;
-
-    auto numColumns = dataRows.at(0).size();
-
-    std::vector<double> maxs;
-    maxs.resize(numColumns, std::numeric_limits<double>::lowest());
-
-    uint64_t i = 0;
-
-    for(const auto& dataRow : dataRows)
+    return processColumns(dataRows, [](double* column, size_t numRows)
     {
-        if(parser != nullptr && parser->cancelled())
-            return false;
-
-        for(size_t column = 0; column < numColumns; column++)
-        {
-            auto value = dataRow.valueAt(column);
-            maxs[column] = std::max(maxs[column], value);
-        }
-
-        if(parser != nullptr)
-            parser->setProgress(static_cast<int>((i * 100) / dataRows.size()));
-
-        i++;
-    }
-
-    for(size_t column = 0; column < numColumns; column++)
-    {
-        if(parser != nullptr && parser->cancelled())
-            return false;
+        auto max = *std::max_element(column, column + numRows);
 
         double sum = 0.0;
-        for(const auto& dataRow : dataRows)
-        {
-            auto value = dataRow.valueAt(column) - maxs.at(column);
-            auto expValue = std::exp(value);
-            sum += expValue;
-        }
-
-        for(auto& dataRow : dataRows)
+        for(size_t row = 0; row < numRows; row++)
         {
-            auto value = dataRow.valueAt(column) - maxs.at(column);
-            auto expValue = std::exp(value);
-            auto newValue = expValue / sum;
-            dataRow.setValueAt(column, newValue);
+            column[row] = std::exp(column[row] - max);
+            sum += column[row];
         }
 
-        if(parser != nullptr)
-            parser->setProgress(static_cast<int>((column * 100) / numColumns));
-    }
-
-    if(parser != nullptr)
-        parser->setProgress(-1);
-
-    return true;
+        for(size_t row = 0; row < numRows; row++)
+            column[row] /= sum;
+    }, parser);
 }
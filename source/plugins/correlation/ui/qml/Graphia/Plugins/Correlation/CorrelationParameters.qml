@@ -43,6 +43,8 @@ BaseParameterDialog
         section: "correlation"
 
         property alias advancedParameters: advancedCheckBox.checked
+        property alias storeEdges: storeEdgesCheckBox.checked
+        property alias edgeStoreFloor: edgeStoreFloorSpinBox.value
         property string defaultTemplate
     }
 
@@ -529,6 +531,7 @@ BaseParameterDialog
                                 scalingComboBox.currentIndex = 0;
                                 normalisationComboBox.currentIndex = 0;
                                 filterTypeComboBox.currentIndex = 0;
+                                linkageComboBox.currentIndex = 0;
                             }
                         }
                     }
@@ -1244,6 +1247,143 @@ BaseParameterDialog
                                     }
                                 }
                             }
+
+                            Text
+                            {
+                                visible: dataTypeComboBox.value === CorrelationDataType.Continuous
+                                text: qsTr("Column Linkage:")
+                                Layout.alignment: Qt.AlignRight
+                                color: palette.buttonText
+                            }
+
+                            ComboBox
+                            {
+                                id: linkageComboBox
+                                visible: dataTypeComboBox.value === CorrelationDataType.Continuous
+                                Layout.preferredWidth: 160
+
+                                model: ListModel
+                                {
+                                    ListElement { text: qsTr("Single");     value: HierarchicalClusteringLinkage.Single }
+                                    ListElement { text: qsTr("Average");    value: HierarchicalClusteringLinkage.Average }
+                                    ListElement { text: qsTr("Complete");   value: HierarchicalClusteringLinkage.Complete }
+                                }
+                                textRole: "text"
+
+                                onCurrentIndexChanged:
+                                {
+                                    parameters.hierarchicalClusteringLinkage = model.get(currentIndex).value;
+                                }
+
+                                property int value: { return model.get(currentIndex).value; }
+                            }
+
+                            HelpTooltip
+                            {
+                                visible: dataTypeComboBox.value === CorrelationDataType.Continuous
+                                title: qsTr("Column Linkage")
+                                GridLayout
+                                {
+                                    columns: 2
+                                    Text
+                                    {
+                                        text: qsTr("<b>Single:</b>")
+                                        textFormat: Text.StyledText
+                                        Layout.alignment: Qt.AlignTop | Qt.AlignLeft
+                                    }
+                                    Text
+                                    {
+                                        text: qsTr("When sorting the plot's columns by hierarchical clustering, " +
+                                            "the distance between two clusters is that of their closest columns.");
+                                        wrapMode: Text.WordWrap
+                                        Layout.fillWidth: true
+                                    }
+
+                                    Text
+                                    {
+                                        text: qsTr("<b>Average:</b>")
+                                        textFormat: Text.StyledText
+                                        Layout.alignment: Qt.AlignTop | Qt.AlignLeft
+                                    }
+                                    Text
+                                    {
+                                        text: qsTr("The distance between two clusters is the mean " +
+                                            "distance between all of their pairs of columns.");
+                                        wrapMode: Text.WordWrap
+                                        Layout.fillWidth: true
+                                    }
+
+                                    Text
+                                    {
+                                        text: qsTr("<b>Complete:</b>")
+                                        textFormat: Text.StyledText
+                                        Layout.alignment: Qt.AlignTop | Qt.AlignLeft
+                                    }
+                                    Text
+                                    {
+                                        text: qsTr("The distance between two clusters is that of their furthest columns.");
+                                        wrapMode: Text.WordWrap
+                                        Layout.fillWidth: true
+                                    }
+                                }
+                            }
+
+                            Text
+                            {
+                                text: qsTr("Store Edges:")
+                                Layout.alignment: Qt.AlignRight
+                                color: palette.buttonText
+                            }
+
+                            RowLayout
+                            {
+                                CheckBox
+                                {
+                                    id: storeEdgesCheckBox
+
+                                    onCheckedChanged: { parameters.storeEdges = checked; }
+                                }
+
+                                Text
+                                {
+                                    text: qsTr("Floor:")
+                                    color: palette.buttonText
+                                }
+
+                                DoubleSpinBox
+                                {
+                                    id: edgeStoreFloorSpinBox
+
+                                    enabled: storeEdgesCheckBox.checked &&
+                                        filterTypeComboBox.value === CorrelationFilterType.Threshold
+                                    implicitWidth: 70
+
+                                    from: 0.0
+                                    to: 1.0
+                                    value: 0.5
+
+                                    decimals: 3
+                                    stepSize: Utils.incrementForRange(from, to);
+                                    editable: true
+
+                                    onValueChanged: { parameters.edgeStoreFloor = value; }
+                                }
+                            }
+
+                            HelpTooltip
+                            {
+                                title: qsTr("Store Edges")
+                                Text
+                                {
+                                    wrapMode: Text.WordWrap
+                                    text: qsTr("Keep the edges that result from the correlation on disk, so that " +
+                                        "importing the same data again with a higher minimum correlation value " +
+                                        "doesn't require the correlation to be recomputed. When thresholding, " +
+                                        "correlation values are stored down to the <i>Floor</i>, regardless " +
+                                        "of the minimum chosen. k-NN edges are only reused when the " +
+                                        "parameters are unchanged.")
+                                }
+                            }
                         }
                     }
 
@@ -1789,6 +1929,17 @@ BaseParameterDialog
 
                             if(normalisationComboBox.value !== NormaliseType.None)
                                 summaryString += Utils.format(qsTr("Normalisation: {0}<br>"), normalisationComboBox.currentText);
+
+                            if(linkageComboBox.value !== HierarchicalClusteringLinkage.Single)
+                                summaryString += Utils.format(qsTr("Column Linkage: {0}<br>"), linkageComboBox.currentText);
+
+                            if(storeEdgesCheckBox.checked)
+                            {
+                                if(filterTypeComboBox.value === CorrelationFilterType.Threshold)
+                                    summaryString += Utils.format(qsTr("Store Edges Above: {0}<br>"), NativeUtils.formatNumberScientific(edgeStoreFloorSpinBox.value));
+                                else
+                                    summaryString += qsTr("Store Edges<br>");
+                            }
                         }
                         else if(dataTypeComboBox.value === CorrelationDataType.Discrete)
                         {
@@ -1955,6 +2106,9 @@ BaseParameterDialog
             missingDataType: MissingDataType.Constant, missingDataValue: 0.0,
             clippingType: ClippingType.None, clippingValue: 0.0,
             treatAsBinary: false,
+            hierarchicalClusteringLinkage: HierarchicalClusteringLinkage.Single,
+            storeEdges: storeEdgesCheckBox.checked,
+            edgeStoreFloor: edgeStoreFloorSpinBox.value,
             additionalTransforms: [], additionalVisualisations: []
         };
 
@@ -33,6 +33,8 @@
 #include "shared/utils/string.h"
 #include "shared/utils/flags.h"
 #include "shared/utils/fatalerror.h"
+#include "shared/utils/statistics.h"
+#include "shared/utils/threadpool.h"
 
 #include <QDesktopServices>
 #include <QSet>
@@ -45,6 +47,7 @@
 #include <numeric>
 #include <vector>
 #include <map>
+#include <thread>
 
 using namespace Qt::Literals::StringLiterals;
 
@@ -662,6 +665,8 @@ bool CorrelationPlot::updateTooltip()
 
     double xCoord = -1.0;
 
+    const bool hoveredLineGraphChanged = updateHoveredLineGraph();
+
     if(_hoverPoint.x() >= 0.0 && _hoverPoint.y() >= 0.0)
     {
         axisRectUnderCursor = _customPlot.axisRectAt(_hoverPoint);
@@ -758,7 +763,7 @@ bool CorrelationPlot::updateTooltip()
         _hoverColorRect->setVisible(false);
         _itemTracer->setVisible(false);
     }
-    else
+    else if(!hoveredLineGraphChanged)
     {
         // Nothing changed
         return false;
@@ -1013,6 +1018,9 @@ void CorrelationPlot::rebuildPlot(InvalidateCache invalidateCache)
     if(_pluginInstance == nullptr)
         return;
 
+    // Sorting can be expensive, so do it before taking the lock so the render thread isn't held up
+    computeSortMap();
+
     const std::unique_lock<std::recursive_mutex> lock(_mutex, std::try_to_lock);
 
     if(!lock.owns_lock())
@@ -1066,8 +1074,12 @@ void CorrelationPlot::rebuildPlot(InvalidateCache invalidateCache)
     }
 
     _meanPlots.clear();
+    _lineDensityRows.clear();
+    _lineDensityValues.clear();
+    _hoveredLineGraph = nullptr;
 
     configureAxisRects();
+    pruneStatisticsCache();
 
     _customPlot.plotLayout()->setMargins(QMargins(0, 0, _rightPadding, 0));
 
@@ -1181,6 +1193,18 @@ void CorrelationPlot::setPluginInstance(CorrelationPluginInstance* pluginInstanc
         if(::Flags<VisualChangeFlags>(nodeChange).test(VisualChangeFlags::Color))
             rebuildPlot();
     });
+
+    // These change the sort map's inputs without changing anything its key can compare
+    auto invalidateSortMap = [this]
+    {
+        _sortMapRevision++;
+        rebuildPlot();
+    };
+
+    connect(_pluginInstance, &CorrelationPluginInstance::columnAnnotationNamesChanged, this, invalidateSortMap);
+    connect(_pluginInstance, &CorrelationPluginInstance::columnAnnotationValuesChanged, this, invalidateSortMap);
+    connect(_pluginInstance, &CorrelationPluginInstance::numColumnsChanged, this, invalidateSortMap);
+    connect(_pluginInstance, &CorrelationPluginInstance::hierarchicalClusteringComplete, this, invalidateSortMap);
 }
 
 void CorrelationPlot::setSelectedRows(const QList<int>& selectedRows)
@@ -1267,197 +1291,336 @@ void CorrelationPlot::setBottomPadding(int padding)
     }
 }
 
-bool CorrelationPlot::updateSortMap()
+namespace
 {
-    auto previousSortmap = _sortMap;
-
-    _sortMap.resize(numColumns());
-    std::iota(_sortMap.begin(), _sortMap.end(), 0);
+// Sort [first, last) by sorting chunks concurrently, then merging pairs of chunks concurrently
+template<typename It, typename Compare>
+void parallelSort(It first, It last, const Compare& compare)
+{
+    const auto size = static_cast<size_t>(std::distance(first, last));
+    const size_t MinimumChunkSize = 4096;
 
-    // Convert the javascript/QML object array into something
-    // efficient to access from inside the sort lambda function
-    struct ColumnSortOrder
+    if(size < MinimumChunkSize * 2)
     {
-        PlotColumnSortType _type = PlotColumnSortType::Natural;
-        Qt::SortOrder _order = Qt::AscendingOrder;
-        const ColumnAnnotation* _annotation = nullptr;
-    };
+        std::sort(first, last, compare);
+        return;
+    }
 
-    std::vector<ColumnSortOrder> columnSortOrders;
-    columnSortOrders.reserve(static_cast<size_t>(_columnSortOrders.size()));
+    const auto numChunks = std::clamp<size_t>(size / MinimumChunkSize, 2,
+        std::max(std::thread::hardware_concurrency(), 2U));
+    const auto chunkSize = (size + numChunks - 1) / numChunks;
 
-    for(const auto& qmlColumnSortOrder : std::as_const(_columnSortOrders))
+    std::vector<size_t> chunkStarts;
+    for(size_t start = 0; start < size; start += chunkSize)
+        chunkStarts.push_back(start);
+
+    parallel_for(chunkStarts.begin(), chunkStarts.end(), [&](size_t start)
     {
-        Q_ASSERT(u::containsAllOf(qmlColumnSortOrder, {"type", "text", "order"}));
+        auto end = std::min(start + chunkSize, size);
+        std::sort(first + static_cast<ptrdiff_t>(start), first + static_cast<ptrdiff_t>(end), compare);
+    });
 
-        ColumnSortOrder columnSortOrder;
-        columnSortOrder._type = normaliseQmlEnum<PlotColumnSortType>(qmlColumnSortOrder[u"type"_s].toInt());
-        columnSortOrder._order = static_cast<Qt::SortOrder>(qmlColumnSortOrder[u"order"_s].toInt());
+    for(auto mergeSize = chunkSize; mergeSize < size; mergeSize *= 2)
+    {
+        std::vector<size_t> mergeStarts;
+        for(size_t start = 0; start + mergeSize < size; start += mergeSize * 2)
+            mergeStarts.push_back(start);
 
-        if(columnSortOrder._type == PlotColumnSortType::ColumnAnnotation)
+        parallel_for(mergeStarts.begin(), mergeStarts.end(), [&](size_t start)
         {
-            auto columnAnnotationName = qmlColumnSortOrder[u"text"_s].toString();
-            columnSortOrder._annotation = _pluginInstance->columnAnnotationByName(columnAnnotationName);
-        }
+            auto middle = start + mergeSize;
+            auto end = std::min(start + (mergeSize * 2), size);
 
-        // If grouping by annotation, sorting by data value doesn't really make sense
-        if(_groupByAnnotation && columnSortOrder._type == PlotColumnSortType::DataValue)
-            continue;
-
-        columnSortOrders.emplace_back(columnSortOrder);
+            std::inplace_merge(first + static_cast<ptrdiff_t>(start),
+                first + static_cast<ptrdiff_t>(middle),
+                first + static_cast<ptrdiff_t>(end), compare);
+        });
     }
+}
+
+// Reduce an ordering of the columns to a (dense) rank per column, so that
+// subsequent comparisons are of contiguous integers rather than the source values
+template<typename LessThan>
+std::vector<size_t> ranksFor(size_t numColumns, Qt::SortOrder order, const LessThan& lessThan)
+{
+    std::vector<size_t> sorted(numColumns);
+    std::iota(sorted.begin(), sorted.end(), 0);
+    parallelSort(sorted.begin(), sorted.end(), lessThan);
 
-    if(_columnDataValueSortOrder.empty())
-        _columnDataValueSortOrder.resize(numColumns());
+    std::vector<size_t> ranks(numColumns);
+    size_t rank = 0;
 
-    if(!_columnSortOrderPinned && std::any_of(columnSortOrders.begin(), columnSortOrders.end(),
-        [](const auto& cso) { return cso._type == PlotColumnSortType::DataValue; }))
+    for(size_t i = 0; i < sorted.size(); i++)
     {
-        std::vector<double> columnValues;
-        columnValues.resize(numColumns(), std::numeric_limits<double>::lowest());
+        if(i > 0 && lessThan(sorted.at(i - 1), sorted.at(i)))
+            rank++;
 
-        for(size_t col = 0; col < _pluginInstance->numDiscreteColumns(); col++)
-        {
-            columnValues.at(col) = 0.0;
+        ranks[sorted.at(i)] = rank;
+    }
 
-            for(auto row : std::as_const(_selectedRows))
-            {
-                if(!_pluginInstance->discreteDataAt(static_cast<size_t>(row), col).isEmpty())
-                    columnValues.at(col) += 1.0;
-            }
-        }
+    if(order == Qt::DescendingOrder)
+    {
+        for(auto& value : ranks)
+            value = rank - value;
+    }
 
-        auto plotAveragingType = normaliseQmlEnum<PlotAveragingType>(_averagingType);
-        auto offset = _pluginInstance->numDiscreteColumns();
+    return ranks;
+}
+} // namespace
 
-        for(size_t col = 0; col < _pluginInstance->numContinuousColumns(); col++)
-        {
-            double total = 0.0;
-            std::vector<double> values;
-            values.reserve(static_cast<size_t>(_selectedRows.size()));
+void CorrelationPlot::updateColumnDataValueSortOrder()
+{
+    auto plotAveragingType = normaliseQmlEnum<PlotAveragingType>(_averagingType);
+
+    ColumnDataValueSortOrderKey key{_selectedRows, static_cast<int>(plotAveragingType), numColumns()};
+
+    if(key == _columnDataValueSortOrderKey && _columnDataValueSortOrder.size() == numColumns())
+        return;
 
-            for(auto row : std::as_const(_selectedRows))
+    _columnDataValueSortOrderKey = std::move(key);
+
+    std::vector<size_t> selectedRows(_selectedRows.begin(), _selectedRows.end());
+    std::vector<double> columnValues(numColumns(), std::numeric_limits<double>::lowest());
+    std::vector<size_t> columns(numColumns());
+    std::iota(columns.begin(), columns.end(), 0);
+
+    auto offset = _pluginInstance->numDiscreteColumns();
+
+    if(!columns.empty())
+    {
+        parallel_for(columns.begin(), columns.end(), [&](size_t col)
+        {
+            if(col < offset)
             {
-                auto value = _pluginInstance->continuousDataAt(static_cast<size_t>(row), col);
+                columnValues[col] = 0.0;
 
-                switch(plotAveragingType)
+                for(auto row : selectedRows)
                 {
-                case PlotAveragingType::MeanLine:
-                case PlotAveragingType::MeanHistogram:
-                    total += value;
-                    break;
-
-                case PlotAveragingType::MedianLine:
-                case PlotAveragingType::IQR:
-                    values.push_back(value);
-                    break;
-
-                default:
-                    columnValues.at(col + offset) = std::max(columnValues.at(col + offset), value);
-                    break;
+                    if(!_pluginInstance->discreteDataAt(row, col).isEmpty())
+                        columnValues[col] += 1.0;
                 }
+
+                return;
             }
 
+            const auto continuousColumn = col - offset;
+
             switch(plotAveragingType)
             {
             case PlotAveragingType::MeanLine:
             case PlotAveragingType::MeanHistogram:
-                columnValues.at(col + offset) = total / static_cast<double>(_selectedRows.size());
+            {
+                double total = 0.0;
+                for(auto row : selectedRows)
+                    total += _pluginInstance->continuousDataAt(row, continuousColumn);
+
+                columnValues[col] = total / static_cast<double>(selectedRows.size());
                 break;
+            }
 
             case PlotAveragingType::MedianLine:
             case PlotAveragingType::IQR:
-                columnValues.at(col + offset) = u::medianOf(values);
+            {
+                std::vector<double> values;
+                values.reserve(selectedRows.size());
+
+                for(auto row : selectedRows)
+                    values.push_back(_pluginInstance->continuousDataAt(row, continuousColumn));
+
+                columnValues[col] = u::medianInPlace(values.begin(), values.end());
                 break;
+            }
 
             default:
+                for(auto row : selectedRows)
+                {
+                    columnValues[col] = std::max(columnValues[col],
+                        _pluginInstance->continuousDataAt(row, continuousColumn));
+                }
                 break;
             }
-        }
-
-        std::vector<size_t> inverseDataValueOrdering(numColumns());
-        std::iota(inverseDataValueOrdering.begin(), inverseDataValueOrdering.end(), 0);
-        std::sort(inverseDataValueOrdering.begin(), inverseDataValueOrdering.end(),
-        [&columnValues](size_t a, size_t b)
-        {
-            return columnValues.at(a) < columnValues.at(b);
         });
+    }
+
+    std::vector<size_t> inverseDataValueOrdering(numColumns());
+    std::iota(inverseDataValueOrdering.begin(), inverseDataValueOrdering.end(), 0);
+    parallelSort(inverseDataValueOrdering.begin(), inverseDataValueOrdering.end(),
+    [&columnValues](size_t a, size_t b)
+    {
+        return columnValues[a] < columnValues[b];
+    });
 
-        for(size_t i = 0; i < inverseDataValueOrdering.size(); i++)
-            _columnDataValueSortOrder[inverseDataValueOrdering.at(i)] = i;
+    _columnDataValueSortOrder.resize(numColumns());
+    for(size_t i = 0; i < inverseDataValueOrdering.size(); i++)
+        _columnDataValueSortOrder[inverseDataValueOrdering.at(i)] = i;
+}
+
+CorrelationPlot::SortMapKey CorrelationPlot::sortMapKey() const
+{
+    SortMapKey key;
+
+    key._columnSortOrders = _columnSortOrders;
+    key._columnSortOrderPinned = _columnSortOrderPinned;
+    key._groupByAnnotation = _groupByAnnotation;
+    key._numColumns = numColumns();
+    key._revision = _sortMapRevision;
+
+    if(_groupByAnnotation)
+        key._visibleColumnAnnotationNames = _visibleColumnAnnotationNames;
+    else if(!_columnSortOrderPinned && columnSortOrderCanBePinned())
+    {
+        key._selectedRows = _selectedRows;
+        key._averagingType = _averagingType;
     }
 
-    std::sort(_sortMap.begin(), _sortMap.end(),
-    [this, &columnSortOrders](size_t a, size_t b)
+    return key;
+}
+
+void CorrelationPlot::computeSortMap()
+{
+    auto key = sortMapKey();
+
+    if(_pendingSortMap.has_value() ? _pendingSortMap->_key == key : _sortMapKey == key)
+        return;
+
+    std::vector<size_t> sortMap;
+    const auto columnCount = numColumns();
+    sortMap.resize(columnCount);
+    std::iota(sortMap.begin(), sortMap.end(), 0);
+
+    // Each sort order contributes a rank per column; these are stored column major so that
+    // comparing two columns only touches two contiguous runs of memory
+    std::vector<std::vector<size_t>> columnRanks;
+    bool decisive = false;
+
+    for(const auto& qmlColumnSortOrder : std::as_const(_columnSortOrders))
     {
-        for(const auto& columnSortOrder : columnSortOrders)
+        Q_ASSERT(u::containsAllOf(qmlColumnSortOrder, {"type", "text", "order"}));
+
+        auto type = normaliseQmlEnum<PlotColumnSortType>(qmlColumnSortOrder[u"type"_s].toInt());
+        auto order = static_cast<Qt::SortOrder>(qmlColumnSortOrder[u"order"_s].toInt());
+
+        // If grouping by annotation, sorting by data value doesn't really make sense
+        if(_groupByAnnotation && type == PlotColumnSortType::DataValue)
+            continue;
+
+        switch(type)
         {
-            switch(columnSortOrder._type)
+        default:
+        case PlotColumnSortType::Natural:
+            columnRanks.emplace_back(ranksFor(columnCount, order,
+                [](size_t a, size_t b) { return a < b; }));
+            decisive = true;
+            break;
+
+        case PlotColumnSortType::ColumnName:
+        {
+            std::vector<QString> columnNames(columnCount);
+            for(size_t column = 0; column < columnCount; column++)
+                columnNames[column] = _pluginInstance->columnName(column);
+
+            columnRanks.emplace_back(ranksFor(columnCount, order, [&columnNames](size_t a, size_t b)
             {
-            default:
-            case PlotColumnSortType::Natural:
-                return columnSortOrder._order == Qt::AscendingOrder ?
-                    a < b : b < a;
+                return u::numericCompare(columnNames[a], columnNames[b]) < 0;
+            }));
+            break;
+        }
 
-            case PlotColumnSortType::ColumnName:
+        case PlotColumnSortType::DataValue:
+            if(!_columnSortOrderPinned)
+                updateColumnDataValueSortOrder();
+            else if(_columnDataValueSortOrder.size() != columnCount)
+                _columnDataValueSortOrder.resize(columnCount);
+
+            columnRanks.emplace_back(ranksFor(columnCount, order, [this](size_t a, size_t b)
             {
-                auto columnNameA = _pluginInstance->columnName(a);
-                auto columnNameB = _pluginInstance->columnName(b);
+                return _columnDataValueSortOrder[a] < _columnDataValueSortOrder[b];
+            }));
+            decisive = true;
+            break;
+
+        case PlotColumnSortType::ColumnAnnotation:
+        {
+            const auto* annotation = _pluginInstance->columnAnnotationByName(
+                qmlColumnSortOrder[u"text"_s].toString());
+
+            if(annotation == nullptr)
+                break;
 
-                if(columnNameA == columnNameB)
-                    continue;
+            std::vector<QString> values(columnCount);
+            std::vector<double> numericValues(columnCount);
 
-                return columnSortOrder._order == Qt::AscendingOrder ?
-                    u::numericCompare(columnNameA, columnNameB) < 0 :
-                    u::numericCompare(columnNameB, columnNameA) < 0;
+            for(size_t column = 0; column < columnCount; column++)
+            {
+                values[column] = annotation->valueAt(column);
+
+                if(annotation->isNumeric() && !values[column].isEmpty())
+                    numericValues[column] = u::toNumber(values[column]);
             }
 
-            case PlotColumnSortType::DataValue:
-                return columnSortOrder._order == Qt::AscendingOrder ?
-                    _columnDataValueSortOrder.at(a) < _columnDataValueSortOrder.at(b) :
-                    _columnDataValueSortOrder.at(b) < _columnDataValueSortOrder.at(a);
+            columnRanks.emplace_back(ranksFor(columnCount, order, [&](size_t a, size_t b)
+            {
+                if(values[a] == values[b])
+                    return false;
+
+                if(annotation->isNumeric() && !values[a].isEmpty() && !values[b].isEmpty())
+                    return numericValues[a] < numericValues[b];
 
-            case PlotColumnSortType::ColumnAnnotation:
+                return u::numericCompare(values[a], values[b]) < 0;
+            }));
+            break;
+        }
+
+        case PlotColumnSortType::HierarchicalClustering:
+            columnRanks.emplace_back(ranksFor(columnCount, order, [this](size_t a, size_t b)
             {
-                auto annotationValueA = columnSortOrder._annotation->valueAt(a);
-                auto annotationValueB = columnSortOrder._annotation->valueAt(b);
+                return _pluginInstance->hcColumn(a) < _pluginInstance->hcColumn(b);
+            }));
+            decisive = true;
+            break;
+        }
+
+        // Any further sort orders can't have an effect
+        if(decisive)
+            break;
+    }
 
-                if(annotationValueA == annotationValueB)
-                    continue;
+    if(!columnRanks.empty())
+    {
+        const auto numKeys = columnRanks.size();
+        std::vector<size_t> sortKeys(columnCount * numKeys);
 
-                if(columnSortOrder._annotation->isNumeric() && !annotationValueA.isEmpty() && !annotationValueB.isEmpty())
-                {
-                    return columnSortOrder._order == Qt::AscendingOrder ?
-                        u::toNumber(annotationValueA) < u::toNumber(annotationValueB) :
-                        u::toNumber(annotationValueB) < u::toNumber(annotationValueA);
-                }
+        for(size_t key = 0; key < numKeys; key++)
+        {
+            for(size_t column = 0; column < columnCount; column++)
+                sortKeys[(column * numKeys) + key] = columnRanks.at(key).at(column);
+        }
 
-                return columnSortOrder._order == Qt::AscendingOrder ?
-                    u::numericCompare(annotationValueA, annotationValueB) < 0 :
-                    u::numericCompare(annotationValueB, annotationValueA) < 0;
-            }
+        parallelSort(sortMap.begin(), sortMap.end(), [&sortKeys, numKeys](size_t a, size_t b)
+        {
+            const auto* keysA = &sortKeys[a * numKeys];
+            const auto* keysB = &sortKeys[b * numKeys];
 
-            case PlotColumnSortType::HierarchicalClustering:
-                return columnSortOrder._order == Qt::AscendingOrder ?
-                    _pluginInstance->hcColumn(a) < _pluginInstance->hcColumn(b) :
-                    _pluginInstance->hcColumn(b) < _pluginInstance->hcColumn(a);
+            for(size_t key = 0; key < numKeys; key++)
+            {
+                if(keysA[key] != keysB[key])
+                    return keysA[key] < keysB[key];
             }
-        }
 
-        // If all else fails, just use natural order
-        return a < b;
-    });
+            // If all else fails, just use natural order
+            return a < b;
+        });
+    }
 
-    const size_t oldSize = _annotationGroupMap.size();
-    _annotationGroupMap.clear();
+    std::vector<std::vector<size_t>> annotationGroupMap;
 
     if(_groupByAnnotation)
     {
         std::vector<QString> lastValueColumn;
 
-        for(size_t i = 0U; i < numColumns(); i++)
+        for(size_t i = 0U; i < columnCount; i++)
         {
-            auto column = _sortMap.at(i);
+            auto column = sortMap.at(i);
 
             std::vector<QString> valueColumn;
             valueColumn.reserve(_visibleColumnAnnotationNames.size());
@@ -1471,20 +1634,36 @@ bool CorrelationPlot::updateSortMap()
             if(valueColumn != lastValueColumn || lastValueColumn.empty())
             {
                 lastValueColumn = valueColumn;
-                _annotationGroupMap.emplace_back();
+                annotationGroupMap.emplace_back();
             }
 
-            _annotationGroupMap.back().push_back(column);
+            annotationGroupMap.back().push_back(column);
         }
     }
 
+    _pendingSortMap = PendingSortMap{std::move(key), std::move(sortMap), std::move(annotationGroupMap)};
+}
+
+bool CorrelationPlot::updateSortMap()
+{
+    if(!_pendingSortMap.has_value())
+        return false;
+
+    const bool sortMapChanged = _sortMap != _pendingSortMap->_sortMap;
+    const size_t oldSize = _annotationGroupMap.size();
+
+    _sortMapKey = std::move(_pendingSortMap->_key);
+    std::swap(_sortMap, _pendingSortMap->_sortMap);
+    std::swap(_annotationGroupMap, _pendingSortMap->_annotationGroupMap);
+    _pendingSortMap.reset();
+
     if(_annotationGroupMap.size() != oldSize)
     {
         computeXAxisRange();
         emit numVisibleColumnsChanged();
     }
 
-    return _sortMap != previousSortmap;
+    return sortMapChanged;
 }
 
 void CorrelationPlot::sortBy(int type, const QString& text)
@@ -22,6 +22,7 @@
 
 #include "plugins/correlation/correlationplugin.h"
 #include "plugins/correlation/columnannotation.h"
+#include "correlationplotstatistics.h"
 
 #include "shared/utils/qmlenum.h"
 
@@ -45,6 +46,8 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <tuple>
+#include <optional>
 #include <mutex>
 #include <atomic>
 
@@ -339,6 +342,18 @@ private:
     QVector<QVariantMap> _columnSortOrders;
     bool _columnSortOrderPinned = false;
     std::vector<size_t> _columnDataValueSortOrder;
+
+    // The data value ordering only depends on the selection and how it's averaged
+    struct ColumnDataValueSortOrderKey
+    {
+        QList<int> _selectedRows;
+        int _averagingType = -1;
+        size_t _numColumns = 0;
+
+        bool operator==(const ColumnDataValueSortOrderKey& other) const = default;
+    };
+
+    ColumnDataValueSortOrderKey _columnDataValueSortOrderKey;
     double _horizontalScrollPosition = 0.0;
     QString _xAxisLabel;
     QString _yAxisLabel;
@@ -353,6 +368,37 @@ private:
     std::set<QString> _visibleColumnAnnotationNames;
     std::vector<std::vector<size_t>> _annotationGroupMap;
 
+    // Everything the sort map and annotation groups are derived from; anything that can't be
+    // compared directly (column annotation values, the clustering) bumps _sortMapRevision
+    struct SortMapKey
+    {
+        QVector<QVariantMap> _columnSortOrders;
+        bool _columnSortOrderPinned = false;
+        bool _groupByAnnotation = false;
+        std::set<QString> _visibleColumnAnnotationNames;
+        size_t _numColumns = 0;
+        int _revision = 0;
+
+        // Only set when the data values affect the sort
+        QList<int> _selectedRows;
+        int _averagingType = -1;
+
+        bool operator==(const SortMapKey& other) const = default;
+    };
+
+    struct PendingSortMap
+    {
+        SortMapKey _key;
+        std::vector<size_t> _sortMap;
+        std::vector<std::vector<size_t>> _annotationGroupMap;
+    };
+
+    // Only accessed from the GUI thread; the sort map is computed without holding
+    // _mutex and then swapped in by updateSortMap once the lock is acquired
+    SortMapKey _sortMapKey;
+    std::optional<PendingSortMap> _pendingSortMap;
+    int _sortMapRevision = 0;
+
     QCPLayer* _lineGraphLayer = nullptr;
 
     struct LineCacheEntry
@@ -364,6 +410,23 @@ private:
 
     QMap<int, LineCacheEntry> _lineGraphCache;
 
+    // Scaled values of the selected rows (column major), when plotted by density
+    QList<int> _lineDensityRows;
+    std::vector<double> _lineDensityValues;
+    QCPGraph* _hoveredLineGraph = nullptr;
+    int _hoveredLineGraphRow = -1;
+
+    // Keyed by row group name, scale type and a hash of the column groups
+    using StatisticsCacheKey = std::tuple<QString, int, size_t>;
+    struct StatisticsCacheEntry
+    {
+        CorrelationPlotStatistics _statistics;
+        int _generation = 0;
+    };
+
+    std::map<StatisticsCacheKey, StatisticsCacheEntry> _statisticsCache;
+    int _statisticsGeneration = 0;
+
     using LabelElisionCacheEntry = QMap<int, QString>;
     QMap<QString, LabelElisionCacheEntry> _labelElisionCache;
 
@@ -379,6 +442,12 @@ private:
     void populateMeanLinePlot();
     void populateMedianLinePlot();
     void populateLinePlot();
+    void populateLineDensityPlot();
+    bool lineDensityPlotRequired() const;
+    double scaleByAttributeValueFor(size_t row) const;
+    template<typename Fn> void forEachScaledRowValue(size_t row, double attributeValue, const Fn& fn) const;
+    void addLineGraphForRow(int row, double& minY, double& maxY);
+    bool updateHoveredLineGraph();
     void populateMeanHistogramPlot();
     void populateIQRPlot();
     void populateIQRAnnotationPlot(const QCPColumnAnnotations* qcpColumnAnnotations);
@@ -387,13 +456,17 @@ private:
         const QVector<double>& stdDevs, const QString& name);
     void populateStdDevPlot(QCPAbstractPlottable* meanPlot,
         double& minY, double& maxY,
-        const QVector<int>& rows, QVector<double>& means);
+        const CorrelationPlotStatistics& statistics, QVector<double>& means);
     void populateStdErrorPlot(QCPAbstractPlottable* meanPlot,
         double& minY, double& maxY,
-        const QVector<int>& rows, QVector<double>& means);
+        const CorrelationPlotStatistics& statistics, QVector<double>& means);
     void populateDispersion(QCPAbstractPlottable* meanPlot,
         double& minY, double& maxY,
-        const QVector<int>& rows, QVector<double>& means);
+        const CorrelationPlotStatistics& statistics, QVector<double>& means);
+
+    const CorrelationPlotStatistics& statisticsFor(const QString& rowGroupName, const QVector<int>& rows,
+        const std::vector<std::vector<size_t>>& columnGroups = {});
+    void pruneStatisticsCache();
 
     bool busy() const { return _worker != nullptr ? _worker->busy() : false; }
     bool zoomed() const { return _worker != nullptr ? _worker->zoomed() : false; }
@@ -411,6 +484,9 @@ private:
     void setRightPadding(int padding);
     void setBottomPadding(int padding);
 
+    void updateColumnDataValueSortOrder();
+    SortMapKey sortMapKey() const;
+    void computeSortMap();
     bool updateSortMap();
     void setColumnSortOrders(const QVector<QVariantMap>& columnSortOrders); // clazy:exclude=qproperty-type-mismatch
     bool columnSortOrderCanBePinned() const;
@@ -430,7 +506,7 @@ private:
     void computeXAxisRange();
     void setContinousYAxisRange(double min, double max);
     void setContinousYAxisRangeForSelection();
-    QVector<double> meanAverageData(double& min, double& max, const QVector<int>& rows);
+    QVector<double> meanAverageData(double& min, double& max, const CorrelationPlotStatistics& statistics);
 
     double visibleHorizontalFraction() const;
     bool isWide() const;
@@ -471,7 +547,7 @@ private:
     }
 
     static std::pair<double, double> addIQRBoxPlotTo(QCPAxis* keyAxis, QCPAxis* valueAxis,
-        size_t column, QVector<double> values, bool showOutliers,
+        size_t column, const std::vector<double>& sortedValues, bool showOutliers,
         const QColor& color = {}, const QString& text = {});
 
 private slots:
@@ -202,17 +202,11 @@ void CorrelationPlot::populateIQRAnnotationPlot(const QCPColumnAnnotations* qcpC
     auto minY = std::numeric_limits<double>::max();
     auto maxY = std::numeric_limits<double>::lowest();
 
+    const auto& statistics = statisticsFor({}, _selectedRows, _annotationGroupMap);
+
     for(size_t column = 0; column < _annotationGroupMap.size(); column++)
     {
-        QVector<double> values;
-
-        for(auto row : std::as_const(_selectedRows))
-        {
-            for(const size_t groupedColumn : _annotationGroupMap.at(column))
-                values.append(_pluginInstance->continuousDataAt(static_cast<size_t>(row), groupedColumn));
-        }
-
-        scale(values);
+        const auto& sortedValues = statistics.group(column).sortedValues();
 
         QColor color;
         QString value;
@@ -225,7 +219,7 @@ void CorrelationPlot::populateIQRAnnotationPlot(const QCPColumnAnnotations* qcpC
         }
 
         auto minmax = addIQRBoxPlotTo(_continuousXAxis, _continuousYAxis, column,
-            std::move(values), _showIqrOutliers, color, value);
+            sortedValues, _showIqrOutliers, color, value);
 
         minY = std::min(minY, minmax.first);
         maxY = std::max(maxY, minmax.second);
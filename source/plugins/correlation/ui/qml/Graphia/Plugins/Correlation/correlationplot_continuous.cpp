@@ -22,8 +22,13 @@
 #include "plugins/correlation/correlationplugin.h"
 #include "qcpcolumnannotations.h"
 
-#include "shared/utils/statistics.h"
 #include "shared/utils/container_randomsample.h"
+#include "shared/utils/threadpool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
 
 using namespace Qt::Literals::StringLiterals;
 
@@ -220,30 +225,54 @@ void CorrelationPlot::setDispersionType(int dispersionType)
     }
 }
 
-QVector<double> CorrelationPlot::meanAverageData(double& min, double& max, const QVector<int>& rows)
+const CorrelationPlotStatistics& CorrelationPlot::statisticsFor(const QString& rowGroupName,
+    const QVector<int>& rows, const std::vector<std::vector<size_t>>& columnGroups)
 {
-    // Use Average Calculation
-    QVector<double> yDataAvg; yDataAvg.reserve(rows.size());
+    size_t columnGroupsHash = 0;
+    for(const auto& columnGroup : columnGroups)
+        columnGroupsHash = qHashRange(columnGroup.begin(), columnGroup.end(), columnGroupsHash + 1);
 
-    for(size_t column = 0; column < _pluginInstance->numContinuousColumns(); column++)
+    const StatisticsCacheKey key{rowGroupName, _scaleType, columnGroupsHash};
+    auto it = _statisticsCache.find(key);
+
+    if(it == _statisticsCache.end())
     {
-        QVector<double> values;
+        auto statistics = !columnGroups.empty() ? CorrelationPlotStatistics(columnGroups) :
+            CorrelationPlotStatistics(_pluginInstance->numContinuousColumns());
 
-        std::transform(rows.begin(), rows.end(), std::back_inserter(values),
-        [this, column](auto row)
-        {
-            return _pluginInstance->continuousDataAt(static_cast<size_t>(row), _sortMap.at(column));
-        });
+        it = _statisticsCache.emplace(key, StatisticsCacheEntry{std::move(statistics), 0}).first;
+    }
 
-        scale(values);
+    auto& [statistics, generation] = it->second;
+    generation = _statisticsGeneration;
 
-        const double runningTotal = std::accumulate(values.begin(), values.end(), 0.0,
-        [](auto partial, auto value)
-        {
-            return partial + value;
-        });
+    statistics.update({rows.begin(), rows.end()}, [this](size_t row, size_t column)
+    {
+        return scale(_pluginInstance->continuousDataAt(row, column));
+    });
+
+    return statistics;
+}
+
+void CorrelationPlot::pruneStatisticsCache()
+{
+    // Anything that wasn't used in the last rebuild is no longer relevant
+    std::erase_if(_statisticsCache, [this](const auto& v)
+    {
+        return v.second._generation != _statisticsGeneration;
+    });
 
-        yDataAvg.append(runningTotal / static_cast<double>(rows.length()));
+    _statisticsGeneration++;
+}
+
+QVector<double> CorrelationPlot::meanAverageData(double& min, double& max, const CorrelationPlotStatistics& statistics)
+{
+    // Use Average Calculation
+    QVector<double> yDataAvg; yDataAvg.reserve(static_cast<int>(_pluginInstance->numContinuousColumns()));
+
+    for(size_t column = 0; column < _pluginInstance->numContinuousColumns(); column++)
+    {
+        yDataAvg.append(statistics.group(_sortMap.at(column)).mean());
 
         max = std::max(max, yDataAvg.back());
         min = std::min(min, yDataAvg.back());
@@ -270,7 +299,7 @@ void addPlotPerAttributeValue(const CorrelationPluginInstance* pluginInstance,
         const auto& rows = map.value(value);
         auto color = pluginInstance->nodeColorForRows({rows.begin(), rows.end()});
 
-        addPlotFn(color, nameTemplate.arg(attributeName, value), rows);
+        addPlotFn(color, nameTemplate.arg(attributeName, value), u"%1: %2"_s.arg(attributeName, value), rows);
     }
 }
 
@@ -282,9 +311,11 @@ void CorrelationPlot::populateMeanLinePlot()
     double minY = std::numeric_limits<double>::max();
     double maxY = std::numeric_limits<double>::lowest();
 
-    auto addMeanPlot =
-    [this, &minY, &maxY](const QColor& color, const QString& name, const QVector<int>& rows)
+    auto addMeanPlot = [this, &minY, &maxY](const QColor& color, const QString& name,
+        const QString& rowGroupName, const QVector<int>& rows)
     {
+        const auto& statistics = statisticsFor(rowGroupName, rows);
+
         auto* graph = _customPlot.addGraph();
         graph->setPen(QPen(color, 2.0, Qt::DashLine));
         graph->setName(name);
@@ -294,12 +325,12 @@ void CorrelationPlot::populateMeanLinePlot()
         std::iota(std::begin(xData), std::end(xData), 0);
 
         // Use Average Calculation and set min / max
-        QVector<double> yDataAvg = meanAverageData(minY, maxY, rows);
+        QVector<double> yDataAvg = meanAverageData(minY, maxY, statistics);
 
         graph->setData(xData, yDataAvg, true);
 
         _meanPlots.append(graph);
-        populateDispersion(graph, minY, maxY, rows, yDataAvg);
+        populateDispersion(graph, minY, maxY, statistics, yDataAvg);
     };
 
     if(!_averagingAttributeName.isEmpty())
@@ -310,7 +341,7 @@ void CorrelationPlot::populateMeanLinePlot()
     else
     {
         addMeanPlot(_pluginInstance->nodeColorForRows({_selectedRows.begin(), _selectedRows.end()}),
-            tr("Mean average of selection"), _selectedRows);
+            tr("Mean average of selection"), {}, _selectedRows);
     }
 
     setContinousYAxisRange(minY, maxY);
@@ -324,11 +355,13 @@ void CorrelationPlot::populateMedianLinePlot()
     double minY = std::numeric_limits<double>::max();
     double maxY = std::numeric_limits<double>::lowest();
 
-    auto addMedianPlot =
-    [this, &minY, &maxY](const QColor& color, const QString& name, const QVector<int>& rows)
+    auto addMedianPlot = [this, &minY, &maxY](const QColor& color, const QString& name,
+        const QString& rowGroupName, const QVector<int>& rows)
     {
         Q_ASSERT(!rows.empty());
 
+        const auto& statistics = statisticsFor(rowGroupName, rows);
+
         auto* graph = _customPlot.addGraph();
         graph->setPen(QPen(color, 2.0, Qt::DashLine));
         graph->setName(name);
@@ -341,17 +374,7 @@ void CorrelationPlot::populateMedianLinePlot()
 
         for(size_t column = 0; column < _pluginInstance->numContinuousColumns(); column++)
         {
-            QVector<double> values;
-
-            std::transform(rows.begin(), rows.end(), std::back_inserter(values),
-            [this, column](auto row)
-            {
-                return _pluginInstance->continuousDataAt(static_cast<size_t>(row), _sortMap.at(column));
-            });
-
-            scale(values);
-
-            yDataAvg[static_cast<int>(column)] = u::medianOf(values);
+            yDataAvg[static_cast<int>(column)] = statistics.group(_sortMap.at(column)).median();
 
             maxY = std::max(maxY, yDataAvg.at(static_cast<int>(column)));
             minY = std::min(minY, yDataAvg.at(static_cast<int>(column)));
@@ -360,7 +383,7 @@ void CorrelationPlot::populateMedianLinePlot()
         graph->setData(xData, yDataAvg, true);
 
         _meanPlots.append(graph);
-        populateDispersion(graph, minY, maxY, rows, yDataAvg);
+        populateDispersion(graph, minY, maxY, statistics, yDataAvg);
     };
 
     if(!_averagingAttributeName.isEmpty())
@@ -371,7 +394,7 @@ void CorrelationPlot::populateMedianLinePlot()
     else
     {
         addMedianPlot(_pluginInstance->nodeColorForRows({_selectedRows.begin(), _selectedRows.end()}),
-            tr("Median average of selection"), _selectedRows);
+            tr("Median average of selection"), {}, _selectedRows);
     }
 
     setContinousYAxisRange(minY, maxY);
@@ -385,15 +408,17 @@ void CorrelationPlot::populateMeanHistogramPlot()
     double minY = std::numeric_limits<double>::max();
     double maxY = std::numeric_limits<double>::lowest();
 
-    auto addMeanBars =
-    [this, &minY, &maxY](const QColor& color, const QString& name, const QVector<int>& rows)
+    auto addMeanBars = [this, &minY, &maxY](const QColor& color, const QString& name,
+        const QString& rowGroupName, const QVector<int>& rows)
     {
+        const auto& statistics = statisticsFor(rowGroupName, rows);
+
         QVector<double> xData(static_cast<int>(_pluginInstance->numContinuousColumns()));
         // xData is just the column indices
         std::iota(std::begin(xData), std::end(xData), 0);
 
         // Use Average Calculation and set min / max
-        QVector<double> yDataAvg = meanAverageData(minY, maxY, rows);
+        QVector<double> yDataAvg = meanAverageData(minY, maxY, statistics);
 
         auto* histogramBars = new QCPBars(_continuousXAxis, _continuousYAxis);
         histogramBars->setName(name);
@@ -412,7 +437,7 @@ void CorrelationPlot::populateMeanHistogramPlot()
         setContinousYAxisRange(minY, maxY);
 
         _meanPlots.append(histogramBars);
-        populateDispersion(histogramBars, minY, maxY, rows, yDataAvg);
+        populateDispersion(histogramBars, minY, maxY, statistics, yDataAvg);
     };
 
     if(!_averagingAttributeName.isEmpty())
@@ -434,22 +459,43 @@ void CorrelationPlot::populateMeanHistogramPlot()
     else
     {
         addMeanBars(_pluginInstance->nodeColorForRows({_selectedRows.begin(), _selectedRows.end()}),
-            tr("Mean histogram of selection"), _selectedRows);
+            tr("Mean histogram of selection"), {}, _selectedRows);
     }
 
     setContinousYAxisRange(minY, maxY);
 }
 
+namespace
+{
+template<typename It>
+double medianOfSorted(It first, It last)
+{
+    if(first == last)
+        return 0.0;
+
+    auto size = std::distance(first, last);
+    auto mid = first + (size / 2);
+    double median = *mid;
+
+    if(size % 2 == 0)
+        median = (*(mid - 1) + median) / 2.0;
+
+    return median;
+}
+} // namespace
+
 std::pair<double, double> CorrelationPlot::addIQRBoxPlotTo(QCPAxis* keyAxis, QCPAxis* valueAxis,
-    size_t column, QVector<double> values, bool showOutliers, const QColor& color, const QString& text)
+    size_t column, const std::vector<double>& sortedValues, bool showOutliers, const QColor& color, const QString& text)
 {
     // Box-plots representing the InterQuatile Range
     // Whiskers represent the maximum and minimum non-outlier values
     // Outlier values are (< Q1 - 1.5IQR and > Q3 + 1.5IQR)
 
-    if(values.empty())
+    if(sortedValues.empty())
         return {};
 
+    Q_ASSERT(std::is_sorted(sortedValues.begin(), sortedValues.end()));
+
     auto* statisticalBox = new QCPStatisticalBox(keyAxis, valueAxis);
     statisticalBox->setName(!text.isEmpty() ? QObject::tr("IQR of %1").arg(text) : QObject::tr("IQR"));
     statisticalBox->setPen(QPen(penColor()));
@@ -460,62 +506,55 @@ std::pair<double, double> CorrelationPlot::addIQRBoxPlotTo(QCPAxis* keyAxis, QCP
     if(color.isValid())
         statisticalBox->setBrush(color);
 
-    // Partial (efficient) sort which is suitable for IQR calculation
-    const auto Q1 = values.size() / 4;
-    const auto Q2 = values.size() / 2;
-    const auto Q3 = Q1 + Q2;
-
-    std::nth_element(values.begin(),          values.begin() + Q1, values.end());
-    std::nth_element(values.begin() + Q1 + 1, values.begin() + Q2, values.end());
-    std::nth_element(values.begin() + Q2 + 1, values.begin() + Q3, values.end());
+    const auto begin = sortedValues.begin();
+    const auto end = sortedValues.end();
+    const auto size = sortedValues.size();
 
-    const double secondQuartile = u::medianOf(values);
+    const double secondQuartile = medianOfSorted(begin, end);
     double firstQuartile = secondQuartile;
     double thirdQuartile = secondQuartile;
 
     // Don't calculate medians if there's only one sample
-    if(values.size() > 1)
+    if(size > 1)
     {
-        if(values.size() % 2 == 0)
-        {
-            firstQuartile = u::medianOf(values.mid(0, (values.size() / 2)));
-            thirdQuartile = u::medianOf(values.mid((values.size() / 2)));
-        }
-        else
-        {
-            firstQuartile = u::medianOf(values.mid(0, ((values.size() - 1) / 2)));
-            thirdQuartile = u::medianOf(values.mid(((values.size() + 1) / 2)));
-        }
+        const auto lowerHalfEnd = begin + static_cast<ptrdiff_t>(size / 2);
+        const auto upperHalfBegin = begin + static_cast<ptrdiff_t>((size + 1) / 2);
+
+        firstQuartile = medianOfSorted(begin, lowerHalfEnd);
+        thirdQuartile = medianOfSorted(upperHalfBegin, end);
     }
 
     const double iqr = thirdQuartile - firstQuartile;
+    const double lowerFence = firstQuartile - (iqr * 1.5);
+    const double upperFence = thirdQuartile + (iqr * 1.5);
+
+    // The values are sorted, so the outliers are a prefix and suffix of them
+    const auto lowOutliersEnd = std::lower_bound(begin, end, lowerFence);
+    const auto nonLowOutliersBegin = std::upper_bound(begin, end, lowerFence);
+    const auto nonHighOutliersEnd = std::lower_bound(begin, end, upperFence);
+    const auto highOutliersBegin = std::upper_bound(begin, end, upperFence);
+
+    // Find Maximum and minimum non-outliers
     double minValue = secondQuartile;
     double maxValue = secondQuartile;
-    QVector<double> outliers;
-    outliers.reserve(values.size());
 
-    for(auto value : std::as_const(values))
-    {
-        // Find Maximum and minimum non-outliers
-        if(value < thirdQuartile + (iqr * 1.5))
-            maxValue = std::max(maxValue, value);
+    if(nonLowOutliersBegin != end)
+        minValue = std::min(minValue, *nonLowOutliersBegin);
 
-        if(value > firstQuartile - (iqr * 1.5))
-            minValue = std::min(minValue, value);
+    if(nonHighOutliersEnd != begin)
+        maxValue = std::max(maxValue, *(nonHighOutliersEnd - 1));
 
-        if(!showOutliers)
-            continue;
+    QVector<double> outliers;
 
-        // Find outliers
-        if(value > thirdQuartile + (iqr * 1.5) || value < firstQuartile - (iqr * 1.5))
-            outliers.push_back(value);
+    if(showOutliers)
+    {
+        outliers.reserve(static_cast<int>(std::distance(begin, lowOutliersEnd) + std::distance(highOutliersBegin, end)));
+        std::copy(begin, lowOutliersEnd, std::back_inserter(outliers));
+        std::copy(highOutliersBegin, end, std::back_inserter(outliers));
     }
 
-    outliers.shrink_to_fit();
-
-    auto minmax = std::minmax_element(outliers.begin(), outliers.end());
-    auto minOutlier = !outliers.empty() ? *minmax.first : minValue;
-    auto maxOutlier = !outliers.empty() ? *minmax.second : maxValue;
+    auto minOutlier = !outliers.empty() ? outliers.front() : minValue;
+    auto maxOutlier = !outliers.empty() ? outliers.back() : maxValue;
 
     const size_t maxOutliers = 100;
     if(static_cast<size_t>(outliers.size()) > maxOutliers)
@@ -543,20 +582,13 @@ void CorrelationPlot::populateIQRPlot()
     auto minY = std::numeric_limits<double>::max();
     auto maxY = std::numeric_limits<double>::lowest();
 
+    const auto& statistics = statisticsFor({}, _selectedRows);
+
     for(size_t column = 0; column < _pluginInstance->numContinuousColumns(); column++)
     {
-        QVector<double> values;
+        const auto& sortedValues = statistics.group(_sortMap.at(column)).sortedValues();
 
-        const auto& selectedRows = std::as_const(_selectedRows);
-        std::transform(selectedRows.begin(), selectedRows.end(), std::back_inserter(values),
-        [this, column](auto row)
-        {
-            return _pluginInstance->continuousDataAt(static_cast<size_t>(row), _sortMap.at(column));
-        });
-
-        scale(values);
-
-        auto minmax = addIQRBoxPlotTo(_continuousXAxis, _continuousYAxis, column, std::move(values), _showIqrOutliers);
+        auto minmax = addIQRBoxPlotTo(_continuousXAxis, _continuousYAxis, column, sortedValues, _showIqrOutliers);
         minY = std::min(minY, minmax.first);
         maxY = std::max(maxY, minmax.second);
     }
@@ -626,21 +658,14 @@ void CorrelationPlot::plotDispersion(QCPAbstractPlottable* meanPlot,
 
 void CorrelationPlot::populateStdDevPlot(QCPAbstractPlottable* meanPlot,
     double& minY, double& maxY,
-    const QVector<int>& rows, QVector<double>& means)
+    const CorrelationPlotStatistics& statistics, QVector<double>& means)
 {
     QVector<double> stdDevs(static_cast<int>(_pluginInstance->numContinuousColumns()));
 
     for(size_t column = 0; column < _pluginInstance->numContinuousColumns(); column++)
     {
-        double stdDev = 0.0;
-        for(auto row : rows)
-        {
-            auto value = _pluginInstance->continuousDataAt(static_cast<size_t>(row), _sortMap.at(column));
-            value = scale(value);
-
-            value = value - means.at(static_cast<int>(column));
-            stdDev += (value * value);
-        }
+        double stdDev = statistics.group(_sortMap.at(column))
+            .sumOfSquaredDeviationsFrom(means.at(static_cast<int>(column)));
 
         stdDev /= static_cast<double>(_pluginInstance->numContinuousColumns());
         stdDev = std::sqrt(stdDev);
@@ -652,24 +677,17 @@ void CorrelationPlot::populateStdDevPlot(QCPAbstractPlottable* meanPlot,
 
 void CorrelationPlot::populateStdErrorPlot(QCPAbstractPlottable* meanPlot,
     double& minY, double& maxY,
-    const QVector<int>& rows, QVector<double>& means)
+    const CorrelationPlotStatistics& statistics, QVector<double>& means)
 {
     QVector<double> stdErrs(static_cast<int>(_pluginInstance->numContinuousColumns()));
 
     for(size_t column = 0; column < _pluginInstance->numContinuousColumns(); column++)
     {
-        double stdErr = 0.0;
-        for(auto row : rows)
-        {
-            auto value = _pluginInstance->continuousDataAt(static_cast<size_t>(row), _sortMap.at(column));
-            value = scale(value);
-
-            value = value - means.at(static_cast<int>(column));
-            stdErr += (value * value);
-        }
+        double stdErr = statistics.group(_sortMap.at(column))
+            .sumOfSquaredDeviationsFrom(means.at(static_cast<int>(column)));
 
         stdErr /= static_cast<double>(_pluginInstance->numContinuousColumns());
-        stdErr = std::sqrt(stdErr) / std::sqrt(static_cast<double>(rows.length()));
+        stdErr = std::sqrt(stdErr) / std::sqrt(static_cast<double>(statistics.numRows()));
         stdErrs[static_cast<int>(column)] = stdErr;
     }
 
@@ -678,7 +696,7 @@ void CorrelationPlot::populateStdErrorPlot(QCPAbstractPlottable* meanPlot,
 
 void CorrelationPlot::populateDispersion(QCPAbstractPlottable* meanPlot,
     double& minY, double& maxY,
-    const QVector<int>& rows, QVector<double>& means)
+    const CorrelationPlotStatistics& statistics, QVector<double>& means)
 {
     if(_groupByAnnotation)
         return;
@@ -690,121 +708,380 @@ void CorrelationPlot::populateDispersion(QCPAbstractPlottable* meanPlot,
         return;
 
     if(dispersionType == PlotDispersionType::StdDev)
-        populateStdDevPlot(meanPlot, minY, maxY, rows, means);
+        populateStdDevPlot(meanPlot, minY, maxY, statistics, means);
     else if(dispersionType == PlotDispersionType::StdErr)
-        populateStdErrorPlot(meanPlot, minY, maxY, rows, means);
+        populateStdErrorPlot(meanPlot, minY, maxY, statistics, means);
+}
+
+double CorrelationPlot::scaleByAttributeValueFor(size_t row) const
+{
+    if(normaliseQmlEnum<PlotScaleType>(_scaleType) != PlotScaleType::ByAttribute || _scaleByAttributeName.isEmpty())
+        return 1.0;
+
+    auto attributeValue = u::toNumber(_pluginInstance->attributeValueFor(_scaleByAttributeName, row));
+
+    if(attributeValue == 0.0 || !std::isfinite(attributeValue))
+        attributeValue = 1.0;
+
+    return attributeValue;
+}
+
+template<typename Fn>
+void CorrelationPlot::forEachScaledRowValue(size_t row, double attributeValue, const Fn& fn) const
+{
+    const auto numColumns = _pluginInstance->numContinuousColumns();
+
+    double rowSum = 0.0;
+    for(size_t col = 0; col < numColumns; col++)
+        rowSum += _pluginInstance->continuousDataAt(row, _sortMap.at(col));
+
+    const double rowMean = rowSum / static_cast<double>(numColumns);
+
+    double variance = 0.0;
+    for(size_t col = 0; col < numColumns; col++)
+    {
+        auto value = _pluginInstance->continuousDataAt(row, _sortMap.at(col)) - rowMean;
+        variance += (value * value);
+    }
+
+    variance /= static_cast<double>(numColumns);
+    const double stdDev = std::sqrt(variance);
+    const double pareto = std::sqrt(stdDev);
+
+    for(size_t col = 0; col < numColumns; col++)
+    {
+        auto value = _pluginInstance->continuousDataAt(row, _sortMap.at(col));
+
+        switch(normaliseQmlEnum<PlotScaleType>(_scaleType))
+        {
+        case PlotScaleType::Log:
+        case PlotScaleType::AntiLog:
+            value = scale(value);
+            break;
+        case PlotScaleType::MeanCentre:
+            value -= rowMean;
+            break;
+        case PlotScaleType::UnitVariance:
+            value -= rowMean;
+            value /= stdDev;
+            break;
+        case PlotScaleType::Pareto:
+            value -= rowMean;
+            value /= pareto;
+            break;
+        case PlotScaleType::ByAttribute:
+            value /= attributeValue;
+            break;
+        default:
+            break;
+        }
+
+        fn(col, value);
+    }
+}
+
+void CorrelationPlot::addLineGraphForRow(int row, double& minY, double& maxY)
+{
+    QCPGraph* graph = nullptr;
+    double rowMinY = std::numeric_limits<double>::max();
+    double rowMaxY = std::numeric_limits<double>::lowest();
+
+    if(!_lineGraphCache.contains(row))
+    {
+        graph = _customPlot.addGraph(_continuousXAxis, _continuousYAxis);
+        graph->setLayer(_lineGraphLayer);
+
+        QVector<double> yData; yData.reserve(static_cast<int>(_pluginInstance->numContinuousColumns()));
+        QVector<double> xData; xData.reserve(static_cast<int>(_pluginInstance->numContinuousColumns()));
+
+        forEachScaledRowValue(static_cast<size_t>(row), scaleByAttributeValueFor(static_cast<size_t>(row)),
+        [&](size_t col, double value)
+        {
+            xData.append(static_cast<double>(col));
+            yData.append(value);
+
+            rowMinY = std::min(rowMinY, value);
+            rowMaxY = std::max(rowMaxY, value);
+        });
+
+        graph->setData(xData, yData, true);
+
+        _lineGraphCache.insert(row, {graph, rowMinY, rowMaxY});
+    }
+    else
+    {
+        const auto& v = _lineGraphCache.value(row);
+        graph = v._graph;
+        rowMinY = v._minY;
+        rowMaxY = v._maxY;
+    }
+
+    minY = std::min(minY, rowMinY);
+    maxY = std::max(maxY, rowMaxY);
+
+    graph->setVisible(true);
+    graph->setSelectable(QCP::SelectionType::stWhole);
+
+    graph->setPen(_pluginInstance->nodeColorForRow(static_cast<size_t>(row)));
+    graph->setName(_pluginInstance->rowName(static_cast<size_t>(row)));
+}
+
+namespace
+{
+// Beyond this many rows, individual line plots are replaced by a density plot
+const int MaxIndividualLinePlots = 2000;
+
+// Resolution of the density plot; each column interval is subdivided horizontally
+const size_t LineDensitySamplesPerColumn = 8;
+const size_t LineDensityNumBins = 256;
+} // namespace
+
+bool CorrelationPlot::lineDensityPlotRequired() const
+{
+    return normaliseQmlEnum<PlotAveragingType>(_averagingType) == PlotAveragingType::Individual &&
+        _selectedRows.size() > MaxIndividualLinePlots;
 }
 
 void CorrelationPlot::populateLinePlot()
 {
+    if(lineDensityPlotRequired())
+    {
+        populateLineDensityPlot();
+        return;
+    }
+
     double minY = std::numeric_limits<double>::max();
     double maxY = std::numeric_limits<double>::lowest();
 
-    QVector<double> yData; yData.reserve(_selectedRows.size());
-    QVector<double> xData; xData.reserve(static_cast<int>(_pluginInstance->numContinuousColumns()));
-
     // Plot each row individually
     for(auto row : std::as_const(_selectedRows))
+        addLineGraphForRow(row, minY, maxY);
+
+    setContinousYAxisRange(minY, maxY);
+}
+
+void CorrelationPlot::populateLineDensityPlot()
+{
+    const auto numColumns = _pluginInstance->numContinuousColumns();
+    const auto numRows = static_cast<size_t>(_selectedRows.size());
+
+    if(numColumns == 0 || numRows == 0)
+        return;
+
+    // Attribute lookups aren't safe to do concurrently, so resolve them up front
+    std::vector<double> attributeValues(numRows);
+    for(size_t i = 0; i < numRows; i++)
+        attributeValues[i] = scaleByAttributeValueFor(static_cast<size_t>(_selectedRows.at(static_cast<int>(i))));
+
+    // Scaled values are stored column major, so that rasterising a column
+    // interval reads two contiguous runs of memory
+    std::vector<double> values(numRows * numColumns);
+    std::vector<size_t> rowIndices(numRows);
+    std::iota(rowIndices.begin(), rowIndices.end(), 0);
+
+    auto rowRanges = parallel_for(rowIndices.begin(), rowIndices.end(),
+    [&](size_t i)
     {
-        QCPGraph* graph = nullptr;
+        auto row = static_cast<size_t>(_selectedRows.at(static_cast<int>(i)));
         double rowMinY = std::numeric_limits<double>::max();
         double rowMaxY = std::numeric_limits<double>::lowest();
 
-        if(!_lineGraphCache.contains(row))
+        forEachScaledRowValue(row, attributeValues.at(i), [&](size_t col, double value)
         {
-            graph = _customPlot.addGraph(_continuousXAxis, _continuousYAxis);
-            graph->setLayer(_lineGraphLayer);
+            values[(col * numRows) + i] = value;
 
-            double rowSum = 0.0;
-            for(size_t col = 0; col < _pluginInstance->numContinuousColumns(); col++)
-                rowSum += _pluginInstance->continuousDataAt(static_cast<size_t>(row), _sortMap.at(col));
+            if(!std::isfinite(value))
+                return;
 
-            const double rowMean = rowSum / static_cast<double>(_pluginInstance->numContinuousColumns());
+            rowMinY = std::min(rowMinY, value);
+            rowMaxY = std::max(rowMaxY, value);
+        });
 
-            double variance = 0.0;
-            for(size_t col = 0; col < _pluginInstance->numContinuousColumns(); col++)
-            {
-                auto value = _pluginInstance->continuousDataAt(static_cast<size_t>(row), _sortMap.at(col)) - rowMean;
-                variance += (value * value);
-            }
+        return std::pair{rowMinY, rowMaxY};
+    });
 
-            variance /= static_cast<double>(_pluginInstance->numContinuousColumns());
-            const double stdDev = std::sqrt(variance);
-            const double pareto = std::sqrt(stdDev);
+    double minY = std::numeric_limits<double>::max();
+    double maxY = std::numeric_limits<double>::lowest();
 
-            double attributeValue = 1.0;
+    for(const auto& [rowMinY, rowMaxY] : rowRanges)
+    {
+        minY = std::min(minY, rowMinY);
+        maxY = std::max(maxY, rowMaxY);
+    }
 
-            if(normaliseQmlEnum<PlotScaleType>(_scaleType) == PlotScaleType::ByAttribute && !_scaleByAttributeName.isEmpty())
-            {
-                attributeValue = u::toNumber(_pluginInstance->attributeValueFor(_scaleByAttributeName, static_cast<size_t>(row)));
+    if(minY > maxY)
+        return;
 
-                if(attributeValue == 0.0 || !std::isfinite(attributeValue))
-                    attributeValue = 1.0;
-            }
+    if(minY == maxY)
+    {
+        minY -= 0.5;
+        maxY += 0.5;
+    }
 
-            yData.clear();
-            xData.clear();
+    const auto width = ((numColumns - 1) * LineDensitySamplesPerColumn) + 1;
+    const auto binScale = static_cast<double>(LineDensityNumBins - 1) / (maxY - minY);
 
-            for(size_t col = 0; col < _pluginInstance->numContinuousColumns(); col++)
-            {
-                auto value = _pluginInstance->continuousDataAt(static_cast<size_t>(row), _sortMap.at(col));
+    auto binFor = [&](double value)
+    {
+        auto bin = static_cast<ptrdiff_t>(std::lround((value - minY) * binScale));
+        return static_cast<size_t>(std::clamp(bin, ptrdiff_t{0},
+            static_cast<ptrdiff_t>(LineDensityNumBins - 1)));
+    };
 
-                switch(normaliseQmlEnum<PlotScaleType>(_scaleType))
-                {
-                case PlotScaleType::Log:
-                case PlotScaleType::AntiLog:
-                    value = scale(value);
-                    break;
-                case PlotScaleType::MeanCentre:
-                    value -= rowMean;
-                    break;
-                case PlotScaleType::UnitVariance:
-                    value -= rowMean;
-                    value /= stdDev;
-                    break;
-                case PlotScaleType::Pareto:
-                    value -= rowMean;
-                    value /= pareto;
-                    break;
-                case PlotScaleType::ByAttribute:
-                    value /= attributeValue;
-                    break;
-                default:
-                    break;
-                }
+    // Each x sample owns its own run of bins, so the samples can be
+    // accumulated concurrently without any synchronisation; every row
+    // contributes a total weight of 1 to each sample, spread over the
+    // bins its line passes through before the next sample
+    std::vector<float> density(width * LineDensityNumBins, 0.0f);
+    std::vector<size_t> samples(width);
+    std::iota(samples.begin(), samples.end(), 0);
 
-                xData.append(static_cast<double>(col));
-                yData.append(value);
+    parallel_for(samples.begin(), samples.end(),
+    [&](size_t x)
+    {
+        const auto column = x / LineDensitySamplesPerColumn;
+        const auto nextColumn = std::min(column + 1, numColumns - 1);
+        const auto step = 1.0 / static_cast<double>(LineDensitySamplesPerColumn);
+        const auto t = static_cast<double>(x % LineDensitySamplesPerColumn) * step;
+        const auto tNext = column != nextColumn ? t + step : t;
 
-                rowMinY = std::min(rowMinY, value);
-                rowMaxY = std::max(rowMaxY, value);
-            }
+        const auto* from = &values[column * numRows];
+        const auto* to = &values[nextColumn * numRows];
+        auto* bins = &density[x * LineDensityNumBins];
+
+        for(size_t i = 0; i < numRows; i++)
+        {
+            const auto delta = to[i] - from[i];
+            const auto y = from[i] + (delta * t);
+            const auto yNext = from[i] + (delta * tNext);
 
-            graph->setData(xData, yData, true);
+            if(!std::isfinite(y) || !std::isfinite(yNext))
+                continue;
 
-            _lineGraphCache.insert(row, {graph, rowMinY, rowMaxY});
+            auto [low, high] = std::minmax(binFor(y), binFor(yNext));
+            const auto weight = 1.0f / static_cast<float>(high - low + 1);
+
+            for(auto bin = low; bin <= high; bin++)
+                bins[bin] += weight;
         }
-        else
+    });
+
+    auto* densityColorMap = new QCPColorMap(_continuousXAxis, _continuousYAxis);
+    densityColorMap->setName(tr("Density of %1 rows").arg(numRows));
+    densityColorMap->setSelectable(QCP::SelectionType::stNone);
+    densityColorMap->setInterpolate(true);
+
+    auto color = _pluginInstance->nodeColorForRows({_selectedRows.begin(), _selectedRows.end()});
+    auto faintColor = color;
+    faintColor.setAlpha(48);
+
+    QCPColorGradient gradient;
+    gradient.setColorStopAt(0.0, QColor(Qt::transparent));
+    gradient.setColorStopAt(0.01, faintColor);
+    gradient.setColorStopAt(1.0, color);
+    densityColorMap->setGradient(gradient);
+
+    densityColorMap->data()->setSize(static_cast<int>(width), static_cast<int>(LineDensityNumBins));
+    densityColorMap->data()->setRange(QCPRange(0.0, static_cast<double>(numColumns - 1)),
+        QCPRange(minY, maxY));
+
+    // Log scale the counts so that sparse outlying lines remain visible
+    double maxDensity = 0.0;
+    for(size_t x = 0; x < width; x++)
+    {
+        for(size_t bin = 0; bin < LineDensityNumBins; bin++)
         {
-            const auto& v = _lineGraphCache.value(row);
-            graph = v._graph;
-            rowMinY = v._minY;
-            rowMaxY = v._maxY;
+            auto value = std::log1p(static_cast<double>(density[(x * LineDensityNumBins) + bin]));
+            maxDensity = std::max(maxDensity, value);
+
+            densityColorMap->data()->setCell(static_cast<int>(x), static_cast<int>(bin), value);
         }
+    }
 
-        minY = std::min(minY, rowMinY);
-        maxY = std::max(maxY, rowMaxY);
+    densityColorMap->setDataRange(QCPRange(0.0, maxDensity > 0.0 ? maxDensity : 1.0));
 
-        graph->setVisible(true);
-        graph->setSelectable(QCP::SelectionType::stWhole);
+    _lineDensityRows = _selectedRows;
+    _lineDensityValues = std::move(values);
 
-        graph->setPen(_pluginInstance->nodeColorForRow(static_cast<size_t>(row)));
-        graph->setName(_pluginInstance->rowName(static_cast<size_t>(row)));
-    }
+    // The row under the cursor is drawn individually, on the tooltip layer so
+    // that hovering doesn't require the (potentially large) plot to be replotted
+    createTooltip();
+    _hoveredLineGraph = new QCPGraph(_continuousXAxis, _continuousYAxis);
+    _hoveredLineGraph->setLayer(_tooltipLayer);
+    _hoveredLineGraph->setVisible(false);
+    _hoveredLineGraph->setSelectable(QCP::SelectionType::stNone);
+    _hoveredLineGraphRow = -1;
 
     setContinousYAxisRange(minY, maxY);
 }
 
+bool CorrelationPlot::updateHoveredLineGraph()
+{
+    if(_hoveredLineGraph == nullptr)
+        return false;
+
+    auto hoveredRow = -1;
+    const auto numColumns = _pluginInstance->numContinuousColumns();
+    const auto numRows = static_cast<size_t>(_lineDensityRows.size());
+
+    if(_hoverPoint.x() >= 0.0 && _hoverPoint.y() >= 0.0 &&
+        _customPlot.axisRectAt(_hoverPoint) == _continuousAxisRect &&
+        _lineDensityValues.size() == numRows * numColumns)
+    {
+        auto key = std::round(_continuousXAxis->pixelToCoord(_hoverPoint.x()));
+
+        if(key >= 0.0 && key < static_cast<double>(numColumns))
+        {
+            const auto* columnValues = &_lineDensityValues[static_cast<size_t>(key) * numRows];
+            auto minDistance = _customPlot.selectionTolerance();
+
+            for(size_t i = 0; i < numRows; i++)
+            {
+                if(!std::isfinite(columnValues[i]))
+                    continue;
+
+                auto distance = std::abs(_continuousYAxis->coordToPixel(columnValues[i]) - _hoverPoint.y());
+                if(distance < minDistance)
+                {
+                    minDistance = distance;
+                    hoveredRow = static_cast<int>(i);
+                }
+            }
+        }
+    }
+
+    if(hoveredRow == _hoveredLineGraphRow)
+        return false;
+
+    _hoveredLineGraphRow = hoveredRow;
+
+    if(hoveredRow < 0)
+    {
+        _hoveredLineGraph->setVisible(false);
+        _hoveredLineGraph->setSelectable(QCP::SelectionType::stNone);
+        return true;
+    }
+
+    QVector<double> xData(static_cast<int>(numColumns));
+    QVector<double> yData(static_cast<int>(numColumns));
+    std::iota(xData.begin(), xData.end(), 0.0);
+
+    for(size_t column = 0; column < numColumns; column++)
+    {
+        yData[static_cast<int>(column)] =
+            _lineDensityValues.at((column * numRows) + static_cast<size_t>(hoveredRow));
+    }
+
+    auto row = static_cast<size_t>(_lineDensityRows.at(hoveredRow));
+    _hoveredLineGraph->setData(xData, yData, true);
+    _hoveredLineGraph->setPen(QPen(_pluginInstance->nodeColorForRow(row), 2.0));
+    _hoveredLineGraph->setName(_pluginInstance->rowName(row));
+    _hoveredLineGraph->setVisible(true);
+    _hoveredLineGraph->setSelectable(QCP::SelectionType::stWhole);
+
+    return true;
+}
+
 void CorrelationPlot::configureContinuousAxisRect()
 {
     if(_continuousAxisRect == nullptr)
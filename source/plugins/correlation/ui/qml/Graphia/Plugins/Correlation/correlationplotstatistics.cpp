@@ -0,0 +1,213 @@
+/* Copyright © 2013-2025 Tim Angus
+ * Copyright © 2013-2025 Tom Freeman
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "correlationplotstatistics.h"
+
+#include "shared/utils/threadpool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <numeric>
+
+void CorrelationPlotStatistics::Group::add(std::vector<double>& values)
+{
+    auto nonFinite = std::partition(values.begin(), values.end(),
+        [](double value) { return std::isfinite(value); });
+    _numNonFinite += static_cast<size_t>(std::distance(nonFinite, values.end()));
+    values.erase(nonFinite, values.end());
+
+    if(values.empty())
+        return;
+
+    if(_sortedValues.empty())
+    {
+        _shift = values.front();
+        _sum = 0.0;
+        _sumOfSquares = 0.0;
+    }
+
+    for(auto value : values)
+    {
+        auto shifted = value - _shift;
+        _sum += shifted;
+        _sumOfSquares += shifted * shifted;
+    }
+
+    std::sort(values.begin(), values.end());
+
+    auto middle = static_cast<ptrdiff_t>(_sortedValues.size());
+    _sortedValues.insert(_sortedValues.end(), values.begin(), values.end());
+    std::inplace_merge(_sortedValues.begin(), _sortedValues.begin() + middle, _sortedValues.end());
+}
+
+void CorrelationPlotStatistics::Group::remove(std::vector<double>& values)
+{
+    auto nonFinite = std::partition(values.begin(), values.end(),
+        [](double value) { return std::isfinite(value); });
+    _numNonFinite -= static_cast<size_t>(std::distance(nonFinite, values.end()));
+    values.erase(nonFinite, values.end());
+
+    if(values.empty())
+        return;
+
+    for(auto value : values)
+    {
+        auto shifted = value - _shift;
+        _sum -= shifted;
+        _sumOfSquares -= shifted * shifted;
+    }
+
+    std::sort(values.begin(), values.end());
+
+    // The values are recomputed from the same source data, so they compare exactly
+    std::vector<double> remaining;
+    remaining.reserve(_sortedValues.size() - values.size());
+    std::set_difference(_sortedValues.begin(), _sortedValues.end(),
+        values.begin(), values.end(), std::back_inserter(remaining));
+    _sortedValues = std::move(remaining);
+
+    if(_sortedValues.empty())
+    {
+        _sum = 0.0;
+        _sumOfSquares = 0.0;
+    }
+}
+
+double CorrelationPlotStatistics::Group::mean() const
+{
+    if(_numNonFinite > 0)
+        return std::numeric_limits<double>::quiet_NaN();
+
+    if(_sortedValues.empty())
+        return 0.0;
+
+    return _shift + (_sum / static_cast<double>(_sortedValues.size()));
+}
+
+double CorrelationPlotStatistics::Group::median() const
+{
+    if(_sortedValues.empty())
+        return 0.0;
+
+    auto size = _sortedValues.size();
+    auto median = _sortedValues.at(size / 2);
+
+    if(size % 2 == 0)
+        median = (_sortedValues.at((size / 2) - 1) + median) / 2.0;
+
+    return median;
+}
+
+double CorrelationPlotStatistics::Group::sumOfSquaredDeviationsFrom(double value) const
+{
+    if(_numNonFinite > 0)
+        return std::numeric_limits<double>::quiet_NaN();
+
+    // Σ(v - x)² = Σ(v - s)² - 2(x - s)Σ(v - s) + n(x - s)²
+    auto delta = value - _shift;
+    auto n = static_cast<double>(_sortedValues.size());
+    auto sumOfSquaredDeviations = _sumOfSquares - (2.0 * delta * _sum) + (n * delta * delta);
+
+    return std::max(sumOfSquaredDeviations, 0.0);
+}
+
+CorrelationPlotStatistics::CorrelationPlotStatistics(size_t numColumns) :
+    _columnGroups(numColumns)
+{
+    for(size_t column = 0; column < numColumns; column++)
+        _columnGroups[column] = {column};
+
+    _groups.resize(_columnGroups.size());
+}
+
+CorrelationPlotStatistics::CorrelationPlotStatistics(std::vector<std::vector<size_t>> columnGroups) :
+    _columnGroups(std::move(columnGroups))
+{
+    _groups.resize(_columnGroups.size());
+}
+
+bool CorrelationPlotStatistics::update(std::vector<size_t> rows, const ValueFn& valueFn)
+{
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+    if(rows == _rows)
+        return false;
+
+    std::vector<size_t> addedRows;
+    std::vector<size_t> removedRows;
+
+    std::set_difference(rows.begin(), rows.end(), _rows.begin(), _rows.end(),
+        std::back_inserter(addedRows));
+    std::set_difference(_rows.begin(), _rows.end(), rows.begin(), rows.end(),
+        std::back_inserter(removedRows));
+
+    // If the change is bigger than the result, it's cheaper to start again
+    if(addedRows.size() + removedRows.size() >= rows.size())
+    {
+        _groups.assign(_columnGroups.size(), {});
+        addedRows = rows;
+        removedRows.clear();
+    }
+
+    _rows = std::move(rows);
+
+    if(_groups.empty())
+        return true;
+
+    std::vector<size_t> groupIndices(_groups.size());
+    std::iota(groupIndices.begin(), groupIndices.end(), 0);
+
+    parallel_for(groupIndices.begin(), groupIndices.end(),
+    [&](size_t index)
+    {
+        const auto& columns = _columnGroups.at(index);
+        auto& group = _groups.at(index);
+
+        auto valuesFor = [&](const std::vector<size_t>& deltaRows)
+        {
+            std::vector<double> values;
+            values.reserve(deltaRows.size() * columns.size());
+
+            for(auto row : deltaRows)
+            {
+                for(auto column : columns)
+                    values.push_back(valueFn(row, column));
+            }
+
+            return values;
+        };
+
+        if(!removedRows.empty())
+        {
+            auto values = valuesFor(removedRows);
+            group.remove(values);
+        }
+
+        if(!addedRows.empty())
+        {
+            auto values = valuesFor(addedRows);
+            group.add(values);
+        }
+    });
+
+    return true;
+}
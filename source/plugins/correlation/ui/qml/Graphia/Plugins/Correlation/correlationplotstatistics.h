@@ -0,0 +1,79 @@
+/* Copyright © 2013-2025 Tim Angus
+ * Copyright © 2013-2025 Tom Freeman
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORRELATIONPLOTSTATISTICS_H
+#define CORRELATIONPLOTSTATISTICS_H
+
+#include <vector>
+#include <functional>
+#include <cstddef>
+
+// Per column summary statistics for a set of rows, which are maintained incrementally
+// when rows are added to or removed from the set, so that only the difference is visited
+class CorrelationPlotStatistics
+{
+public:
+    using ValueFn = std::function<double(size_t row, size_t column)>;
+
+    class Group
+    {
+        friend class CorrelationPlotStatistics;
+
+    private:
+        // Sums are of the values relative to _shift, which keeps them well conditioned
+        double _shift = 0.0;
+        double _sum = 0.0;
+        double _sumOfSquares = 0.0;
+        size_t _numNonFinite = 0;
+
+        // Finite values only
+        std::vector<double> _sortedValues;
+
+        void add(std::vector<double>& values);
+        void remove(std::vector<double>& values);
+
+    public:
+        double mean() const;
+        double median() const;
+        double sumOfSquaredDeviationsFrom(double value) const;
+
+        const std::vector<double>& sortedValues() const { return _sortedValues; }
+    };
+
+    // Each column is summarised individually
+    explicit CorrelationPlotStatistics(size_t numColumns);
+
+    // Each group of columns is summarised as a whole
+    explicit CorrelationPlotStatistics(std::vector<std::vector<size_t>> columnGroups);
+
+    // Returns false if rows is the same set of rows as the previous update
+    bool update(std::vector<size_t> rows, const ValueFn& valueFn);
+
+    size_t numRows() const { return _rows.size(); }
+    const Group& group(size_t index) const { return _groups.at(index); }
+
+private:
+    std::vector<std::vector<size_t>> _columnGroups;
+    std::vector<Group> _groups;
+
+    // Sorted
+    std::vector<size_t> _rows;
+};
+
+#endif // CORRELATIONPLOTSTATISTICS_H
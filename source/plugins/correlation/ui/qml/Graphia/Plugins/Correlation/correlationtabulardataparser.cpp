@@ -27,6 +27,7 @@
 
 #include "shared/loading/graphsizeestimate.h"
 #include "shared/loading/tabulardata.h"
+#include "shared/loading/tabulardatacache.h"
 #include "shared/loading/xlsxtabulardataparser.h"
 
 #include "shared/utils/container.h"
@@ -41,6 +42,8 @@
 #include <utility>
 #include <limits>
 #include <span>
+#include <algorithm>
+#include <iterator>
 
 using namespace Qt::Literals::StringLiterals;
 
@@ -209,6 +212,8 @@ void CorrelationTabularDataParser::setTransposed(bool transposed)
 
     if(this->transposed() != transposed)
     {
+        clearSampledCorrelation();
+
         auto transposedDataRect = _dataRect.transposed();
         transposedDataRect.moveLeft(_dataRect.y());
         transposedDataRect.moveTop(_dataRect.x());
@@ -295,23 +300,46 @@ bool CorrelationTabularDataParser::parse(const QUrl& fileUrl, const QString& fil
         if(fileUrl.isEmpty() || fileType.isEmpty())
             return;
 
-        parseUsing(fileType, [fileUrl, this](auto&& parser)
+        auto onParsed = [this]
+        {
+            clearSampledCorrelation();
+
+            _dataHasNumericalRect = !_dataPtr->findLargestNumericalDataRect(this).isEmpty();
+            emit dataHasNumericalRectChanged();
+        };
+
+        setProgress(-1);
+        const TabularDataCache cache(fileUrl, CorrelationFileParser::tabularDataCacheParameters(fileType));
+
+        auto cachedData = std::make_shared<TabularData>();
+        std::vector<TypeIdentity> columnTypeIdentities;
+        if(cache.load(*cachedData, columnTypeIdentities))
         {
-            _cancellableParser = &parser;
-            auto atExit = std::experimental::make_scope_exit([this] { _cancellableParser = nullptr; });
+            _dataPtr = cachedData;
+            onParsed();
+        }
+        else
+        {
+            parseUsing(fileType, [fileUrl, this, &cache, &onParsed](auto&& parser)
+            {
+                _cancellableParser = &parser;
+                auto atExit = std::experimental::make_scope_exit([this] { _cancellableParser = nullptr; });
 
-            parser.setProgressFn([this](int progress) { setProgress(progress); });
+                parser.setProgressFn([this](int progress) { setProgress(progress); });
 
-            if(!parser.parse(fileUrl))
-                return false;
+                if(!parser.parse(fileUrl))
+                    return false;
 
-            _dataPtr = std::make_shared<TabularData>(std::move(parser.tabularData()));
+                _dataPtr = std::make_shared<TabularData>(std::move(parser.tabularData()));
 
-            _dataHasNumericalRect = !_dataPtr->findLargestNumericalDataRect(this).isEmpty();
-            emit dataHasNumericalRectChanged();
+                setProgress(-1);
+                cache.save(*_dataPtr, {});
 
-            return true;
-        });
+                onParsed();
+
+                return true;
+            });
+        }
 
         setProgress(-1);
     });
@@ -418,6 +446,8 @@ void CorrelationTabularDataParser::clearData()
 {
     if(_dataPtr != nullptr)
         _dataPtr->reset();
+
+    clearSampledCorrelation();
 }
 
 static std::vector<size_t> randomRowIndices(size_t first, size_t numRows, size_t numSamples)
@@ -445,6 +475,7 @@ ContinuousDataVectors CorrelationTabularDataParser::sampledContinuousDataRows(
 
     ContinuousDataVectors dataRows;
     std::vector<double> rowData;
+    bool valuesAreMissing = false;
 
     auto rowIndices = randomRowIndices(static_cast<size_t>(_dataRect.y()), _dataPtr->numRows(), numSampleRows);
     rowData.reserve(rowIndices.size() * static_cast<size_t>(_dataRect.width()));
@@ -474,15 +505,25 @@ ContinuousDataVectors CorrelationTabularDataParser::sampledContinuousDataRows(
             }
             else
             {
-                transformedValue = CorrelationFileParser::imputeValue(
-                    missingDataType, replacementValue,
-                    *_dataPtr, _dataRect, columnIndex, rowIndex);
+                transformedValue = std::numeric_limits<double>::quiet_NaN();
+                valuesAreMissing = true;
             }
 
             rowData.emplace_back(transformedValue);
         }
     }
 
+    if(valuesAreMissing)
+    {
+        // Column averages must come from the whole of the data, not just the sampled rows
+        std::vector<double> columnAverages;
+        if(missingDataType == MissingDataType::ColumnAverage)
+            columnAverages = CorrelationFileParser::columnAveragesFor(*_dataPtr, _dataRect);
+
+        CorrelationFileParser::imputeValues(missingDataType, replacementValue,
+            static_cast<size_t>(_dataRect.width()), rowData, std::move(columnAverages));
+    }
+
     CorrelationFileParser::clipValues(clippingType, clippingValue,
         static_cast<size_t>(_dataRect.width()), rowData);
 
@@ -547,6 +588,87 @@ DiscreteDataVectors CorrelationTabularDataParser::sampledDiscreteDataRows(
     return dataRows;
 }
 
+std::shared_ptr<const EdgeList> CorrelationTabularDataParser::sampledCorrelation(
+    size_t numSampleRows, const QVariantMap& parameters)
+{
+    QVariantMap key;
+
+    for(const auto& name : {u"correlationDataType"_s, u"continuousCorrelationType"_s,
+        u"discreteCorrelationType"_s, u"treatAsBinary"_s, u"missingDataType"_s,
+        u"missingDataValue"_s, u"scaling"_s, u"normalise"_s, u"clippingType"_s,
+        u"clippingValue"_s})
+    {
+        key.insert(name, parameters.value(name));
+    }
+
+    key.insert(u"dataRect"_s, _dataRect);
+    key.insert(u"numSampleRows"_s, static_cast<qulonglong>(numSampleRows));
+
+    {
+        const std::unique_lock<std::mutex> lock(_sampledCorrelationMutex);
+
+        if(_sampledCorrelationEdges != nullptr && _sampledCorrelationKey == key)
+            return _sampledCorrelationEdges;
+    }
+
+    auto correlationDataType = normaliseQmlEnum<CorrelationDataType>(parameters[u"correlationDataType"_s].toInt());
+    auto continuousCorrelationType = normaliseQmlEnum<CorrelationType>(parameters[u"continuousCorrelationType"_s].toInt());
+    auto discreteCorrelationType = normaliseQmlEnum<CorrelationType>(parameters[u"discreteCorrelationType"_s].toInt());
+
+    // Retain every pair, so that the filtering parameters can subsequently be applied at will
+    auto allPairsParameters = parameters;
+    allPairsParameters[u"minimumThreshold"_s] = 0.0;
+    allPairsParameters[u"correlationPolarity"_s] = static_cast<int>(CorrelationPolarity::Both);
+
+    EdgeList edges;
+
+    switch(correlationDataType)
+    {
+    default:
+    case CorrelationDataType::Continuous:
+    {
+        auto correlation = ContinuousCorrelation::create(continuousCorrelationType, CorrelationFilterType::Threshold);
+        auto dataRows = sampledContinuousDataRows(numSampleRows, parameters);
+
+        if(correlation == nullptr || dataRows.empty())
+            return nullptr;
+
+        edges = correlation->edgeList(dataRows, allPairsParameters, &_graphSizeEstimateCancellable);
+        break;
+    }
+
+    case CorrelationDataType::Discrete:
+    {
+        auto correlation = DiscreteCorrelation::create(discreteCorrelationType, CorrelationFilterType::Threshold);
+        auto dataRows = sampledDiscreteDataRows(numSampleRows, parameters);
+
+        if(correlation == nullptr || dataRows.empty())
+            return nullptr;
+
+        edges = correlation->edgeList(dataRows, allPairsParameters, &_graphSizeEstimateCancellable);
+        break;
+    }
+    }
+
+    if(_graphSizeEstimateCancellable.cancelled())
+        return nullptr;
+
+    auto sharedEdges = std::make_shared<const EdgeList>(std::move(edges));
+
+    const std::unique_lock<std::mutex> lock(_sampledCorrelationMutex);
+    _sampledCorrelationKey = key;
+    _sampledCorrelationEdges = sharedEdges;
+
+    return sharedEdges;
+}
+
+void CorrelationTabularDataParser::clearSampledCorrelation()
+{
+    const std::unique_lock<std::mutex> lock(_sampledCorrelationMutex);
+    _sampledCorrelationKey.clear();
+    _sampledCorrelationEdges = nullptr;
+}
+
 void CorrelationTabularDataParser::estimateGraphSize(const QVariantMap& parameters)
 {
     Q_ASSERT(!parameters.isEmpty());
@@ -564,11 +686,10 @@ void CorrelationTabularDataParser::estimateGraphSize(const QVariantMap& paramete
     {
         Q_ASSERT(!parameters.isEmpty());
 
+        auto minimumThreshold = parameters[u"minimumThreshold"_s].toDouble();
         auto maximumK = static_cast<size_t>(parameters[u"maximumK"_s].toUInt());
         auto correlationFilterType = normaliseQmlEnum<CorrelationFilterType>(parameters[u"correlationFilterType"_s].toInt());
-        auto correlationDataType = normaliseQmlEnum<CorrelationDataType>(parameters[u"correlationDataType"_s].toInt());
-        auto continuousCorrelationType = normaliseQmlEnum<CorrelationType>(parameters[u"continuousCorrelationType"_s].toInt());
-        auto discreteCorrelationType = normaliseQmlEnum<CorrelationType>(parameters[u"discreteCorrelationType"_s].toInt());
+        auto correlationPolarity = normaliseQmlEnum<CorrelationPolarity>(parameters[u"correlationPolarity"_s].toInt());
 
         if(_dataPtr->numRows() == 0)
             return QVariantMap();
@@ -578,35 +699,19 @@ void CorrelationTabularDataParser::estimateGraphSize(const QVariantMap& paramete
 
         const size_t maxSampleRows = 1400;
         const auto numSampleRows = std::min(maxSampleRows, _dataPtr->numRows());
-        EdgeList sampleEdges;
-
-        switch(correlationDataType)
-        {
-        default:
-        case CorrelationDataType::Continuous:
-        {
-            auto correlation = ContinuousCorrelation::create(continuousCorrelationType, correlationFilterType);
-            auto dataRows = sampledContinuousDataRows(numSampleRows, parameters);
 
-            if(correlation == nullptr || dataRows.empty())
-                return QVariantMap();
-
-            sampleEdges = correlation->edgeList(dataRows, parameters, &_graphSizeEstimateCancellable);
-            break;
-        }
+        // The (potentially cached) correlation values are the expensive part; changing
+        // the threshold, polarity or k only requires them to be filtered and swept again
+        auto allPairs = sampledCorrelation(numSampleRows, parameters);
+        if(allPairs == nullptr)
+            return QVariantMap();
 
-        case CorrelationDataType::Discrete:
+        EdgeList sampleEdges;
+        std::copy_if(allPairs->begin(), allPairs->end(), std::back_inserter(sampleEdges),
+        [correlationPolarity, minimumThreshold](const auto& edge)
         {
-            auto correlation = DiscreteCorrelation::create(discreteCorrelationType, correlationFilterType);
-            auto dataRows = sampledDiscreteDataRows(numSampleRows, parameters);
-
-            if(correlation == nullptr || dataRows.empty())
-                return QVariantMap();
-
-            sampleEdges = correlation->edgeList(dataRows, parameters, &_graphSizeEstimateCancellable);
-            break;
-        }
-        }
+            return correlationExceedsThreshold(correlationPolarity, edge._weight, minimumThreshold);
+        });
 
         switch(correlationFilterType)
         {
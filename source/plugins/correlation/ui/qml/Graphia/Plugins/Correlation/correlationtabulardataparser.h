@@ -41,6 +41,7 @@
 
 #include <memory>
 #include <atomic>
+#include <mutex>
 
 class CorrelationTabularDataParser : public QObject, public Cancellable, public Progressable
 {
@@ -87,11 +88,20 @@ private:
     QFutureWatcher<QVariantMap> _graphSizeEstimateFutureWatcher;
     QVariantMap _graphSizeEstimate;
 
+    // The correlation values of every pair of sampled rows, which remain valid as long as
+    // the parameters that influence the values (as opposed to their filtering) don't change
+    std::mutex _sampledCorrelationMutex;
+    QVariantMap _sampledCorrelationKey;
+    std::shared_ptr<const EdgeList> _sampledCorrelationEdges;
+
     QVariantMap dataRect() const;
 
     ContinuousDataVectors sampledContinuousDataRows(size_t numSampleRows, const QVariantMap& parameters);
     DiscreteDataVectors sampledDiscreteDataRows(size_t numSampleRows, const QVariantMap& parameters);
 
+    std::shared_ptr<const EdgeList> sampledCorrelation(size_t numSampleRows, const QVariantMap& parameters);
+    void clearSampledCorrelation();
+
     void waitForDataRectangleFuture();
 
 public:
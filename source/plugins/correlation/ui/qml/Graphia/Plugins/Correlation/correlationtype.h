@@ -69,6 +69,11 @@ DEFINE_QML_ENUM(MissingDataType,
     ColumnAverage,
     RowInterpolation);
 
+DEFINE_QML_ENUM(HierarchicalClusteringLinkage,
+    Single,
+    Average,
+    Complete);
+
 DEFINE_QML_ENUM(ClippingType,
     None,
     Constant,
@@ -0,0 +1,344 @@
+/* Copyright © 2013-2025 Tim Angus
+ * Copyright © 2013-2025 Tom Freeman
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "binaryblock_json.h"
+
+#include "shared/utils/container.h"
+#include "shared/utils/threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+
+#include <QByteArray>
+
+namespace
+{
+// Chunks are encoded and decoded independently, so that this can happen concurrently
+constexpr size_t ChunkSize = 1 << 22;
+
+template<typename T> constexpr const char* binaryTypeName();
+template<> constexpr const char* binaryTypeName<double>() { return "float64"; }
+template<> constexpr const char* binaryTypeName<int>() { return "int32"; }
+
+constexpr const char* Utf8TypeName = "utf8";
+
+static_assert(sizeof(double) == 8 && sizeof(int) == 4);
+
+std::vector<size_t> chunkIndicesFor(size_t numChunks)
+{
+    std::vector<size_t> chunkIndices(numChunks);
+    std::iota(chunkIndices.begin(), chunkIndices.end(), 0);
+
+    return chunkIndices;
+}
+
+// Group together the bytes of each element by significance, least significant first;
+// for numeric data this makes the highly correlated sign and exponent bytes contiguous,
+// which greatly improves compression, and it also takes care of byte order
+void shuffle(const char* bytes, size_t numBytes, size_t elementSize, char* shuffledBytes)
+{
+    const size_t numElements = numBytes / elementSize;
+
+    for(size_t b = 0; b < elementSize; b++)
+    {
+        const size_t sourceByte = std::endian::native == std::endian::little ? b : elementSize - 1 - b;
+        auto* plane = shuffledBytes + (b * numElements);
+
+        for(size_t i = 0; i < numElements; i++)
+            plane[i] = bytes[(i * elementSize) + sourceByte];
+    }
+}
+
+void unshuffle(const char* shuffledBytes, size_t numBytes, size_t elementSize, char* bytes)
+{
+    const size_t numElements = numBytes / elementSize;
+
+    for(size_t b = 0; b < elementSize; b++)
+    {
+        const size_t targetByte = std::endian::native == std::endian::little ? b : elementSize - 1 - b;
+        const auto* plane = shuffledBytes + (b * numElements);
+
+        for(size_t i = 0; i < numElements; i++)
+            bytes[(i * elementSize) + targetByte] = plane[i];
+    }
+}
+
+json encodeBlock(const char* type, size_t count, const char* bytes, size_t numBytes,
+    size_t elementSize, bool compress)
+{
+    const size_t numChunks = (numBytes + ChunkSize - 1) / ChunkSize;
+    std::vector<QByteArray> encodedChunks(numChunks);
+
+    if(numChunks > 0)
+    {
+        auto chunkIndices = chunkIndicesFor(numChunks);
+        parallel_for(chunkIndices.begin(), chunkIndices.end(),
+        [&](size_t chunkIndex)
+        {
+            const size_t offset = chunkIndex * ChunkSize;
+            const size_t chunkBytes = std::min(ChunkSize, numBytes - offset);
+
+            QByteArray chunk(static_cast<qsizetype>(chunkBytes), Qt::Uninitialized);
+            shuffle(bytes + offset, chunkBytes, elementSize, chunk.data());
+
+            if(compress)
+                chunk = qCompress(chunk);
+
+            encodedChunks.at(chunkIndex) = chunk.toBase64();
+        });
+    }
+
+    json jsonBlock;
+
+    jsonBlock["type"] = type;
+    jsonBlock["count"] = count;
+    jsonBlock["numBytes"] = numBytes;
+    jsonBlock["chunkSize"] = ChunkSize;
+    jsonBlock["compressed"] = compress;
+    jsonBlock["chunks"] = json::array();
+
+    for(const auto& encodedChunk : encodedChunks)
+        jsonBlock["chunks"].push_back(encodedChunk.toStdString());
+
+    return jsonBlock;
+}
+
+bool decodeBlock(const json& jsonBlock, char* bytes, size_t numBytes, size_t elementSize)
+{
+    const auto& jsonChunks = jsonBlock["chunks"];
+    const auto chunkSize = jsonBlock["chunkSize"].get<size_t>();
+    const bool compressed = jsonBlock["compressed"];
+
+    if(jsonBlock["numBytes"].get<size_t>() != numBytes)
+        return false;
+
+    if(chunkSize == 0 || (chunkSize % elementSize) != 0)
+        return false;
+
+    const size_t numChunks = (numBytes + chunkSize - 1) / chunkSize;
+    if(jsonChunks.size() != numChunks)
+        return false;
+
+    if(numChunks == 0)
+        return true;
+
+    std::atomic<bool> valid = true;
+
+    auto chunkIndices = chunkIndicesFor(numChunks);
+    parallel_for(chunkIndices.begin(), chunkIndices.end(),
+    [&](size_t chunkIndex)
+    {
+        const auto& jsonChunk = jsonChunks.at(chunkIndex);
+        if(!jsonChunk.is_string())
+        {
+            valid = false;
+            return;
+        }
+
+        const auto& base64 = jsonChunk.get_ref<const std::string&>();
+        auto decoded = QByteArray::fromBase64Encoding(QByteArray::fromRawData(
+            base64.data(), static_cast<qsizetype>(base64.size())), QByteArray::AbortOnBase64DecodingErrors);
+
+        if(!decoded)
+        {
+            valid = false;
+            return;
+        }
+
+        auto chunk = compressed ? qUncompress(decoded.decoded) : std::move(decoded.decoded);
+
+        const size_t offset = chunkIndex * chunkSize;
+        const size_t chunkBytes = std::min(chunkSize, numBytes - offset);
+
+        if(static_cast<size_t>(chunk.size()) != chunkBytes)
+        {
+            valid = false;
+            return;
+        }
+
+        unshuffle(chunk.constData(), chunkBytes, elementSize, bytes + offset);
+    });
+
+    return valid;
+}
+
+bool isBinaryBlockOfType(const json& jsonBlock, const char* type)
+{
+    return u::isBinaryBlock(jsonBlock) && jsonBlock["type"] == type;
+}
+
+template<typename T>
+json numericBinaryBlockAsJson(const std::vector<T>& values, bool compress)
+{
+    return encodeBlock(binaryTypeName<T>(), values.size(),
+        reinterpret_cast<const char*>(values.data()), // NOLINT cppcoreguidelines-pro-type-reinterpret-cast
+        values.size() * sizeof(T), sizeof(T), compress);
+}
+
+template<typename T>
+bool numericBinaryBlockFromJson(const json& jsonBlock, std::vector<T>& values)
+{
+    if(!isBinaryBlockOfType(jsonBlock, binaryTypeName<T>()))
+        return false;
+
+    std::vector<T> decodedValues(jsonBlock["count"].get<size_t>());
+
+    if(!decodeBlock(jsonBlock,
+        reinterpret_cast<char*>(decodedValues.data()), // NOLINT cppcoreguidelines-pro-type-reinterpret-cast
+        decodedValues.size() * sizeof(T), sizeof(T)))
+    {
+        return false;
+    }
+
+    values = std::move(decodedValues);
+    return true;
+}
+} // namespace
+
+json u::binaryBlockAsJson(const std::vector<double>& values, bool compress)
+{
+    return numericBinaryBlockAsJson(values, compress);
+}
+
+json u::binaryBlockAsJson(const std::vector<int>& values, bool compress)
+{
+    return numericBinaryBlockAsJson(values, compress);
+}
+
+json u::binaryBlockAsJson(const std::vector<QString>& values, bool compress)
+{
+    // Each string is stored as a little-endian uint32_t byte length, followed by its UTF-8 bytes
+    std::vector<QByteArray> utf8Values(values.size());
+
+    if(!values.empty())
+    {
+        parallel_for(values.begin(), values.end(),
+        [&](std::vector<QString>::const_iterator it)
+        {
+            auto index = static_cast<size_t>(std::distance(values.begin(), it));
+            utf8Values.at(index) = it->toUtf8();
+        });
+    }
+
+    size_t numBytes = 0;
+    for(const auto& utf8Value : utf8Values)
+        numBytes += sizeof(uint32_t) + static_cast<size_t>(utf8Value.size());
+
+    std::vector<char> bytes(numBytes);
+    auto* byte = bytes.data();
+
+    for(const auto& utf8Value : utf8Values)
+    {
+        auto length = static_cast<uint32_t>(utf8Value.size());
+
+        for(size_t b = 0; b < sizeof(uint32_t); b++)
+            *byte++ = static_cast<char>((length >> (b * 8)) & 0xFFu);
+
+        std::memcpy(byte, utf8Value.constData(), length);
+        byte += length;
+    }
+
+    return encodeBlock(Utf8TypeName, values.size(), bytes.data(), bytes.size(), 1, compress);
+}
+
+bool u::isBinaryBlock(const json& jsonValue)
+{
+    if(!jsonValue.is_object() ||
+        !u::containsAllOf(jsonValue, {"type", "count", "numBytes", "chunkSize", "compressed", "chunks"}))
+    {
+        return false;
+    }
+
+    return jsonValue["type"].is_string() &&
+        jsonValue["count"].is_number_unsigned() &&
+        jsonValue["numBytes"].is_number_unsigned() &&
+        jsonValue["chunkSize"].is_number_unsigned() &&
+        jsonValue["compressed"].is_boolean() &&
+        jsonValue["chunks"].is_array();
+}
+
+bool u::binaryBlockFromJson(const json& jsonBlock, std::vector<double>& values)
+{
+    return numericBinaryBlockFromJson(jsonBlock, values);
+}
+
+bool u::binaryBlockFromJson(const json& jsonBlock, std::vector<int>& values)
+{
+    return numericBinaryBlockFromJson(jsonBlock, values);
+}
+
+bool u::binaryBlockFromJson(const json& jsonBlock, std::vector<QString>& values)
+{
+    if(!isBinaryBlockOfType(jsonBlock, Utf8TypeName))
+        return false;
+
+    std::vector<char> bytes(jsonBlock["numBytes"].get<size_t>());
+
+    if(!decodeBlock(jsonBlock, bytes.data(), bytes.size(), 1))
+        return false;
+
+    // Find where each string starts, then convert them concurrently
+    const auto count = jsonBlock["count"].get<size_t>();
+    std::vector<size_t> offsets;
+    offsets.reserve(count);
+
+    size_t offset = 0;
+    while(offsets.size() < count)
+    {
+        if(offset + sizeof(uint32_t) > bytes.size())
+            return false;
+
+        uint32_t length = 0;
+        for(size_t b = 0; b < sizeof(uint32_t); b++)
+            length |= static_cast<uint32_t>(static_cast<unsigned char>(bytes.at(offset + b))) << (b * 8);
+
+        offsets.push_back(offset);
+        offset += sizeof(uint32_t) + length;
+
+        if(offset > bytes.size())
+            return false;
+    }
+
+    if(offset != bytes.size())
+        return false;
+
+    std::vector<QString> decodedValues(count);
+
+    if(count > 0)
+    {
+        auto indices = chunkIndicesFor(count);
+        parallel_for(indices.begin(), indices.end(),
+        [&](size_t index)
+        {
+            const auto stringOffset = offsets.at(index);
+            const auto stringEnd = index + 1 < count ? offsets.at(index + 1) : bytes.size();
+            const auto* utf8 = bytes.data() + stringOffset + sizeof(uint32_t);
+
+            decodedValues.at(index) = QString::fromUtf8(utf8,
+                static_cast<qsizetype>(stringEnd - stringOffset - sizeof(uint32_t)));
+        });
+    }
+
+    values = std::move(decodedValues);
+    return true;
+}
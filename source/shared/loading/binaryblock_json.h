@@ -0,0 +1,46 @@
+/* Copyright © 2013-2025 Tim Angus
+ * Copyright © 2013-2025 Tom Freeman
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BINARYBLOCK_JSON_H
+#define BINARYBLOCK_JSON_H
+
+#include <json_helper.h>
+
+#include <vector>
+
+#include <QString>
+
+namespace u
+{
+    // Large dense arrays are slow to format and parse as JSON text, so instead they
+    // are encoded as little-endian binary, split into chunks that are byte shuffled,
+    // optionally compressed, and then base64 encoded into the strings of a JSON object
+    json binaryBlockAsJson(const std::vector<double>& values, bool compress = true);
+    json binaryBlockAsJson(const std::vector<int>& values, bool compress = true);
+    json binaryBlockAsJson(const std::vector<QString>& values, bool compress = true);
+
+    bool isBinaryBlock(const json& jsonValue);
+
+    // These return false if the block is malformed or of the wrong type
+    bool binaryBlockFromJson(const json& jsonBlock, std::vector<double>& values);
+    bool binaryBlockFromJson(const json& jsonBlock, std::vector<int>& values);
+    bool binaryBlockFromJson(const json& jsonBlock, std::vector<QString>& values);
+} // namespace u
+
+#endif // BINARYBLOCK_JSON_H
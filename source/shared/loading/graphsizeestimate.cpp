@@ -21,19 +21,112 @@
 
 #include "shared/utils/utils.h"
 
-#include "shared/graph/elementid_containers.h"
-#include "shared/graph/undirectededge.h"
-
 #include <QVector>
 
 #include <algorithm>
-#include <set>
+#include <numeric>
+#include <limits>
+#include <vector>
+#include <unordered_set>
+#include <cstdint>
 #include <cstdlib>
 #include <cmath>
 
 using namespace Qt::Literals::StringLiterals;
 
-QVariantMap graphSizeEstimateThreshold(EdgeList edgeList,
+namespace
+{
+// The undirected node pairs that have been seen; when the number of nodes
+// is small enough, as is the case for sampled data, this is a dense bitset
+class NodePairSet
+{
+private:
+    static constexpr size_t MAX_DENSE_NODES = 1u << 14u;
+
+    size_t _numNodes;
+    std::vector<bool> _dense;
+    std::unordered_set<uint64_t> _sparse;
+
+public:
+    explicit NodePairSet(size_t numNodes) : _numNodes(numNodes)
+    {
+        if(numNodes <= MAX_DENSE_NODES)
+            _dense.resize(numNodes * numNodes);
+    }
+
+    // Returns true if the pair wasn't already present
+    bool insert(size_t a, size_t b)
+    {
+        if(a > b)
+            std::swap(a, b);
+
+        auto index = (a * _numNodes) + b;
+
+        if(!_dense.empty())
+        {
+            if(_dense[index])
+                return false;
+
+            _dense[index] = true;
+            return true;
+        }
+
+        return _sparse.insert(index).second;
+    }
+};
+
+size_t numNodesIn(const EdgeList& edgeList)
+{
+    size_t numNodes = 0;
+
+    for(const auto& edge : edgeList)
+    {
+        numNodes = std::max({numNodes, static_cast<size_t>(edge._source) + 1,
+            static_cast<size_t>(edge._target) + 1});
+    }
+
+    return numNodes;
+}
+
+// Stable counting sort of the indices of the values, by their key
+std::vector<size_t> indicesByKey(const std::vector<size_t>& keys, size_t numKeys)
+{
+    std::vector<size_t> offsets(numKeys + 1, 0);
+    for(auto key : keys)
+        offsets[key + 1]++;
+
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    std::vector<size_t> indices(keys.size());
+    for(size_t i = 0; i < keys.size(); i++)
+        indices[offsets[keys[i]]++] = i;
+
+    return indices;
+}
+
+QVariantMap estimateAsMap(QVector<double>& keys, QVector<double>& estimatedNumNodes,
+    QVector<double>& estimatedNumEdges, QVector<double>& estimatedNumUniqueEdges)
+{
+    std::reverse(keys.begin(), keys.end());
+    std::reverse(estimatedNumNodes.begin(), estimatedNumNodes.end());
+    std::reverse(estimatedNumEdges.begin(), estimatedNumEdges.end());
+    std::reverse(estimatedNumUniqueEdges.begin(), estimatedNumUniqueEdges.end());
+
+    keys.shrink_to_fit();
+    estimatedNumNodes.shrink_to_fit();
+    estimatedNumEdges.shrink_to_fit();
+    estimatedNumUniqueEdges.shrink_to_fit();
+
+    QVariantMap map;
+    map.insert(u"keys"_s, QVariant::fromValue(keys));
+    map.insert(u"numNodes"_s, QVariant::fromValue(estimatedNumNodes));
+    map.insert(u"numEdges"_s, QVariant::fromValue(estimatedNumEdges));
+    map.insert(u"numUniqueEdges"_s, QVariant::fromValue(estimatedNumUniqueEdges));
+    return map;
+}
+} // namespace
+
+QVariantMap graphSizeEstimateThreshold(const EdgeList& edgeList,
     size_t numSampleNodes, size_t maxNodes)
 {
     if(edgeList.empty())
@@ -45,30 +138,42 @@ QVariantMap graphSizeEstimateThreshold(EdgeList edgeList,
     auto nodesScale = static_cast<double>(maxNodes) / static_cast<double>(numSampleNodes);
     auto edgesScale = nodesScale * nodesScale;
 
-    std::sort(edgeList.begin(), edgeList.end(),
-        [](const auto& a, const auto& b) { return std::abs(a._weight) > std::abs(b._weight); });
+    auto [smallestEdge, largestEdge] = std::minmax_element(edgeList.begin(), edgeList.end(),
+        [](const auto& a, const auto& b) { return std::abs(a._weight) < std::abs(b._weight); });
 
-    const auto smallestWeight = std::abs(edgeList.back()._weight);
-    const auto largestWeight = std::abs(edgeList.front()._weight);
-    const auto numEstimateSamples = 100;
+    const auto smallestWeight = std::abs(smallestEdge->_weight);
+    const auto largestWeight = std::abs(largestEdge->_weight);
+    const size_t numEstimateSamples = 100;
     const auto sampleQuantum = (largestWeight - smallestWeight) / (numEstimateSamples - 1);
-    auto sampleCutoff = std::abs(largestWeight) - sampleQuantum;
+    const auto numBins = sampleQuantum > 0.0 ? numEstimateSamples : 1;
+
+    // Histogram the edges by the first sample (in descending order of weight) they are present in
+    std::vector<size_t> bins;
+    bins.reserve(edgeList.size());
+    for(const auto& edge : edgeList)
+    {
+        size_t bin = 0;
+
+        if(numBins > 1)
+        {
+            bin = static_cast<size_t>(std::ceil((largestWeight - std::abs(edge._weight)) / sampleQuantum));
+            bin = std::min(bin, numBins - 1);
+        }
+
+        bins.push_back(bin);
+    }
+
+    auto edgeIndices = indicesByKey(bins, numBins);
 
     QVector<double> keys;
     QVector<double> estimatedNumNodes;
     QVector<double> estimatedNumEdges;
     QVector<double> estimatedNumUniqueEdges;
 
-    keys.reserve(static_cast<qsizetype>(numEstimateSamples));
-    estimatedNumNodes.reserve(static_cast<qsizetype>(numEstimateSamples));
-    estimatedNumEdges.reserve(static_cast<qsizetype>(numEstimateSamples));
-    estimatedNumUniqueEdges.reserve(static_cast<qsizetype>(numEstimateSamples));
-
-    size_t numEdges = 0;
-    size_t numUniqueEdges = 0;
-    NodeIdSet nonSingletonNodes;
-    std::set<UndirectedEdge> uniqueEdges;
-    auto weight = largestWeight;
+    keys.reserve(static_cast<qsizetype>(numBins));
+    estimatedNumNodes.reserve(static_cast<qsizetype>(numBins));
+    estimatedNumEdges.reserve(static_cast<qsizetype>(numBins));
+    estimatedNumUniqueEdges.reserve(static_cast<qsizetype>(numBins));
 
     auto append = [&](double w, size_t n, size_t e, size_t ue)
     {
@@ -78,44 +183,50 @@ QVariantMap graphSizeEstimateThreshold(EdgeList edgeList,
         estimatedNumUniqueEdges.append(std::ceil(std::min(static_cast<double>(ue) * edgesScale, static_cast<double>(maxEdges))));
     };
 
-    for(const auto& edge : edgeList)
+    const auto numNodes = numNodesIn(edgeList);
+    std::vector<bool> nonSingletonNodes(numNodes, false);
+    NodePairSet uniqueEdges(numNodes);
+
+    size_t numNonSingletonNodes = 0;
+    size_t numEdges = 0;
+    size_t numUniqueEdges = 0;
+
+    auto addNode = [&](NodeId nodeId)
     {
-        if(std::abs(edge._weight) < sampleCutoff)
+        auto index = static_cast<size_t>(nodeId);
+        if(!nonSingletonNodes[index])
         {
-            append(weight, nonSingletonNodes.size(), numEdges, numUniqueEdges);
-            sampleCutoff -= sampleQuantum;
-            weight = std::abs(edge._weight);
+            nonSingletonNodes[index] = true;
+            numNonSingletonNodes++;
         }
+    };
 
-        nonSingletonNodes.insert(edge._source);
-        nonSingletonNodes.insert(edge._target);
-        numEdges++;
+    auto edgeIndexIt = edgeIndices.begin();
+    for(size_t bin = 0; bin < numBins; bin++)
+    {
+        for(; edgeIndexIt != edgeIndices.end() && bins[*edgeIndexIt] == bin; ++edgeIndexIt)
+        {
+            const auto& edge = edgeList[*edgeIndexIt];
 
-        if(uniqueEdges.emplace(edge._source, edge._target).second)
-            numUniqueEdges++;
-    }
+            addNode(edge._source);
+            addNode(edge._target);
+            numEdges++;
 
-    append(std::min(weight, smallestWeight), nonSingletonNodes.size(), numEdges, numUniqueEdges);
+            if(uniqueEdges.insert(static_cast<size_t>(edge._source), static_cast<size_t>(edge._target)))
+                numUniqueEdges++;
+        }
 
-    std::reverse(keys.begin(), keys.end());
-    std::reverse(estimatedNumNodes.begin(), estimatedNumNodes.end());
-    std::reverse(estimatedNumEdges.begin(), estimatedNumEdges.end());
-    std::reverse(estimatedNumUniqueEdges.begin(), estimatedNumUniqueEdges.end());
+        auto weight = bin < numBins - 1 ?
+            largestWeight - (static_cast<double>(bin) * sampleQuantum) :
+            smallestWeight;
 
-    keys.shrink_to_fit();
-    estimatedNumNodes.shrink_to_fit();
-    estimatedNumEdges.shrink_to_fit();
-    estimatedNumUniqueEdges.shrink_to_fit();
+        append(weight, numNonSingletonNodes, numEdges, numUniqueEdges);
+    }
 
-    QVariantMap map;
-    map.insert(u"keys"_s, QVariant::fromValue(keys));
-    map.insert(u"numNodes"_s, QVariant::fromValue(estimatedNumNodes));
-    map.insert(u"numEdges"_s, QVariant::fromValue(estimatedNumEdges));
-    map.insert(u"numUniqueEdges"_s, QVariant::fromValue(estimatedNumUniqueEdges));
-    return map;
+    return estimateAsMap(keys, estimatedNumNodes, estimatedNumEdges, estimatedNumUniqueEdges);
 }
 
-QVariantMap graphSizeEstimateKnn(EdgeList edgeList, size_t maximumK,
+QVariantMap graphSizeEstimateKnn(const EdgeList& edgeList, size_t maximumK,
     size_t numSampleNodes, size_t maxNodes)
 {
     if(edgeList.empty())
@@ -124,9 +235,6 @@ QVariantMap graphSizeEstimateKnn(EdgeList edgeList, size_t maximumK,
     auto maxEdges = maxNodes * maxNodes;
     auto scale = static_cast<double>(maxNodes) / static_cast<double>(numSampleNodes);
 
-    std::sort(edgeList.begin(), edgeList.end(),
-        [](const auto& a, const auto& b) { return std::abs(a._weight) > std::abs(b._weight); });
-
     auto numEstimateSamples = std::min(static_cast<size_t>(100), maximumK);
     auto sampleIntervals = u::evenDivisionOf(maximumK - 1, numEstimateSamples - 1);
 
@@ -140,43 +248,73 @@ QVariantMap graphSizeEstimateKnn(EdgeList edgeList, size_t maximumK,
     estimatedNumEdges.reserve(static_cast<qsizetype>(numEstimateSamples));
     estimatedNumUniqueEdges.reserve(static_cast<qsizetype>(numEstimateSamples));
 
-    NodeIdMap<std::vector<size_t>> nodes;
-    for(size_t i = 0; i < edgeList.size(); i++)
+    // Group the (indices of) edges by each of their nodes
+    const auto numNodes = numNodesIn(edgeList);
+    std::vector<size_t> endpoints;
+    endpoints.reserve(edgeList.size() * 2);
+    for(const auto& edge : edgeList)
     {
-        const auto& edge = edgeList.at(i);
-        nodes[edge._source].push_back(i);
-        nodes[edge._target].push_back(i);
+        endpoints.push_back(static_cast<size_t>(edge._source));
+        endpoints.push_back(static_cast<size_t>(edge._target));
     }
 
-    const auto numNonSingletonNodes = nodes.size();
-    size_t k = 1;
-    std::set<size_t> edges;
-    std::set<UndirectedEdge> uniqueEdges;
-    size_t i = 0;
+    auto endpointIndices = indicesByKey(endpoints, numNodes);
 
-    while(k <= maximumK)
+    // The rank of each edge in the edges of whichever of its nodes it ranks highest in,
+    // i.e. the smallest k for which the edge is present; maximumK if it never is
+    std::vector<size_t> edgeRanks(edgeList.size(), maximumK);
+    size_t numNonSingletonNodes = 0;
+
+    for(auto first = endpointIndices.begin(); first != endpointIndices.end();)
     {
-        while(i < k)
+        auto node = endpoints[*first];
+        auto last = std::find_if(first, endpointIndices.end(),
+            [&](size_t index) { return endpoints[index] != node; });
+
+        std::stable_sort(first, last, [&](size_t a, size_t b)
         {
-            for(const auto& [nodeId, indices] : nodes)
-            {
-                if(i >= indices.size())
-                    continue;
+            return std::abs(edgeList[a / 2]._weight) > std::abs(edgeList[b / 2]._weight);
+        });
 
-                auto index = indices.at(i);
-                edges.insert(index);
+        for(auto it = first; it != last; ++it)
+        {
+            auto rank = static_cast<size_t>(std::distance(first, it));
+            auto& edgeRank = edgeRanks[*it / 2];
+            edgeRank = std::min(edgeRank, rank);
+        }
 
-                const auto& edge = edgeList.at(index);
-                const NodeId opposite = (nodeId == edge._source) ? edge._target : edge._source;
+        numNonSingletonNodes++;
+        first = last;
+    }
 
-                uniqueEdges.emplace(nodeId, opposite);
-            }
+    // Histogram the edges, and unique edges, by their rank
+    std::vector<size_t> numEdgesAtRank(maximumK + 1, 0);
+    std::vector<size_t> numUniqueEdgesAtRank(maximumK + 1, 0);
+    NodePairSet uniqueEdges(numNodes);
 
-            i++;
-        }
+    for(auto index : indicesByKey(edgeRanks, maximumK + 1))
+    {
+        const auto& edge = edgeList[index];
+        auto rank = edgeRanks[index];
+
+        numEdgesAtRank[rank]++;
+
+        if(uniqueEdges.insert(static_cast<size_t>(edge._source), static_cast<size_t>(edge._target)))
+            numUniqueEdgesAtRank[rank]++;
+    }
+
+    size_t k = 1;
+    size_t numEdges = 0;
+    size_t numUniqueEdges = 0;
+    size_t i = 0;
 
-        auto numEdges = edges.size();
-        auto numUniqueEdges = uniqueEdges.size();
+    while(k <= maximumK)
+    {
+        for(; i < k; i++)
+        {
+            numEdges += numEdgesAtRank[i];
+            numUniqueEdges += numUniqueEdgesAtRank[i];
+        }
 
         keys.append(static_cast<double>(k));
         estimatedNumNodes.append(std::ceil(std::min(static_cast<double>(numNonSingletonNodes) * scale, static_cast<double>(maxNodes))));
@@ -190,20 +328,5 @@ QVariantMap graphSizeEstimateKnn(EdgeList edgeList, size_t maximumK,
         sampleIntervals.pop_back();
     }
 
-    std::reverse(keys.begin(), keys.end());
-    std::reverse(estimatedNumNodes.begin(), estimatedNumNodes.end());
-    std::reverse(estimatedNumEdges.begin(), estimatedNumEdges.end());
-    std::reverse(estimatedNumUniqueEdges.begin(), estimatedNumUniqueEdges.end());
-
-    keys.shrink_to_fit();
-    estimatedNumNodes.shrink_to_fit();
-    estimatedNumEdges.shrink_to_fit();
-    estimatedNumUniqueEdges.shrink_to_fit();
-
-    QVariantMap map;
-    map.insert(u"keys"_s, QVariant::fromValue(keys));
-    map.insert(u"numNodes"_s, QVariant::fromValue(estimatedNumNodes));
-    map.insert(u"numEdges"_s, QVariant::fromValue(estimatedNumEdges));
-    map.insert(u"numUniqueEdges"_s, QVariant::fromValue(estimatedNumUniqueEdges));
-    return map;
+    return estimateAsMap(keys, estimatedNumNodes, estimatedNumEdges, estimatedNumUniqueEdges);
 }
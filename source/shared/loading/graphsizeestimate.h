@@ -26,11 +26,11 @@
 
 #include <limits>
 
-QVariantMap graphSizeEstimateThreshold(EdgeList edgeList,
+QVariantMap graphSizeEstimateThreshold(const EdgeList& edgeList,
     size_t numSampleNodes = std::numeric_limits<size_t>::max(),
     size_t maxNodes = std::numeric_limits<size_t>::max());
 
-QVariantMap graphSizeEstimateKnn(EdgeList edgeList, size_t k,
+QVariantMap graphSizeEstimateKnn(const EdgeList& edgeList, size_t k,
      size_t numSampleNodes = std::numeric_limits<size_t>::max(),
      size_t maxNodes = std::numeric_limits<size_t>::max());
 
@@ -25,6 +25,7 @@
 #include <set>
 #include <stack>
 #include <algorithm>
+#include <utility>
 
 using namespace Qt::Literals::StringLiterals;
 
@@ -32,7 +33,9 @@ TabularData::TabularData(TabularData&& other) noexcept :
     _data(std::move(other._data)),
     _columns(other._columns),
     _rows(other._rows),
-    _transposed(other._transposed)
+    _transposed(other._transposed),
+    _numericValues(std::exchange(other._numericValues, {})),
+    _numericValuesStorage(std::move(other._numericValuesStorage))
 
 {
     other.reset();
@@ -46,6 +49,8 @@ TabularData& TabularData::operator=(TabularData&& other) noexcept
         _columns = other._columns;
         _rows = other._rows;
         _transposed = other._transposed;
+        _numericValues = std::exchange(other._numericValues, {});
+        _numericValuesStorage = std::move(other._numericValuesStorage);
 
         other.reset();
     }
@@ -139,6 +144,13 @@ void TabularData::setValueAt(size_t column, size_t row, const QString& value, in
 
     _data.resize(newSize);
     _data.at(index(column, row)) = value.trimmed();
+
+    // Any numeric values are now stale
+    if(hasNumericValues())
+    {
+        _numericValues = {};
+        _numericValuesStorage.reset();
+    }
 }
 
 void TabularData::shrinkToFit()
@@ -160,6 +172,9 @@ void TabularData::shrinkToFit()
     }
 
     _data.shrink_to_fit();
+
+    if(hasNumericValues())
+        _numericValues = _numericValues.first(_data.size());
 }
 
 void TabularData::reset()
@@ -168,6 +183,8 @@ void TabularData::reset()
     _columns = 0;
     _rows = 0;
     _transposed = false;
+    _numericValues = {};
+    _numericValuesStorage.reset();
 }
 
 const QString& TabularData::valueAt(size_t column, size_t row) const
@@ -175,6 +192,15 @@ const QString& TabularData::valueAt(size_t column, size_t row) const
     return _data.at(index(column, row));
 }
 
+double TabularData::numericValueAt(size_t column, size_t row) const
+{
+    Q_ASSERT(hasNumericValues());
+
+    const auto i = index(column, row);
+    Q_ASSERT(i < _numericValues.size());
+    return _numericValues[i];
+}
+
 TypeIdentity TabularData::columnTypeIdentity(size_t columnIndex, size_t rowIndex) const
 {
     TypeIdentity identity;
@@ -37,6 +37,8 @@
 
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <span>
 #include <string>
 #include <vector>
 #include <limits>
@@ -53,12 +55,19 @@ struct MatrixTypeResult
 
 class TabularData
 {
+    friend class TabularDataCache;
+
 private:
     std::vector<QString> _data;
     size_t _columns = 0;
     size_t _rows = 0;
     bool _transposed = false;
 
+    // When available, the numeric value of each cell in _data, or NaN if it has none; these
+    // are held by _numericValuesStorage, which may be a vector or a memory mapped file
+    std::span<const double> _numericValues;
+    std::shared_ptr<const void> _numericValuesStorage;
+
     size_t index(size_t column, size_t row) const;
 
 public:
@@ -78,6 +87,9 @@ public:
     bool transposed() const { return _transposed; }
     const QString& valueAt(size_t column, size_t row) const;
 
+    bool hasNumericValues() const { return !_numericValues.empty(); }
+    double numericValueAt(size_t column, size_t row) const;
+
     void setTransposed(bool transposed) { _transposed = transposed; }
     void setValueAt(size_t column, size_t row, const QString& value, int progressHint = -1);
 
@@ -0,0 +1,394 @@
+/* Copyright © 2013-2025 Tim Angus
+ * Copyright © 2013-2025 Tom Freeman
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tabulardatacache.h"
+
+#include "shared/loading/tabulardata.h"
+#include "shared/utils/threadpool.h"
+#include "shared/utils/preferences.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <span>
+
+using namespace Qt::Literals::StringLiterals;
+
+namespace
+{
+// Bump this whenever the layout below changes
+constexpr uint32_t CACHE_VERSION = 2;
+constexpr uint32_t CACHE_MAGIC = 0x43445447; // "GTDC"
+constexpr size_t HASH_SIZE = 32; // SHA-256
+
+// Entries are typically several times the size of the text they're parsed from
+constexpr qint64 DEFAULT_CACHE_SIZE_MB = 2048;
+
+// The file consists of this header, followed by the column TypeIdentity counts,
+// the numeric value of each cell, the offset of each cell's text and finally
+// the UTF-16 text of every cell, all of which are in host byte order; every
+// section is 8 byte aligned so that the numeric values can be used in place
+struct Header
+{
+    uint32_t _magic = CACHE_MAGIC;
+    uint32_t _version = CACHE_VERSION;
+    uint64_t _sourceSize = 0;
+    int64_t _sourceModified = 0;
+    std::array<uint8_t, HASH_SIZE> _sourceHash{};
+    uint64_t _columns = 0;
+    uint64_t _rows = 0;
+    uint64_t _numTypeIdentities = 0;
+    uint64_t _textLength = 0;
+};
+
+static_assert(sizeof(Header) % sizeof(uint64_t) == 0);
+static_assert(sizeof(QChar) == sizeof(char16_t));
+
+constexpr size_t NUM_TYPE_COUNTS = std::tuple_size_v<TypeIdentity::TypeCounts>;
+
+uint64_t expectedFileSize(const Header& header)
+{
+    const auto numCells = header._columns * header._rows;
+
+    return sizeof(Header) +
+        (header._numTypeIdentities * NUM_TYPE_COUNTS * sizeof(uint64_t)) +
+        (numCells * sizeof(double)) +
+        ((numCells + 1) * sizeof(uint64_t)) +
+        (header._textLength * sizeof(char16_t));
+}
+
+// The preferences aren't defined when running headless, hence the defaults
+bool cacheEnabled()
+{
+    const auto enabled = u::getPref(u"misc/cacheParsedData"_s);
+    return !enabled.isValid() || enabled.toBool();
+}
+
+qint64 cacheBudget()
+{
+    bool success = false;
+    auto megabytes = u::getPref(u"misc/parsedDataCacheSize"_s).toLongLong(&success);
+    if(!success)
+        megabytes = DEFAULT_CACHE_SIZE_MB;
+
+    return megabytes * 1024 * 1024;
+}
+
+std::vector<size_t> indicesUpTo(size_t size)
+{
+    std::vector<size_t> indices(size);
+    std::iota(indices.begin(), indices.end(), 0);
+
+    return indices;
+}
+} // namespace
+
+QString TabularDataCache::directory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + u"/tabulardata"_s;
+}
+
+void TabularDataCache::prune(qint64 budget)
+{
+    const QDir dir(directory());
+    auto fileInfos = dir.entryInfoList({u"*.cache"_s}, QDir::Files, QDir::Time);
+
+    // Entries are touched when they're used, so this is most recently used first;
+    // keep as many as fit within the budget, and remove everything after that
+    qint64 totalSize = 0;
+    for(const auto& fileInfo : fileInfos)
+    {
+        totalSize += fileInfo.size();
+
+        if(totalSize > budget)
+            QFile::remove(fileInfo.absoluteFilePath());
+    }
+}
+
+TabularDataCache::TabularDataCache(const QUrl& url, const QString& parameters)
+{
+    if(!url.isLocalFile() || !cacheEnabled())
+        return;
+
+    const QFileInfo fileInfo(url.toLocalFile());
+    _sourceFileName = fileInfo.canonicalFilePath();
+    if(_sourceFileName.isEmpty() || !fileInfo.isFile())
+        return;
+
+    _sourceSize = fileInfo.size();
+    _sourceModified = fileInfo.lastModified().toMSecsSinceEpoch();
+
+    // Hashing the content of the source is deferred until it's actually needed, so
+    // that a cache hit only costs a stat of the source and mapping of the cache
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(u"%1:%2:%3"_s.arg(_sourceFileName, parameters).arg(CACHE_VERSION).toUtf8());
+
+    _fileName = u"%1/%2.cache"_s.arg(directory(), QString(hash.result().toHex()));
+}
+
+const QByteArray& TabularDataCache::sourceHash() const
+{
+    if(!_sourceHash.isEmpty())
+        return _sourceHash;
+
+    QFile file(_sourceFileName);
+    if(!file.open(QIODevice::ReadOnly))
+        return _sourceHash;
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    if(hash.addData(&file))
+        _sourceHash = hash.result();
+
+    return _sourceHash;
+}
+
+bool TabularDataCache::load(TabularData& tabularData, std::vector<TypeIdentity>& columnTypeIdentities) const
+{
+    if(!valid())
+        return false;
+
+    // The file remains open and mapped for as long as tabularData refers to it
+    auto file = std::make_shared<QFile>(_fileName);
+    if(!file->open(QIODevice::ReadOnly) || file->size() < static_cast<qint64>(sizeof(Header)))
+        return false;
+
+    const auto* mapped = file->map(0, file->size());
+    if(mapped == nullptr)
+        return false;
+
+    Header header;
+    std::memcpy(&header, mapped, sizeof(Header));
+
+    if(header._magic != CACHE_MAGIC || header._version != CACHE_VERSION ||
+        expectedFileSize(header) != static_cast<uint64_t>(file->size()))
+    {
+        return false;
+    }
+
+    if(header._sourceSize != static_cast<uint64_t>(_sourceSize))
+        return false;
+
+    if(header._sourceModified != _sourceModified)
+    {
+        // The source may only have been touched, so check if its content is still the
+        // same before giving up, and if it is refresh the stamp so we don't check again
+        const auto& hash = sourceHash();
+        if(hash.size() != static_cast<qsizetype>(HASH_SIZE) ||
+            std::memcmp(hash.constData(), header._sourceHash.data(), HASH_SIZE) != 0)
+        {
+            return false;
+        }
+
+        QFile stampFile(_fileName);
+        if(stampFile.open(QIODevice::ReadWrite) && stampFile.seek(offsetof(Header, _sourceModified)))
+        {
+            const int64_t sourceModified = _sourceModified;
+            stampFile.write(reinterpret_cast<const char*>(&sourceModified), sizeof(sourceModified)); // NOLINT cppcoreguidelines-pro-type-reinterpret-cast
+        }
+    }
+
+    const auto numCells = static_cast<size_t>(header._columns * header._rows);
+    const auto* position = mapped + sizeof(Header);
+
+    columnTypeIdentities.clear();
+    columnTypeIdentities.reserve(header._numTypeIdentities);
+    for(uint64_t i = 0; i < header._numTypeIdentities; i++)
+    {
+        std::array<uint64_t, NUM_TYPE_COUNTS> counts{};
+        std::memcpy(counts.data(), position, sizeof(counts));
+        position += sizeof(counts);
+
+        TypeIdentity::TypeCounts typeCounts{};
+        std::copy(counts.begin(), counts.end(), typeCounts.begin());
+        columnTypeIdentities.emplace_back(typeCounts);
+    }
+
+    // NOLINTNEXTLINE cppcoreguidelines-pro-type-reinterpret-cast
+    const std::span<const double> numericValues(reinterpret_cast<const double*>(position), numCells);
+    position += numCells * sizeof(double);
+
+    // NOLINTNEXTLINE cppcoreguidelines-pro-type-reinterpret-cast
+    const std::span<const uint64_t> offsets(reinterpret_cast<const uint64_t*>(position), numCells + 1);
+    position += offsets.size() * sizeof(uint64_t);
+
+    if(offsets.front() != 0 || offsets.back() != header._textLength)
+        return false;
+
+    const auto* text = reinterpret_cast<const QChar*>(position); // NOLINT cppcoreguidelines-pro-type-reinterpret-cast
+    std::vector<QString> data(numCells);
+    std::atomic<bool> offsetsValid = true;
+
+    // Every consumer of TabularData reads the text of its cells, so the strings must
+    // still be constructed; this involves an allocation for each, so do it concurrently
+    const auto columns = static_cast<size_t>(header._columns);
+    auto rows = indicesUpTo(static_cast<size_t>(header._rows));
+    if(!rows.empty())
+    {
+        parallel_for(rows.begin(), rows.end(),
+        [&](size_t row)
+        {
+            for(size_t i = row * columns; i < (row + 1) * columns; i++)
+            {
+                if(offsets[i] > offsets[i + 1])
+                {
+                    offsetsValid = false;
+                    return;
+                }
+
+                data[i] = QString(text + offsets[i],
+                    static_cast<qsizetype>(offsets[i + 1] - offsets[i]));
+            }
+        });
+    }
+
+    if(!offsetsValid)
+        return false;
+
+    tabularData.reset();
+    tabularData._data = std::move(data);
+    tabularData._columns = columns;
+    tabularData._rows = static_cast<size_t>(header._rows);
+
+    if(numCells > 0)
+    {
+        tabularData._numericValues = numericValues;
+        tabularData._numericValuesStorage = file;
+    }
+
+    // Mark this entry as recently used, so it survives pruning
+    file->setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+
+    return true;
+}
+
+bool TabularDataCache::save(TabularData& tabularData, const std::vector<TypeIdentity>& columnTypeIdentities) const
+{
+    if(!valid() || tabularData.empty())
+        return false;
+
+    const auto& data = tabularData._data;
+    const auto columns = tabularData._columns;
+    auto numericValues = std::make_shared<std::vector<double>>(data.size());
+
+    // Numeric conversion is comparatively expensive, so do it concurrently
+    auto rows = indicesUpTo(tabularData._rows);
+    parallel_for(rows.begin(), rows.end(),
+    [&](size_t row)
+    {
+        for(size_t i = row * columns; i < (row + 1) * columns; i++)
+        {
+            bool success = false;
+            auto value = !data[i].isEmpty() ? data[i].toDouble(&success) : 0.0;
+            (*numericValues)[i] = success ? value : std::numeric_limits<double>::quiet_NaN();
+        }
+    });
+
+    // Hang on to the values, so that they don't need to be converted again by the consumer
+    tabularData._numericValues = *numericValues;
+    tabularData._numericValuesStorage = numericValues;
+
+    if(!QDir().mkpath(directory()))
+        return false;
+
+    Header header;
+
+    // If load had to check the content of the source, this doesn't hash it again
+    const auto& hash = sourceHash();
+    if(hash.size() != static_cast<qsizetype>(HASH_SIZE))
+        return false;
+
+    std::memcpy(header._sourceHash.data(), hash.constData(), HASH_SIZE);
+
+    // If the source has changed since it was parsed, the data we have doesn't represent it
+    const QFileInfo sourceInfo(_sourceFileName);
+    if(sourceInfo.size() != _sourceSize || sourceInfo.lastModified().toMSecsSinceEpoch() != _sourceModified)
+        return false;
+
+    std::vector<uint64_t> offsets;
+    offsets.reserve(data.size() + 1);
+    offsets.push_back(0);
+    for(const auto& value : data)
+        offsets.push_back(offsets.back() + static_cast<uint64_t>(value.size()));
+
+    header._sourceSize = static_cast<uint64_t>(_sourceSize);
+    header._sourceModified = _sourceModified;
+    header._columns = columns;
+    header._rows = tabularData._rows;
+    header._numTypeIdentities = columnTypeIdentities.size();
+    header._textLength = offsets.back();
+
+    // Don't bother writing an entry that would immediately be evicted
+    const auto budget = cacheBudget();
+    if(expectedFileSize(header) > static_cast<uint64_t>(budget))
+        return false;
+
+    QSaveFile file(_fileName);
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+
+    auto write = [&file](const void* bytes, size_t size)
+    {
+        return file.write(static_cast<const char*>(bytes), static_cast<qint64>(size)) ==
+            static_cast<qint64>(size);
+    };
+
+    bool success = write(&header, sizeof(header));
+
+    for(const auto& columnTypeIdentity : columnTypeIdentities)
+    {
+        std::array<uint64_t, NUM_TYPE_COUNTS> counts{};
+        const auto& typeCounts = columnTypeIdentity.typeCounts();
+        std::copy(typeCounts.begin(), typeCounts.end(), counts.begin());
+        success = success && write(counts.data(), sizeof(counts));
+    }
+
+    success = success && write(numericValues->data(), numericValues->size() * sizeof(double));
+    success = success && write(offsets.data(), offsets.size() * sizeof(uint64_t));
+
+    for(const auto& value : data)
+    {
+        if(!success)
+            break;
+
+        success = write(value.constData(), static_cast<size_t>(value.size()) * sizeof(char16_t));
+    }
+
+    Q_ASSERT(!success || static_cast<uint64_t>(file.size()) == expectedFileSize(header));
+
+    if(!success || !file.commit())
+        return false;
+
+    prune(budget);
+
+    return true;
+}
@@ -0,0 +1,70 @@
+/* Copyright © 2013-2025 Tim Angus
+ * Copyright © 2013-2025 Tom Freeman
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TABULARDATACACHE_H
+#define TABULARDATACACHE_H
+
+#include "shared/utils/typeidentity.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QUrl>
+
+#include <vector>
+
+class TabularData;
+
+// Persists parsed TabularData, keyed by the path of the file it was parsed from
+// and validated against its size, modification time and content, so that
+// subsequently opening the same file avoids parsing it again; the cache can be
+// disabled, and is limited in size, evicting the least recently used entries,
+// according to the misc/cacheParsedData and misc/parsedDataCacheSize preferences
+class TabularDataCache
+{
+private:
+    QString _sourceFileName;
+    qint64 _sourceSize = -1;
+    qint64 _sourceModified = -1;
+
+    // Computed at most once, so that a hash performed when validating
+    // an existing entry isn't repeated when replacing it
+    mutable QByteArray _sourceHash;
+
+    QString _fileName;
+
+    const QByteArray& sourceHash() const;
+
+    static QString directory();
+    static void prune(qint64 budget);
+
+public:
+    // parameters should encode anything that influences how url is parsed
+    TabularDataCache(const QUrl& url, const QString& parameters);
+
+    bool valid() const { return !_fileName.isEmpty(); }
+
+    // On success the numeric values of tabularData refer directly to the cache file
+    bool load(TabularData& tabularData, std::vector<TypeIdentity>& columnTypeIdentities) const;
+
+    // An empty columnTypeIdentities is stored as unknown; the numeric values computed
+    // in order to populate the cache are retained by tabularData, whether or not it succeeds
+    bool save(TabularData& tabularData, const std::vector<TypeIdentity>& columnTypeIdentities) const;
+};
+
+#endif // TABULARDATACACHE_H
@@ -19,21 +19,74 @@
 
 #include "random.h"
 
+#include <atomic>
 #include <random>
 
-static std::random_device randomh_rd;
-static std::mt19937 randomh_mt19937(randomh_rd());
+static std::atomic<uint32_t> randomh_seed{0};
+static std::atomic<uint32_t> randomh_seedGeneration{0};
+
+// The generator of the RandomStream currently in scope on this thread, if any
+static thread_local std::mt19937* randomh_streamGenerator = nullptr;
+
+// Per thread, so that the functions can be used concurrently
+static std::mt19937& randomGenerator()
+{
+    if(randomh_streamGenerator != nullptr)
+        return *randomh_streamGenerator;
+
+    static thread_local std::mt19937 mt19937(std::random_device{}());
+    static thread_local uint32_t seedGeneration = 0;
+
+    const auto currentSeedGeneration = randomh_seedGeneration.load();
+    if(seedGeneration != currentSeedGeneration)
+    {
+        mt19937.seed(randomh_seed.load());
+        seedGeneration = currentSeedGeneration;
+    }
+
+    return mt19937;
+}
+
+void u::setRandomSeed(uint32_t seed)
+{
+    randomh_seed = seed;
+    randomh_seedGeneration++;
+}
+
+u::RandomStream::Scope::Scope(RandomStream& stream, uint64_t streamId) :
+    _previousGenerator(randomh_streamGenerator)
+{
+    const auto currentSeedGeneration = randomh_seedGeneration.load();
+    if(currentSeedGeneration == 0)
+        return;
+
+    if(stream._generator == nullptr || stream._seedGeneration != currentSeedGeneration)
+    {
+        std::seed_seq seedSequence{randomh_seed.load(),
+            static_cast<uint32_t>(streamId), static_cast<uint32_t>(streamId >> 32u)};
+
+        stream._generator = std::make_unique<std::mt19937>(seedSequence);
+        stream._seedGeneration = currentSeedGeneration;
+    }
+
+    randomh_streamGenerator = stream._generator.get();
+}
+
+u::RandomStream::Scope::~Scope()
+{
+    randomh_streamGenerator = _previousGenerator;
+}
 
 float u::rand(float low, float high)
 {
     std::uniform_real_distribution<> distribution(low, high);
-    return static_cast<float>(distribution(randomh_mt19937));
+    return static_cast<float>(distribution(randomGenerator()));
 }
 
 int u::rand(int low, int high)
 {
     std::uniform_int_distribution<> distribution(low, high);
-    return distribution(randomh_mt19937);
+    return distribution(randomGenerator());
 }
 
 QVector2D u::randQVector2D(float low, float high)
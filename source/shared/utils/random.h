@@ -24,8 +24,45 @@
 #include <QVector3D>
 #include <QColor>
 
+#include <cstdint>
+#include <memory>
+#include <random>
+
 namespace u
 {
+    // Random numbers are normally seeded non-deterministically; once this has been
+    // called, every thread's generator restarts from seed, so that a given sequence
+    // of calls on a thread produces the same results from run to run
+    void setRandomSeed(uint32_t seed);
+
+    // Which thread a piece of work runs on generally varies from run to run, so seeding
+    // each thread isn't enough to make work that is scheduled on a pool reproducible;
+    // instead such work draws from a stream of its own, while one of its Scopes exists
+    class RandomStream
+    {
+    private:
+        std::unique_ptr<std::mt19937> _generator;
+        uint32_t _seedGeneration = 0;
+
+    public:
+        class Scope
+        {
+        private:
+            std::mt19937* _previousGenerator = nullptr;
+
+        public:
+            // The stream is (re)started from the seed mixed with streamId when it's first
+            // used after a seed is set; when no seed is set, this has no effect
+            Scope(RandomStream& stream, uint64_t streamId);
+            ~Scope();
+
+            Scope(const Scope&) = delete;
+            Scope(Scope&&) = delete;
+            Scope& operator=(const Scope&) = delete;
+            Scope& operator=(Scope&&) = delete;
+        };
+    };
+
     float rand(float low, float high);
     int rand(int low, int high);
 
@@ -118,28 +118,37 @@ Statistics findStatisticsFor(const C& container, bool storeValues = false)
     return findStatisticsFor(container, [](typename C::const_reference& t) { return t; }, storeValues);
 }
 
-template<typename C>
-double medianOf(const C& container)
+// Note that this reorders the values in the range [first, last)
+template<typename It>
+double medianInPlace(It first, It last)
 {
-    if(container.empty())
+    if(first == last)
         return 0.0;
 
-    std::vector<double> v{container.begin(), container.end()};
-
-    auto mid = v.size() / 2;
-    std::nth_element(v.begin(), v.begin() +
-        static_cast<std::vector<double>::difference_type>(mid), v.end());
-    auto median = v.at(mid);
+    auto size = std::distance(first, last);
+    auto mid = first + (size / 2);
+    std::nth_element(first, mid, last);
+    double median = *mid;
 
-    if(v.size() % 2 == 0)
+    if(size % 2 == 0)
     {
-        auto max = *std::max_element(v.begin(), v.begin() +
-            static_cast<std::vector<double>::difference_type>(mid));
+        auto max = *std::max_element(first, mid);
         median = (max + median) / 2.0;
     }
 
     return median;
 }
 
+template<typename C>
+double medianOf(const C& container)
+{
+    if(container.empty())
+        return 0.0;
+
+    std::vector<double> v{container.begin(), container.end()};
+
+    return medianInPlace(v.begin(), v.end());
+}
+
 } // namespace u
 #endif // STATISTICS_H
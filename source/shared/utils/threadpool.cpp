@@ -25,6 +25,8 @@
 
 using namespace Qt::Literals::StringLiterals;
 
+thread_local const ThreadPool* ThreadPool::_workerThreadPool = nullptr;
+
 ThreadPool::ThreadPool(const QString& threadNamePrefix, unsigned int numThreads)
 {
 #ifdef Q_OS_WASM
@@ -41,6 +43,8 @@ ThreadPool::ThreadPool(const QString& threadNamePrefix, unsigned int numThreads)
 
         _threads.emplace_back([threadName, this]
         {
+            _workerThreadPool = this;
+
             std::unique_lock<std::mutex> lock(_mutex);
 
             while(!_stop)
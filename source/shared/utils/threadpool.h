@@ -51,6 +51,9 @@ private:
     std::queue<void_callable_wrapper> _tasks;
     bool _stop = false;
 
+    // The pool that owns the current thread, if any
+    static thread_local const ThreadPool* _workerThreadPool;
+
 public:
     explicit ThreadPool(const QString& threadNamePrefix = u"Worker"_s,
         unsigned int numThreads = std::thread::hardware_concurrency());
@@ -473,9 +476,39 @@ public:
         return future;
     }
 
+    bool isWorkerThread() const { return _workerThreadPool == this; }
+    size_t numThreads() const { return _threads.size(); }
+
     template<typename It, typename Fn>
     auto parallel_for(It first, It last, Fn f, ResultsPolicy resultsPolicy = Blocking)
     {
+        static_assert(std::is_convertible_v<FirstArgumentType<Fn>, It> ||
+            std::is_convertible_v<FirstArgumentType<Fn>, typename It::value_type>,
+            "Fn's argument must be an It or an It::value_type");
+
+        static_assert(function_traits<Fn>::arity == 1 || HasThreadIndexArgument<Fn>,
+            "Fn's (optional) second index argument must be size_t");
+
+        std::vector<std::future<typename Executor<It, Fn>::ResultsVectorOrVoid>> futures;
+
+        if(isWorkerThread())
+        {
+            // When called from one of our own workers, every other worker may be busy, possibly
+            // waiting on this one, so queueing more tasks risks deadlock; just do the work here
+            std::packaged_task<typename Executor<It, Fn>::ResultsVectorOrVoid()> task([&]
+            {
+                return Executor<It, Fn>::execute(first, last, 0, f);
+            });
+
+            futures.emplace_back(task.get_future());
+            task();
+
+            auto results = Results<It, Fn>(std::move(futures));
+            results.wait();
+
+            return results;
+        }
+
         std::unique_lock<std::mutex> lock(_mutex);
 
         Coster<It> coster(first, last);
@@ -485,14 +518,6 @@ public:
         const auto costPerThread = totalCost / numThreads +
                 ((totalCost % numThreads) ? 1 : 0);
 
-        static_assert(std::is_convertible_v<FirstArgumentType<Fn>, It> ||
-            std::is_convertible_v<FirstArgumentType<Fn>, typename It::value_type>,
-            "Fn's argument must be an It or an It::value_type");
-
-        static_assert(function_traits<Fn>::arity == 1 || HasThreadIndexArgument<Fn>,
-            "Fn's (optional) second index argument must be size_t");
-
-        std::vector<std::future<typename Executor<It, Fn>::ResultsVectorOrVoid>> futures;
         size_t threadIndex = 0;
 
         for(It it = first; it != last;)
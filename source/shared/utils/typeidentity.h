@@ -45,6 +45,13 @@ private:
     void decrement(Type type);
 
 public:
+    using TypeCounts = std::array<size_t, 3>;
+
+    TypeIdentity() = default;
+    explicit TypeIdentity(const TypeCounts& typeCounts) : _typeCounts(typeCounts) {}
+
+    const TypeCounts& typeCounts() const { return _typeCounts; }
+
     void updateType(const QString& value, const QString& previousValue = {});
 
     template<typename C>